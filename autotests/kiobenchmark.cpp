@@ -0,0 +1,127 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "kiobenchmark.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTest>
+
+void KioBenchmark::useBuildTree(const char *dataDir)
+{
+    // the slave is in kf5/kio next to the test
+    QCoreApplication::addLibraryPath(QCoreApplication::applicationDirPath());
+    qputenv("XDG_DATA_DIRS", QByteArray(dataDir) + ':' + qgetenv("XDG_DATA_DIRS"));
+}
+
+int KioBenchmark::setting(const char *variable, int defaultValue)
+{
+    return qEnvironmentVariableIsSet(variable) ? qEnvironmentVariableIntValue(variable) : defaultValue;
+}
+
+std::mt19937_64 &KioBenchmark::random()
+{
+    static std::mt19937_64 generator(42);
+    return generator;
+}
+
+qint64 KioBenchmark::createRandomFile(const QString &path, int megabytes)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "cannot create" << path << file.errorString();
+        return -1;
+    }
+
+    QByteArray block(1024 * 1024, '\0');
+    for (int i = 0; i < block.size(); ++i) {
+        block[i] = char(random()());
+    }
+    for (int i = 0; i < megabytes; ++i) {
+        if (file.write(block) != block.size()) {
+            qWarning() << "cannot write" << path << file.errorString();
+            return -1;
+        }
+    }
+    return file.size();
+}
+
+bool KioBenchmark::createFiles(const QString &dir, int count, int linkEvery)
+{
+    if (!QDir().mkpath(dir)) {
+        return false;
+    }
+    if (QDir(dir).entryList(QDir::Files | QDir::System).count() == count) {
+        return true;
+    }
+    for (int i = 0; i < count; ++i) {
+        const QString name = dir + QStringLiteral("/file%1").arg(i, 6, 10, QLatin1Char('0'));
+        if (linkEvery > 0 && i % linkEvery == linkEvery - 1) {
+            if (!QFile::link(QStringLiteral("file%1").arg(i - 1, 6, 10, QLatin1Char('0')), name)) {
+                qWarning() << "cannot create" << name;
+                return false;
+            }
+        } else {
+            QFile file(name);
+            if (!file.open(QIODevice::WriteOnly)) {
+                qWarning() << "cannot create" << name << file.errorString();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+QByteArray KioBenchmark::fileHash(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    return hash.result();
+}
+
+void KioBenchmark::startMeasurement()
+{
+    m_timer.start();
+}
+
+void KioBenchmark::report(const QString &operation, int count, quint64 bytes)
+{
+    const qint64 msecs = qMax<qint64>(m_timer.elapsed(), 1);
+
+    QString line = operation;
+    if (QTest::currentDataTag()) {
+        line += QStringLiteral(" (%1)").arg(QLatin1String(QTest::currentDataTag()));
+    }
+    line += QStringLiteral(": %1 ms").arg(msecs) + counters(count, msecs);
+    if (bytes > 0) {
+        line += QStringLiteral(", %1 MB/s").arg(bytes / 1048576.0 / (msecs / 1000.0), 0, 'f', 1);
+    }
+    qInfo().noquote() << line;
+}
+
+QString KioBenchmark::counters(int count, qint64 msecs) const
+{
+    return QStringLiteral(", %1 ms per operation").arg(double(msecs) / qMax(count, 1), 0, 'f', 2);
+}
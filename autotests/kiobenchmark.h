@@ -0,0 +1,103 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIOBENCHMARK_H
+#define KIOBENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+
+#include <random>
+
+/**
+ * Skips the test case unless the environment variable @p variable is set,
+ * for benchmarks that take too long to run with every ctest.
+ */
+#define KIO_BENCHMARK_REQUIRE(variable) \
+    if (qEnvironmentVariableIsEmpty(variable)) { \
+        QSKIP("set " variable "=1 to run these benchmarks"); \
+    }
+
+/**
+ * Base of the slave benchmarks added with kio_add_benchmark().
+ *
+ * Has what they share: running the slave from the build tree, test data
+ * generated the same way every run, and timing.  Subclasses call
+ * startMeasurement() before and report() after what they measure, and
+ * override counters() to add what their server counted in between.
+ */
+class KioBenchmark : public QObject
+{
+    Q_OBJECT
+
+protected:
+    KioBenchmark() = default;
+
+    /**
+     * Makes KIO use the slave and its protocol file from the build tree,
+     * pass it KIO_BENCHMARK_DATA_DIR.
+     */
+    static void useBuildTree(const char *dataDir);
+
+    /**
+     * @return the value of the environment variable @p variable, or
+     * @p defaultValue if it isn't set
+     */
+    static int setting(const char *variable, int defaultValue);
+
+    /**
+     * The random numbers for test data, always with the same seed, so that
+     * runs are comparable.
+     */
+    static std::mt19937_64 &random();
+
+    /**
+     * Writes @p megabytes MB of random data to @p path.
+     * @return the size of the file, or -1 if it couldn't be written
+     */
+    static qint64 createRandomFile(const QString &path, int megabytes);
+
+    /**
+     * Creates @p dir with @p count empty files named file000000 and so on,
+     * unless it already has that many.  With @p linkEvery every that many
+     * entries is a symlink to the file before it.
+     */
+    static bool createFiles(const QString &dir, int count, int linkEvery = 0);
+
+    static QByteArray fileHash(const QString &path);
+
+    virtual void startMeasurement();
+
+    /**
+     * Prints the time since startMeasurement() for @p count operations, and
+     * the throughput if they moved @p bytes.
+     */
+    void report(const QString &operation, int count, quint64 bytes = 0);
+
+    /**
+     * @return what to add to the report for @p count operations that took
+     * @p msecs, by default the time per operation
+     */
+    virtual QString counters(int count, qint64 msecs) const;
+
+private:
+    QElapsedTimer m_timer;
+};
+
+#endif
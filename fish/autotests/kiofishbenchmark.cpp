@@ -0,0 +1,608 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "kiofishbenchmark.h"
+
+#include <config-fish.h>
+
+#include <kio/copyjob.h>
+#include <kio/filejob.h>
+#include <kio/job.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+QTEST_GUILESS_MAIN(KioFishBenchmark)
+
+static const int s_statCount = 200;
+static const int s_copyCount = 100;
+
+// the slave leaves out its perl server for jobs that ask for "shell"
+static void setServer(KIO::Job *job, const QString &server)
+{
+    job->addMetaData(QStringLiteral("fishserver"), server);
+}
+
+static bool writeFile(const QString &path, const QByteArray &content)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(content) == content.size();
+}
+
+static QByteArray readFile(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void KioFishBenchmark::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+    m_host = QString::fromLocal8Bit(qgetenv("KIO_FISH_BENCH_HOST"));
+    if (m_host.isEmpty()) {
+        m_host = QStringLiteral("localhost");
+    }
+
+    useBuildTree(KIO_BENCHMARK_DATA_DIR);
+
+    m_fileSize = createRandomFile(localPath(QStringLiteral("big")), setting("KIO_FISH_BENCH_FILE_MB", 16));
+    QVERIFY(m_fileSize > 0);
+
+    qInfo() << "fish to" << m_host << "in" << m_tempDir.path();
+}
+
+void KioFishBenchmark::addServerRows()
+{
+    QTest::addColumn<QString>("server");
+
+    QTest::newRow("perl") << QStringLiteral("perl");
+    QTest::newRow("shell") << QStringLiteral("shell");
+}
+
+void KioFishBenchmark::login(const QString &server)
+{
+    // the slave connects again when the server changes, which is not to be measured
+    KIO::StatJob *job = KIO::stat(fishUrl(QString()), KIO::HideProgressInfo);
+    setServer(job, server);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+}
+
+QUrl KioFishBenchmark::fishUrl(const QString &path) const
+{
+    QUrl url;
+    url.setScheme(QStringLiteral("fish"));
+    url.setHost(m_host);
+    url.setPath(localPath(path));
+    return url;
+}
+
+QString KioFishBenchmark::localPath(const QString &path) const
+{
+    return m_tempDir.path() + QLatin1Char('/') + path;
+}
+
+void KioFishBenchmark::benchStat_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::benchStat()
+{
+    KIO_BENCHMARK_REQUIRE("KIO_FISH_BENCHMARK");
+    QFETCH(QString, server);
+
+    const QString dir = QStringLiteral("stat");
+    QVERIFY(createFiles(localPath(dir), s_statCount));
+
+    login(server);
+    startMeasurement();
+    for (int i = 0; i < s_statCount; ++i) {
+        const QString name = QStringLiteral("/file%1").arg(i, 6, 10, QLatin1Char('0'));
+        KIO::StatJob *job = KIO::stat(fishUrl(dir + name), KIO::HideProgressInfo);
+        setServer(job, server);
+        QVERIFY2(job->exec(), qPrintable(job->errorString()));
+        QVERIFY(job->statResult().isDir() == false);
+    }
+    report(QStringLiteral("stat"), s_statCount);
+}
+
+void KioFishBenchmark::benchListDir_data()
+{
+    QTest::addColumn<QString>("server");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("perl 1k") << QStringLiteral("perl") << 1000;
+    QTest::newRow("perl 10k") << QStringLiteral("perl") << 10000;
+    // the shell runs file(1) for every entry, more would take minutes
+    QTest::newRow("shell 1k") << QStringLiteral("shell") << 1000;
+}
+
+void KioFishBenchmark::benchListDir()
+{
+    KIO_BENCHMARK_REQUIRE("KIO_FISH_BENCHMARK");
+    QFETCH(QString, server);
+    QFETCH(int, count);
+
+    const QString dir = QStringLiteral("list%1").arg(count);
+    QVERIFY(createFiles(localPath(dir), count));
+
+    int listed = 0;
+    login(server);
+    startMeasurement();
+    KIO::ListJob *job = KIO::listDir(fishUrl(dir), KIO::HideProgressInfo);
+    setServer(job, server);
+    connect(job, &KIO::ListJob::entries, this, [&listed](KIO::Job *, const KIO::UDSEntryList &entries) {
+        listed += entries.count();
+    });
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("listDir"), count);
+
+    QVERIFY(listed >= count); // and "." and maybe ".."
+}
+
+void KioFishBenchmark::benchGet_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::benchGet()
+{
+    KIO_BENCHMARK_REQUIRE("KIO_FISH_BENCHMARK");
+    QFETCH(QString, server);
+
+    const QString dest = localPath(QStringLiteral("got"));
+    QFile::remove(dest);
+
+    login(server);
+    startMeasurement();
+    KIO::FileCopyJob *job = KIO::file_copy(fishUrl(QStringLiteral("big")), QUrl::fromLocalFile(dest),
+                                           -1, KIO::HideProgressInfo);
+    setServer(job, server);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("get"), 1, m_fileSize);
+
+    QCOMPARE(fileHash(dest), fileHash(localPath(QStringLiteral("big"))));
+}
+
+void KioFishBenchmark::benchPut_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::benchPut()
+{
+    KIO_BENCHMARK_REQUIRE("KIO_FISH_BENCHMARK");
+    QFETCH(QString, server);
+
+    const QString dest = localPath(QStringLiteral("put"));
+    QFile::remove(dest);
+
+    login(server);
+    startMeasurement();
+    KIO::FileCopyJob *job = KIO::file_copy(QUrl::fromLocalFile(localPath(QStringLiteral("big"))),
+                                           fishUrl(QStringLiteral("put")), -1, KIO::HideProgressInfo);
+    setServer(job, server);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("put"), 1, m_fileSize);
+
+    QCOMPARE(fileHash(dest), fileHash(localPath(QStringLiteral("big"))));
+}
+
+void KioFishBenchmark::benchCopyFiles_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::benchCopyFiles()
+{
+    KIO_BENCHMARK_REQUIRE("KIO_FISH_BENCHMARK");
+    QFETCH(QString, server);
+
+    // many small files in one job, see https://bugs.kde.org/show_bug.cgi?id=147948
+    const QString src = QStringLiteral("copy");
+    QVERIFY(createFiles(localPath(src), s_copyCount));
+    const QString dest = QStringLiteral("copied-") + server;
+    QDir(localPath(dest)).removeRecursively();
+    QVERIFY(QDir().mkpath(localPath(dest)));
+
+    QList<QUrl> urls;
+    const QStringList names = QDir(localPath(src)).entryList(QDir::Files);
+    for (const QString &name : names) {
+        urls << QUrl::fromLocalFile(localPath(src + QLatin1Char('/') + name));
+    }
+
+    login(server);
+    startMeasurement();
+    KIO::CopyJob *job = KIO::copy(urls, fishUrl(dest), KIO::HideProgressInfo);
+    setServer(job, server);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("copy files"), s_copyCount);
+
+    QCOMPARE(QDir(localPath(dest)).entryList(QDir::Files), names);
+}
+
+void KioFishBenchmark::testOverwrite_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::testOverwrite()
+{
+    QFETCH(QString, server);
+
+    // writes of a FileJob within the file replace what is there, and only that
+    const QString name = QStringLiteral("overwrite-") + server;
+    QByteArray expected(4096, 'a');
+    QFile file(localPath(name));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(expected), qint64(expected.size()));
+    file.close();
+
+    KIO::FileJob *job = KIO::open(fishUrl(name), QIODevice::ReadWrite);
+    setServer(job, server);
+    QSignalSpy opened(job, &KIO::FileJob::open);
+    QSignalSpy written(job, &KIO::FileJob::written);
+    QSignalSpy closed(job, static_cast<void (KIO::FileJob::*)(KIO::Job *)>(&KIO::FileJob::close));
+    QVERIFY(opened.wait());
+    QCOMPARE(job->size(), KIO::filesize_t(expected.size()));
+
+    job->seek(1000);
+    job->write("0123456789");
+    QVERIFY(written.wait());
+    expected.replace(1000, 10, "0123456789");
+
+    job->seek(0);
+    job->write("start");
+    QVERIFY(written.wait());
+    expected.replace(0, 5, "start");
+
+    job->close();
+    QVERIFY(closed.wait());
+
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), expected);
+}
+
+void KioFishBenchmark::testCodec_data()
+{
+    QTest::addColumn<QString>("codec");
+    QTest::addColumn<bool>("built");
+
+#ifdef HAVE_ZLIB
+    QTest::newRow("gzip") << QStringLiteral("gzip") << true;
+#else
+    QTest::newRow("gzip") << QStringLiteral("gzip") << false;
+#endif
+#ifdef HAVE_ZSTD
+    QTest::newRow("zstd") << QStringLiteral("zstd") << true;
+#else
+    QTest::newRow("zstd") << QStringLiteral("zstd") << false;
+#endif
+}
+
+void KioFishBenchmark::testCodec()
+{
+    QFETCH(QString, codec);
+    QFETCH(bool, built);
+
+    if (!built) {
+        QSKIP("the slave is built without this codec");
+    }
+    // the perl server compresses with the command line tool
+    if (QStandardPaths::findExecutable(codec).isEmpty()) {
+        QSKIP("the codec's tool is not installed");
+    }
+
+    // text, which ZRETR and ZWRITE do compress, several blocks of it
+    const QString name = QStringLiteral("codec-") + codec;
+    QByteArray text;
+    for (int i = 0; text.size() < 3 * 1024 * 1024; ++i) {
+        text += "line " + QByteArray::number(i) + " of the compressed transfer test\n";
+    }
+    QFile file(localPath(name + QStringLiteral(".txt")));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(text), qint64(text.size()));
+    file.close();
+
+    const QString got = localPath(name + QStringLiteral("-got.txt"));
+    QFile::remove(got);
+    KIO::FileCopyJob *job = KIO::file_copy(fishUrl(name + QStringLiteral(".txt")), QUrl::fromLocalFile(got),
+                                           -1, KIO::HideProgressInfo);
+    job->addMetaData(QStringLiteral("fishcodec"), codec);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    QCOMPARE(fileHash(got), fileHash(file.fileName()));
+
+    QFile::remove(localPath(name + QStringLiteral("-put.txt")));
+    job = KIO::file_copy(QUrl::fromLocalFile(file.fileName()), fishUrl(name + QStringLiteral("-put.txt")),
+                         -1, KIO::HideProgressInfo);
+    job->addMetaData(QStringLiteral("fishcodec"), codec);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    QCOMPARE(fileHash(localPath(name + QStringLiteral("-put.txt"))), fileHash(file.fileName()));
+}
+
+void KioFishBenchmark::testPartialOverwrite_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::testPartialOverwrite()
+{
+    QFETCH(QString, server);
+
+    // a put over a file that is partly the same, which the perl server
+    // compares block by block with HASH and rewrites where they differ,
+    // both in the middle and at the end, where the new file is shorter
+    const QString src = localPath(QStringLiteral("partial-src"));
+    QVERIFY(createRandomFile(src, 3) > 0);
+    QFile srcFile(src);
+    QVERIFY(srcFile.open(QIODevice::ReadOnly));
+    const QByteArray content = srcFile.readAll();
+    srcFile.close();
+
+    const QString name = QStringLiteral("partial-") + server;
+    QByteArray old = content;
+    old.replace(1536 * 1024, 10, "0123456789");
+    old.append(QByteArray(4096, 'x'));
+    QFile dest(localPath(name));
+    QVERIFY(dest.open(QIODevice::WriteOnly));
+    QCOMPARE(dest.write(old), qint64(old.size()));
+    dest.close();
+
+    KIO::FileCopyJob *job = KIO::file_copy(QUrl::fromLocalFile(src), fishUrl(name), -1,
+                                           KIO::Overwrite | KIO::HideProgressInfo);
+    setServer(job, server);
+    job->addMetaData(QStringLiteral("fishhash"), QStringLiteral("true"));
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+
+    QCOMPARE(QFileInfo(dest.fileName()).size(), qint64(content.size()));
+    QCOMPARE(fileHash(dest.fileName()), fileHash(src));
+}
+
+void KioFishBenchmark::testListDir_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::testListDir()
+{
+    QFETCH(QString, server);
+
+    // names with spaces, sizes and symlinks, which XLIST sends as records
+    // and LIST as lines, and more entries than fit in one chunk of records
+    const QString dir = QStringLiteral("entries");
+    QVERIFY(createFiles(localPath(dir + QStringLiteral("/many")), 300, 10));
+    QVERIFY(writeFile(localPath(dir + QStringLiteral("/a file")), QByteArray(12345, 'a')));
+    QVERIFY(QDir().mkpath(localPath(dir + QStringLiteral("/sub dir"))));
+    QFile::remove(localPath(dir + QStringLiteral("/link")));
+    QVERIFY(QFile::link(QStringLiteral("a file"), localPath(dir + QStringLiteral("/link"))));
+
+    QHash<QString, KIO::UDSEntry> listed;
+    KIO::ListJob *job = KIO::listDir(fishUrl(dir), KIO::HideProgressInfo);
+    setServer(job, server);
+    connect(job, &KIO::ListJob::entries, this, [&listed](KIO::Job *, const KIO::UDSEntryList &entries) {
+        for (const KIO::UDSEntry &entry : entries) {
+            listed.insert(entry.stringValue(KIO::UDSEntry::UDS_NAME), entry);
+        }
+    });
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+
+    QVERIFY(listed.contains(QStringLiteral(".")));
+    QVERIFY(listed.value(QStringLiteral("sub dir")).isDir());
+    QVERIFY(listed.value(QStringLiteral("many")).isDir());
+    const KIO::UDSEntry file = listed.value(QStringLiteral("a file"));
+    QVERIFY(!file.isDir());
+    QCOMPARE(file.numberValue(KIO::UDSEntry::UDS_SIZE), 12345LL);
+    const KIO::UDSEntry link = listed.value(QStringLiteral("link"));
+    QVERIFY(link.isLink());
+    QCOMPARE(link.stringValue(KIO::UDSEntry::UDS_LINK_DEST), QStringLiteral("a file"));
+
+    listed.clear();
+    job = KIO::listDir(fishUrl(dir + QStringLiteral("/many")), KIO::HideProgressInfo);
+    setServer(job, server);
+    connect(job, &KIO::ListJob::entries, this, [&listed](KIO::Job *, const KIO::UDSEntryList &entries) {
+        for (const KIO::UDSEntry &entry : entries) {
+            listed.insert(entry.stringValue(KIO::UDSEntry::UDS_NAME), entry);
+        }
+    });
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+
+    const QStringList names = QDir(localPath(dir + QStringLiteral("/many"))).entryList(QDir::Files | QDir::System);
+    QCOMPARE(names.count(), 300);
+    for (const QString &name : names) {
+        QVERIFY2(listed.contains(name), qPrintable(name));
+    }
+    QVERIFY(listed.value(QStringLiteral("file000009")).isLink());
+    QCOMPARE(listed.value(QStringLiteral("file000009")).stringValue(KIO::UDSEntry::UDS_LINK_DEST),
+             QStringLiteral("file000008"));
+}
+
+void KioFishBenchmark::testStat_data()
+{
+    QTest::addColumn<QString>("server");
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<int>("error");
+    QTest::addColumn<bool>("isDir");
+    QTest::addColumn<QString>("linkDest");
+
+    const QStringList servers = { QStringLiteral("perl"), QStringLiteral("shell") };
+    for (const QString &server : servers) {
+        const QByteArray tag = server.toLatin1();
+        QTest::newRow(tag + " file") << server << QStringLiteral("entries/a file") << 0 << false << QString();
+        QTest::newRow(tag + " dir") << server << QStringLiteral("entries/sub dir") << 0 << true << QString();
+        QTest::newRow(tag + " link") << server << QStringLiteral("entries/link") << 0 << false << QStringLiteral("a file");
+        QTest::newRow(tag + " missing") << server << QStringLiteral("entries/missing") << int(KIO::ERR_DOES_NOT_EXIST)
+                                        << false << QString();
+    }
+}
+
+void KioFishBenchmark::testStat()
+{
+    QFETCH(QString, server);
+    QFETCH(QString, path);
+    QFETCH(int, error);
+    QFETCH(bool, isDir);
+    QFETCH(QString, linkDest);
+
+    QVERIFY(QDir().mkpath(localPath(QStringLiteral("entries/sub dir"))));
+    QVERIFY(writeFile(localPath(QStringLiteral("entries/a file")), QByteArray(12345, 'a')));
+    if (!QFileInfo(localPath(QStringLiteral("entries/link"))).isSymLink()) {
+        QVERIFY(QFile::link(QStringLiteral("a file"), localPath(QStringLiteral("entries/link"))));
+    }
+
+    KIO::StatJob *job = KIO::stat(fishUrl(path), KIO::HideProgressInfo);
+    setServer(job, server);
+    job->exec();
+    QCOMPARE(job->error(), error);
+    if (error) {
+        return;
+    }
+
+    const KIO::UDSEntry entry = job->statResult();
+    QCOMPARE(entry.stringValue(KIO::UDSEntry::UDS_NAME), path.mid(path.lastIndexOf(QLatin1Char('/')) + 1));
+    QCOMPARE(entry.isDir(), isDir);
+    QCOMPARE(entry.stringValue(KIO::UDSEntry::UDS_LINK_DEST), linkDest);
+    // of a symlink the shell has the size of its target, perl its own
+    if (!isDir && linkDest.isEmpty()) {
+        QCOMPARE(entry.numberValue(KIO::UDSEntry::UDS_SIZE), 12345LL);
+    }
+}
+
+void KioFishBenchmark::testServerCopy_data()
+{
+    QTest::addColumn<QString>("server");
+    QTest::addColumn<QString>("kind");
+    QTest::addColumn<int>("error");
+
+    const QStringList servers = { QStringLiteral("perl"), QStringLiteral("shell") };
+    for (const QString &server : servers) {
+        const QByteArray tag = server.toLatin1();
+        // the same file, which the two HASHes sent in one go find out
+        QTest::newRow(tag + " identical") << server << QStringLiteral("identical") << 0;
+        QTest::newRow(tag + " differs") << server << QStringLiteral("differs") << 0;
+        // MSTAT of source and destination, which answers for both
+        QTest::newRow(tag + " missing") << server << QStringLiteral("missing") << int(KIO::ERR_DOES_NOT_EXIST);
+        QTest::newRow(tag + " exists") << server << QStringLiteral("exists") << int(KIO::ERR_FILE_ALREADY_EXIST);
+        QTest::newRow(tag + " dir") << server << QStringLiteral("dir") << int(KIO::ERR_DIR_ALREADY_EXIST);
+    }
+}
+
+void KioFishBenchmark::testServerCopy()
+{
+    QFETCH(QString, server);
+    QFETCH(QString, kind);
+    QFETCH(int, error);
+
+    const QString src = QStringLiteral("server-copy-src");
+    const QString dest = QStringLiteral("server-copy-") + server;
+    const QByteArray content(100000, 's');
+    QVERIFY(writeFile(localPath(src), content));
+    QFile::remove(localPath(dest));
+    QDir(localPath(dest)).removeRecursively();
+
+    QByteArray expected = content;
+    if (kind == QLatin1String("identical")) {
+        QVERIFY(writeFile(localPath(dest), content));
+    } else if (kind == QLatin1String("differs") || kind == QLatin1String("exists")) {
+        QByteArray other = content;
+        other[50000] = 'x';
+        QVERIFY(writeFile(localPath(dest), other));
+        if (error) {
+            expected = other;
+        }
+    } else if (kind == QLatin1String("dir")) {
+        QVERIFY(QDir().mkpath(localPath(dest)));
+    }
+
+    const QString from = (kind == QLatin1String("missing") ? QStringLiteral("missing") : src);
+    KIO::JobFlags flags = KIO::HideProgressInfo;
+    if (!error) {
+        flags |= KIO::Overwrite;
+    }
+    KIO::FileCopyJob *job = KIO::file_copy(fishUrl(from), fishUrl(dest), -1, flags);
+    setServer(job, server);
+    job->addMetaData(QStringLiteral("fishhash"), QStringLiteral("true"));
+    job->exec();
+    QCOMPARE(job->error(), error);
+    if (kind != QLatin1String("missing") && kind != QLatin1String("dir")) {
+        QCOMPARE(readFile(localPath(dest)), expected);
+    }
+
+    // whatever was sent ahead of an error is answered and dropped, the
+    // next job on the connection gets its own response
+    KIO::StatJob *stat = KIO::stat(fishUrl(src), KIO::HideProgressInfo);
+    setServer(stat, server);
+    stat->addMetaData(QStringLiteral("fishhash"), QStringLiteral("true"));
+    QVERIFY2(stat->exec(), qPrintable(stat->errorString()));
+    QCOMPARE(stat->statResult().numberValue(KIO::UDSEntry::UDS_SIZE), qint64(content.size()));
+}
+
+void KioFishBenchmark::testRead_data()
+{
+    addServerRows();
+}
+
+void KioFishBenchmark::testRead()
+{
+    QFETCH(QString, server);
+
+    // more than the 256 KiB the slave reads from the server at once, and
+    // not a multiple of it
+    const QString name = QStringLiteral("read");
+    QByteArray content(1024 * 1024 + 12345, '\0');
+    for (int i = 0; i < content.size(); ++i) {
+        content[i] = char(random()());
+    }
+    QVERIFY(writeFile(localPath(name), content));
+
+    const QString got = localPath(QStringLiteral("read-got-") + server);
+    QFile::remove(got);
+    KIO::FileCopyJob *job = KIO::file_copy(fishUrl(name), QUrl::fromLocalFile(got), -1, KIO::HideProgressInfo);
+    setServer(job, server);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    QCOMPARE(readFile(got), content);
+
+    // READ of a FileJob, from an offset and across the buffer size
+    KIO::FileJob *file = KIO::open(fishUrl(name), QIODevice::ReadOnly);
+    setServer(file, server);
+    QSignalSpy opened(file, &KIO::FileJob::open);
+    QSignalSpy position(file, &KIO::FileJob::position);
+    QSignalSpy closed(file, static_cast<void (KIO::FileJob::*)(KIO::Job *)>(&KIO::FileJob::close));
+    QByteArray received;
+    connect(file, &KIO::FileJob::data, this, [&received](KIO::Job *, const QByteArray &data) {
+        received += data;
+    });
+    QVERIFY(opened.wait());
+    QCOMPARE(file->size(), KIO::filesize_t(content.size()));
+
+    file->seek(100000);
+    QVERIFY(position.wait());
+    while (received.size() < 300000) {
+        const int before = received.size();
+        file->read(300000 - before);
+        QTRY_VERIFY(received.size() > before);
+    }
+    QCOMPARE(received, content.mid(100000, 300000));
+
+    file->close();
+    QVERIFY(closed.wait());
+}
@@ -0,0 +1,92 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIOFISHBENCHMARK_H
+#define KIOFISHBENCHMARK_H
+
+#include "kiobenchmark.h"
+
+#include <QTemporaryDir>
+#include <QUrl>
+
+/**
+ * Benchmark and regression harness for kio_fish.
+ *
+ * Runs the slave in its local mode, fish://localhost, which starts the shell
+ * directly instead of through ssh, against files generated in a temporary
+ * directory.  As the same user it needs no password, so it runs unattended.  Every
+ * test runs once with the perl server and once with the shell commands
+ * alone, which the slave uses when a job's "fishserver" metadata is "shell".
+ * Compression and HASH, which the slave leaves out on local connections,
+ * are turned on by the "fishcodec" and "fishhash" metadata.
+ * The bench cases print time, time per operation and throughput, and check
+ * that the results are correct.  benchCopyFiles is the case tests/copytester
+ * was written for.  The test cases check behaviour only and are quick.
+ *
+ * As they take a while, the bench cases only run if KIO_FISH_BENCHMARK is
+ * set.  Further knobs (environment):
+ *   KIO_FISH_BENCH_HOST      host to log in to, default localhost; any other
+ *                            must share this machine's /tmp, e.g. 127.0.0.1
+ *                            with an ssh key
+ *   KIO_FISH_BENCH_FILE_MB   size of the transfer test file (default 16)
+ */
+class KioFishBenchmark : public KioBenchmark
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void benchStat_data();
+    void benchStat();
+    void benchListDir_data();
+    void benchListDir();
+    void benchGet_data();
+    void benchGet();
+    void benchPut_data();
+    void benchPut();
+    void benchCopyFiles_data();
+    void benchCopyFiles();
+
+    void testOverwrite_data();
+    void testOverwrite();
+    void testCodec_data();
+    void testCodec();
+    void testPartialOverwrite_data();
+    void testPartialOverwrite();
+    void testListDir_data();
+    void testListDir();
+    void testStat_data();
+    void testStat();
+    void testServerCopy_data();
+    void testServerCopy();
+    void testRead_data();
+    void testRead();
+
+private:
+    void addServerRows();
+    void login(const QString &server);
+    QUrl fishUrl(const QString &path) const;
+    QString localPath(const QString &path = QString()) const;
+
+    QTemporaryDir m_tempDir;
+    QString m_host;
+    qint64 m_fileSize = 0;
+};
+
+#endif
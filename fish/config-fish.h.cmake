@@ -25,3 +25,9 @@
 /* Defines whether we can use the openpty() function */
 #cmakedefine HAVE_OPENPTY 1
 
+
+/* Defines whether zlib is available for gzip compressed transfers */
+#cmakedefine HAVE_ZLIB 1
+
+/* Defines whether libzstd is available for zstd compressed transfers */
+#cmakedefine HAVE_ZSTD 1
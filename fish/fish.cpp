@@ -36,6 +36,7 @@
 #include <QStandardPaths>
 #include <QMimeType>
 #include <QMimeDatabase>
+#include <QCryptographicHash>
 
 #include <stdlib.h>
 #include <sys/resource.h>
@@ -61,6 +62,7 @@
 
 #ifndef Q_OS_WIN
 #include <errno.h>
+#include <pwd.h>
 #endif
 
 #include <kmessagebox.h>
@@ -112,6 +114,22 @@ static KProcess *childPid = 0;
 
 #define E(x) ((const char*)remoteEncoding()->encode(x).data())
 
+/** the number of commands sent ahead of the response being read */
+#define FISH_PIPELINE_DEPTH 16
+
+/** bytes a READ of a FileJob fetches at first, and at most while reads go on in sequence */
+#define FISH_READ_AHEAD_MIN (64*1024)
+#define FISH_READ_AHEAD_MAX (1024*1024)
+
+/** bytes of put data that one HASH compares with the file being overwritten */
+#define FISH_HASH_BLOCK (1024*1024)
+
+/** bytes of the child's output that run() reads in one go */
+#define FISH_READ_BUFFER (256*1024)
+
+/** bytes of put data that one WRITE or APPEND carries */
+#define FISH_WRITE_BLOCK (1024*1024)
+
 using namespace KIO;
 extern "C" {
 
@@ -142,7 +160,7 @@ const struct fishProtocol::fish_info fishProtocol::fishInfo[] = {
       ("echo; /bin/sh -c start_fish_server > /dev/null 2>/dev/null; perl .fishsrv.pl " CHECKSUM " 2>/dev/null; perl -e '$|=1; print \"### 100 transfer fish server\\n\"; while(<STDIN>) { last if /^__END__/; $code.=$_; } exit(eval($code));' 2>/dev/null;"),
       1 },
     { ("VER 0.0.3 copy append lscount lslinks lsmime exec stat"), 0,
-      ("echo 'VER 0.0.3 copy append lscount lslinks lsmime exec stat'"),
+      ("echo \"VER 0.0.3 copy append lscount lslinks lsmime exec stat`sha256sum < /dev/null > /dev/null 2>&1 && echo ' hash:sha256'`\""),
       1 },
     { ("PWD"), 0,
       ("pwd"),
@@ -201,11 +219,13 @@ const struct fishProtocol::fish_info fishProtocol::fishInfo[] = {
     // On network connections, read() may not fill the buffer
     // completely (no more data immediately available), but dd
     // does ignore that fact by design. Sorry, writes are slow.
-    // OTOH, WRITE is not used by the current ioslave methods,
-    // we use APPEND.
+    // The second dd writes byte by byte too, as that is the only
+    // block size any offset is a multiple of, and leaves the rest
+    // of the file alone. Puts use APPEND, only writes of a FileJob
+    // that are not at the end of the file come here.
     { ("WRITE"), 3,
       (">> %3; echo '### 001'; ( [ %2 -gt 0 ] && dd ibs=1 obs=%2 count=%2 2>/dev/null ) | "
-              "( dd ibs=32768 obs=%1 seek=1 of=%3 2>/dev/null || echo Error $?; cat >/dev/null; )"),
+              "( dd bs=1 seek=%1 conv=notrunc of=%3 2>/dev/null || echo Error $?; cat >/dev/null; )"),
       0 },
     { ("COPY"), 2,
       ("if [ -L %1 ]; then if cp -pdf %1 %2 2>/dev/null; then :; else LINK=\"`readlink %1`\"; ln -sf $LINK %2; fi; else cp -pf %1 %2; fi"),
@@ -215,12 +235,41 @@ const struct fishProtocol::fish_info fishProtocol::fishInfo[] = {
       0 },
     { ("EXEC"), 2,
       ("UMASK=`umask`; umask 077; touch %2; umask $UMASK; eval %1 < /dev/null > %2 2>&1; echo \"###RESULT: $?\" >> %2"),
+      0 },
+    // Compressed transfers need the perl server, which lists the codecs
+    // it has in its VER response. The shell never gets these.
+    { ("ZRETR"), 2,
+      ("echo not supported"),
+      0 },
+    { ("ZWRITE"), 4,
+      ("echo not supported"),
+      0 },
+    // LIST and STAT as records, for servers which have "lsrecords"
+    { ("XLIST"), 1,
+      ("echo not supported"),
+      0 },
+    { ("XSTAT"), 1,
+      ("echo not supported"),
+      0 },
+    // STAT of any number of paths, %1 stands for all of them. The perl
+    // server sends records, the shell starts each path with a "=" line.
+    { ("MSTAT"), -1,
+      ("for f in %1; do echo \"=$f\"; echo `ls -dLla \"$f\" 2> /dev/null | grep '^[-dsplcb]' | wc -l`; ls -dLla \"$f\" 2>/dev/null | grep '^[-dspl]' | ( while read -r p x u g s m d y n; do file -b -i $n 2>/dev/null | sed -e '\\,^[^/]*$,d;s/^/M/;s,/.*[ \t],/,'; FILE=\"$f\"; if [ -e \"$f/$n\" ]; then FILE=\"$f/$n\"; fi; if [ -L \"$FILE\" ]; then echo \":$n\"; ls -lad \"$FILE\" | sed -e 's/.* -> /L/'; else echo \":$n\" | sed -e 's/ -> /\\\nL/'; fi; echo \"P$p $u.$g\nS$s\nd$m $d $y\n\"; done; );"
+                "ls -dLla \"$f\" 2>/dev/null | grep '^[cb]' | ( while read -r p x u g a i m d y n; do echo \"P$p $u.$g\nE$a$i\nd$m $d $y\n:$n\n\"; done; ); done"),
+      0 },
+    // the digest of length bytes from offset on, or of the whole file if
+    // length is negative, for servers which have "hash:<name>"
+    { ("HASH"), 4,
+      ("if [ %3 -lt 0 ]; then sha256sum < %4; else tail -c +`expr %2 + 1` < %4 | head -c %3 | sha256sum; fi | ( read -r h x; echo $h )"),
+      1 },
+    { ("TRUNCATE"), 2,
+      ("dd if=/dev/null of=%2 bs=1 seek=%1 2>/dev/null"),
       0 }
 };
 
 fishProtocol::fishProtocol(const QByteArray &pool_socket, const QByteArray &app_socket)
-  : SlaveBase("fish", pool_socket, app_socket), mimeBuffer(1024, '\0'),
-    mimeTypeSent(false)
+  : SlaveBase("fish", pool_socket, app_socket), readBuffer(FISH_READ_BUFFER, '\0'),
+    mimeBuffer(1024, '\0'), mimeTypeSent(false)
 {
     myDebug( << "fishProtocol::fishProtocol()");
     if (sshPath == nullptr) {
@@ -240,6 +289,9 @@ fishProtocol::fishProtocol(const QByteArray &pool_socket, const QByteArray &app_
     isLoggedIn = false;
     writeReady = true;
     isRunning = false;
+    connecting = false;
+    holding = false;
+    discarding = false;
     firstLogin = true;
     errorCount = 0;
     rawRead = 0;
@@ -254,7 +306,21 @@ fishProtocol::fishProtocol(const QByteArray &pool_socket, const QByteArray &app_
 
     udsType = 0;
 
+    shellOnly = false;
+    forcedHash = false;
     hasAppend = false;
+    hasListRecords = false;
+    hasWriteAt = false;
+    readingRecords = false;
+    statReason = CHECK;
+    openMode = QIODevice::NotOpen;
+    openSize = 0;
+    openOffset = 0;
+    readAheadOffset = 0;
+    readAheadSize = FISH_READ_AHEAD_MIN;
+    compareSize = 0;
+    putEnded = false;
+    plainData.reserve(FISH_READ_BUFFER);
 
     isStat = false; // FIXME: just a workaround for konq deficiencies
     redirectUser = ""; // FIXME: just a workaround for konq deficiencies
@@ -276,7 +342,17 @@ fishProtocol::~fishProtocol()
 Connects to a server and logs us in via SSH. Then starts FISH protocol.
 */
 void fishProtocol::openConnection() {
+    // a job may ask for the shell commands alone, tests/fishbench does
+    // so to compare them with the perl server, and for a codec or HASH,
+    // which the autotest needs on local connections too
+    const bool shell = (metaData(QStringLiteral("fishserver")) == QLatin1String("shell"));
+    const QString codec = metaData(QStringLiteral("fishcodec"));
+    const bool hash = (metaData(QStringLiteral("fishhash")) == QLatin1String("true"));
+    if (childPid && (shell != shellOnly || codec != forcedCodec || hash != forcedHash)) shutdownConnection();
     if (childPid) return;
+    shellOnly = shell;
+    forcedCodec = codec;
+    forcedHash = hash;
 
     if (connectionHost.isEmpty())
     {
@@ -295,6 +371,13 @@ void fishProtocol::openConnection() {
         return;
     };
     myDebug( << "subprocess is running");
+    if (isLoggedIn) {
+        // The VER response tells how the commands of the job are best sent,
+        // so the server is started before they are queued.
+        connecting = true;
+        run();
+        connecting = false;
+    }
 }
 
 // XXX Use KPty! XXX
@@ -419,6 +502,14 @@ bool fishProtocol::connectionStart() {
         }
     }
 #else
+    // su asks for a password even to become the user the slave already runs
+    // as, which needs no login at all
+    bool sameUser = false;
+    if (local) {
+        const struct passwd *pw = getpwuid(getuid());
+        sameUser = (pw != nullptr && connectionUser == QString::fromLocal8Bit(pw->pw_name));
+    }
+
     childPid = fork();
     if (childPid == -1) {
         myDebug( << "fork failed, error: " << strerror(errno));
@@ -463,7 +554,9 @@ bool fishProtocol::connectionStart() {
         if (dev) ::close(::open(dev, O_WRONLY, 0));
         setpgid(0,0);
 
-        if (local) {
+        if (local && sameUser) {
+            execl("/bin/sh", "sh", "-c", "cd ~;echo FISH:;exec /bin/sh -c \"if env true 2>/dev/null; then env PS1= PS2= TZ=UTC LANG=C LC_ALL=C LOCALE=C /bin/sh; else PS1= PS2= TZ=UTC LANG=C LC_ALL=C LOCALE=C /bin/sh; fi\"", (void *)nullptr);
+        } else if (local) {
             execl(suPath, "su", "-", connectionUser.toLatin1().constData(), "-c", "cd ~;echo FISH:;exec /bin/sh -c \"if env true 2>/dev/null; then env PS1= PS2= TZ=UTC LANG=C LC_ALL=C LOCALE=C /bin/sh; else PS1= PS2= TZ=UTC LANG=C LC_ALL=C LOCALE=C /bin/sh; fi\"", (void *)nullptr);
         } else {
             #define common_args "-l", connectionUser.toLatin1().constData(), "-x", "-e", "none", \
@@ -768,6 +861,10 @@ void fishProtocol::shutdownConnection(bool forced){
     qlist.clear();
     commandList.clear();
     commandCodes.clear();
+    pipelineCodes.clear();
+    discarding = false;
+    transferCodec.reset();
+    recordStrings.clear();
     isLoggedIn = false;
     writeReady = true;
     isRunning = false;
@@ -780,31 +877,49 @@ void fishProtocol::shutdownConnection(bool forced){
 builds each FISH request and sets the error counter
 */
 bool fishProtocol::sendCommand(fish_command_type cmd, ...) {
+    va_list list;
+    va_start(list, cmd);
+    QStringList args;
+    for (int i = 0; i < fishInfo[cmd].params; i++) {
+        args.append(QString(va_arg(list, const char *)));
+    }
+    va_end(list);
+    return sendCommand(cmd, args);
+}
+
+/**
+builds a FISH request from a list of arguments, which may be of any length
+for commands that take a list of paths
+*/
+bool fishProtocol::sendCommand(fish_command_type cmd, const QStringList &args) {
     const fish_info &info = fishInfo[cmd];
     myDebug( << "queuing: cmd="<< cmd << "['" << info.command << "'](" << info.params <<"), alt=['" << info.alt << "'], lines=" << info.lines);
 
-    va_list list;
-    va_start(list, cmd);
     QString realCmd = info.command;
-    QString realAlt = info.alt;
+    // without the perl server, FISH only has to answer
+    QString realAlt = (cmd == FISH_FISH && shellOnly ? QStringLiteral("echo") : QString(info.alt));
+    QStringList quoted;
     static QRegExp rx("[][\\\\\n $`#!()*?{}~&<>;'\"%^@|\t]");
-    for (int i = 0; i < info.params; i++) {
-        QString arg(va_arg(list, const char *));
+    for (int i = 0; i < args.count(); i++) {
+        QString arg(args.at(i));
         int pos = -2;
         while ((pos = rx.indexIn(arg,pos+2)) >= 0) {
             arg.replace(pos,0,QString("\\"));
         }
         //myDebug( << "arg " << i << ": " << arg);
         realCmd.append(" ").append(arg);
-        realAlt.replace(QRegExp('%'+QString::number(i+1)),arg);
+        if (info.params >= 0)
+            realAlt.replace(QRegExp('%'+QString::number(i+1)),arg);
+        quoted.append(arg);
     }
+    if (info.params < 0)
+        realAlt.replace(QLatin1String("%1"),quoted.join(QLatin1Char(' ')));
     QString s("#");
     s.append(realCmd).append("\n ").append(realAlt).append(" 2>&1;echo '### 000'\n");
     if (realCmd == "FISH")
         s.prepend(" ");
     commandList.append(s);
     commandCodes.append(cmd);
-    va_end(list);
     return true;
 }
 
@@ -868,12 +983,42 @@ void fishProtocol::manageConnection(const QString &l) {
     QDateTime dt;
     long pos, pos2, pos3;
     bool isOk = false;
+    if (discarding) {
+        // response of a command sent ahead of an error, only its end
+        // matters, and the records in between are skipped
+        if (rc == 100) readingRecords = (fishCommand == FISH_XLIST || fishCommand == FISH_XSTAT || fishCommand == FISH_MSTAT);
+        else if (rc == 0 && readingRecords) rawRead = qMax(0LL, line.toLongLong());
+        else if (rc != 0) finished();
+        return;
+    }
     if (!rc) {
         switch (fishCommand) {
         case FISH_VER:
             if (line.startsWith(QLatin1String("VER 0.0.3"))) {
                 line.append(" ");
                 hasAppend = line.contains(" append ");
+                hasListRecords = line.contains(" lsrecords ");
+                hasWriteAt = line.contains(" writeat ");
+                codecName.clear();
+                hashName.clear();
+                // compression is of no use without a network in between
+                if (!local || !forcedCodec.isEmpty()) {
+                    const QStringList codecs = FishCodec::available();
+                    for (const QString &codec : codecs) {
+                        if ((forcedCodec.isEmpty() || codec == forcedCodec)
+                                && line.contains(" codec:" + codec + ' ')) {
+                            codecName = codec;
+                            break;
+                        }
+                    }
+                }
+                // nor is reading a file to save writing it
+                if (!local || forcedHash) {
+                    if (line.contains(QLatin1String(" hash:sha256 ")))
+                        hashName = QStringLiteral("sha256");
+                    else if (line.contains(QLatin1String(" hash:md5 ")))
+                        hashName = QStringLiteral("md5");
+                }
             } else {
                 error(ERR_UNSUPPORTED_PROTOCOL,line);
                 shutdownConnection();
@@ -883,9 +1028,19 @@ void fishProtocol::manageConnection(const QString &l) {
             url.setPath(line);
             redirection(url);
             break;
-        case FISH_LIST:
-            myDebug( << "listReason: " << static_cast<int>(listReason));
+        case FISH_MSTAT:
+            if (readingRecords) {
+                // the length of the next chunk of records
+                rawRead = line.toLongLong(&isOk);
+                if (!isOk || rawRead < 0) {
+                    rawRead = 0;
+                    error(ERR_CONNECTION_BROKEN,connectionHost);
+                    shutdownConnection();
+                }
+                break;
+            }
             /* Fall through */
+        case FISH_LIST:
         case FISH_STAT:
             if (line.length() > 0) {
                 switch (line[0].cell()) {
@@ -901,8 +1056,9 @@ void fishProtocol::manageConnection(const QString &l) {
                 case '9':
                 {
                     long long val = line.toLongLong(&isOk);
-                    if (val > 0 && isOk) errorCount--;
-                    if ((fishCommand == FISH_LIST) && (listReason == LIST))
+                    // a path of MSTAT that does not exist is no error
+                    if ((val > 0 || fishCommand == FISH_MSTAT) && isOk) errorCount--;
+                    if (fishCommand == FISH_LIST)
                         totalSize(val);
                 }
                 break;
@@ -996,6 +1152,12 @@ void fishProtocol::manageConnection(const QString &l) {
                     errorCount--;
                     break;
 
+                case '=':
+                    // the next path of MSTAT
+                    statResults.append(KIO::UDSEntry());
+                    errorCount--;
+                    break;
+
                 case ':':
                     pos = line.lastIndexOf('/');
                     thisFn = line.mid(pos < 0?1:pos+1);
@@ -1034,23 +1196,42 @@ void fishProtocol::manageConnection(const QString &l) {
                     break;
                 }
             } else {
-                if (!udsMime.isNull())
-                    udsEntry.insert(KIO::UDSEntry::UDS_MIME_TYPE, udsMime);
-                udsMime.clear();
-
-                udsEntry.insert( KIO::UDSEntry::UDS_FILE_TYPE, udsType );
-                udsType = 0;
-
-                if (fishCommand == FISH_STAT)
-                    udsStatEntry = udsEntry;
-                else if (listReason == LIST) {
-                    listEntry(udsEntry); //1
-                } else if (listReason == CHECK) checkExist = true; //0
+                finishEntry();
                 errorCount--;
-                udsEntry.clear();
             }
             break;
 
+        case FISH_XLIST:
+        case FISH_XSTAT:
+            if (readingRecords) {
+                // the length of the next chunk of records
+                rawRead = line.toLongLong(&isOk);
+                if (!isOk || rawRead < 0) {
+                    rawRead = 0;
+                    error(ERR_CONNECTION_BROKEN,connectionHost);
+                    shutdownConnection();
+                }
+            } else if (fishCommand == FISH_XLIST) {
+                totalSize(line.toLongLong());
+            }
+            break;
+
+        case FISH_HASH:
+            remoteHash = line;
+            break;
+
+        case FISH_ZRETR:
+            if (transferCodec) {
+                // the length of the next chunk of compressed data
+                rawRead = line.toLongLong(&isOk);
+                if (!isOk || rawRead < 0) {
+                    rawRead = 0;
+                    error(ERR_COULD_NOT_READ,url.toDisplayString());
+                    shutdownConnection();
+                }
+                break;
+            }
+            /* fall through */
         case FISH_RETR:
             if (line.length() == 0) {
                 error(ERR_IS_DIRECTORY,url.toDisplayString());
@@ -1073,8 +1254,6 @@ void fishProtocol::manageConnection(const QString &l) {
             writeChild(fishCode, fishCodeLen);
             break;
         case FISH_READ:
-            recvLen = 1024;
-            /* fall through */
         case FISH_RETR:
             myDebug( << "reading " << recvLen);
             if (recvLen == -1) {
@@ -1091,9 +1270,32 @@ void fishProtocol::manageConnection(const QString &l) {
                 }
             }
             break;
+        case FISH_ZRETR:
+            myDebug( << "reading " << recvLen << " compressed");
+            transferCodec.reset(FishCodec::create(codecName));
+            if (recvLen == -1 || !transferCodec) {
+                error(ERR_COULD_NOT_READ,url.toDisplayString());
+                shutdownConnection();
+            } else {
+                dataRead = 0;
+                mimeTypeSent = false;
+                if (recvLen == 0)
+                {
+                    mimeType("application/x-zerosize");
+                    mimeTypeSent = true;
+                }
+            }
+            break;
+        case FISH_XLIST:
+        case FISH_XSTAT:
+        case FISH_MSTAT:
+            readingRecords = true;
+            recordBuffer.clear();
+            break;
         case FISH_STOR:
         case FISH_WRITE:
         case FISH_APPEND:
+        case FISH_ZWRITE:
             rawWrite = sendLen;
             //myDebug( << "sending " << sendLen);
             writeChild(nullptr,0);
@@ -1105,10 +1307,21 @@ void fishProtocol::manageConnection(const QString &l) {
         case FISH_STOR:
         case FISH_WRITE:
         case FISH_APPEND:
+        case FISH_ZWRITE:
             error(ERR_COULD_NOT_WRITE,url.toDisplayString());
             shutdownConnection();
             break;
+        case FISH_TRUNCATE:
+            error(ERR_COULD_NOT_WRITE,url.toDisplayString());
+            break;
+        case FISH_HASH:
+            // compared as different
+            hashResults.append(QString());
+            hashed();
+            finished();
+            break;
         case FISH_RETR:
+        case FISH_ZRETR:
             error(ERR_COULD_NOT_READ,url.toDisplayString());
             shutdownConnection();
             break;
@@ -1136,17 +1349,26 @@ void fishProtocol::manageConnection(const QString &l) {
             error(ERR_CANNOT_ENTER_DIRECTORY,url.toDisplayString());
             break;
         case FISH_LIST:
-            myDebug( << "list error. reason: " << static_cast<int>(listReason));
-            if (listReason == LIST) error(ERR_CANNOT_ENTER_DIRECTORY,url.toDisplayString());
-            else if (listReason == CHECK) {
-                checkExist = false;
-                finished();
-            }
+        case FISH_XLIST:
+            error(ERR_CANNOT_ENTER_DIRECTORY,url.toDisplayString());
             break;
         case FISH_STAT:
+        case FISH_XSTAT:
             error(ERR_DOES_NOT_EXIST,url.toDisplayString());
             udsStatEntry.clear();
             break;
+        case FISH_MSTAT:
+            if (statReason == OPEN) {
+                error(ERR_COULD_NOT_STAT,url.toDisplayString());
+                break;
+            }
+            // a check that cannot be made does not stop the job
+            myDebug( << "check failed");
+            checkExist = false;
+            statResults.clear();
+            checked();
+            finished();
+            break;
         case FISH_CHMOD:
             error(ERR_CANNOT_CHMOD,url.toDisplayString());
             break;
@@ -1177,30 +1399,54 @@ void fishProtocol::manageConnection(const QString &l) {
         default : break;
         }
     } else {
-        if (fishCommand == FISH_STOR) fishCommand = (hasAppend?FISH_APPEND:FISH_WRITE);
+        if (fishCommand == FISH_STOR && openUrl.isEmpty()) fishCommand = (hasAppend?FISH_APPEND:FISH_WRITE);
         if (fishCommand == FISH_FISH) {
             connected();
-        } else if (fishCommand == FISH_LIST) {
-            if (listReason == CHECK && !checkOverwrite && checkExist) {
-                error(ERR_FILE_ALREADY_EXIST,url.toDisplayString());
-                return; // Don't call finished!
-            }
-        } else if (fishCommand == FISH_STAT) {
+        } else if (fishCommand == FISH_STAT || fishCommand == FISH_XSTAT) {
             udsStatEntry.insert( KIO::UDSEntry::UDS_NAME, url.fileName() );
             statEntry(udsStatEntry);
+        } else if (fishCommand == FISH_MSTAT) {
+            if (statReason != OPEN) {
+                if (!checkResults())
+                    return; // Don't call finished!
+                checked();
+            }
+        } else if (fishCommand == FISH_HASH) {
+            hashResults.append(remoteHash);
+            hashed();
+        } else if (!openUrl.isEmpty()) {
+            // STOR, WRITE or APPEND of a FileJob, whose method goes on
         } else if (fishCommand == FISH_APPEND) {
-            dataReq();
-            if (readData(rawData) > 0) sendCommand(FISH_APPEND,E(QString::number(rawData.size())),E(url.path()));
+            if (readBlock(FISH_WRITE_BLOCK) > 0) sendCommand(FISH_APPEND,E(QString::number(rawData.size())),E(url.path()));
             else if (!checkExist && putPerm > -1) sendCommand(FISH_CHMOD,E(QString::number(putPerm,8)),E(url.path()));
             sendLen = rawData.size();
-        } else if (fishCommand == FISH_WRITE) {
-            dataReq();
-            if (readData(rawData) > 0) sendCommand(FISH_WRITE,E(QString::number(putPos)),E(QString::number(rawData.size())),E(url.path()));
+        } else if ((fishCommand == FISH_WRITE || fishCommand == FISH_ZWRITE) && compareSize > 0) {
+            nextBlock();
+        } else if (fishCommand == FISH_WRITE || fishCommand == FISH_ZWRITE) {
+            if (readBlock(FISH_WRITE_BLOCK) > 0) {
+                QByteArray packed;
+                if (transferCodec && transferCodec->encode(rawData, packed) && packed.size() < rawData.size()) {
+                    sendCommand(FISH_ZWRITE,E(transferCodec->name()),E(QString::number(putPos)),E(QString::number(packed.size())),E(url.path()));
+                    putPos += rawData.size();
+                    rawData = packed;
+                } else {
+                    sendCommand(FISH_WRITE,E(QString::number(putPos)),E(QString::number(rawData.size())),E(url.path()));
+                    putPos += rawData.size();
+                }
+            }
             else if (!checkExist && putPerm > -1) sendCommand(FISH_CHMOD,E(QString::number(putPerm,8)),E(url.path()));
-            putPos += rawData.size();
             sendLen = rawData.size();
         } else if (fishCommand == FISH_RETR) {
             data(QByteArray());
+        } else if (fishCommand == FISH_ZRETR) {
+            if (!transferCodec || !transferCodec->atEnd()) {
+                error(ERR_COULD_NOT_READ,url.toDisplayString());
+                shutdownConnection();
+                return;
+            }
+            transferCodec.reset();
+            if (!mimeTypeSent) emitMimeType();
+            data(QByteArray());
         }
         finished();
     }
@@ -1260,47 +1506,29 @@ int fishProtocol::received(const char *buffer, KIO::fileoffset_t buflen)
         if (rawRead > 0) {
             myDebug( << "processedSize " << dataRead << ", len " << buflen << "/" << rawRead);
             int dataSize = (rawRead > buflen?buflen:rawRead);
-            if (!mimeTypeSent)
-            {
-                int mimeSize = qMin(dataSize, (int)(mimeBuffer.size()-dataRead));
-                memcpy(mimeBuffer.data()+dataRead,buffer,mimeSize);
-                dataRead += mimeSize;
-                rawRead -= mimeSize;
-                buffer += mimeSize;
-                buflen -= mimeSize;
-                if (rawRead == 0) // End of data
-                    mimeBuffer.resize(dataRead);
-                if (dataRead < (int)mimeBuffer.size())
-                {
-                    myDebug( << "wait for more");
-                    break;
-                }
-
-                QMimeDatabase db;
-                sendmimeType(db.mimeTypeForFileNameAndData(url.path(), mimeBuffer).name());
-                mimeTypeSent = true;
-                if (fishCommand != FISH_READ) {
-                    totalSize(dataRead + rawRead);
-                    data(mimeBuffer);
-                    processedSize(dataRead);
-                }
-                mimeBuffer.resize(1024);
-                pos = 0;
-                continue; // Process rest of buffer/buflen
-            }
-
-            QByteArray bdata(buffer,dataSize);
-            data(bdata);
-
-            dataRead += dataSize;
             rawRead -= dataSize;
-            processedSize(dataRead);
-            if (rawRead <= 0) {
-                buffer += dataSize;
-                buflen -= dataSize;
+            if (discarding) {
+                // records of a command sent ahead of an error
+            } else if (fishCommand == FISH_XLIST || fishCommand == FISH_XSTAT || fishCommand == FISH_MSTAT) {
+                receivedRecords(buffer, dataSize);
+            } else if (fishCommand == FISH_READ && !openUrl.isEmpty()) {
+                readAhead.append(buffer, dataSize);
+            } else if (fishCommand == FISH_ZRETR) {
+                plainData.resize(0);
+                if (!transferCodec->decode(buffer, dataSize, plainData)) {
+                    error(ERR_COULD_NOT_READ,url.toDisplayString());
+                    shutdownConnection();
+                    return 0;
+                }
+                receivedData(plainData.constData(), plainData.size());
             } else {
-                return 0;
+                receivedData(buffer, dataSize);
+                if (rawRead == 0 && !mimeTypeSent) // all data is in mimeBuffer
+                    emitMimeType();
             }
+            buffer += dataSize;
+            buflen -= dataSize;
+            if (rawRead > 0) return 0;
         }
 
         if (buflen <= 0) break;
@@ -1312,7 +1540,7 @@ int fishProtocol::received(const char *buffer, KIO::fileoffset_t buflen)
 
         if (pos < buflen)
         {
-           QString s = remoteEncoding()->decode(QByteArray(buffer,pos));
+           QString s = remoteEncoding()->decode(QByteArray::fromRawData(buffer,pos));
 
            buffer += pos+1;
            buflen -= pos+1;
@@ -1327,6 +1555,340 @@ int fishProtocol::received(const char *buffer, KIO::fileoffset_t buflen)
     } while (childPid && buflen && (rawRead > 0 || pos < buflen));
     return buflen;
 }
+/** passes on data of a RETR or READ, the first bytes go to the mimetype check */
+void fishProtocol::receivedData(const char *buffer, int len)
+{
+    if (!mimeTypeSent) {
+        if (dataRead == 0 && len >= (int)mimeBuffer.size()) {
+            // enough to tell the mimetype, the data goes on in one piece
+            sniffMimeType(QByteArray::fromRawData(buffer,mimeBuffer.size()));
+        } else {
+            int mimeSize = qMin(len, (int)(mimeBuffer.size()-dataRead));
+            memcpy(mimeBuffer.data()+dataRead,buffer,mimeSize);
+            dataRead += mimeSize;
+            buffer += mimeSize;
+            len -= mimeSize;
+            if (dataRead < (int)mimeBuffer.size()) {
+                myDebug( << "wait for more");
+                return;
+            }
+            emitMimeType();
+        }
+    }
+    if (len <= 0) return;
+
+    // the data is sent before buffer is reused, so it needs no copy
+    data(QByteArray::fromRawData(buffer,len));
+
+    dataRead += len;
+    processedSize(dataRead);
+}
+
+/** sends the mimetype for the data in mimeBuffer */
+void fishProtocol::emitMimeType()
+{
+    mimeBuffer.resize(dataRead);
+    sniffMimeType(mimeBuffer);
+    if (fishCommand != FISH_READ) {
+        data(mimeBuffer);
+        processedSize(dataRead);
+    }
+    mimeBuffer.resize(1024);
+}
+
+/** sends the mimetype for the first bytes of a file, and its size */
+void fishProtocol::sniffMimeType(const QByteArray &head)
+{
+    QMimeDatabase db;
+    sendmimeType(db.mimeTypeForFileNameAndData(url.path(), head).name());
+    mimeTypeSent = true;
+    if (fishCommand != FISH_READ)
+        totalSize(recvLen);
+}
+
+/** collects the records of XLIST and XSTAT until a chunk is complete */
+void fishProtocol::receivedRecords(const char *buffer, int len)
+{
+    if (rawRead == 0 && recordBuffer.isEmpty()) {
+        // the whole chunk is at hand
+        parseRecords(buffer, len);
+        return;
+    }
+    recordBuffer.append(buffer, len);
+    if (rawRead == 0) {
+        parseRecords(recordBuffer.constData(), recordBuffer.size());
+        recordBuffer.clear();
+    }
+}
+
+/**
+decodes complete records of XLIST and XSTAT
+
+Each record has the fields type, mode, user, group, size, mtime, name, link
+and mimetype, each ending with a NUL. They are taken from the buffer as they
+are, without splitting it into lines first.
+*/
+void fishProtocol::parseRecords(const char *buffer, int len)
+{
+    const char *end = buffer + len;
+    const char *field[10];
+    QMimeDatabase db;
+    while (buffer < end) {
+        for (int i = 0; i < 9; i++) {
+            const char *next = (const char *)memchr(buffer, '\0', end - buffer);
+            if (!next) {
+                myDebug( << "incomplete record");
+                error(ERR_CONNECTION_BROKEN,connectionHost);
+                shutdownConnection();
+                return;
+            }
+            field[i] = buffer;
+            buffer = next + 1;
+        }
+        field[9] = buffer;
+
+        if (fishCommand == FISH_MSTAT)
+            statResults.append(KIO::UDSEntry());
+        switch (field[0][0]) {
+        case 'd':
+            udsType = S_IFDIR;
+            udsMime = "inode/directory";
+            break;
+        case '-': udsType = S_IFREG; break;
+        case 'l': udsType = S_IFLNK; break;
+        case 'c': udsType = S_IFCHR; break;
+        case 'b': udsType = S_IFBLK; break;
+        case 's': udsType = S_IFSOCK; break;
+        case 'p': udsType = S_IFIFO; break;
+        case '\0':
+            // a path of MSTAT that does not exist
+            continue;
+        default:
+            myDebug( << "unknown file type: " << field[0][0]);
+            continue;
+        }
+        udsEntry.insert(KIO::UDSEntry::UDS_ACCESS, strtoll(field[1], nullptr, 10));
+        udsEntry.insert(KIO::UDSEntry::UDS_USER, recordString(field[2], field[3]-field[2]-1));
+        udsEntry.insert(KIO::UDSEntry::UDS_GROUP, recordString(field[3], field[4]-field[3]-1));
+        udsEntry.insert(KIO::UDSEntry::UDS_SIZE, strtoll(field[4], nullptr, 10));
+        udsEntry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, strtoll(field[5], nullptr, 10));
+
+        thisFn = remoteEncoding()->decode(QByteArray::fromRawData(field[6], field[7]-field[6]-1));
+        if (fishCommand == FISH_MSTAT) {
+            // named by the whole path
+            thisFn = thisFn.mid(thisFn.lastIndexOf('/')+1);
+        }
+        if (fishCommand == FISH_XLIST) {
+            udsEntry.insert(KIO::UDSEntry::UDS_NAME, thisFn);
+        }
+        if (field[8]-field[7] > 1) {
+            udsEntry.insert(KIO::UDSEntry::UDS_LINK_DEST,
+                            remoteEncoding()->decode(QByteArray::fromRawData(field[7], field[8]-field[7]-1)));
+        }
+
+        // as with LIST, file(1) is only the fallback for the extension
+        if (udsType != S_IFDIR) {
+            QMimeType mime = db.mimeTypeForFile(thisFn, QMimeDatabase::MatchExtension);
+            if (!mime.isDefault())
+                udsMime = mime.name();
+        }
+        if (udsMime.isEmpty() && field[9]-field[8] > 1) {
+            QString mime = recordString(field[8], field[9]-field[8]-1);
+            if (!mime.endsWith(QLatin1String("/unknown")) &&
+                    (thisFn.indexOf('.') < 0 || (!mime.startsWith(QLatin1String("text/x-"))
+                                                 && mime != QLatin1String("text/plain")))) {
+                udsMime = mime;
+                if (udsMime == QLatin1String("inode/directory")) // a symlink to a dir is a dir
+                    udsType = S_IFDIR;
+            }
+        }
+        finishEntry();
+    }
+}
+
+/** decodes a user, group or mimetype of a record */
+QString fishProtocol::recordString(const char *str, int len)
+{
+    QHash<QByteArray, QString>::const_iterator it = recordStrings.constFind(QByteArray::fromRawData(str, len));
+    if (it != recordStrings.constEnd())
+        return it.value();
+    QString decoded = remoteEncoding()->decode(QByteArray(str, len));
+    recordStrings.insert(QByteArray(str, len), decoded);
+    return decoded;
+}
+
+/** passes on the entry of LIST or STAT that is complete now */
+void fishProtocol::finishEntry()
+{
+    if (!udsMime.isNull())
+        udsEntry.insert(KIO::UDSEntry::UDS_MIME_TYPE, udsMime);
+    udsMime.clear();
+
+    udsEntry.insert( KIO::UDSEntry::UDS_FILE_TYPE, udsType );
+    udsType = 0;
+
+    if (fishCommand == FISH_STAT || fishCommand == FISH_XSTAT)
+        udsStatEntry = udsEntry;
+    else if (fishCommand == FISH_MSTAT) {
+        udsEntry.insert(KIO::UDSEntry::UDS_NAME, thisFn);
+        if (!statResults.isEmpty()) statResults.last() = udsEntry;
+    } else {
+        listEntry(udsEntry);
+    }
+    udsEntry.clear();
+}
+
+/**
+checks what MSTAT found at the source and destination of a write
+
+The source of a copy or rename must exist. The destination must not, unless
+it may be overwritten.
+*/
+bool fishProtocol::checkResults()
+{
+    int i = 0;
+    if (!checkSource.isEmpty()) {
+        if (statResults.value(i).count() == 0) {
+            error(ERR_DOES_NOT_EXIST,checkSource.toDisplayString());
+            return false;
+        }
+        i++;
+    }
+    const KIO::UDSEntry dest = statResults.value(i);
+    checkExist = (dest.count() > 0);
+    if (checkExist && !checkOverwrite) {
+        error(dest.isDir()?ERR_DIR_ALREADY_EXIST:ERR_FILE_ALREADY_EXIST,url.toDisplayString());
+        return false;
+    }
+    return true;
+}
+
+/**
+goes on with put or copy once MSTAT has checked their paths
+
+A file that is overwritten is compared with what replaces it first, by
+HASH on the server and the same digest here, so that re-copying a file
+that has hardly changed costs little more than reading it.
+*/
+void fishProtocol::checked()
+{
+    const KIO::UDSEntry dest = statResults.value(checkSource.isEmpty()?0:1);
+    const KIO::filesize_t destSize = dest.numberValue(KIO::UDSEntry::UDS_SIZE, 0);
+    const bool destIsFile = (dest.numberValue(KIO::UDSEntry::UDS_FILE_TYPE) == S_IFREG);
+    if (statReason == PUT) {
+        // rewriting the blocks that differ only pays off where WRITE is
+        // as fast as APPEND; the shell's writes byte by byte
+        if (destIsFile && destSize > 0 && !hashName.isEmpty() && hasWriteAt) {
+            compareSize = destSize;
+            nextBlock();
+        } else {
+            sendCommand(FISH_STOR,"0",E(url.path()));
+        }
+    } else if (statReason == COPY) {
+        const KIO::UDSEntry src = statResults.value(0);
+        hashResults.clear();
+        if (destIsFile && destSize > 0 && !hashName.isEmpty()
+                && src.numberValue(KIO::UDSEntry::UDS_FILE_TYPE) == S_IFREG
+                && src.numberValue(KIO::UDSEntry::UDS_SIZE, 0) == destSize) {
+            sendCommand(FISH_HASH,E(hashName),"0","-1",E(checkSource.path()));
+            sendCommand(FISH_HASH,E(hashName),"0","-1",E(url.path()));
+        } else {
+            hashResults << QString() << QString();
+            hashed();
+        }
+    }
+}
+
+/**
+collects up to size bytes of put data in rawData, returns the number of bytes
+
+The job hands over data in small pieces, which would cost a round trip
+each if they were sent on their own.
+*/
+int fishProtocol::readBlock(int size)
+{
+    rawData.clear();
+    QByteArray buffer;
+    while (!putEnded && rawData.size() < size) {
+        dataReq();
+        if (readData(buffer) <= 0) putEnded = true;
+        else rawData.append(buffer);
+    }
+    return rawData.size();
+}
+
+/**
+takes the next block of put data and compares or writes it
+
+Blocks which lie within the file being overwritten are compared with it
+first. Those past its end are written as they come, and if the data ends
+before the file does, the rest is cut off.
+*/
+void fishProtocol::nextBlock()
+{
+    if (readBlock(FISH_HASH_BLOCK) == 0) {
+        if (putPos < compareSize)
+            sendCommand(FISH_TRUNCATE,E(QString::number(putPos)),E(url.path()));
+        compareSize = 0;
+    } else if (putPos+rawData.size() <= compareSize) {
+        hashResults.clear();
+        sendCommand(FISH_HASH,E(hashName),E(QString::number(putPos)),E(QString::number(rawData.size())),E(url.path()));
+    } else {
+        compareSize = 0;
+        sendCommand(FISH_WRITE,E(QString::number(putPos)),E(QString::number(rawData.size())),E(url.path()));
+        putPos += rawData.size();
+        sendLen = rawData.size();
+    }
+}
+
+/** goes on with put or copy once HASH has answered */
+void fishProtocol::hashed()
+{
+    if (statReason == PUT) {
+        const QByteArray local = QCryptographicHash::hash(rawData,
+            (hashName == QLatin1String("md5")?QCryptographicHash::Md5:QCryptographicHash::Sha256)).toHex();
+        if (hashResults.value(0) == QLatin1String(local)) {
+            // the block is there already
+            putPos += rawData.size();
+            nextBlock();
+        } else {
+            sendCommand(FISH_WRITE,E(QString::number(putPos)),E(QString::number(rawData.size())),E(url.path()));
+            putPos += rawData.size();
+            sendLen = rawData.size();
+        }
+    } else if (statReason == COPY && hashResults.count() == 2) {
+        if (hashResults.at(0).isEmpty() || hashResults.at(0) != hashResults.at(1))
+            sendCommand(FISH_COPY,E(checkSource.path()),E(url.path()));
+        else
+            myDebug( << "identical, not copied");
+        if (putPerm > -1) sendCommand(FISH_CHMOD,E(QString::number(putPerm,8)),E(url.path()));
+    }
+}
+
+/** true if transfers of path are worth compressing */
+bool fishProtocol::canCompress(const QString &path)
+{
+    if (codecName.isEmpty()) return false;
+
+    // formats that are compressed already
+    static const char * const packed[] = {
+        "application/gzip", "application/x-bzip", "application/x-xz",
+        "application/x-lzma", "application/zstd", "application/zip",
+        "application/x-7z-compressed", "application/vnd.rar", "application/x-rar",
+        "application/x-rpm", "application/vnd.debian.binary-package",
+        "image/jpeg", "image/png", "image/gif", "image/webp",
+        "audio/mpeg", "audio/ogg", "audio/flac", "audio/mp4", "audio/aac",
+        nullptr
+    };
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForFile(path, QMimeDatabase::MatchExtension);
+    if (mime.name().startsWith(QLatin1String("video/"))) return false;
+    for (int i = 0; packed[i]; i++) {
+        if (mime.inherits(QLatin1String(packed[i]))) return false;
+    }
+    return true;
+}
+
 /** get a file */
 void fishProtocol::get(const QUrl& u){
     myDebug( << "@@@@@@@@@ get " << u);
@@ -1339,7 +1901,11 @@ void fishProtocol::get(const QUrl& u){
         sendCommand(FISH_PWD);
     } else {
         recvLen = -1;
-        sendCommand(FISH_RETR,E(url.path()));
+        transferCodec.reset();
+        if (canCompress(url.path()))
+            sendCommand(FISH_ZRETR,E(codecName),E(url.path()));
+        else
+            sendCommand(FISH_RETR,E(url.path()));
     }
     run();
 }
@@ -1358,12 +1924,16 @@ void fishProtocol::put(const QUrl& u, int permissions, KIO::JobFlags flags) {
     } else {
         putPerm = permissions;
 
-        checkOverwrite = flags & KIO::Overwrite;
+        // a resumed file is compared block by block like an overwritten one
+        checkOverwrite = flags & (KIO::Overwrite | KIO::Resume);
         checkExist = false;
         putPos = 0;
-        listReason = CHECK;
-        sendCommand(FISH_LIST,E(url.path()));
-        sendCommand(FISH_STOR,"0",E(url.path()));
+        compareSize = 0;
+        putEnded = false;
+        transferCodec.reset(canCompress(url.path()) ? FishCodec::create(codecName) : nullptr);
+        statReason = PUT;
+        checkSource.clear();
+        sendCommand(FISH_MSTAT,QStringList(E(url.path())));
 
         const QString mtimeStr = metaData( "modified" );
         if ( !mtimeStr.isEmpty() ) {
@@ -1374,19 +1944,182 @@ void fishProtocol::put(const QUrl& u, int permissions, KIO::JobFlags flags) {
     }
     run();
 }
+/**
+open a file for random access
+
+Nothing stays open on the server. READ and WRITE carry the offset and the
+path, so all that is kept here is the size and the position.
+*/
+void fishProtocol::open(const QUrl &u, QIODevice::OpenMode mode) {
+    myDebug( << "@@@@@@@@@ open " << u << " " << mode);
+    setHostInternal(u);
+    url = u;
+    openConnection();
+    if (!isLoggedIn) return;
+    url = url.adjusted(QUrl::NormalizePathSegments);
+    if (url.path().isEmpty()) {
+        error(ERR_CANNOT_OPEN_FOR_READING,url.toDisplayString());
+        return;
+    }
+    openUrl = url;
+    openMode = mode;
+    readAhead.clear();
+
+    // the size is that of the target if the file is a link
+    QString path = url.path();
+    KIO::UDSEntry entry;
+    for (int hops = 0; hops < 8; hops++) {
+        statReason = OPEN;
+        sendCommand(FISH_MSTAT,QStringList(E(path)));
+        if (!runHolding()) return;
+        entry = statResults.value(0);
+        const QString dest = entry.stringValue(KIO::UDSEntry::UDS_LINK_DEST);
+        if (entry.numberValue(KIO::UDSEntry::UDS_FILE_TYPE) != S_IFLNK || dest.isEmpty()) break;
+        path = (dest.startsWith('/')?dest:path.left(path.lastIndexOf('/')+1)+dest);
+    }
+    if (entry.count() == 0 && !(mode & QIODevice::WriteOnly)) {
+        error(ERR_DOES_NOT_EXIST,url.toDisplayString());
+        return;
+    }
+    if (entry.isDir()) {
+        error(ERR_IS_DIRECTORY,url.toDisplayString());
+        return;
+    }
+    if (entry.count() > 0 && entry.numberValue(KIO::UDSEntry::UDS_FILE_TYPE) != S_IFREG) {
+        error(ERR_CANNOT_OPEN_FOR_READING,url.toDisplayString());
+        return;
+    }
+
+    openSize = entry.numberValue(KIO::UDSEntry::UDS_SIZE, 0);
+    if (entry.count() == 0 || (mode & QIODevice::Truncate)) {
+        // created or emptied before anything is written
+        openSize = 0;
+        sendLen = 0;
+        sendCommand(FISH_STOR,"0",E(url.path()));
+        if (!runHolding()) return;
+    }
+
+    if (mode & QIODevice::ReadOnly) {
+        if (openSize == 0) {
+            mimeType("application/x-zerosize");
+        } else {
+            // the first READ ahead serves for the mimetype too
+            if (!readAt(0, 1024)) return;
+            QMimeDatabase db;
+            mimeType(db.mimeTypeForFileNameAndData(url.path(), readAhead.left(1024)).name());
+        }
+    }
+
+    openOffset = (mode & QIODevice::Append)?openSize:0;
+    totalSize(openSize);
+    position(openOffset);
+    opened();
+    finished();
+}
+
+/** read from the open file */
+void fishProtocol::read(KIO::filesize_t bytes) {
+    myDebug( << "@@@@@@@@@ read " << openOffset << " " << bytes);
+    url = openUrl;
+    openConnection();
+    if (!isLoggedIn) return;
+    // READ goes on past the end of the file, so it never gets asked to
+    bytes = qMin(bytes, (openSize > openOffset?openSize-openOffset:0));
+    bytes = qMin(bytes, (KIO::filesize_t)FISH_READ_AHEAD_MAX);
+    if (bytes > 0 && (openOffset < readAheadOffset
+            || openOffset+bytes > readAheadOffset+readAhead.size())) {
+        if (!readAt(openOffset, bytes)) return;
+    }
+    data(bytes > 0?readAhead.mid(openOffset-readAheadOffset, bytes):QByteArray());
+    openOffset += bytes;
+    finished();
+}
+
+/**
+reads from offset into readAhead, at least size bytes unless the file ends
+
+Small reads in sequence are served from one larger READ, which doubles in
+size for as long as they keep going where the last one ended.
+*/
+bool fishProtocol::readAt(KIO::filesize_t offset, KIO::filesize_t size) {
+    if (!readAhead.isEmpty() && offset == readAheadOffset+readAhead.size())
+        readAheadSize = qMin(readAheadSize*2, FISH_READ_AHEAD_MAX);
+    else
+        readAheadSize = FISH_READ_AHEAD_MIN;
+    recvLen = qMin(qMax(size, (KIO::filesize_t)readAheadSize), openSize-offset);
+    readAhead.clear();
+    readAheadOffset = offset;
+    sendCommand(FISH_READ,E(QString::number(offset)),E(QString::number(recvLen)),E(url.path()));
+    return runHolding();
+}
+
+/** write to the open file */
+void fishProtocol::write(const QByteArray &data) {
+    myDebug( << "@@@@@@@@@ write " << openOffset << " " << data.size());
+    url = openUrl;
+    openConnection();
+    if (!isLoggedIn) return;
+    // what was read ahead may be out of date now
+    readAhead.clear();
+    rawData = data;
+    sendLen = data.size();
+    if (hasAppend && openOffset == openSize)
+        sendCommand(FISH_APPEND,E(QString::number(sendLen)),E(url.path()));
+    else
+        sendCommand(FISH_WRITE,E(QString::number(openOffset)),E(QString::number(sendLen)),E(url.path()));
+    if (!runHolding()) return;
+    openOffset += data.size();
+    openSize = qMax(openSize, openOffset);
+    written(data.size());
+    finished();
+}
+
+/** move to another position in the open file, which needs no command */
+void fishProtocol::seek(KIO::filesize_t offset) {
+    myDebug( << "@@@@@@@@@ seek " << offset);
+    openOffset = offset;
+    position(offset);
+    finished();
+}
+
+/** close the open file */
+void fishProtocol::close() {
+    myDebug( << "@@@@@@@@@ close");
+    openUrl.clear();
+    readAhead.clear();
+    finished();
+}
+
+/** runs the queued commands of a FileJob method, false after an error */
+bool fishProtocol::runHolding() {
+    holding = true;
+    run();
+    holding = false;
+    // error() closes the file
+    return !openUrl.isEmpty();
+}
+
 /** executes next command in sequence or calls finished() if all is done */
 void fishProtocol::finished() {
-    if (commandList.count() > 0) {
-        fishCommand = (fish_command_type)commandCodes.first();
-        errorCount = -fishInfo[fishCommand].lines;
-        rawRead = 0;
-        rawWrite = -1;
-        udsEntry.clear();
-        udsStatEntry.clear();
+    if (pipelineCodes.count() > 0) {
+        // already sent, its response comes right after the last one
+        beginResponse((fish_command_type)pipelineCodes.first());
+        pipelineCodes.erase(pipelineCodes.begin());
+        fillPipeline();
+    } else if (commandList.count() > 0) {
+        beginResponse((fish_command_type)commandCodes.first());
         writeStdin(commandList.first());
         //if (fishCommand != FISH_APPEND && fishCommand != FISH_WRITE) infoMessage("Sending "+(commandList.first().mid(1,commandList.first().indexOf("\n")-1))+"...");
         commandList.erase(commandList.begin());
         commandCodes.erase(commandCodes.begin());
+        fillPipeline();
+    } else if (discarding) {
+        // everything sent before the error is answered, the job has ended already
+        discarding = false;
+        isRunning = false;
+    } else if (connecting || holding) {
+        // the server is up or the FileJob method has its data, the job goes on
+        isRunning = false;
     } else {
         myDebug( << "_______ emitting finished()");
         SlaveBase::finished();
@@ -1394,13 +2127,75 @@ void fishProtocol::finished() {
     }
 }
 
+/** makes cmd the command whose response is read next */
+void fishProtocol::beginResponse(fish_command_type cmd) {
+    fishCommand = cmd;
+    errorCount = -fishInfo[fishCommand].lines;
+    readingRecords = false;
+    rawRead = 0;
+    rawWrite = -1;
+    udsEntry.clear();
+    udsStatEntry.clear();
+    statResults.clear();
+    remoteHash.clear();
+}
+
+/**
+sends the queued commands that need not wait for the responses before them
+
+Commands without side effects are sent while the response to the one before
+is still on its way, so that a burst of them shares round trips. The server
+answers them in order. Nothing is sent ahead of a command that reads data
+from stdin, as the data would be mixed up with the commands.
+*/
+void fishProtocol::fillPipeline() {
+    if (!canPipeline(fishCommand)) return;
+    while (commandList.count() > 0 && pipelineCodes.count() < FISH_PIPELINE_DEPTH
+            && canPipeline(commandCodes.first())) {
+        myDebug( << "pipelining " << commandCodes.first());
+        pipelineCodes.append(commandCodes.first());
+        writeStdin(commandList.first());
+        commandList.erase(commandList.begin());
+        commandCodes.erase(commandCodes.begin());
+    }
+}
+
+/** true if cmd has no side effects and its response ends with its result line.
+    CWD isn't one: it changes the server's directory, which a command discarded
+    after an error would leave changed. */
+bool fishProtocol::canPipeline(int cmd) {
+    switch (cmd) {
+    case FISH_PWD:
+    case FISH_LIST:
+    case FISH_STAT:
+    case FISH_XLIST:
+    case FISH_XSTAT:
+    case FISH_MSTAT:
+    case FISH_HASH:
+        return true;
+    default:
+        return false;
+    }
+}
+
 /** aborts command sequence and calls error() */
 void fishProtocol::error(int type, const QString &detail) {
     commandList.clear();
     commandCodes.clear();
+    // the FileJob ends with the error
+    openUrl.clear();
+    readAhead.clear();
     myDebug( << "ERROR: " << type << " - " << detail);
     SlaveBase::error(type,detail);
-    isRunning = false;
+    // Commands sent ahead are answered all the same. Their responses are
+    // read and dropped, or the next job would take them for its own.
+    if (childPid && pipelineCodes.count() > 0) {
+        discarding = true;
+        beginResponse((fish_command_type)pipelineCodes.first());
+        pipelineCodes.erase(pipelineCodes.begin());
+    } else {
+        isRunning = false;
+    }
 }
 
 /** executes a chain of commands */
@@ -1417,7 +2212,7 @@ with .fishsrv.pl typically running on another computer. */
         fd_set rfds, wfds;
         FD_ZERO(&rfds);
 #endif
-        char buf[32768];
+        char *buf = readBuffer.data();
         int offset = 0;
         while (isRunning) {
 #ifndef Q_OS_WIN
@@ -1474,10 +2269,10 @@ with .fishsrv.pl typically running on another computer. */
             }
 #ifndef Q_OS_WIN
             else if (FD_ISSET(childFd,&rfds)) {
-                rc = ::read(childFd, buf + offset, sizeof(buf) - offset);
+                rc = ::read(childFd, buf + offset, readBuffer.size() - offset);
 #else
             else if (childPid->waitForReadyRead(1000)) {
-                rc = childPid->read(buf + offset, sizeof(buf) - offset);
+                rc = childPid->read(buf + offset, readBuffer.size() - offset);
 #endif
                 //myDebug( << "read " << rc << " bytes");
                 if (rc > 0) {
@@ -1517,7 +2312,7 @@ void fishProtocol::stat(const QUrl& u){
     if (url.path().isEmpty()) {
         sendCommand(FISH_PWD);
     } else {
-        sendCommand(FISH_STAT,E(url.adjusted(QUrl::StripTrailingSlash).path()));
+        sendCommand(hasListRecords?FISH_XSTAT:FISH_STAT,E(url.adjusted(QUrl::StripTrailingSlash).path()));
     }
     run();
 }
@@ -1548,8 +2343,7 @@ void fishProtocol::listDir(const QUrl& u){
     if (url.path().isEmpty()) {
         sendCommand(FISH_PWD);
     } else {
-        listReason = LIST;
-        sendCommand(FISH_LIST,E(url.path()));
+        sendCommand(hasListRecords?FISH_XLIST:FISH_LIST,E(url.path()));
     }
     run();
 }
@@ -1587,9 +2381,11 @@ void fishProtocol::rename(const QUrl& s, const QUrl& d, KIO::JobFlags flags) {
         sendCommand(FISH_PWD);
     } else {
         if (!(flags & KIO::Overwrite)) {
-            listReason = CHECK;
+            // the source and destination in one go
             checkOverwrite = false;
-            sendCommand(FISH_LIST,E(url.path()));
+            statReason = CHECK;
+            checkSource = src;
+            sendCommand(FISH_MSTAT,QStringList() << E(src.path()) << E(url.path()));
         }
         sendCommand(FISH_RENAME,E(src.path()),E(url.path()));
     }
@@ -1607,9 +2403,10 @@ void fishProtocol::symlink(const QString& target, const QUrl& u, KIO::JobFlags f
         sendCommand(FISH_PWD);
     } else {
         if (!(flags & KIO::Overwrite)) {
-            listReason = CHECK;
             checkOverwrite = false;
-            sendCommand(FISH_LIST,E(url.path()));
+            statReason = CHECK;
+            checkSource.clear();
+            sendCommand(FISH_MSTAT,QStringList(E(url.path())));
         }
         sendCommand(FISH_SYMLINK,E(target),E(url.path()));
     }
@@ -1648,13 +2445,17 @@ void fishProtocol::copy(const QUrl &s, const QUrl &d, int permissions, KIO::JobF
     if (src.path().isEmpty()) {
         sendCommand(FISH_PWD);
     } else {
-        if (!(flags & KIO::Overwrite)) {
-            listReason = CHECK;
-            checkOverwrite = false;
-            sendCommand(FISH_LIST,E(url.path()));
+        putPerm = permissions;
+        if (!(flags & KIO::Overwrite) || !hashName.isEmpty()) {
+            // the source and destination in one go, the copy follows
+            checkOverwrite = flags & KIO::Overwrite;
+            statReason = COPY;
+            checkSource = src;
+            sendCommand(FISH_MSTAT,QStringList() << E(src.path()) << E(url.path()));
+        } else {
+            sendCommand(FISH_COPY,E(src.path()),E(url.path()));
+            if (permissions > -1) sendCommand(FISH_CHMOD,E(QString::number(permissions,8)),E(url.path()));
         }
-        sendCommand(FISH_COPY,E(src.path()),E(url.path()));
-        if (permissions > -1) sendCommand(FISH_CHMOD,E(QString::number(permissions,8)),E(url.path()));
     }
     run();
 }
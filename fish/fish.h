@@ -20,6 +20,11 @@
 #include <kio/slavebase.h>
 #include <kio/authinfo.h>
 
+#include <QHash>
+#include <QScopedPointer>
+
+#include "fishcodec.h"
+
 #define FISH_EXEC_CMD 'X'
 
 class fishProtocol : public KIO::SlaveBase
@@ -74,6 +79,16 @@ It is set to false if the connection becomes closed.
   void del(const QUrl &u, bool isfile) override;
   /** special like background execute */
   void special( const QByteArray &data ) override;
+  /** open a file for random access */
+  void open(const QUrl &url, QIODevice::OpenMode mode) override;
+  /** read from the open file */
+  void read(KIO::filesize_t size) override;
+  /** write to the open file */
+  void write(const QByteArray &data) override;
+  /** move to another position in the open file */
+  void seek(KIO::filesize_t offset) override;
+  /** close the open file */
+  void close() override;
 
 private: // Private attributes
   /** fd for reading and writing to the process */
@@ -131,6 +146,10 @@ protected: // Protected attributes
   QStringList commandList;
   /** queue for commands to be sent */
   QList<int> commandCodes;
+  /** commands sent ahead of fishCommand, their responses follow its one in this order */
+  QList<int> pipelineCodes;
+  /** true while the responses of commands sent ahead of a failed one are skipped */
+  bool discarding;
   /** bytes still to be read in raw mode */
   KIO::fileoffset_t rawRead;
   /** bytes still to be written in raw mode */
@@ -143,10 +162,61 @@ protected: // Protected attributes
   bool writeReady;
   /** true if a command stack is currently executing */
   bool isRunning;
-  /** reason of LIST command */
-  enum { CHECK, LIST } listReason;
+  /** true while openConnection runs FISH and VER on their own */
+  bool connecting;
+  /** true while a FileJob method runs commands, it reports the outcome itself */
+  bool holding;
+  /** true if the connection runs without the perl server, as the job's fishserver metadata asked */
+  bool shellOnly;
+  /** codec the job's fishcodec metadata asked for, used even on a local connection */
+  QString forcedCodec;
+  /** true if the job's fishhash metadata asked for HASH even on a local connection */
+  bool forcedHash;
   /** true if FISH server understands APPEND command */
   bool hasAppend;
+  /** true if FISH server understands XLIST and XSTAT */
+  bool hasListRecords;
+  /** true if FISH server writes at any offset as fast as it appends */
+  bool hasWriteAt;
+  /** true once the records of XLIST or XSTAT have begun */
+  bool readingRecords;
+  /** a chunk of records that has not been received completely */
+  QByteArray recordBuffer;
+  /** users, groups and mimetypes seen in records, which repeat a lot */
+  QHash<QByteArray, QString> recordStrings;
+  /** entries of MSTAT in the order of its paths, empty for those which do not exist */
+  QList<KIO::UDSEntry> statResults;
+  /** source of a copy or rename, checked along with url by MSTAT */
+  QUrl checkSource;
+  /** reason of MSTAT command, and of HASH for PUT and COPY */
+  enum { CHECK, PUT, COPY, OPEN } statReason;
+  /** digest both ends support for HASH, empty if there is none */
+  QString hashName;
+  /** digest in the response to HASH */
+  QString remoteHash;
+  /** digests the HASHes of the job have answered, empty where they failed */
+  QStringList hashResults;
+  /** size of the file put() overwrites, its blocks are compared by HASH before they are sent */
+  KIO::filesize_t compareSize;
+  /** true once the job has handed over all of the put data */
+  bool putEnded;
+  /** the file of the FileJob, empty if none is open */
+  QUrl openUrl;
+  /** how the file of the FileJob was opened */
+  QIODevice::OpenMode openMode;
+  /** size of the open file, as far as writes have got */
+  KIO::filesize_t openSize;
+  /** position in the open file */
+  KIO::filesize_t openOffset;
+  /** data of the open file from readAheadOffset on, read before it was asked for */
+  QByteArray readAhead;
+  KIO::filesize_t readAheadOffset;
+  /** bytes the next READ fetches, this grows while reads go on in sequence */
+  int readAheadSize;
+  /** compression both ends support, empty if there is none */
+  QString codecName;
+  /** codec of the current transfer, if it is compressed */
+  QScopedPointer<FishCodec> transferCodec;
   /** permission of created file */
   int putPerm;
   /** true if file may be overwritten */
@@ -157,6 +227,10 @@ protected: // Protected attributes
   bool checkExist;
   /** true if this is the first login attempt (== use cached password) */
   bool firstLogin;
+  /** read buffer, of fixed size; data in it is passed on without being copied */
+  QByteArray readBuffer;
+  /** decompressed data of a ZRETR, reused for every piece */
+  QByteArray plainData;
   /** write buffer */
   QByteArray rawData;
   /** buffer for storing bytes used for MimeMagic */
@@ -177,7 +251,9 @@ protected: // Protected attributes
     FISH_RETR, FISH_STOR,
     FISH_CWD, FISH_CHMOD, FISH_DELE, FISH_MKD, FISH_RMD,
     FISH_RENAME, FISH_LINK, FISH_SYMLINK, FISH_CHOWN,
-    FISH_CHGRP, FISH_READ, FISH_WRITE, FISH_COPY, FISH_APPEND, FISH_EXEC } fishCommand;
+    FISH_CHGRP, FISH_READ, FISH_WRITE, FISH_COPY, FISH_APPEND, FISH_EXEC,
+    FISH_ZRETR, FISH_ZWRITE, FISH_XLIST, FISH_XSTAT, FISH_MSTAT,
+    FISH_HASH, FISH_TRUNCATE } fishCommand;
   int fishCodeLen;
 protected: // Protected methods
   /** manages initial communication setup including password queries */
@@ -187,15 +263,52 @@ protected: // Protected methods
   int establishConnection(const QByteArray &buffer);
 #endif
   int received(const char *buffer, KIO::fileoffset_t buflen);
+  /** passes on data of a RETR or READ, the first bytes go to the mimetype check */
+  void receivedData(const char *buffer, int len);
+  /** sends the mimetype for the data in mimeBuffer */
+  void emitMimeType();
+  /** sends the mimetype for the first bytes of a file, and its size */
+  void sniffMimeType(const QByteArray &head);
+  /** collects up to size bytes of put data in rawData, returns the number of bytes */
+  int readBlock(int size);
+  /** collects the records of XLIST and XSTAT until a chunk is complete */
+  void receivedRecords(const char *buffer, int len);
+  /** decodes complete records of XLIST and XSTAT */
+  void parseRecords(const char *buffer, int len);
+  /** decodes a user, group or mimetype of a record */
+  QString recordString(const char *str, int len);
+  /** passes on the entry of LIST or STAT that is complete now */
+  void finishEntry();
+  /** checks what MSTAT found at the source and destination of a write, false after an error */
+  bool checkResults();
+  /** goes on with put or copy once MSTAT has checked their paths */
+  void checked();
+  /** takes the next block of put data and compares or writes it */
+  void nextBlock();
+  /** goes on with put or copy once HASH has answered */
+  void hashed();
+  /** reads from offset into readAhead, at least size bytes unless the file ends, false after an error */
+  bool readAt(KIO::filesize_t offset, KIO::filesize_t size);
+  /** runs the queued commands of a FileJob method, false after an error */
+  bool runHolding();
   void sent();
+  /** true if transfers of path are worth compressing */
+  bool canCompress(const QString &path);
   /** builds each FISH request and sets the error counter */
   bool sendCommand(fish_command_type cmd, ...);
+  bool sendCommand(fish_command_type cmd, const QStringList &args);
   /** checks response string for result code, converting 000 and 001 appropriately */
   int handleResponse(const QString &str);
   /** parses a ls -l time spec */
   int makeTimeFromLs(const QString &dayStr, const QString &monthStr, const QString &timeyearStr);
   /** executes a chain of commands */
   void run();
+  /** makes cmd the command whose response is read next */
+  void beginResponse(fish_command_type cmd);
+  /** sends the queued commands that need not wait for the responses before them */
+  void fillPipeline();
+  /** true if cmd has no side effects and its response ends with its result line */
+  static bool canPipeline(int cmd);
   /** creates the subprocess */
   bool connectionStart();
   /** writes one chunk of data to stdin of child process */
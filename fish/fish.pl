@@ -37,6 +37,20 @@ use strict;
 use POSIX qw(getcwd dup2 strftime);
 $SIG{'CHLD'} = 'IGNORE';
 $| = 1;
+# compression tools for ZRETR and ZWRITE
+my %codecs;
+foreach my $tool ('zstd','gzip') {
+    foreach (split(/:/,$ENV{'PATH'})) {
+        if (-x "$_/$tool") {
+            $codecs{$tool} = "$_/$tool";
+            last;
+        }
+    }
+}
+# digests for HASH
+my %hashes;
+$hashes{'sha256'} = sub { Digest::SHA->new(256) } if eval { require Digest::SHA; 1 };
+$hashes{'md5'} = sub { Digest::MD5->new } if eval { require Digest::MD5; 1 };
 MAIN: while (<STDIN>) {
     chomp;
     chomp;
@@ -45,8 +59,13 @@ MAIN: while (<STDIN>) {
     s/^#//;
     /^VER / && do {
         # We do not advertise "append" capability anymore, as "write" is
-        # as fast in perl mode and more reliable (overlapping writes)
-        print "VER 0.0.3 copy lscount lslinks lsmime exec stat\n### 200\n";
+        # as fast in perl mode and more reliable (overlapping writes).
+        # "writeat": WRITE at any offset is cheap, so blocks can be
+        # compared with HASH and rewritten one by one
+        print "VER 0.0.3 copy lscount lslinks lsmime exec stat lsrecords writeat";
+        print " codec:$_" foreach (sort keys %codecs);
+        print " hash:$_" foreach (sort keys %hashes);
+        print "\n### 200\n";
         next;
     };
     /^PWD$/ && do {
@@ -160,6 +179,27 @@ MAIN: while (<STDIN>) {
         list($1, 0);
         next;
     };
+    /^XLIST\s+((?:\\.|[^\\])*?)\s*$/ && do {
+        xlist($1, 1);
+        next;
+    };
+    /^XSTAT\s+((?:\\.|[^\\])*?)\s*$/ && do {
+        xlist($1, 0);
+        next;
+    };
+    /^MSTAT((?:\s+(?:\\.|[^\\\s])+)+)\s*$/ && do {
+        mstat(map { unquote($_) } ($1 =~ /((?:\\.|[^\\\s])+)/g));
+        next;
+    };
+    /^HASH\s+(\w+)\s+(\d+)\s+(-?\d+)\s+((?:\\.|[^\\])*?)\s*$/ && do {
+        hash($1,$2,$3,$4);
+        next;
+    };
+    /^TRUNCATE\s+(\d+)\s+((?:\\.|[^\\])*?)\s*$/ && do {
+        my $fn = unquote($2);
+        print (truncate($fn,int($1))?"### 200\n":"### 500 $!\n");
+        next;
+    };
     /^WRITE\s+(\d+)\s+(\d+)\s+((?:\\.|[^\\])*?)\s*$/ && do {
         write_loop($2,$3,O_WRONLY|O_CREAT,$1);
         next;
@@ -176,6 +216,14 @@ MAIN: while (<STDIN>) {
         read_loop($1);
         next;
     };
+    /^ZRETR\s+(\w+)\s+((?:\\.|[^\\])*?)\s*$/ && do {
+        zread_loop($1,$2);
+        next;
+    };
+    /^ZWRITE\s+(\w+)\s+(\d+)\s+(\d+)\s+((?:\\.|[^\\])*?)\s*$/ && do {
+        zwrite_loop($1,$3,$4,$2);
+        next;
+    };
     /^READ\s+(\d+)\s+(\d+)\s+((?:\\.|[^\\])*?)\s*$/ && do {
         read_loop($3,$2,$1);
         next;
@@ -237,6 +285,95 @@ sub list {
     print "### 200\n";
 }
 
+# like list, but each entry is a record of NUL terminated fields: type,
+# mode, user, group, size, mtime, name, link and mimetype. The records are
+# sent in chunks of "<length>\n<data>".
+sub xlist {
+    my $dn = unquote($_[0]);
+    my @entries;
+    if (!-e $dn) {
+        print "### 404 File does not exist\n";
+        return;
+    } elsif ($_[1] && -d _) {
+        opendir(DIR,$dn) || do { print "### 500 $!\n"; return; };
+        @entries = readdir(DIR);
+        closedir(DIR);
+    } else {
+        ($dn, @entries) = $dn =~ m{(.*)/(.*)};
+        $dn = '/' if (!length($dn));
+    }
+    print scalar(@entries),"\n### 100\n";
+    my $cwd = getcwd();
+    chdir($dn) || do { print "### 500 $!\n"; return; };
+    my (%users,%groups);
+    while (@entries) {
+        my @batch = splice(@entries,0,256);
+        my @types = mimetypes(@batch);
+        my $chunk = '';
+        foreach (@batch) {
+            $chunk .= record($_,shift(@types),\%users,\%groups);
+        }
+        print length($chunk),"\n",$chunk;
+    }
+    chdir($cwd);
+    print "### 200\n";
+}
+
+# like xlist, with one record for each of the paths, whose name is the
+# path as given. A path that cannot be stat()ed gets a record with an empty type.
+sub mstat {
+    my @paths = @_;
+    print scalar(@paths),"\n### 100\n";
+    my (%users,%groups);
+    while (@paths) {
+        my @batch = splice(@paths,0,256);
+        my @types = mimetypes(@batch);
+        my $chunk = '';
+        foreach (@batch) {
+            $chunk .= record($_,shift(@types),\%users,\%groups);
+        }
+        print length($chunk),"\n",$chunk;
+    }
+    print "### 200\n";
+}
+
+# the record of a file, with the names of users and groups looked up once
+sub record {
+    my ($fn,$type,$users,$groups) = @_;
+    my $link = readlink($fn);
+    my ($mode,$uid,$gid,$size,$mtime) = (lstat($fn))[2,4,5,7,9];
+    return join("\0",'','','','','','',$fn,'','')."\0" if !defined $mode;
+    $users->{$uid} = (getpwuid($uid)||$uid) if !defined $users->{$uid};
+    $groups->{$gid} = (getgrgid($gid)||$gid) if !defined $groups->{$gid};
+    return join("\0",filekind($link),$mode & 07777,$users->{$uid},$groups->{$gid},
+        $size,$mtime,$fn,(defined $link?$link:''),$type)."\0";
+}
+
+# prints the digest of length bytes of a file from offset on, or of all
+# the rest if length is negative
+sub hash {
+    my ($name,$offset,$length) = @_;
+    my $fn = unquote($_[3]);
+    print "### 500 Unknown digest\n" and return if !$hashes{$name};
+    my $digest = $hashes{$name}->();
+    sysopen(FH,$fn,O_RDONLY) || do { print "### 500 $!\n"; return; };
+    if ($offset) {
+        sysseek(FH,int($offset),0) || do { close(FH); print "### 500 $!\n"; return; };
+    }
+    my $buffer = '';
+    my $read = 1;
+    while ($length != 0 && ($read = sysread(FH,$buffer,($length > 0 && $length < 32768)?$length:32768)) > 0) {
+        $digest->add($buffer);
+        $length -= $read if $length > 0;
+    }
+    close(FH);
+    if (defined $read) {
+        print $digest->hexdigest,"\n### 200\n";
+    } else {
+        print "### 500 $!\n";
+    }
+}
+
 sub read_loop {
     my $fn = unquote($_[0]);
     my ($size) = ($_[1]?int($_[1]):(stat($fn))[7]);
@@ -308,21 +445,98 @@ sub write_loop {
     }
 }
 
+# sends a file compressed by a codec, as chunks of "<length>\n<data>"
+sub zread_loop {
+    my $tool = $codecs{$_[0]};
+    my $fn = unquote($_[1]);
+    print "### 500 Unknown codec\n" and return if !$tool;
+    print "### 501 Is directory\n" and return if -d $fn;
+    sysopen(FH,$fn,O_RDONLY) || do { print "### 500 $!\n"; return; };
+    my ($size) = (stat(FH))[7];
+    local $SIG{'CHLD'} = 'DEFAULT';
+    my $pid = open(ZFH,'-|');
+    defined($pid) || do { close(FH); print "### 500 $!\n"; return; };
+    if (!$pid) {
+        # closed first, or perl would seek the file to where STDIN was
+        close(STDIN);
+        sysopen(NULL,'/dev/null',O_RDWR);
+        dup2(fileno(FH),0);
+        dup2(fileno(NULL),fileno(STDERR));
+        exec($tool,'-q','-c');
+        exit(255);
+    }
+    close(FH);
+    print "$size\n### 100\n";
+    my $buffer = '';
+    my $read;
+    while (($read = sysread(ZFH,$buffer,32768)) > 0) {
+        print "$read\n",$buffer;
+    }
+    my $error = (defined($read)?'':"$!");
+    close(ZFH) || ($error ||= "$_[0] failed");
+    if (!$error) {
+        print "### 200\n";
+    } else {
+        print "### 500 $error\n";
+    }
+}
+
+# like write_loop, for data compressed by a codec
+sub zwrite_loop {
+    my $tool = $codecs{$_[0]};
+    my $size = int($_[1]);
+    my $fn = unquote($_[2]);
+    my $error = '';
+    print "### 400 Unknown codec\n" and return if !$tool;
+    sysopen(FH,$fn,O_WRONLY|O_CREAT) || do { print "### 400 $!\n"; return; };
+    eval { flock(FH,2); };
+    sysseek(FH,int($_[3]),0) || do { close(FH);print "### 400 $!\n"; return; };
+    local $SIG{'CHLD'} = 'DEFAULT';
+    local $SIG{'PIPE'} = 'IGNORE';
+    my $pid = open(ZFH,'|-');
+    defined($pid) || do { close(FH); print "### 400 $!\n"; return; };
+    if (!$pid) {
+        sysopen(NULL,'/dev/null',O_RDWR);
+        dup2(fileno(FH),fileno(STDOUT));
+        dup2(fileno(NULL),fileno(STDERR));
+        exec($tool,'-q','-d','-c');
+        exit(255);
+    }
+    close(FH);
+    <STDIN>;
+    print "### 100\n";
+    my $buffer = '';
+    my $read = 1;
+    while ($size > 0 && ($read = read(STDIN,$buffer,($size > 32768?32768:$size))) > 0) {
+        $size -= $read;
+        $error ||= $! if (syswrite(ZFH,$buffer,$read) != $read);
+    }
+    close(ZFH) || ($error ||= "$_[0] failed");
+    if (!$error) {
+        print "### 200\n";
+    } else {
+        print "### 500 $error\n";
+    }
+}
+
 sub unquote { $_ = shift; s/\\(.)/$1/g; return $_; }
 
+# the ls type letter of the file that was stat()ed last
+sub filekind {
+    my ($link) = @_;
+    -f _ && return '-';
+    -d _ && return 'd';
+    defined($link) && return 'l';
+    -c _ && return 'c';
+    -b _ && return 'b';
+    -S _ && return 's';
+    -p _ && return 'p';
+    return '?';
+}
+
 sub filetype {
     my ($mode,$link,$uid,$gid) = @_;
-    my $result = 'P';
-    while (1) {
-        -f _ && do { $result .= '-'; last; };
-        -d _ && do { $result .= 'd'; last; };
-        defined($link) && do { $result .= 'l'; last; };
-        -c _ && do { $result .= 'c'; last; };
-        -b _ && do { $result .= 'b'; last; };
-        -S _ && do { $result .= 's'; last; };
-        -p _ && do { $result .= 'p'; last; };
-        $result .= '?'; last;
-    }
+    my $result = 'P'.filekind($link);
     $result .= ($mode & 0400?'r':'-');
     $result .= ($mode & 0200?'w':'-');
     $result .= ($mode & 0100?($mode&04000?'s':'x'):($mode&04000?'S':'-'));
@@ -341,6 +555,37 @@ sub filetype {
     return $result;
 }
 
+# mimetype of several names, without the M, with one file(1) for all of them
+sub mimetypes {
+    my @files = grep { !-d $_ } @_;
+    my %types;
+    if (@files) {
+        pipe(IN,OUT);
+        my $pid = fork();
+        if (defined $pid && !$pid) {
+            close(IN);
+            sysopen(NULL,'/dev/null',O_RDWR);
+            dup2(fileno(NULL),fileno(STDIN));
+            dup2(fileno(OUT),fileno(STDOUT));
+            dup2(fileno(NULL),fileno(STDERR));
+            exec('/usr/bin/file','-i','-b','-L','--',@files);
+            exit(0);
+        }
+        close(OUT);
+        if (defined $pid) {
+            foreach (@files) {
+                my $type = <IN>;
+                last if !defined $type;
+                chomp $type;
+                $type =~ s/[,; ].*//;
+                $types{$_} = $type if ($type =~ m/\//);
+            }
+        }
+        close(IN);
+    }
+    return map { -d $_?'inode/directory':(defined $types{$_}?$types{$_}:'') } @_;
+}
+
 sub mimetype {
     my $fn = shift;
     return "Minode/directory\n" if -d $fn;
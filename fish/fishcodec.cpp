@@ -0,0 +1,178 @@
+/***************************************************************************
+                          fishcodec.cpp  -  compression for FISH transfers
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, version 2 of the License                *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "fishcodec.h"
+
+#include "config-fish.h"
+
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_ZLIB
+/** the gzip format, decoded as a stream of concatenated members like gzip -d does */
+class GzipCodec : public FishCodec
+{
+public:
+    GzipCodec() : ended(false) {
+        memset(&inflater, 0, sizeof(inflater));
+        ready = (inflateInit2(&inflater, 16 + MAX_WBITS) == Z_OK);
+    }
+
+    ~GzipCodec() override {
+        if (ready) inflateEnd(&inflater);
+    }
+
+    QString name() const override {
+        return QStringLiteral("gzip");
+    }
+
+    bool decode(const char *data, int len, QByteArray &out) override {
+        if (!ready) return false;
+        inflater.next_in = (Bytef *)data;
+        inflater.avail_in = len;
+        do {
+            if (ended && inflater.avail_in > 0) {
+                // another member follows
+                if (inflateReset(&inflater) != Z_OK) return false;
+                ended = false;
+            }
+            int pos = out.size();
+            out.resize(pos + 65536);
+            inflater.next_out = (Bytef *)out.data() + pos;
+            inflater.avail_out = 65536;
+            int rc = inflate(&inflater, Z_NO_FLUSH);
+            out.resize(out.size() - inflater.avail_out);
+            if (rc == Z_STREAM_END) {
+                ended = true;
+            } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                return false;
+            }
+        } while (inflater.avail_in > 0 || inflater.avail_out == 0);
+        return true;
+    }
+
+    bool atEnd() const override {
+        return ended;
+    }
+
+    bool encode(const QByteArray &data, QByteArray &out) override {
+        z_stream deflater;
+        memset(&deflater, 0, sizeof(deflater));
+        if (deflateInit2(&deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        out.resize(deflateBound(&deflater, data.size()));
+        deflater.next_in = (Bytef *)data.constData();
+        deflater.avail_in = data.size();
+        deflater.next_out = (Bytef *)out.data();
+        deflater.avail_out = out.size();
+        int rc = deflate(&deflater, Z_FINISH);
+        out.resize(out.size() - deflater.avail_out);
+        deflateEnd(&deflater);
+        return rc == Z_STREAM_END;
+    }
+
+private:
+    z_stream inflater;
+    bool ready;
+    bool ended;
+};
+#endif
+
+#ifdef HAVE_ZSTD
+/** the zstd format, decoded as a stream of concatenated frames like zstd -d does */
+class ZstdCodec : public FishCodec
+{
+public:
+    ZstdCodec() : ended(false) {
+        stream = ZSTD_createDStream();
+        if (stream) ZSTD_initDStream(stream);
+    }
+
+    ~ZstdCodec() override {
+        if (stream) ZSTD_freeDStream(stream);
+    }
+
+    QString name() const override {
+        return QStringLiteral("zstd");
+    }
+
+    bool decode(const char *data, int len, QByteArray &out) override {
+        if (!stream) return false;
+        ZSTD_inBuffer input = { data, (size_t)len, 0 };
+        bool full;
+        do {
+            if (ended && input.pos < input.size) {
+                // another frame follows
+                ZSTD_initDStream(stream);
+                ended = false;
+            }
+            int pos = out.size();
+            int chunk = ZSTD_DStreamOutSize();
+            out.resize(pos + chunk);
+            ZSTD_outBuffer output = { out.data() + pos, (size_t)chunk, 0 };
+            size_t rc = ZSTD_decompressStream(stream, &output, &input);
+            out.resize(pos + output.pos);
+            if (ZSTD_isError(rc)) return false;
+            ended = (rc == 0);
+            full = (output.pos == output.size);
+        } while (input.pos < input.size || full);
+        return true;
+    }
+
+    bool atEnd() const override {
+        return ended;
+    }
+
+    bool encode(const QByteArray &data, QByteArray &out) override {
+        out.resize(ZSTD_compressBound(data.size()));
+        size_t rc = ZSTD_compress(out.data(), out.size(), data.constData(), data.size(), 3);
+        if (ZSTD_isError(rc)) return false;
+        out.resize(rc);
+        return true;
+    }
+
+private:
+    ZSTD_DStream *stream;
+    bool ended;
+};
+#endif
+
+/** names of the codecs this build supports, the preferred one first */
+QStringList FishCodec::available() {
+    QStringList names;
+#ifdef HAVE_ZSTD
+    names << QStringLiteral("zstd");
+#endif
+#ifdef HAVE_ZLIB
+    names << QStringLiteral("gzip");
+#endif
+    return names;
+}
+
+/** creates the codec called name, or returns nullptr if there is none */
+FishCodec *FishCodec::create(const QString &name) {
+#ifdef HAVE_ZSTD
+    if (name == QLatin1String("zstd")) return new ZstdCodec;
+#endif
+#ifdef HAVE_ZLIB
+    if (name == QLatin1String("gzip")) return new GzipCodec;
+#endif
+    Q_UNUSED(name);
+    return nullptr;
+}
@@ -0,0 +1,42 @@
+/***************************************************************************
+                          fishcodec.h  -  compression for FISH transfers
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, version 2 of the License                *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef FISHCODEC_H
+#define FISHCODEC_H
+
+#include <QByteArray>
+#include <QStringList>
+
+/**
+A compression format shared with the FISH server, which runs the tool of the
+same name (gzip, zstd) to compress RETR data and to decompress STOR data.
+*/
+class FishCodec
+{
+public:
+  virtual ~FishCodec() {}
+
+  /** names of the codecs this build supports, the preferred one first */
+  static QStringList available();
+  /** creates the codec called name, or returns nullptr if there is none */
+  static FishCodec *create(const QString &name);
+
+  /** name of the codec, as understood by the FISH server */
+  virtual QString name() const = 0;
+  /** decompresses the next len bytes of a stream, appending to out. Returns false on bad data. */
+  virtual bool decode(const char *data, int len, QByteArray &out) = 0;
+  /** true if decode has seen the complete stream */
+  virtual bool atEnd() const = 0;
+  /** compresses data into out as one complete stream. Returns false on failure. */
+  virtual bool encode(const QByteArray &data, QByteArray &out) = 0;
+};
+
+#endif
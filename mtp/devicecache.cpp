@@ -40,6 +40,7 @@ CachedDevice::CachedDevice(LIBMTP_mtpdevice_t *device, LIBMTP_raw_device_t *rawd
     this->mtpdevice = device;
     this->rawdevice = *rawdevice;
     this->udi = udi;
+    this->fileCache = new FileCache(this);
 
     char *deviceName = LIBMTP_Get_Friendlyname(device);
     char *deviceModel = LIBMTP_Get_Modelname(device);
@@ -66,11 +67,21 @@ LIBMTP_mtpdevice_t *CachedDevice::getDevice()
         qCDebug(LOG_KIO_MTP) << "reopen mtpdevice if we have no storage found";
         LIBMTP_Release_Device(mtpdevice);
         mtpdevice = LIBMTP_Open_Raw_Device_Uncached(&rawdevice);
+        // object ids are only valid for one session
+        fileCache->clear();
     }
 
     return mtpdevice;
 }
 
+/**
+ * The index of the files and folders on this device, it lives as long as the device is cached
+ */
+FileCache *CachedDevice::getFileCache()
+{
+    return fileCache;
+}
+
 const QString CachedDevice::getName()
 {
     return name;
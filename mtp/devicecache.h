@@ -31,6 +31,8 @@
 
 #include <libmtp.h>
 
+#include "filecache.h"
+
 Q_DECLARE_LOGGING_CATEGORY(LOG_KIO_MTP)
 
 class CachedDevice : public QObject
@@ -42,6 +44,7 @@ public:
     ~CachedDevice() override;
 
     LIBMTP_mtpdevice_t *getDevice();
+    FileCache *getFileCache();
     const QString getName();
     const QString getUdi();
 
@@ -50,6 +53,7 @@ private:
     QTimer *timer;
     LIBMTP_mtpdevice_t *mtpdevice;
     LIBMTP_raw_device_t rawdevice;
+    FileCache *fileCache;
 
     QString name;
     QString udi;
@@ -19,55 +19,244 @@
 
 #include "filecache.h"
 
-#include <QTimer>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QSet>
 
 FileCache::FileCache(QObject *parent)
     : QObject(parent)
 {
 }
 
-uint32_t FileCache::queryPath(const QString &path, int timeToLive)
+FileCache::~FileCache()
+{
+    clear();
+}
+
+LIBMTP_file_t *FileCache::queryPath(LIBMTP_mtpdevice_t *device, uint32_t storageId, const QStringList &names, int timeToLive)
+{
+    qCDebug(LOG_KIO_MTP) << "Querying" << names;
+
+    uint32_t parentId = 0xFFFFFFFF;
+    LIBMTP_file_t *file = nullptr;
+
+    for (const QString &name : names) {
+        if (file && file->filetype != LIBMTP_FILETYPE_FOLDER) {
+            return nullptr;
+        }
+
+        Storage &storage = storages[storageId];
+        QHash<uint32_t, Folder>::const_iterator folder = storage.folders.constFind(parentId);
+        if (folder == storage.folders.constEnd()
+            || (!folder->names.contains(name) && folder->listed.addSecs(timeToLive) < QDateTime::currentDateTime())) {
+            if (!listFolder(device, storageId, parentId)) {
+                return nullptr;
+            }
+            folder = storage.folders.constFind(parentId);
+        }
+
+        // of several children with the same name, the path can only lead to one
+        const uint32_t id = folder->names.value(name);
+        if (id == 0) {
+            qCDebug(LOG_KIO_MTP) << "No" << name << "in" << parentId;
+            return nullptr;
+        }
+
+        file = storage.files.value(id);
+        parentId = id;
+    }
+
+    return file;
+}
+
+bool FileCache::children(LIBMTP_mtpdevice_t *device, uint32_t storageId, uint32_t parentId, QList<LIBMTP_file_t *> &files, bool refresh)
+{
+    Storage &storage = storages[storageId];
+    if ((refresh || !storage.folders.contains(parentId)) && !listFolder(device, storageId, parentId)) {
+        return false;
+    }
+
+    files.clear();
+    const QList<uint32_t> ids = storage.folders.value(parentId).children;
+    for (uint32_t id : ids) {
+        files.append(storage.files.value(id));
+    }
+    return true;
+}
+
+void FileCache::addFile(LIBMTP_file_t *file)
 {
-    qCDebug(LOG_KIO_MTP) << "Querying" << path;
+    Storage &storage = storages[file->storage_id];
+    insertFile(storage, file);
+
+    // files in the root of a storage may have 0 as parent_id, there is no object 0
+    const uint32_t parentId = file->parent_id != 0 ? file->parent_id : 0xFFFFFFFF;
+    storage.parents.insert(file->item_id, parentId);
+
+    QHash<uint32_t, Folder>::iterator parent = storage.folders.find(parentId);
+    if (parent != storage.folders.end()) {
+        parent->add(QString::fromUtf8(file->filename), file->item_id);
+    }
 
-    QPair< QDateTime, uint32_t > item = cache.value(path);
+    if (file->filetype == LIBMTP_FILETYPE_FOLDER) {
+        storage.folders[file->item_id].listed = QDateTime::currentDateTime();
+    }
+}
+
+LIBMTP_file_t *FileCache::refreshFile(LIBMTP_mtpdevice_t *device, uint32_t storageId, uint32_t id)
+{
+    qCDebug(LOG_KIO_MTP) << "Refreshing" << id << "on storage" << storageId;
+
+    LIBMTP_file_t *file = LIBMTP_Get_Filemetadata(device, id);
+    if (!file) {
+        removeFile(storageId, id);
+        return nullptr;
+    }
+    file->next = nullptr;
+
+    Storage &storage = storages[storageId];
+    Folder *parent = parentFolder(storage, id);
+    LIBMTP_file_t *old = storage.files.value(id);
+    if (parent && old) {
+        parent->remove(QString::fromUtf8(old->filename), id);
+        parent->add(QString::fromUtf8(file->filename), id);
+    }
+    insertFile(storage, file);
 
-    if (item.second != 0) {
-        QDateTime dateTime = QDateTime::currentDateTime();
+    return file;
+}
 
-        if (item.first > dateTime) {
-            qCDebug(LOG_KIO_MTP) << "Found item with ttl:" << item.first << "- now:" << dateTime;
+void FileCache::renameFile(uint32_t storageId, uint32_t id, const QString &name)
+{
+    Storage &storage = storages[storageId];
+    LIBMTP_file_t *file = storage.files.value(id);
+    if (!file) {
+        return;
+    }
 
-            item.first = dateTime.addSecs(timeToLive);
+    if (Folder *parent = parentFolder(storage, id)) {
+        parent->remove(QString::fromUtf8(file->filename), id);
+        parent->add(name, id);
+    }
 
-            qCDebug(LOG_KIO_MTP) << "Reset item ttl:" << item.first;
+    free(file->filename);
+    file->filename = strdup(name.toUtf8().data());
+}
 
-            cache.insert(path, item);
+void FileCache::removeFile(uint32_t storageId, uint32_t id)
+{
+    Storage &storage = storages[storageId];
+    Folder *parent = parentFolder(storage, id);
+    LIBMTP_file_t *file = storage.files.value(id);
+    if (parent && file) {
+        parent->remove(QString::fromUtf8(file->filename), id);
+    }
 
-            return item.second;
-        } else {
-            qCDebug(LOG_KIO_MTP) << "Item too old (" << item.first << "), removed. Current Time: " << dateTime;
+    removeTree(storage, id);
+}
 
-            cache.remove(path);
-            return 0;
+void FileCache::clear()
+{
+    for (const Storage &storage : storages) {
+        for (LIBMTP_file_t *file : storage.files) {
+            LIBMTP_destroy_file_t(file);
         }
     }
+    storages.clear();
+}
+
+/**
+ * Returns the listed folder a file is a child of, nullptr if that folder hasn't been listed.
+ */
+FileCache::Folder *FileCache::parentFolder(Storage &storage, uint32_t id)
+{
+    const QHash<uint32_t, uint32_t>::const_iterator parentId = storage.parents.constFind(id);
+    if (parentId == storage.parents.constEnd()) {
+        return nullptr;
+    }
 
-    return 0;
+    const QHash<uint32_t, Folder>::iterator parent = storage.folders.find(*parentId);
+    return parent != storage.folders.end() ? &*parent : nullptr;
 }
 
-void FileCache::addPath(const QString &path, uint32_t id, int timeToLive)
+/**
+ * Lists a folder from the device, replacing what was known about its children.
+ * Children that are gone are removed along with everything below them.
+ * If the device fails to list it, what was known is kept.
+ */
+bool FileCache::listFolder(LIBMTP_mtpdevice_t *device, uint32_t storageId, uint32_t parentId)
 {
-    QDateTime dateTime = QDateTime::currentDateTime();
-    dateTime = dateTime.addSecs(timeToLive);
+    qCDebug(LOG_KIO_MTP) << "Listing" << parentId << "on storage" << storageId;
+
+    // an empty folder and an error both give no files, only the error stack tells them apart
+    LIBMTP_Clear_Errorstack(device);
+    LIBMTP_file_t *file = LIBMTP_Get_Files_And_Folders(device, storageId, parentId);
+    if (!file && LIBMTP_Get_Errorstack(device)) {
+        qCWarning(LOG_KIO_MTP) << "Could not list" << parentId << "on storage" << storageId;
+        LIBMTP_Dump_Errorstack(device);
+        LIBMTP_Clear_Errorstack(device);
+        return false;
+    }
+
+    Storage &storage = storages[storageId];
+    QSet<uint32_t> gone = storage.folders.value(parentId).children.toSet();
+
+    Folder listed;
+    while (file) {
+        LIBMTP_file_t *next = file->next;
+        file->next = nullptr;
 
-    QPair< QDateTime, uint32_t > item(dateTime, id);
+        gone.remove(file->item_id);
+        listed.add(QString::fromUtf8(file->filename), file->item_id);
+        storage.parents.insert(file->item_id, parentId);
+        insertFile(storage, file);
 
-    cache.insert(path, item);
+        file = next;
+    }
+    listed.listed = QDateTime::currentDateTime();
+    storage.folders.insert(parentId, listed);
+
+    for (uint32_t id : gone) {
+        removeTree(storage, id);
+    }
+
+    return true;
 }
 
-void FileCache::removePath(const QString &path)
+void FileCache::Folder::add(const QString &name, uint32_t id)
 {
-    cache.remove(path);
+    children.append(id);
+    names.insert(name, id);
 }
 
+void FileCache::Folder::remove(const QString &name, uint32_t id)
+{
+    children.removeOne(id);
+    names.remove(name, id);
+}
+
+void FileCache::insertFile(Storage &storage, LIBMTP_file_t *file)
+{
+    LIBMTP_file_t *old = storage.files.value(file->item_id);
+    if (old && old != file) {
+        LIBMTP_destroy_file_t(old);
+    }
+    storage.files.insert(file->item_id, file);
+}
+
+void FileCache::removeTree(Storage &storage, uint32_t id)
+{
+    LIBMTP_file_t *file = storage.files.take(id);
+    if (file) {
+        LIBMTP_destroy_file_t(file);
+    }
+    storage.parents.remove(id);
+
+    if (storage.folders.contains(id)) {
+        const QList<uint32_t> children = storage.folders.take(id).children;
+        for (uint32_t child : children) {
+            removeTree(storage, child);
+        }
+    }
+}
@@ -26,13 +26,20 @@
 
 #include <QDateTime>
 #include <QHash>
-#include <QPair>
+#include <QList>
+#include <QStringList>
 #include <QLoggingCategory>
 
+#include <libmtp.h>
+
 Q_DECLARE_LOGGING_CATEGORY(LOG_KIO_MTP)
 
 /**
- * @class FileCache Implements a time based cache for file ids, mapping their path to their ID. Does _not_ store the device they are on.
+ * @class FileCache Implements an index of the files and folders of one device, per storage the children of every
+ * folder that has been listed. Paths are resolved by looking up one name per level, a folder is only listed from the
+ * device the first time it is needed. The slave keeps the index up to date with its own changes.
+ *
+ * The index owns the LIBMTP_file_t it hands out, they stay valid until the object is removed or listed again.
  */
 class FileCache : public QObject
 {
@@ -40,42 +47,98 @@ Q_OBJECT
 
 public:
     explicit FileCache(QObject *parent = nullptr);
+    ~FileCache() override;
+
+    /**
+     * Returns the file or folder at the given path below a storage, else nullptr.
+     * Lists the folders along the path that are not known yet. A name that is not found is looked for
+     * on the device again if the listing of its folder is older than timeToLive.
+     *
+     * @param device The device the storage is on
+     * @param storageId The ID of the storage
+     * @param names The path below the storage, one name per level
+     * @param timeToLive The time in seconds a folder listing is trusted to be complete
+     * @return The file or folder if it exists, else nullptr
+     */
+    LIBMTP_file_t *queryPath(LIBMTP_mtpdevice_t *device, uint32_t storageId, const QStringList &names, int timeToLive = 60);
 
     /**
-     * Returns the ID of the item at the given path, else 0.
-     * Automatically discards old items.
+     * Gets the children of a folder, listing it from the device if it is not known yet or refresh is true.
      *
-     * @param path The Path to query the cache for
-     * @return The ID of the Item if it exists, else 0
+     * @param device The device the storage is on
+     * @param storageId The ID of the storage
+     * @param parentId The ID of the folder, 0xFFFFFFFF for the root of the storage
+     * @param files Set to the children
+     * @param refresh If the folder should be listed again
+     * @return false if the device failed to list the folder, what was known about it is kept then
      */
-    uint32_t queryPath(const QString &path, int timeToLive = 60);
+    bool children(LIBMTP_mtpdevice_t *device, uint32_t storageId, uint32_t parentId, QList<LIBMTP_file_t *> &files, bool refresh = false);
 
     /**
-     * Adds a Path to the Cache with the given id and ttl.
+     * Adds a file or folder that was just created on the device, the cache takes ownership.
+     * A new folder is known to be empty.
      *
-     * @param path The path of the file/folder
-     * @param id The file ID on the storage
-     * @param timeToLive The time in seconds the entry should be valid
+     * @param file The file with its storage, parent and item ID set
      */
-    void addPath(const QString &path, uint32_t id, int timeToLive = 60);
+    void addFile(LIBMTP_file_t *file);
 
     /**
-     * Remove the given path from the cache, i.e. if it got deleted
+     * Gets the metadata of a file from the device again, as its size, time or name may have changed since its
+     * folder was listed. Pointers to the file the cache handed out before are invalid afterwards.
      *
-     * @param path The path that should be removed
+     * @param device The device the storage is on
+     * @param storageId The ID of the storage
+     * @param id The ID of the file
+     * @return The file as the device knows it now, or nullptr if it is gone
      */
-    void removePath(const QString &path);
+    LIBMTP_file_t *refreshFile(LIBMTP_mtpdevice_t *device, uint32_t storageId, uint32_t id);
 
-// private slots:
-//     void insertItem( const QString& path, QPair<QDateTime, uint32_t> item );
-//     void removeItem( const QString& path );
-//
-// signals:
-//     void s_insertItem( const QString& path, QPair<QDateTime, uint32_t> item );
-//     void s_removeItem( const QString& path );
+    /**
+     * Changes the name of a file or folder, i.e. if it got renamed
+     *
+     * @param storageId The ID of the storage
+     * @param id The ID of the file or folder
+     * @param name The new name
+     */
+    void renameFile(uint32_t storageId, uint32_t id, const QString &name);
+
+    /**
+     * Remove the given file or folder and everything below it from the cache, i.e. if it got deleted
+     *
+     * @param storageId The ID of the storage
+     * @param id The ID of the file or folder
+     */
+    void removeFile(uint32_t storageId, uint32_t id);
+
+    /**
+     * Forget everything, i.e. if the device was opened again
+     */
+    void clear();
 
 private:
-    QHash<QString, QPair<QDateTime, uint32_t> > cache;
+    /** a folder that has been listed, its children in the order listed and by name, which need not be unique */
+    struct Folder {
+        QList<uint32_t> children;
+        QMultiHash<QString, uint32_t> names;
+        QDateTime listed;
+
+        void add(const QString &name, uint32_t id);
+        void remove(const QString &name, uint32_t id);
+    };
+
+    struct Storage {
+        QHash<uint32_t, LIBMTP_file_t *> files;
+        QHash<uint32_t, Folder> folders;
+        /** the folder every file is a child of, devices differ in the parent_id they report for the root */
+        QHash<uint32_t, uint32_t> parents;
+    };
+
+    Folder *parentFolder(Storage &storage, uint32_t id);
+    bool listFolder(LIBMTP_mtpdevice_t *device, uint32_t storageId, uint32_t parentId);
+    void insertFile(Storage &storage, LIBMTP_file_t *file);
+    void removeTree(Storage &storage, uint32_t id);
+
+    QHash<uint32_t, Storage> storages;
 };
 
 #endif // KIO_MTP_FILE_CACHE_H
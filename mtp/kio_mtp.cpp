@@ -26,6 +26,8 @@
 #include <QDateTime>
 #include <QCoreApplication>
 #include <QTimer>
+#include <QMimeDatabase>
+#include <QDataStream>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -68,7 +70,7 @@ MTPSlave::MTPSlave(const QByteArray &pool, const QByteArray &app)
     qCDebug(LOG_KIO_MTP) << "Slave started";
 
     deviceCache = new DeviceCache(60000);
-    fileCache = new FileCache(this);
+    openDevice = nullptr;
 
     qCDebug(LOG_KIO_MTP) << "Caches created";
 }
@@ -76,16 +78,17 @@ MTPSlave::MTPSlave(const QByteArray &pool, const QByteArray &app)
 MTPSlave::~MTPSlave()
 {
     qCDebug(LOG_KIO_MTP) << "Slave destroyed";
-    delete fileCache;
+    closeWithoutFinish();
     delete deviceCache;
 }
 
 /**
  * @brief Get's the correct object from the device.
  * @param pathItems A QStringList containing the items of the filepath
+ * @param refresh If the metadata of a file should be read from the device rather than taken from the last listing
  * @return QPair with the object and its device. pair.first is a nullpointer if the object doesn't exist or for root or, depending on the pathItems size device (1), storage (2) or file (>=3)
  */
-QPair<void *, LIBMTP_mtpdevice_t *> MTPSlave::getPath(const QString &path)
+QPair<void *, LIBMTP_mtpdevice_t *> MTPSlave::getPath(const QString &path, bool refresh)
 {
     QStringList pathItems = path.split(QLatin1Char('/'), QString::SkipEmptyParts);
 
@@ -99,7 +102,8 @@ QPair<void *, LIBMTP_mtpdevice_t *> MTPSlave::getPath(const QString &path)
     }
 
     if (deviceCache->contains(pathItems.at(0))) {
-        LIBMTP_mtpdevice_t *device = deviceCache->get(pathItems.at(0))->getDevice();
+        CachedDevice *cachedDevice = deviceCache->get(pathItems.at(0));
+        LIBMTP_mtpdevice_t *device = cachedDevice->getDevice();
 
         // return specific device
         if (pathItems.size() == 1) {
@@ -107,64 +111,13 @@ QPair<void *, LIBMTP_mtpdevice_t *> MTPSlave::getPath(const QString &path)
             ret.second = device;
 
             qCDebug(LOG_KIO_MTP) << "returning LIBMTP_mtpdevice_t";
-        }
-
-        if (pathItems.size() > 2) {
-            // Query Cache after we have the device
-            uint32_t c_fileID = fileCache->queryPath(path);
-            if (c_fileID != 0) {
-                qCDebug(LOG_KIO_MTP)  << "Match found in cache, checking device";
-
-                LIBMTP_file_t *file = LIBMTP_Get_Filemetadata(device, c_fileID);
-                if (file) {
-                    qCDebug(LOG_KIO_MTP) << "Found file in cache";
-                    ret.first = file;
-                    ret.second = device;
-
-                    qCDebug(LOG_KIO_MTP) << "returning LIBMTP_file_t from cache";
-
-                    return ret;
-                }
-            }
-            // Query cache for parent
-            else if (pathItems.size() > 3) {
-                QString parentPath = convertToPath(pathItems, pathItems.size() - 1);
-                uint32_t c_parentID = fileCache->queryPath(parentPath);
-
-                qCDebug(LOG_KIO_MTP)  << "Match for parent found in cache, checking device. Parent id = " << c_parentID;
-
-                LIBMTP_file_t *parent = LIBMTP_Get_Filemetadata(device, c_parentID);
-                if (parent) {
-                    qCDebug(LOG_KIO_MTP) << "Found parent in cache";
-//                     fileCache->addPath( parentPath, c_parentID );
-
-                    QMap<QString, LIBMTP_file_t *> files = getFiles(device, parent->storage_id, c_parentID);
-
-                    for (QMap<QString, LIBMTP_file_t *>::iterator it = files.begin(); it != files.end(); ++it) {
-                        QString filePath = parentPath;
-                        filePath.append(QString::fromUtf8("/")).append(it.key());
-                        fileCache->addPath(filePath, it.value()->item_id);
-                    }
-
-                    if (files.contains(pathItems.last())) {
-                        LIBMTP_file_t *file = files.value(pathItems.last());
-
-                        ret.first = file;
-                        ret.second = device;
-
-                        qCDebug(LOG_KIO_MTP) << "returning LIBMTP_file_t from cached parent" ;
-
-                        fileCache->addPath(path, file->item_id);
-                    }
 
-                    return ret;
-                }
-            }
+            return ret;
         }
 
         QMap<QString, LIBMTP_devicestorage_t *> storages = getDevicestorages(device);
 
-        if (pathItems.size() > 1 && storages.contains(pathItems.at(1))) {
+        if (storages.contains(pathItems.at(1))) {
             LIBMTP_devicestorage_t *storage = storages.value(pathItems.at(1));
 
             if (pathItems.size() == 2) {
@@ -176,34 +129,34 @@ QPair<void *, LIBMTP_mtpdevice_t *> MTPSlave::getPath(const QString &path)
                 return ret;
             }
 
-            int currentLevel = 2, currentParent = 0xFFFFFFFF;
-
-            QMap<QString, LIBMTP_file_t *> files;
-
-            // traverse further while depth not reached
-            while (currentLevel < pathItems.size()) {
-                files = getFiles(device, storage->id, currentParent);
-
-                if (files.contains(pathItems.at(currentLevel))) {
-                    currentParent = files.value(pathItems.at(currentLevel))->item_id;
-                } else {
-                    qCDebug(LOG_KIO_MTP) << "returning LIBMTP_file_t using tree walk";
-
-                    return ret;
-                }
-                currentLevel++;
+            // one lookup per level, the device is only asked for folders not listed yet
+            LIBMTP_file_t *file = cachedDevice->getFileCache()->queryPath(device, storage->id, pathItems.mid(2));
+            if (file && refresh && file->filetype != LIBMTP_FILETYPE_FOLDER) {
+                file = cachedDevice->getFileCache()->refreshFile(device, storage->id, file->item_id);
             }
+            if (file) {
+                ret.first = file;
+                ret.second = device;
 
-            ret.first = LIBMTP_Get_Filemetadata(device, currentParent);
-            ret.second = device;
-
-            fileCache->addPath(path, currentParent);
+                qCDebug(LOG_KIO_MTP) << "returning LIBMTP_file_t";
+            }
         }
     }
 
     return ret;
 }
 
+/**
+ * @brief The index of the files on the device the path is on.
+ * @return The FileCache of the device, or nullptr if the device is not known
+ */
+FileCache *MTPSlave::getFileCache(const QString &path)
+{
+    CachedDevice *cachedDevice = deviceCache->get(path.section(QLatin1Char('/'), 0, 0, QString::SectionSkipEmpty));
+
+    return cachedDevice ? cachedDevice->getFileCache() : nullptr;
+}
+
 int MTPSlave::checkUrl(const QUrl &url, bool redirect)
 {
     qCDebug(LOG_KIO_MTP) << url;
@@ -313,8 +266,11 @@ void MTPSlave::listDir(const QUrl &url)
             }
             // Storage, list files and folders of storage root
             else {
-                QMap<QString, LIBMTP_file_t *> files;
+                QList<LIBMTP_file_t *> files;
+                bool listed;
+                FileCache *fileCache = getFileCache(url.path());
 
+                // listing is how changes made on the device itself show up, so the folder is always listed again
                 if (pathItems.size() == 2) {
                     qCDebug(LOG_KIO_MTP) << "Getting storage root listing";
 
@@ -322,25 +278,19 @@ void MTPSlave::listDir(const QUrl &url)
 
                     qCDebug(LOG_KIO_MTP) << "We have a storage:" << (storage == nullptr);
 
-                    files = getFiles(device, storage->id);
+                    listed = fileCache->children(device, storage->id, 0xFFFFFFFF, files, true);
                 } else {
                     LIBMTP_file_t *parent = (LIBMTP_file_t *)pair.first;
 
-                    files = getFiles(device, parent->storage_id, parent->item_id);
+                    listed = fileCache->children(device, parent->storage_id, parent->item_id, files, true);
                 }
 
-                for (QMap<QString, LIBMTP_file_t *>::iterator it = files.begin(); it != files.end(); ++it) {
-                    LIBMTP_file_t *file = it.value();
-
-                    QString filePath;
-                    if (url.path().endsWith(QLatin1Char('/'))) {
-                        filePath = url.path().append(it.key());
-                    } else {
-                        filePath = url.path().append(QLatin1Char('/')).append(it.key());
-                    }
-
-                    fileCache->addPath(filePath, file->item_id);
+                if (!listed) {
+                    error(ERR_CANNOT_ENTER_DIRECTORY, url.path());
+                    return;
+                }
 
+                for (LIBMTP_file_t *file : files) {
                     getEntry(entry, file);
 
                     listEntry(entry);
@@ -382,7 +332,7 @@ void MTPSlave::stat(const QUrl &url)
 
     QStringList pathItems = url.path().split(QLatin1Char('/'), QString::SkipEmptyParts);
 
-    QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path());
+    QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path(), true);
     UDSEntry entry;
 
     if (pair.first) {
@@ -436,10 +386,23 @@ void MTPSlave::mimetype(const QUrl &url)
     if (pair.first) {
 //      NOTE the difference between calling mimetype and mimeType
         if (pathItems.size() > 2) {
-            mimeType(getMimetype(((LIBMTP_file_t *) pair.first)->filetype));
+            LIBMTP_file_t *file = (LIBMTP_file_t *) pair.first;
+            LIBMTP_mtpdevice_t *device = pair.second;
+            QByteArray buffer;
+
+            // look at the start of the file instead of going by the file type the device reports
+            if (file->filetype != LIBMTP_FILETYPE_FOLDER && file->filesize > 0
+                && LIBMTP_Check_Capability(device, LIBMTP_DEVICECAP_GetPartialObject)
+                && getPartialObject(device, file->item_id, 0, MIMETYPE_SNIFF_SIZE, buffer)) {
+                QMimeDatabase db;
+                mimeType(db.mimeTypeForFileNameAndData(QString::fromUtf8(file->filename), buffer).name());
+            } else {
+                mimeType(getMimetype(file->filetype));
+            }
         } else {
             mimeType(QString::fromLatin1("inode/directory"));
         }
+        finished();
     } else {
         error(ERR_DOES_NOT_EXIST, url.path());
         return;
@@ -462,7 +425,7 @@ void MTPSlave::put(const QUrl &url, int, JobFlags flags)
     QStringList destItems = url.path().split(QLatin1Char('/'), QString::SkipEmptyParts);
 
     // Can't copy to root or device, needs storage
-    if (destItems.size() < 2) {
+    if (destItems.size() < 3) {
         error(ERR_UNSUPPORTED_ACTION, url.path());
         return;
     }
@@ -482,41 +445,79 @@ void MTPSlave::put(const QUrl &url, int, JobFlags flags)
     }
 
     LIBMTP_mtpdevice_t *device = pair.second;
-    LIBMTP_file_t *parent = (LIBMTP_file_t *) pair.first;
-    if (parent->filetype != LIBMTP_FILETYPE_FOLDER) {
-        error(ERR_IS_FILE, urlDirectory(url));
-        return;
+    uint32_t parentId, storageId;
+
+    // put straight into a storage
+    if (destItems.size() == 2) {
+        parentId = 0xFFFFFFFF;
+        storageId = ((LIBMTP_devicestorage_t *) pair.first)->id;
+    } else {
+        LIBMTP_file_t *parent = (LIBMTP_file_t *) pair.first;
+        if (parent->filetype != LIBMTP_FILETYPE_FOLDER) {
+            error(ERR_IS_FILE, urlDirectory(url));
+            return;
+        }
+        parentId = parent->item_id;
+        storageId = parent->storage_id;
     }
 
+    LIBMTP_file_t *file = LIBMTP_new_file_t();
+    file->parent_id = parentId;
+    file->filename = strdup(urlFileName(url).toUtf8().data());
+    file->filetype = getFiletype(urlFileName(url));
+    file->modificationdate = QDateTime::currentDateTime().toTime_t();
+    file->storage_id = storageId;
+
+    DataGetSource source;
+    source.slave = this;
+    int ret;
+
     // We did get a total size from the application
-    if (hasMetaData(QLatin1String("sourceSize"))) {
+    const bool direct = hasMetaData(QLatin1String("sourceSize"));
+    if (direct) {
         qCDebug(LOG_KIO_MTP) << "direct put";
 
-        LIBMTP_file_t *file = LIBMTP_new_file_t();
-        file->parent_id = parent->item_id;
-        file->filename = strdup(urlFileName(url).toUtf8().data());
-        file->filetype = getFiletype(urlFileName(url));
         file->filesize = metaData(QLatin1String("sourceSize")).toULongLong();
-        file->modificationdate = QDateTime::currentDateTime().toTime_t();
-        file->storage_id = parent->storage_id;
-
-        qCDebug(LOG_KIO_MTP) << "Sending file" << file->filename;
+    }
+    // The device needs the size up front, read as much of the file into memory as we allow
+    else {
+        QByteArray buffer;
+        int len = 0;
 
-        int ret = LIBMTP_Send_File_From_Handler(device, &dataGet, this, file, &dataProgress, this);
-        LIBMTP_destroy_file_t(file);
+        do {
+            dataReq();
+            len = readData(buffer);
+            source.buffer.append(buffer);
+        } while (len > 0 && source.buffer.size() < MAX_PUT_BUFFER_SIZE);
 
-        if (ret != 0) {
-            error(KIO::ERR_COULD_NOT_WRITE, urlFileName(url));
-            LIBMTP_Dump_Errorstack(device);
-            LIBMTP_Clear_Errorstack(device);
+        if (len < 0) {
+            LIBMTP_destroy_file_t(file);
+            error(KIO::ERR_COULD_NOT_READ, url.path());
             return;
         }
+
+        source.ended = (len == 0);
+        file->filesize = source.buffer.size();
+    }
+
+    if (direct || source.ended) {
+        qCDebug(LOG_KIO_MTP) << "Sending file" << file->filename << "of" << file->filesize << "bytes";
+
+        totalSize(file->filesize);
+        ret = LIBMTP_Send_File_From_Handler(device, &dataGet, &source, file, &dataProgress, this);
     }
-    // We need to get the entire file first, then we can upload
+    // Too large for memory, we need to get the entire file first, then we can upload
     else {
         qCDebug(LOG_KIO_MTP) << "use temp file";
 
         QTemporaryFile temp;
+        if (!temp.open() || temp.write(source.buffer) != source.buffer.size()) {
+            LIBMTP_destroy_file_t(file);
+            error(KIO::ERR_COULD_NOT_WRITE, urlFileName(url));
+            return;
+        }
+        source.buffer.clear();
+
         QByteArray buffer;
         int len = 0;
 
@@ -526,25 +527,30 @@ void MTPSlave::put(const QUrl &url, int, JobFlags flags)
             temp.write(buffer);
         } while (len > 0);
 
-        QFileInfo info(temp);
-
-        LIBMTP_file_t *file = LIBMTP_new_file_t();
-        file->parent_id = parent->item_id;
-        file->filename = strdup(urlFileName(url).toUtf8().data());
-        file->filetype = getFiletype(urlFileName(url));
-        file->filesize = info.size();
-        file->modificationdate = QDateTime::currentDateTime().toTime_t();
-        file->storage_id = parent->storage_id;
-
-        int ret = LIBMTP_Send_File_From_File_Descriptor(device, temp.handle(), file, nullptr, nullptr);
-        LIBMTP_destroy_file_t(file);
-
-        if (ret != 0) {
-            error(KIO::ERR_COULD_NOT_WRITE, urlFileName(url));
+        if (len < 0) {
+            LIBMTP_destroy_file_t(file);
+            error(KIO::ERR_COULD_NOT_READ, url.path());
             return;
         }
-        finished();
+
+        // libmtp reads from the current position of the descriptor
+        temp.seek(0);
+        file->filesize = temp.size();
+
+        totalSize(file->filesize);
+        ret = LIBMTP_Send_File_From_File_Descriptor(device, temp.handle(), file, &dataProgress, this);
+    }
+
+    if (ret != 0) {
+        LIBMTP_destroy_file_t(file);
+        error(KIO::ERR_COULD_NOT_WRITE, urlFileName(url));
+        LIBMTP_Dump_Errorstack(device);
+        LIBMTP_Clear_Errorstack(device);
+        return;
     }
+
+    getFileCache(url.path())->addFile(file);
+    finished();
 }
 
 void MTPSlave::get(const QUrl &url)
@@ -564,7 +570,7 @@ void MTPSlave::get(const QUrl &url)
 
     // File
     if (pathItems.size() > 2) {
-        QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path());
+        QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path(), true);
 
         if (pair.first) {
             LIBMTP_file_t *file = (LIBMTP_file_t *) pair.first;
@@ -667,15 +673,17 @@ void MTPSlave::copy(const QUrl &src, const QUrl &dest, int, JobFlags flags)
         totalSize(source.size());
 
         int ret = LIBMTP_Send_File_From_File(device, src.path().toUtf8().data(), file, (LIBMTP_progressfunc_t) &dataProgress, this);
-        LIBMTP_destroy_file_t(file);
 
         if (ret != 0) {
+            LIBMTP_destroy_file_t(file);
             error(KIO::ERR_COULD_NOT_WRITE, urlFileName(dest));
             LIBMTP_Dump_Errorstack(device);
             LIBMTP_Clear_Errorstack(device);
             return;
         }
 
+        getFileCache(dest.path())->addFile(file);
+
         qCDebug(LOG_KIO_MTP) << "Sent file";
     } else if (src.scheme() == QLatin1String("mtp") && dest.scheme() == QLatin1String("file")) {
         int check = checkUrl(src);
@@ -765,6 +773,7 @@ void MTPSlave::mkdir(const QUrl &url, int)
         LIBMTP_mtpdevice_t *device;
         LIBMTP_file_t *file;
         LIBMTP_devicestorage_t *storage;
+        uint32_t parentId = 0xFFFFFFFF, storageId = 0;
         int ret = 0;
 
         QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(urlDirectory(url));
@@ -773,7 +782,8 @@ void MTPSlave::mkdir(const QUrl &url, int)
             //the folder need to be created straight to a storage device
             storage = (LIBMTP_devicestorage_t *) pair.first;
             device = pair.second;
-            ret = LIBMTP_Create_Folder(device, dirName, 0xFFFFFFFF, storage->id);
+            storageId = storage->id;
+            ret = LIBMTP_Create_Folder(device, dirName, parentId, storageId);
         } else if (pair.first) {
             file = (LIBMTP_file_t *) pair.first;
             device = pair.second;
@@ -782,12 +792,22 @@ void MTPSlave::mkdir(const QUrl &url, int)
                 qCDebug(LOG_KIO_MTP) << "Found parent" << file->item_id << file->filename;
                 qCDebug(LOG_KIO_MTP) << "Attempting to create folder" << dirName;
 
-                ret = LIBMTP_Create_Folder(device, dirName, file->item_id, file->storage_id);
+                parentId = file->item_id;
+                storageId = file->storage_id;
+                ret = LIBMTP_Create_Folder(device, dirName, parentId, storageId);
 
             }
         }
         if (ret != 0) {
-            fileCache->addPath(url.path(), ret);
+            LIBMTP_file_t *folder = LIBMTP_new_file_t();
+            folder->item_id = ret;
+            folder->parent_id = parentId;
+            folder->storage_id = storageId;
+            folder->filename = dirName;
+            folder->filetype = LIBMTP_FILETYPE_FOLDER;
+            folder->modificationdate = QDateTime::currentDateTime().toTime_t();
+            getFileCache(url.path())->addFile(folder);
+
             finished();
             return;
         } else {
@@ -817,7 +837,8 @@ void MTPSlave::del(const QUrl &url, bool)
 
     QStringList pathItems = url.path().split(QLatin1Char('/'), QString::SkipEmptyParts);
 
-    if (pathItems.size() < 2) {
+    // devices and storages can't be deleted
+    if (pathItems.size() < 3) {
         error(ERR_CANNOT_DELETE, url.path());
         return;
     }
@@ -825,17 +846,19 @@ void MTPSlave::del(const QUrl &url, bool)
     QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path());
 
     LIBMTP_file_t *file = (LIBMTP_file_t *) pair.first;
+    if (!file) {
+        error(ERR_DOES_NOT_EXIST, url.path());
+        return;
+    }
 
     int ret = LIBMTP_Delete_Object(pair.second, file->item_id);
 
-    LIBMTP_destroy_file_t (file);
-
     if (ret != 0) {
         error(ERR_CANNOT_DELETE, url.path());
         return;
     }
 
-    fileCache->removePath(url.path());
+    getFileCache(url.path())->removeFile(file->storage_id, file->item_id);
     finished();
 }
 
@@ -874,7 +897,12 @@ void MTPSlave::rename(const QUrl &src, const QUrl &dest, JobFlags flags)
             return;
         } else {
             LIBMTP_file_t *destination = (LIBMTP_file_t *) getPath(dest.path()).first;
-            LIBMTP_file_t *source = (LIBMTP_file_t *) pair.first;
+            // looking up the destination may have listed the folder of the source again
+            LIBMTP_file_t *source = (LIBMTP_file_t *) getPath(src.path()).first;
+            if (!source) {
+                error(ERR_DOES_NOT_EXIST, src.path());
+                return;
+            }
 
             if (!(flags & KIO::Overwrite) && destination) {
                 if (destination->filetype == LIBMTP_FILETYPE_FOLDER) {
@@ -891,11 +919,8 @@ void MTPSlave::rename(const QUrl &src, const QUrl &dest, JobFlags flags)
                 error(ERR_CANNOT_RENAME, src.path());
                 return;
             } else {
-                fileCache->addPath(dest.path(), source->item_id);
-                fileCache->removePath(src.path());
+                getFileCache(src.path())->renameFile(source->storage_id, source->item_id, urlFileName(dest));
             }
-
-            LIBMTP_destroy_file_t (source);
         }
 
         finished();
@@ -904,6 +929,346 @@ void MTPSlave::rename(const QUrl &src, const QUrl &dest, JobFlags flags)
     }
 }
 
+void MTPSlave::open(const QUrl &url, QIODevice::OpenMode mode)
+{
+    int check = checkUrl(url);
+    switch (check) {
+    case 0:
+        break;
+    default:
+        error(ERR_MALFORMED_URL, url.path());
+        return;
+    }
+
+    qCDebug(LOG_KIO_MTP) << url.path() << mode;
+
+    QStringList pathItems = url.path().split(QLatin1Char('/'), QString::SkipEmptyParts);
+
+    // Devices and storages can't be opened
+    if (pathItems.size() < 3) {
+        error(ERR_IS_DIRECTORY, url.path());
+        return;
+    }
+
+    QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path(), true);
+    LIBMTP_file_t *file = (LIBMTP_file_t *) pair.first;
+
+    if (!file) {
+        error(ERR_DOES_NOT_EXIST, url.path());
+        return;
+    }
+    if (file->filetype == LIBMTP_FILETYPE_FOLDER) {
+        error(ERR_IS_DIRECTORY, url.path());
+        return;
+    }
+
+    LIBMTP_mtpdevice_t *device = pair.second;
+
+    // Without partial objects a file can only be transferred as a whole, get and put do that
+    if (mode.testFlag(QIODevice::ReadOnly) && !LIBMTP_Check_Capability(device, LIBMTP_DEVICECAP_GetPartialObject)) {
+        error(ERR_CANNOT_OPEN_FOR_READING, url.path());
+        return;
+    }
+
+    const bool truncate = mode.testFlag(QIODevice::Truncate);
+
+    if (mode.testFlag(QIODevice::WriteOnly)) {
+        if (!LIBMTP_Check_Capability(device, LIBMTP_DEVICECAP_EditObjects)) {
+            error(ERR_CANNOT_OPEN_FOR_WRITING, url.path());
+            return;
+        }
+
+        if (LIBMTP_BeginEditObject(device, file->item_id) != 0) {
+            LIBMTP_Dump_Errorstack(device);
+            LIBMTP_Clear_Errorstack(device);
+            error(ERR_CANNOT_OPEN_FOR_WRITING, url.path());
+            return;
+        }
+
+        if (truncate && LIBMTP_TruncateObject(device, file->item_id, 0) != 0) {
+            LIBMTP_Dump_Errorstack(device);
+            LIBMTP_Clear_Errorstack(device);
+            LIBMTP_EndEditObject(device, file->item_id);
+            error(ERR_CANNOT_OPEN_FOR_WRITING, url.path());
+            return;
+        }
+    }
+
+    openDevice = device;
+    openId = file->item_id;
+    openUrl = url;
+    openForWriting = mode.testFlag(QIODevice::WriteOnly);
+    openSize = (openForWriting && truncate) ? 0 : file->filesize;
+    openOffset = mode.testFlag(QIODevice::Append) ? openSize : 0;
+    readAhead.clear();
+    readAheadOffset = 0;
+
+    // Only the start of the file is read for the mimetype, a player seeking elsewhere right away
+    // does not have to wait for more. It also serves the first read().
+    if (mode.testFlag(QIODevice::ReadOnly)) {
+        if (!fillReadAhead(0, MIMETYPE_SNIFF_SIZE)) {
+            error(ERR_COULD_NOT_READ, url.path());
+            closeWithoutFinish();
+            return;
+        }
+
+        QMimeDatabase db;
+        mimeType(db.mimeTypeForFileNameAndData(urlFileName(url), readAhead).name());
+    }
+
+    totalSize(openSize);
+    position(openOffset);
+    opened();
+    finished();
+}
+
+void MTPSlave::read(KIO::filesize_t size)
+{
+    qCDebug(LOG_KIO_MTP) << "read" << size << "bytes at" << openOffset;
+
+    Q_ASSERT(openDevice);
+
+    if (openOffset >= openSize || size == 0) {
+        data(QByteArray());
+        finished();
+        return;
+    }
+
+    if (openOffset < readAheadOffset || openOffset >= readAheadOffset + readAhead.size()) {
+        if (!fillReadAhead(openOffset, qBound<KIO::filesize_t>(MAX_READ_AHEAD_SIZE, size, MAX_READ_SIZE))) {
+            error(ERR_COULD_NOT_READ, openUrl.path());
+            closeWithoutFinish();
+            return;
+        }
+    }
+
+    // what is left of the read-ahead, the job asks again for the rest
+    const int start = openOffset - readAheadOffset;
+    const int length = qMin<KIO::filesize_t>(size, readAhead.size() - start);
+
+    openOffset += length;
+    data(QByteArray::fromRawData(readAhead.constData() + start, length));
+    finished();
+}
+
+void MTPSlave::write(const QByteArray &data)
+{
+    qCDebug(LOG_KIO_MTP) << "write" << data.size() << "bytes at" << openOffset;
+
+    Q_ASSERT(openDevice);
+
+    if (!openForWriting) {
+        error(ERR_COULD_NOT_WRITE, openUrl.path());
+        closeWithoutFinish();
+        return;
+    }
+
+    if (LIBMTP_SendPartialObject(openDevice, openId, openOffset, (unsigned char *) data.constData(), data.size()) != 0) {
+        LIBMTP_Dump_Errorstack(openDevice);
+        LIBMTP_Clear_Errorstack(openDevice);
+        error(ERR_COULD_NOT_WRITE, openUrl.path());
+        closeWithoutFinish();
+        return;
+    }
+
+    openOffset += data.size();
+    openSize = qMax(openSize, openOffset);
+    readAhead.clear();
+
+    written(data.size());
+    finished();
+}
+
+void MTPSlave::seek(KIO::filesize_t offset)
+{
+    qCDebug(LOG_KIO_MTP) << "seek to" << offset;
+
+    Q_ASSERT(openDevice);
+
+    // MTP can't write with a gap before the data
+    if (offset > openSize) {
+        error(ERR_COULD_NOT_SEEK, openUrl.path());
+        closeWithoutFinish();
+        return;
+    }
+
+    openOffset = offset;
+    position(openOffset);
+    finished();
+}
+
+void MTPSlave::close()
+{
+    const QString path = openUrl.path();
+
+    if (!closeWithoutFinish()) {
+        error(ERR_COULD_NOT_WRITE, path);
+        return;
+    }
+
+    finished();
+}
+
+bool MTPSlave::fillReadAhead(KIO::filesize_t offset, KIO::filesize_t size)
+{
+    readAhead.clear();
+    readAheadOffset = offset;
+
+    if (offset >= openSize) {
+        return true;
+    }
+
+    if (!getPartialObject(openDevice, openId, offset, qMin(size, openSize - offset), readAhead)) {
+        return false;
+    }
+
+    // nothing before the end of the file would be taken for the end by the job
+    if (readAhead.isEmpty()) {
+        qCWarning(LOG_KIO_MTP) << "device returned no data at" << offset << "of" << openSize;
+        return false;
+    }
+
+    return true;
+}
+
+bool MTPSlave::closeWithoutFinish()
+{
+    if (!openDevice) {
+        return true;
+    }
+
+    bool ret = true;
+
+    if (openForWriting) {
+        if (LIBMTP_EndEditObject(openDevice, openId) != 0) {
+            LIBMTP_Dump_Errorstack(openDevice);
+            LIBMTP_Clear_Errorstack(openDevice);
+            ret = false;
+        }
+
+        LIBMTP_file_t *file = (LIBMTP_file_t *) getPath(openUrl.path()).first;
+        if (file) {
+            file->filesize = openSize;
+        }
+    }
+
+    openDevice = nullptr;
+    readAhead.clear();
+
+    return ret;
+}
+
+void MTPSlave::special(const QByteArray &data)
+{
+    int command;
+    QDataStream stream(data);
+    stream >> command;
+
+    switch (command) {
+    case 1: {
+        QUrl url;
+        stream >> url;
+        thumbnail(url);
+        return;
+    }
+    default:
+        error(ERR_UNSUPPORTED_ACTION, QString::number(command));
+        return;
+    }
+}
+
+void MTPSlave::thumbnail(const QUrl &url)
+{
+    int check = checkUrl(url);
+    switch (check) {
+    case 0:
+        break;
+    default:
+        error(ERR_MALFORMED_URL, url.path());
+        return;
+    }
+
+    qCDebug(LOG_KIO_MTP) << url.path();
+
+    QStringList pathItems = url.path().split(QLatin1Char('/'), QString::SkipEmptyParts);
+
+    if (pathItems.size() < 3) {
+        error(ERR_IS_DIRECTORY, url.path());
+        return;
+    }
+
+    QPair<void *, LIBMTP_mtpdevice_t *> pair = getPath(url.path());
+    LIBMTP_file_t *file = (LIBMTP_file_t *) pair.first;
+
+    if (!file) {
+        error(ERR_DOES_NOT_EXIST, url.path());
+        return;
+    }
+    if (file->filetype == LIBMTP_FILETYPE_FOLDER) {
+        error(ERR_IS_DIRECTORY, url.path());
+        return;
+    }
+
+    LIBMTP_mtpdevice_t *device = pair.second;
+
+    // Most devices keep a thumbnail of every image and video they know about
+    unsigned char *thumb = nullptr;
+    unsigned int size = 0;
+    if (LIBMTP_Get_Thumbnail(device, file->item_id, &thumb, &size) == 0 && thumb && size > 0) {
+        const QByteArray buffer((const char *) thumb, size);
+        free(thumb);
+
+        sendThumbnail(buffer, QLatin1String("device"));
+        return;
+    }
+    free(thumb);
+    LIBMTP_Clear_Errorstack(device);
+
+    // Photos usually carry a small thumbnail in the EXIF data at the start of the file
+    if ((file->filetype == LIBMTP_FILETYPE_JPEG || file->filetype == LIBMTP_FILETYPE_JFIF)
+        && LIBMTP_Check_Capability(device, LIBMTP_DEVICECAP_GetPartialObject)) {
+        QByteArray buffer;
+        if (getPartialObject(device, file->item_id, 0, EXIF_READ_SIZE, buffer)) {
+            const QByteArray exif = getExifThumbnail(buffer);
+            if (!exif.isEmpty()) {
+                sendThumbnail(exif, QLatin1String("exif"));
+                return;
+            }
+        }
+    }
+
+    // No thumbnail anywhere, send the file to create one from
+    qCDebug(LOG_KIO_MTP) << "No thumbnail on the device, sending the file";
+
+    setMetaData(QLatin1String("thumbnailSource"), QLatin1String("file"));
+    mimeType(getMimetype(file->filetype));
+    totalSize(file->filesize);
+
+    int ret = LIBMTP_Get_File_To_Handler(device, file->item_id, &dataPut, this, &dataProgress, this);
+    if (ret != 0) {
+        LIBMTP_Dump_Errorstack(device);
+        LIBMTP_Clear_Errorstack(device);
+        error(ERR_COULD_NOT_READ, url.path());
+        return;
+    }
+    data(QByteArray());
+    finished();
+}
+
+void MTPSlave::sendThumbnail(const QByteArray &thumbnail, const QString &source)
+{
+    qCDebug(LOG_KIO_MTP) << "Sending" << thumbnail.size() << "bytes of thumbnail from" << source;
+
+    QMimeDatabase db;
+
+    setMetaData(QLatin1String("thumbnailSource"), source);
+    mimeType(db.mimeTypeForData(thumbnail).name());
+    totalSize(thumbnail.size());
+    data(thumbnail);
+    data(QByteArray());
+    finished();
+}
+
 void MTPSlave::virtual_hook(int id, void *data)
 {
     switch(id) {
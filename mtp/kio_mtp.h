@@ -39,6 +39,15 @@
 #include <QLoggingCategory>
 
 #define MAX_XFER_BUF_SIZE 16348
+// uploads of unknown size up to this are sent from memory, larger ones are spooled to a temporary file
+#define MAX_PUT_BUFFER_SIZE (16 * 1024 * 1024)
+// how much is read from the device at once for open(), a larger read() is read as asked up to MAX_READ_SIZE
+#define MAX_READ_AHEAD_SIZE (1024 * 1024)
+#define MAX_READ_SIZE (16 * 1024 * 1024)
+// how much of a file is looked at to determine its mimetype
+#define MIMETYPE_SNIFF_SIZE 4096
+// how much of a JPEG file is read to find the thumbnail in its EXIF data, which is at most 64 KiB
+#define EXIF_READ_SIZE (128 * 1024)
 #define KIO_MTP 7000
 
 using namespace KIO;
@@ -66,6 +75,14 @@ public:
     void del(const QUrl &url, bool) override;
     void rename(const QUrl &src, const QUrl &dest, JobFlags flags) override;
 
+    void open(const QUrl &url, QIODevice::OpenMode mode) override;
+    void read(KIO::filesize_t size) override;
+    void write(const QByteArray &data) override;
+    void seek(KIO::filesize_t offset) override;
+    void close() override;
+
+    void special(const QByteArray &data) override;
+
 // private slots:
 //
 //     void test();
@@ -87,9 +104,42 @@ private:
 
     void fileSystemFreeSpace(const QUrl &url);
 
-    FileCache *fileCache;
+    /**
+     * special() command 1, sends a thumbnail of the file at url without downloading all of it if possible:
+     * the one the device keeps, else the one in the EXIF data of a JPEG, else the whole file.
+     * The metadata "thumbnailSource" tells which it was, "device", "exif" or "file".
+     */
+    void thumbnail(const QUrl &url);
+    void sendThumbnail(const QByteArray &thumbnail, const QString &source);
+
+    /**
+     * Reads from the opened file at offset into readAhead, size bytes or up to its end.
+     *
+     * @return false if the device could not read it
+     */
+    bool fillReadAhead(KIO::filesize_t offset, KIO::filesize_t size);
+    /**
+     * Ends the editing of the opened file, if any, and forgets about it.
+     *
+     * @return false if the device did not accept the changes
+     */
+    bool closeWithoutFinish();
+
     DeviceCache *deviceCache;
-    QPair<void *, LIBMTP_mtpdevice_t *> getPath(const QString &path);
+    QPair<void *, LIBMTP_mtpdevice_t *> getPath(const QString &path, bool refresh = false);
+    FileCache *getFileCache(const QString &path);
+
+    /*
+     * The file opened with open(). The device stays valid as the slave does nothing else until close().
+     */
+    LIBMTP_mtpdevice_t *openDevice;
+    uint32_t openId;
+    QUrl openUrl;
+    bool openForWriting;
+    KIO::filesize_t openOffset;
+    KIO::filesize_t openSize;
+    QByteArray readAhead;
+    KIO::filesize_t readAheadOffset;
 };
 
 #endif // KIO_MTP_H
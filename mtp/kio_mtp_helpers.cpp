@@ -19,6 +19,11 @@
 
 #include "kio_mtp_helpers.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <QtEndian>
+
 int dataProgress(uint64_t const sent, uint64_t const, void const *const priv)
 {
     ((MTPSlave *) priv)->processedSize(sent);
@@ -41,31 +46,167 @@ uint16_t dataPut(void *, void *priv, uint32_t sendlen, unsigned char *data, uint
 
 /**
  * MTPDataGetFunc callback function, "gets" data and puts it on the device
+ *
+ * priv is a DataGetSource, the data is requested from the job until wantlen bytes are copied.
  */
-uint16_t dataGet(void *, void *priv, uint32_t, unsigned char *data, uint32_t *gotlen)
+uint16_t dataGet(void *, void *priv, uint32_t wantlen, unsigned char *data, uint32_t *gotlen)
 {
-    ((MTPSlave *) priv)->dataReq();
+    DataGetSource *source = (DataGetSource *) priv;
+    uint32_t copied = 0;
+
+    while (copied < wantlen) {
+        if (source->offset == source->buffer.size()) {
+            if (source->ended) {
+                break;
+            }
+
+            source->slave->dataReq();
+            const int len = source->slave->readData(source->buffer);
+            source->offset = 0;
+
+            if (len < 0) {
+                return LIBMTP_HANDLER_RETURN_ERROR;
+            } else if (len == 0) {
+                source->ended = true;
+                break;
+            }
+        }
 
-    QByteArray buffer;
-    *gotlen = ((MTPSlave *) priv)->readData(buffer);
+        const uint32_t count = qMin<uint32_t>(wantlen - copied, source->buffer.size() - source->offset);
+        memcpy(data + copied, source->buffer.constData() + source->offset, count);
+        copied += count;
+        source->offset += count;
+    }
+
+    qCDebug(LOG_KIO_MTP) << "transferring" << copied << "bytes to the device";
 
-    qCDebug(LOG_KIO_MTP) << "transferring" << *gotlen << "bytes to data()";
+    *gotlen = copied;
 
-    data = (unsigned char *) buffer.data();
+    // the job sent less than the size the file was announced with
+    if (copied == 0 && wantlen > 0) {
+        return LIBMTP_HANDLER_RETURN_ERROR;
+    }
 
     return LIBMTP_HANDLER_RETURN_OK;
 }
 
-QString convertToPath(const QStringList &pathItems, const int elements)
+/**
+ * Reads up to maxbytes of a file on the device, starting at offset
+ *
+ * @return false if the device could not read it
+ */
+bool getPartialObject(LIBMTP_mtpdevice_t *device, uint32_t id, uint64_t offset, uint32_t maxbytes, QByteArray &buffer)
+{
+    unsigned char *data = nullptr;
+    unsigned int size = 0;
+
+    if (LIBMTP_GetPartialObject(device, id, offset, maxbytes, &data, &size) != 0) {
+        LIBMTP_Dump_Errorstack(device);
+        LIBMTP_Clear_Errorstack(device);
+        return false;
+    }
+
+    qCDebug(LOG_KIO_MTP) << "read" << size << "bytes at" << offset << "of" << id;
+
+    buffer = QByteArray((const char *) data, size);
+    free(data);
+
+    return true;
+}
+
+/**
+ * Finds the thumbnail in the TIFF structure of EXIF data, it is described by the second IFD
+ */
+static QByteArray getTiffThumbnail(const QByteArray &tiff)
+{
+    const uchar *d = (const uchar *) tiff.constData();
+    const quint64 size = tiff.size();
+
+    if (size < 8) {
+        return QByteArray();
+    }
+
+    const bool littleEndian = d[0] == 'I' && d[1] == 'I';
+    if (!littleEndian && !(d[0] == 'M' && d[1] == 'M')) {
+        return QByteArray();
+    }
+
+    auto read16 = [d, littleEndian](quint64 pos) -> quint32 {
+        return littleEndian ? qFromLittleEndian<quint16>(d + pos) : qFromBigEndian<quint16>(d + pos);
+    };
+    auto read32 = [d, littleEndian](quint64 pos) -> quint32 {
+        return littleEndian ? qFromLittleEndian<quint32>(d + pos) : qFromBigEndian<quint32>(d + pos);
+    };
+
+    // skip IFD0, the one of the image itself
+    quint64 ifd = read32(4);
+    if (ifd + 2 > size) {
+        return QByteArray();
+    }
+    const quint64 next = ifd + 2 + read16(ifd) * 12;
+    if (next + 4 > size) {
+        return QByteArray();
+    }
+
+    ifd = read32(next);
+    if (ifd == 0 || ifd + 2 > size) {
+        return QByteArray();
+    }
+
+    quint32 offset = 0, length = 0;
+    const quint32 count = read16(ifd);
+    for (quint32 i = 0; i < count && ifd + 2 + (i + 1) * 12 <= size; ++i) {
+        const quint64 entry = ifd + 2 + i * 12;
+        switch (read16(entry)) {
+        case 0x0201: // JPEGInterchangeFormat
+            offset = read32(entry + 8);
+            break;
+        case 0x0202: // JPEGInterchangeFormatLength
+            length = read32(entry + 8);
+            break;
+        }
+    }
+
+    if (offset == 0 || length == 0 || quint64(offset) + length > size) {
+        return QByteArray();
+    }
+
+    return tiff.mid(offset, length);
+}
+
+/**
+ * Finds the thumbnail in the EXIF data at the start of a JPEG file
+ *
+ * @param data The start of the file
+ * @return The embedded JPEG thumbnail, empty if there is none in data
+ */
+QByteArray getExifThumbnail(const QByteArray &data)
 {
-    QString path;
+    const uchar *d = (const uchar *) data.constData();
+    const int size = data.size();
+
+    if (size < 4 || d[0] != 0xFF || d[1] != 0xD8) {
+        return QByteArray();
+    }
+
+    // walk the segments up to the image data, APP1 holds the EXIF data
+    int pos = 2;
+    while (pos + 4 <= size && d[pos] == 0xFF) {
+        const uchar marker = d[pos + 1];
+        const int length = (d[pos + 2] << 8) | d[pos + 3];
+
+        if (marker == 0xDA || marker == 0xD9 || length < 2) {
+            break;
+        }
 
-    for (int i = 0; i < elements && elements <= pathItems.size(); i++) {
-        path.append(QLatin1Char('/'));
-        path.append(pathItems.at(i));
+        if (marker == 0xE1 && length >= 8 && pos + 2 + length <= size && memcmp(d + pos + 4, "Exif\0\0", 6) == 0) {
+            return getTiffThumbnail(data.mid(pos + 10, length - 8));
+        }
+
+        pos += 2 + length;
     }
 
-    return path;
+    return QByteArray();
 }
 
 QString getMimetype(LIBMTP_filetype_t filetype)
@@ -283,23 +424,6 @@ QMap<QString, LIBMTP_devicestorage_t *> getDevicestorages(LIBMTP_mtpdevice_t *&d
     return storages;
 }
 
-QMap<QString, LIBMTP_file_t *> getFiles(LIBMTP_mtpdevice_t *&device, uint32_t storage_id, uint32_t parent_id)
-{
-    qCDebug(LOG_KIO_MTP) << "getFiles() for parent" << parent_id;
-
-    QMap<QString, LIBMTP_file_t *> fileMap;
-
-    LIBMTP_file_t *files = LIBMTP_Get_Files_And_Folders(device, storage_id, parent_id), *file;
-    for (file = files; file != nullptr; file = file->next) {
-        fileMap.insert(QString::fromUtf8(file->filename), file);
-        //         qCDebug(LOG_KIO_MTP) << "found file" << file->filename;
-    }
-
-    qCDebug(LOG_KIO_MTP) << "[EXIT]";
-
-    return fileMap;
-}
-
 void getEntry(UDSEntry &entry, LIBMTP_mtpdevice_t *device)
 {
     char *charName = LIBMTP_Get_Friendlyname(device);
@@ -27,17 +27,28 @@
 
 Q_DECLARE_LOGGING_CATEGORY(LOG_KIO_MTP)
 
+/**
+ * The source of an upload through dataGet, it holds what the job sent beyond what the device asked for
+ */
+struct DataGetSource {
+    MTPSlave *slave;
+    QByteArray buffer;
+    int offset = 0;
+    bool ended = false;
+};
+
 int dataProgress(uint64_t const sent, uint64_t const, void const *const priv);
 uint16_t dataPut(void *, void *priv, uint32_t sendlen, unsigned char *data, uint32_t *putlen);
-uint16_t dataGet(void *, void *priv, uint32_t, unsigned char *data, uint32_t *gotlen);
+uint16_t dataGet(void *, void *priv, uint32_t wantlen, unsigned char *data, uint32_t *gotlen);
+
+bool getPartialObject(LIBMTP_mtpdevice_t *device, uint32_t id, uint64_t offset, uint32_t maxbytes, QByteArray &buffer);
 
-QString convertToPath(const QStringList &pathItems, const int elements);
+QByteArray getExifThumbnail(const QByteArray &data);
 
 QString getMimetype(LIBMTP_filetype_t filetype);
 LIBMTP_filetype_t getFiletype(const QString &filename);
 
 QMap<QString, LIBMTP_devicestorage_t *> getDevicestorages(LIBMTP_mtpdevice_t *&device);
-QMap<QString, LIBMTP_file_t *> getFiles(LIBMTP_mtpdevice_t *&device, uint32_t storage_id, uint32_t parent_id = 0xFFFFFFFF);
 
 void getEntry(UDSEntry &entry, LIBMTP_mtpdevice_t *device);
 void getEntry(UDSEntry &entry, const LIBMTP_devicestorage_t *storage);
@@ -0,0 +1,343 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "kionfsbenchmark.h"
+#include "mocknfsserver.h"
+
+#include <kio/filejob.h>
+#include <kio/job.h>
+#include <kio/storedtransferjob.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <random>
+
+QTEST_GUILESS_MAIN(KioNfsBenchmark)
+
+static const int s_statCount = 1000;
+static const int s_linkEvery = 10;
+static const int s_randomReadCount = 200;
+static const int s_randomReadSize = 64 * 1024;
+
+void KioNfsBenchmark::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+    QVERIFY(QDir().mkpath(exportPath()));
+
+    m_latency = setting("KIO_NFS_BENCH_LATENCY", 1);
+
+    m_server = new MockNfsServer(exportPath());
+    m_server->moveToThread(&m_serverThread);
+    connect(&m_serverThread, &QThread::finished, m_server, &QObject::deleteLater);
+    m_serverThread.start();
+    QMetaObject::invokeMethod(m_server, "start", Qt::BlockingQueuedConnection);
+    QVERIFY(m_server->port() != 0);
+
+    useBuildTree(KIO_BENCHMARK_DATA_DIR);
+
+    m_fileSize = createRandomFile(exportPath(QStringLiteral("big")), setting("KIO_NFS_BENCH_FILE_MB", 16));
+    QVERIFY(m_fileSize > 0);
+
+    qInfo() << "mock NFS server on port" << m_server->port() << "latency" << m_latency << "ms";
+}
+
+void KioNfsBenchmark::cleanupTestCase()
+{
+    if (m_server) {
+        QMetaObject::invokeMethod(m_server, "stop", Qt::BlockingQueuedConnection);
+        m_serverThread.quit();
+        m_serverThread.wait();
+        m_server = nullptr;
+    }
+}
+
+void KioNfsBenchmark::init()
+{
+    m_server->setLatency(m_latency);
+    m_server->setPreferredSizes(64 * 1024, 64 * 1024, 8 * 1024);
+    m_server->setReadDirPlusSupported(true);
+}
+
+QUrl KioNfsBenchmark::exportUrl(const QString &path) const
+{
+    // with the port in the URL the slave doesn't ask for a portmapper
+    QUrl url;
+    url.setScheme(QStringLiteral("nfs"));
+    url.setHost(QStringLiteral("127.0.0.1"));
+    url.setPort(m_server->port());
+    url.setPath(QStringLiteral("/bench/") + path);
+    return url;
+}
+
+QString KioNfsBenchmark::exportPath(const QString &path) const
+{
+    return m_tempDir.path() + QStringLiteral("/export/") + path;
+}
+
+void KioNfsBenchmark::startMeasurement()
+{
+    m_server->resetCounters();
+    KioBenchmark::startMeasurement();
+}
+
+QString KioNfsBenchmark::counters(int count, qint64 msecs) const
+{
+    Q_UNUSED(msecs)
+
+    const quint64 calls = m_server->totalCalls();
+    QString line = QStringLiteral(", %1 calls (%2 per operation)")
+                   .arg(calls)
+                   .arg(double(calls) / qMax(count, 1), 0, 'f', 2);
+
+    QStringList procedures;
+    for (quint32 proc = NFSPROC3_NULL; proc <= NFSPROC3_COMMIT; ++proc) {
+        if (const quint64 procCalls = m_server->calls(proc)) {
+            procedures << QStringLiteral("%1 %2").arg(QLatin1String(MockNfsServer::procedureName(proc))).arg(procCalls);
+        }
+    }
+    if (!procedures.isEmpty()) {
+        line += QStringLiteral(" [") + procedures.join(QStringLiteral(", ")) + QLatin1Char(']');
+    }
+    return line;
+}
+
+void KioNfsBenchmark::benchListDir_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("readDirPlus");
+
+    const int large = setting("KIO_NFS_BENCH_LIST", 10000);
+
+    QTest::newRow("1k READDIRPLUS") << 1000 << true;
+    QTest::newRow("1k READDIR") << 1000 << false;
+    QTest::newRow("large READDIRPLUS") << large << true;
+    QTest::newRow("large READDIR") << large << false;
+}
+
+void KioNfsBenchmark::benchListDir()
+{
+    QFETCH(int, count);
+    QFETCH(bool, readDirPlus);
+
+    const QString dir = QStringLiteral("list%1").arg(count);
+    QVERIFY(createFiles(exportPath(dir), count, s_linkEvery));
+    m_server->setReadDirPlusSupported(readDirPlus);
+
+    int listed = 0;
+    int links = 0;
+    startMeasurement();
+    KIO::ListJob *job = KIO::listDir(exportUrl(dir), KIO::HideProgressInfo);
+    connect(job, &KIO::ListJob::entries, this, [&listed, &links](KIO::Job *, const KIO::UDSEntryList &entries) {
+        listed += entries.count();
+        for (const KIO::UDSEntry &entry : entries) {
+            if (entry.contains(KIO::UDSEntry::UDS_LINK_DEST)) {
+                ++links;
+            }
+        }
+    });
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("listDir"), 1);
+
+    QCOMPARE(listed, count);
+    QCOMPARE(links, count / s_linkEvery);
+}
+
+void KioNfsBenchmark::benchStatStorm()
+{
+    const QString dir = QStringLiteral("stat");
+    QVERIFY(createFiles(exportPath(dir), s_statCount, s_linkEvery));
+
+    startMeasurement();
+    for (int i = 0; i < s_statCount; ++i) {
+        const QString name = QStringLiteral("/file%1").arg(i, 6, 10, QLatin1Char('0'));
+        KIO::StatJob *job = KIO::stat(exportUrl(dir + name), KIO::HideProgressInfo);
+        QVERIFY2(job->exec(), qPrintable(job->errorString()));
+        QVERIFY(job->statResult().isDir() == false);
+    }
+    report(QStringLiteral("stat"), s_statCount);
+}
+
+void KioNfsBenchmark::benchGet_data()
+{
+    QTest::addColumn<int>("window");
+
+    QTest::newRow("window 1") << 1;
+    QTest::newRow("window 4") << 4;
+    QTest::newRow("window 16") << 16;
+    QTest::newRow("window 64") << 64;
+}
+
+void KioNfsBenchmark::benchGet()
+{
+    QFETCH(int, window);
+
+    startMeasurement();
+    KIO::StoredTransferJob *job = KIO::storedGet(exportUrl(QStringLiteral("big")), KIO::NoReload, KIO::HideProgressInfo);
+    job->addMetaData(QStringLiteral("ReadWindow"), QString::number(window));
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("get"), 1, m_fileSize);
+
+    QCOMPARE(qint64(job->data().size()), m_fileSize);
+    QCOMPARE(QCryptographicHash::hash(job->data(), QCryptographicHash::Sha1),
+             fileHash(exportPath(QStringLiteral("big"))));
+}
+
+void KioNfsBenchmark::benchPut_data()
+{
+    QTest::addColumn<int>("window");
+
+    QTest::newRow("window 1") << 1;
+    QTest::newRow("window 16") << 16;
+}
+
+void KioNfsBenchmark::benchPut()
+{
+    QFETCH(int, window);
+
+    QFile src(exportPath(QStringLiteral("big")));
+    QVERIFY(src.open(QIODevice::ReadOnly));
+    const QByteArray data = src.readAll();
+    QFile::remove(exportPath(QStringLiteral("put")));
+
+    startMeasurement();
+    KIO::StoredTransferJob *job = KIO::storedPut(data, exportUrl(QStringLiteral("put")), -1, KIO::HideProgressInfo);
+    job->addMetaData(QStringLiteral("WriteWindow"), QString::number(window));
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("put"), 1, m_fileSize);
+
+    QCOMPARE(fileHash(exportPath(QStringLiteral("put"))), QCryptographicHash::hash(data, QCryptographicHash::Sha1));
+}
+
+void KioNfsBenchmark::benchCopy()
+{
+    QFile::remove(exportPath(QStringLiteral("copy")));
+
+    startMeasurement();
+    KIO::FileCopyJob *job = KIO::file_copy(exportUrl(QStringLiteral("big")), exportUrl(QStringLiteral("copy")),
+                                           -1, KIO::HideProgressInfo);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("copy"), 1, m_fileSize);
+
+    QCOMPARE(fileHash(exportPath(QStringLiteral("copy"))), fileHash(exportPath(QStringLiteral("big"))));
+}
+
+void KioNfsBenchmark::benchFileJobRandomRead()
+{
+    QFile reference(exportPath(QStringLiteral("big")));
+    QVERIFY(reference.open(QIODevice::ReadOnly));
+
+    startMeasurement();
+    KIO::FileJob *job = KIO::open(exportUrl(QStringLiteral("big")), QIODevice::ReadOnly);
+    QSignalSpy openSpy(job, &KIO::FileJob::open);
+    QVERIFY(openSpy.wait(10000));
+
+    QSignalSpy positionSpy(job, &KIO::FileJob::position);
+    QSignalSpy dataSpy(job, &KIO::FileJob::data);
+    for (int i = 0; i < s_randomReadCount; ++i) {
+        const qint64 offset = std::uniform_int_distribution<qint64>(0, m_fileSize - s_randomReadSize)(random());
+
+        job->seek(offset);
+        QVERIFY(positionSpy.count() > i || positionSpy.wait(10000));
+
+        job->read(s_randomReadSize);
+        QVERIFY(dataSpy.count() > i || dataSpy.wait(10000));
+
+        const QByteArray data = dataSpy.at(i).at(1).toByteArray();
+        reference.seek(offset);
+        QCOMPARE(data, reference.read(data.size()));
+    }
+
+    job->close();
+    report(QStringLiteral("FileJob random read"), s_randomReadCount, quint64(s_randomReadCount) * s_randomReadSize);
+}
+
+void KioNfsBenchmark::testReadError()
+{
+    // somewhere in the middle of the file, with reads outstanding
+    m_server->failCall(NFSPROC3_READ, 10, NFS3ERR_IO);
+
+    KIO::StoredTransferJob *job = KIO::storedGet(exportUrl(QStringLiteral("big")), KIO::NoReload, KIO::HideProgressInfo);
+    QVERIFY(!job->exec());
+    QVERIFY(job->error() != 0);
+}
+
+void KioNfsBenchmark::testDroppedConnection()
+{
+    // the server goes away without answering, the job has to fail rather
+    // than wait for replies that never come
+    m_server->failCall(NFSPROC3_READ, 10, 0);
+
+    QElapsedTimer timer;
+    timer.start();
+    KIO::StoredTransferJob *job = KIO::storedGet(exportUrl(QStringLiteral("big")), KIO::NoReload, KIO::HideProgressInfo);
+    QVERIFY(!job->exec());
+    QVERIFY(job->error() != 0);
+    QVERIFY(timer.elapsed() < 20000);
+
+    // and the next job gets a working connection again
+    KIO::StatJob *stat = KIO::stat(exportUrl(QStringLiteral("big")), KIO::HideProgressInfo);
+    QVERIFY2(stat->exec(), qPrintable(stat->errorString()));
+}
+
+void KioNfsBenchmark::testRebootDuringPut()
+{
+    QFile src(exportPath(QStringLiteral("big")));
+    QVERIFY(src.open(QIODevice::ReadOnly));
+    const QByteArray data = src.readAll();
+    QFile::remove(exportPath(QStringLiteral("rebooted")));
+
+    m_server->resetCounters();
+    KIO::StoredTransferJob *job = KIO::storedPut(data, exportUrl(QStringLiteral("rebooted")), -1, KIO::HideProgressInfo);
+    QSignalSpy resultSpy(job, &KJob::result);
+
+    // once unstable writes are out, the server loses them
+    while (m_server->calls(NFSPROC3_WRITE) == 0 && resultSpy.isEmpty()) {
+        QTest::qWait(1);
+    }
+    m_server->reboot();
+
+    QVERIFY(!resultSpy.isEmpty() || resultSpy.wait(60000));
+    QVERIFY2(job->error() == 0, qPrintable(job->errorString()));
+    QCOMPARE(fileHash(exportPath(QStringLiteral("rebooted"))), QCryptographicHash::hash(data, QCryptographicHash::Sha1));
+}
+
+void KioNfsBenchmark::testOpenCreatesFile()
+{
+    QFile::remove(exportPath(QStringLiteral("opened")));
+
+    KIO::FileJob *job = KIO::open(exportUrl(QStringLiteral("opened")), QIODevice::WriteOnly);
+    QSignalSpy openSpy(job, &KIO::FileJob::open);
+    QVERIFY2(openSpy.wait(10000), qPrintable(job->errorString()));
+
+    QSignalSpy writtenSpy(job, &KIO::FileJob::written);
+    job->write(QByteArrayLiteral("created by open"));
+    QVERIFY(writtenSpy.wait(10000));
+
+    QSignalSpy closeSpy(job, &KIO::FileJob::close);
+    job->close();
+    QVERIFY(closeSpy.wait(10000));
+
+    QFile created(exportPath(QStringLiteral("opened")));
+    QVERIFY(created.open(QIODevice::ReadOnly));
+    QCOMPARE(created.readAll(), QByteArrayLiteral("created by open"));
+}
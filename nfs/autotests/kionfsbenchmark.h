@@ -0,0 +1,82 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIONFSBENCHMARK_H
+#define KIONFSBENCHMARK_H
+
+#include "kiobenchmark.h"
+
+#include <QTemporaryDir>
+#include <QThread>
+#include <QUrl>
+
+class MockNfsServer;
+
+/**
+ * Benchmark and regression harness for kio_nfs.
+ *
+ * Runs the slave against MockNfsServer, which serves a generated directory
+ * from this process, so it needs neither root nor a kernel NFS server and
+ * is deterministic enough for CI.  Every test prints time, NFS calls per
+ * operation and throughput, and checks that the results are correct; the
+ * failure tests check that injected errors reach the job.
+ *
+ * Knobs (environment):
+ *   KIO_NFS_BENCH_LATENCY   latency in ms the server adds to every reply
+ *                           (default 1, so that the window sizes matter)
+ *   KIO_NFS_BENCH_FILE_MB   size of the transfer test file (default 16)
+ *   KIO_NFS_BENCH_LIST      entries in the large listing (default 10000)
+ */
+class KioNfsBenchmark : public KioBenchmark
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void benchListDir_data();
+    void benchListDir();
+    void benchStatStorm();
+    void benchGet_data();
+    void benchGet();
+    void benchPut_data();
+    void benchPut();
+    void benchCopy();
+    void benchFileJobRandomRead();
+
+    void testReadError();
+    void testDroppedConnection();
+    void testRebootDuringPut();
+    void testOpenCreatesFile();
+
+private:
+    QUrl exportUrl(const QString &path = QString()) const;
+    QString exportPath(const QString &path = QString()) const;
+    void startMeasurement() override;
+    QString counters(int count, qint64 msecs) const override;
+
+    QTemporaryDir m_tempDir;
+    QThread m_serverThread;
+    MockNfsServer *m_server = nullptr;
+    int m_latency = 1;
+    qint64 m_fileSize = 0;
+};
+
+#endif
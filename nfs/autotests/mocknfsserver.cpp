@@ -0,0 +1,1179 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "mocknfsserver.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QHostAddress>
+#include <QMutexLocker>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+// the path the directory is exported as
+static const char s_exportName[] = "/bench";
+
+// what the server accepts in a single READ or WRITE
+static const quint32 s_maxTransfer = 1024 * 1024;
+
+static const quint32 s_lastFragment = 0x80000000u;
+
+// the space an entry takes in a READDIR reply, without its name
+static const u_int s_entrySize = 24;
+// ... and in a READDIRPLUS reply, with attributes and handle
+static const u_int s_entryPlusSize = 24 + 88 + 20;
+
+static nfsstat3 errnoStatus(int error)
+{
+    switch (error) {
+    case EPERM:
+        return NFS3ERR_PERM;
+    case ENOENT:
+        return NFS3ERR_NOENT;
+    case EACCES:
+        return NFS3ERR_ACCES;
+    case EEXIST:
+        return NFS3ERR_EXIST;
+    case ENOTDIR:
+        return NFS3ERR_NOTDIR;
+    case EISDIR:
+        return NFS3ERR_ISDIR;
+    case EINVAL:
+        return NFS3ERR_INVAL;
+    case EFBIG:
+        return NFS3ERR_FBIG;
+    case ENOSPC:
+        return NFS3ERR_NOSPC;
+    case EROFS:
+        return NFS3ERR_ROFS;
+    case ENAMETOOLONG:
+        return NFS3ERR_NAMETOOLONG;
+    case ENOTEMPTY:
+        return NFS3ERR_NOTEMPTY;
+    default:
+        return NFS3ERR_IO;
+    }
+}
+
+MockNfsServer::MockNfsServer(const QString &exportPath)
+    : m_exportPath(QFile::encodeName(exportPath)),
+      m_port(0),
+      m_server(nullptr),
+      m_latency(0),
+      m_rtpref(64 * 1024),
+      m_wtpref(64 * 1024),
+      m_dtpref(8 * 1024),
+      m_readDirPlus(true),
+      m_verifier(1)
+{
+}
+
+void MockNfsServer::setLatency(int ms)
+{
+    QMutexLocker locker(&m_mutex);
+    m_latency = ms;
+}
+
+void MockNfsServer::setPreferredSizes(quint32 rtpref, quint32 wtpref, quint32 dtpref)
+{
+    QMutexLocker locker(&m_mutex);
+    m_rtpref = rtpref;
+    m_wtpref = wtpref;
+    m_dtpref = dtpref;
+}
+
+void MockNfsServer::setReadDirPlusSupported(bool supported)
+{
+    QMutexLocker locker(&m_mutex);
+    m_readDirPlus = supported;
+}
+
+void MockNfsServer::failCall(quint32 proc, int count, int nfsStatus)
+{
+    QMutexLocker locker(&m_mutex);
+    m_failures.append({ proc, count, nfsStatus });
+}
+
+void MockNfsServer::reboot()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_verifier;
+}
+
+quint64 MockNfsServer::calls(quint32 proc) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_calls.value(proc);
+}
+
+quint64 MockNfsServer::totalCalls() const
+{
+    QMutexLocker locker(&m_mutex);
+    quint64 total = 0;
+    for (quint64 calls : m_calls) {
+        total += calls;
+    }
+    return total;
+}
+
+void MockNfsServer::resetCounters()
+{
+    QMutexLocker locker(&m_mutex);
+    m_calls.clear();
+}
+
+const char *MockNfsServer::procedureName(quint32 proc)
+{
+    static const char *const names[] = {
+        "NULL", "GETATTR", "SETATTR", "LOOKUP", "ACCESS", "READLINK", "READ", "WRITE",
+        "CREATE", "MKDIR", "SYMLINK", "MKNOD", "REMOVE", "RMDIR", "RENAME", "LINK",
+        "READDIR", "READDIRPLUS", "FSSTAT", "FSINFO", "PATHCONF", "COMMIT"
+    };
+    return proc < sizeof(names) / sizeof(names[0]) ? names[proc] : "?";
+}
+
+void MockNfsServer::start()
+{
+    handle(m_exportPath);
+
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &MockNfsServer::newConnection);
+    if (!m_server->listen(QHostAddress::LocalHost)) {
+        qWarning() << "mock NFS server cannot listen:" << m_server->errorString();
+        return;
+    }
+    m_port = m_server->serverPort();
+}
+
+void MockNfsServer::stop()
+{
+    delete m_server;
+    m_server = nullptr;
+    qDeleteAll(findChildren<QTcpSocket *>());
+    m_input.clear();
+}
+
+void MockNfsServer::newConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        socket->setParent(this);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readCalls(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_input.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MockNfsServer::readCalls(QTcpSocket *socket)
+{
+    if (!m_input.contains(socket) && socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    m_input[socket] += socket->readAll();
+
+    forever {
+        const QByteArray &input = m_input[socket];
+
+        // a call may be split into several fragments
+        QByteArray record;
+        int pos = 0;
+        bool complete = false;
+        while (!complete && pos + 4 <= input.size()) {
+            const quint32 mark = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(input.constData() + pos));
+            const int length = int(mark & ~s_lastFragment);
+            if (pos + 4 + length > input.size()) {
+                break;
+            }
+            record += input.mid(pos + 4, length);
+            pos += 4 + length;
+            complete = (mark & s_lastFragment) != 0;
+        }
+        if (!complete) {
+            return;
+        }
+        m_input[socket].remove(0, pos);
+
+        bool drop = false;
+        const QByteArray reply = handleCall(record, drop);
+        if (drop) {
+            m_input.remove(socket);
+            socket->abort();
+            return;
+        }
+        if (!reply.isEmpty()) {
+            sendReply(socket, reply);
+        }
+    }
+}
+
+void MockNfsServer::sendReply(QTcpSocket *socket, const QByteArray &reply)
+{
+    int latency;
+    {
+        QMutexLocker locker(&m_mutex);
+        latency = m_latency;
+    }
+
+    if (latency <= 0) {
+        socket->write(reply);
+        return;
+    }
+
+    // timers with the same interval fire in the order they were started,
+    // so the replies keep their order
+    QTimer::singleShot(latency, Qt::PreciseTimer, socket, [socket, reply]() { socket->write(reply); });
+}
+
+QByteArray MockNfsServer::handleCall(const QByteArray &record, bool &drop)
+{
+    XDR xdr;
+    xdrmem_create(&xdr, const_cast<char *>(record.constData()), record.size(), XDR_DECODE);
+
+    char credentials[MAX_AUTH_BYTES];
+    char verifier[MAX_AUTH_BYTES];
+    rpc_msg call;
+    memset(&call, 0, sizeof(call));
+    call.rm_call.cb_cred.oa_base = credentials;
+    call.rm_call.cb_verf.oa_base = verifier;
+
+    if (!xdr_callmsg(&xdr, &call) || call.rm_direction != CALL) {
+        XDR_DESTROY(&xdr);
+        drop = true;
+        return QByteArray();
+    }
+
+    const quint32 xid = call.rm_xid;
+    const u_long prog = call.rm_call.cb_prog;
+    const u_long vers = call.rm_call.cb_vers;
+    const quint32 proc = call.rm_call.cb_proc;
+
+    QByteArray reply;
+    if (prog != MOUNT_PROGRAM && prog != NFS_PROGRAM) {
+        reply = acceptedReply(xid, PROG_UNAVAIL);
+    } else if (vers != 3) {
+        reply = acceptedReply(xid, PROG_MISMATCH);
+    } else if (prog == MOUNT_PROGRAM) {
+        switch (proc) {
+        case MOUNTPROC3_NULL:
+        case MOUNTPROC3_UMNT:
+        case MOUNTPROC3_UMNTALL:
+            reply = acceptedReply(xid, SUCCESS);
+            break;
+        case MOUNTPROC3_MNT:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_dirpath3, (xdrproc_t) xdr_mountres3, &MockNfsServer::mount);
+            break;
+        case MOUNTPROC3_DUMP: {
+            mountlist3 list = nullptr;
+            reply = acceptedReply(xid, SUCCESS, (xdrproc_t) xdr_mountlist3, &list);
+            break;
+        }
+        case MOUNTPROC3_EXPORT:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_void, (xdrproc_t) xdr_exports3, &MockNfsServer::exportList);
+            break;
+        default:
+            reply = acceptedReply(xid, PROC_UNAVAIL);
+            break;
+        }
+    } else {
+        int failStatus = -1;
+        {
+            QMutexLocker locker(&m_mutex);
+            ++m_calls[proc];
+            for (int i = 0; i < m_failures.size(); ++i) {
+                Failure &failure = m_failures[i];
+                if (failure.proc == proc && --failure.count <= 0) {
+                    failStatus = failure.nfsStatus;
+                    m_failures.removeAt(i);
+                    break;
+                }
+            }
+            if (proc == NFSPROC3_READDIRPLUS && !m_readDirPlus && failStatus < 0) {
+                failStatus = NFS3ERR_NOTSUPP;
+            }
+        }
+
+        if (failStatus == 0) {
+            XDR_DESTROY(&xdr);
+            drop = true;
+            return QByteArray();
+        }
+
+        switch (proc) {
+        case NFSPROC3_NULL:
+            reply = acceptedReply(xid, SUCCESS);
+            break;
+        case NFSPROC3_GETATTR:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_GETATTR3args, (xdrproc_t) xdr_GETATTR3res, &MockNfsServer::getAttr, failStatus);
+            break;
+        case NFSPROC3_SETATTR:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_SETATTR3args, (xdrproc_t) xdr_SETATTR3res, &MockNfsServer::setAttr, failStatus);
+            break;
+        case NFSPROC3_LOOKUP:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_LOOKUP3args, (xdrproc_t) xdr_LOOKUP3res, &MockNfsServer::lookup, failStatus);
+            break;
+        case NFSPROC3_ACCESS:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_ACCESS3args, (xdrproc_t) xdr_ACCESS3res, &MockNfsServer::access, failStatus);
+            break;
+        case NFSPROC3_READLINK:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_READLINK3args, (xdrproc_t) xdr_READLINK3res, &MockNfsServer::readLink, failStatus);
+            break;
+        case NFSPROC3_READ:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_READ3args, (xdrproc_t) xdr_READ3res, &MockNfsServer::read, failStatus);
+            break;
+        case NFSPROC3_WRITE:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_WRITE3args, (xdrproc_t) xdr_WRITE3res, &MockNfsServer::write, failStatus);
+            break;
+        case NFSPROC3_CREATE:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_CREATE3args, (xdrproc_t) xdr_CREATE3res, &MockNfsServer::create, failStatus);
+            break;
+        case NFSPROC3_MKDIR:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_MKDIR3args, (xdrproc_t) xdr_MKDIR3res, &MockNfsServer::makeDir, failStatus);
+            break;
+        case NFSPROC3_SYMLINK:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_SYMLINK3args, (xdrproc_t) xdr_SYMLINK3res, &MockNfsServer::symLink, failStatus);
+            break;
+        case NFSPROC3_REMOVE:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_REMOVE3args, (xdrproc_t) xdr_REMOVE3res, &MockNfsServer::remove, failStatus);
+            break;
+        case NFSPROC3_RMDIR:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_RMDIR3args, (xdrproc_t) xdr_RMDIR3res, &MockNfsServer::removeDir, failStatus);
+            break;
+        case NFSPROC3_RENAME:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_RENAME3args, (xdrproc_t) xdr_RENAME3res, &MockNfsServer::rename, failStatus);
+            break;
+        case NFSPROC3_READDIR:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_READDIR3args, (xdrproc_t) xdr_READDIR3res, &MockNfsServer::readDir, failStatus);
+            break;
+        case NFSPROC3_READDIRPLUS:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_READDIRPLUS3args, (xdrproc_t) xdr_READDIRPLUS3res, &MockNfsServer::readDirPlus, failStatus);
+            break;
+        case NFSPROC3_FSSTAT:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_FSSTAT3args, (xdrproc_t) xdr_FSSTAT3res, &MockNfsServer::fsStat, failStatus);
+            break;
+        case NFSPROC3_FSINFO:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_FSINFO3args, (xdrproc_t) xdr_FSINFO3res, &MockNfsServer::fsInfo, failStatus);
+            break;
+        case NFSPROC3_PATHCONF:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_PATHCONF3args, (xdrproc_t) xdr_PATHCONF3res, &MockNfsServer::pathConf, failStatus);
+            break;
+        case NFSPROC3_COMMIT:
+            reply = serve(&xdr, xid, (xdrproc_t) xdr_COMMIT3args, (xdrproc_t) xdr_COMMIT3res, &MockNfsServer::commit, failStatus);
+            break;
+        default:
+            reply = acceptedReply(xid, PROC_UNAVAIL);
+            break;
+        }
+    }
+
+    XDR_DESTROY(&xdr);
+    return reply;
+}
+
+template<typename Args, typename Res>
+QByteArray MockNfsServer::serve(XDR *xdr, quint32 xid, xdrproc_t xargs, xdrproc_t xres,
+                                void (MockNfsServer::*handler)(const Args &, Res &), int failStatus)
+{
+    Args args;
+    memset(&args, 0, sizeof(args));
+    if (!xargs(xdr, &args)) {
+        xdr_free(xargs, reinterpret_cast<char *>(&args));
+        return acceptedReply(xid, GARBAGE_ARGS);
+    }
+
+    Res res;
+    memset(&res, 0, sizeof(res));
+    if (failStatus > 0) {
+        // every NFSv3 result starts with its status, and an empty failure
+        // branch is valid
+        *reinterpret_cast<nfsstat3 *>(&res) = nfsstat3(failStatus);
+    } else {
+        (this->*handler)(args, res);
+    }
+
+    const QByteArray reply = acceptedReply(xid, SUCCESS, xres, &res);
+
+    xdr_free(xargs, reinterpret_cast<char *>(&args));
+    m_scratch.clear();
+
+    return reply;
+}
+
+QByteArray MockNfsServer::acceptedReply(quint32 xid, int acceptStatus, xdrproc_t xres, void *res)
+{
+    rpc_msg reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.rm_xid = xid;
+    reply.rm_direction = REPLY;
+    reply.rm_reply.rp_stat = MSG_ACCEPTED;
+    reply.acpted_rply.ar_verf = _null_auth;
+    reply.acpted_rply.ar_stat = accept_stat(acceptStatus);
+
+    u_int size = 64;
+    if (acceptStatus == SUCCESS) {
+        if (xres == nullptr) {
+            xres = (xdrproc_t) xdr_void;
+        } else {
+            size += xdr_sizeof(xres, res);
+        }
+        reply.acpted_rply.ar_results.where = reinterpret_cast<caddr_t>(res);
+        reply.acpted_rply.ar_results.proc = xres;
+    } else if (acceptStatus == PROG_MISMATCH) {
+        reply.acpted_rply.ar_vers.low = 3;
+        reply.acpted_rply.ar_vers.high = 3;
+    }
+
+    QByteArray buffer(int(4 + size), '\0');
+    XDR xdr;
+    xdrmem_create(&xdr, buffer.data() + 4, size, XDR_ENCODE);
+    const bool encoded = xdr_replymsg(&xdr, &reply);
+    const u_int length = xdr_getpos(&xdr);
+    XDR_DESTROY(&xdr);
+
+    if (!encoded) {
+        qWarning() << "mock NFS server cannot encode reply";
+        return QByteArray();
+    }
+
+    buffer.resize(int(4 + length));
+    qToBigEndian<quint32>(s_lastFragment | length, reinterpret_cast<uchar *>(buffer.data()));
+    return buffer;
+}
+
+char *MockNfsServer::scratch(const QByteArray &data)
+{
+    m_scratch.append(data);
+    return m_scratch.last().data();
+}
+
+nfs_fh3 MockNfsServer::handle(const QByteArray &path)
+{
+    quint32 id = m_handleIds.value(path, quint32(m_paths.size()));
+    if (id == quint32(m_paths.size())) {
+        QByteArray data("KIOT", 4);
+        data.resize(8);
+        qToBigEndian<quint32>(id, reinterpret_cast<uchar *>(data.data() + 4));
+
+        m_paths.append(path);
+        m_handles.append(data);
+        m_handleIds.insert(path, id);
+    }
+
+    // the data of the QByteArray doesn't move with the vector
+    nfs_fh3 fh;
+    fh.data.data_len = 8;
+    fh.data.data_val = const_cast<char *>(m_handles.at(id).constData());
+    return fh;
+}
+
+bool MockNfsServer::path(const nfs_fh3 &fh, QByteArray &path) const
+{
+    if (fh.data.data_len != 8 || memcmp(fh.data.data_val, "KIOT", 4) != 0) {
+        return false;
+    }
+
+    const quint32 id = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(fh.data.data_val + 4));
+    if (id >= quint32(m_paths.size())) {
+        return false;
+    }
+
+    path = m_paths.at(id);
+    return true;
+}
+
+bool MockNfsServer::childPath(const diropargs3 &args, QByteArray &path, nfsstat3 &status) const
+{
+    QByteArray dirPath;
+    if (!this->path(args.dir, dirPath)) {
+        status = NFS3ERR_STALE;
+        return false;
+    }
+
+    const QByteArray name(args.name);
+    if (name.isEmpty() || name.contains('/')) {
+        status = NFS3ERR_INVAL;
+        return false;
+    }
+
+    if (name == ".") {
+        path = dirPath;
+    } else if (name == "..") {
+        path = dirPath == m_exportPath ? dirPath : dirPath.left(dirPath.lastIndexOf('/'));
+    } else {
+        path = dirPath + '/' + name;
+    }
+    return true;
+}
+
+void MockNfsServer::renamed(const QByteArray &from, const QByteArray &to)
+{
+    for (int id = 0; id < m_paths.size(); ++id) {
+        const QByteArray &path = m_paths.at(id);
+        if (path == from || path.startsWith(from + '/')) {
+            const QByteArray newPath = to + path.mid(from.size());
+            m_handleIds.remove(path);
+            m_handleIds.insert(newPath, quint32(id));
+            m_paths[id] = newPath;
+        }
+    }
+}
+
+bool MockNfsServer::attributes(const QByteArray &path, fattr3 &attributes) const
+{
+    struct stat st;
+    if (lstat(path.constData(), &st) != 0) {
+        return false;
+    }
+
+    memset(&attributes, 0, sizeof(attributes));
+    if (S_ISDIR(st.st_mode)) {
+        attributes.type = NF3DIR;
+    } else if (S_ISLNK(st.st_mode)) {
+        attributes.type = NF3LNK;
+    } else if (S_ISBLK(st.st_mode)) {
+        attributes.type = NF3BLK;
+    } else if (S_ISCHR(st.st_mode)) {
+        attributes.type = NF3CHR;
+    } else if (S_ISSOCK(st.st_mode)) {
+        attributes.type = NF3SOCK;
+    } else if (S_ISFIFO(st.st_mode)) {
+        attributes.type = NF3FIFO;
+    } else {
+        attributes.type = NF3REG;
+    }
+    attributes.mode = st.st_mode & 07777;
+    attributes.nlink = st.st_nlink;
+    attributes.uid = st.st_uid;
+    attributes.gid = st.st_gid;
+    attributes.size = st.st_size;
+    attributes.used = quint64(st.st_blocks) * 512;
+    attributes.rdev.specdata1 = major(st.st_rdev);
+    attributes.rdev.specdata2 = minor(st.st_rdev);
+    attributes.fsid = st.st_dev;
+    attributes.fileid = st.st_ino;
+    attributes.atime.seconds = st.st_atim.tv_sec;
+    attributes.atime.nseconds = st.st_atim.tv_nsec;
+    attributes.mtime.seconds = st.st_mtim.tv_sec;
+    attributes.mtime.nseconds = st.st_mtim.tv_nsec;
+    attributes.ctime.seconds = st.st_ctim.tv_sec;
+    attributes.ctime.nseconds = st.st_ctim.tv_nsec;
+    return true;
+}
+
+void MockNfsServer::postOpAttr(const QByteArray &path, post_op_attr &attributes) const
+{
+    attributes.attributes_follow = this->attributes(path, attributes.post_op_attr_u.attributes);
+}
+
+void MockNfsServer::postOpFh(const QByteArray &path, post_op_fh3 &fh)
+{
+    fh.handle_follows = true;
+    fh.post_op_fh3_u.handle = handle(path);
+}
+
+void MockNfsServer::wccData(const QByteArray &path, wcc_data &wcc) const
+{
+    wcc.before.attributes_follow = false;
+    postOpAttr(path, wcc.after);
+}
+
+void MockNfsServer::applyAttributes(const QByteArray &path, const sattr3 &attributes)
+{
+    if (attributes.mode.set_it) {
+        chmod(path.constData(), attributes.mode.set_mode3_u.mode);
+    }
+    if (attributes.uid.set_it || attributes.gid.set_it) {
+        lchown(path.constData(),
+               attributes.uid.set_it ? uid_t(attributes.uid.set_uid3_u.uid) : uid_t(-1),
+               attributes.gid.set_it ? gid_t(attributes.gid.set_gid3_u.gid) : gid_t(-1));
+    }
+    if (attributes.size.set_it) {
+        truncate(path.constData(), attributes.size.set_size3_u.size);
+    }
+
+    timespec times[2];
+    const set_atime &atime = attributes.atime;
+    const set_mtime &mtime = attributes.mtime;
+    times[0].tv_sec = atime.set_it == SET_TO_CLIENT_TIME ? atime.set_atime_u.atime.seconds : 0;
+    times[0].tv_nsec = atime.set_it == SET_TO_CLIENT_TIME ? long(atime.set_atime_u.atime.nseconds)
+                       : atime.set_it == SET_TO_SERVER_TIME ? UTIME_NOW : UTIME_OMIT;
+    times[1].tv_sec = mtime.set_it == SET_TO_CLIENT_TIME ? mtime.set_mtime_u.mtime.seconds : 0;
+    times[1].tv_nsec = mtime.set_it == SET_TO_CLIENT_TIME ? long(mtime.set_mtime_u.mtime.nseconds)
+                       : mtime.set_it == SET_TO_SERVER_TIME ? UTIME_NOW : UTIME_OMIT;
+    if (atime.set_it != DONT_CHANGE || mtime.set_it != DONT_CHANGE) {
+        utimensat(AT_FDCWD, path.constData(), times, AT_SYMLINK_NOFOLLOW);
+    }
+}
+
+const QList<QByteArray> &MockNfsServer::listing(const QByteArray &path, quint64 cookie)
+{
+    // read the directory once per listing, not once per page
+    if (cookie == 0 || !m_listings.contains(path)) {
+        QList<QByteArray> names;
+        if (DIR *dir = opendir(path.constData())) {
+            while (dirent *entry = readdir(dir)) {
+                names.append(QByteArray(entry->d_name));
+            }
+            closedir(dir);
+        }
+        // sorted, so pages come out the same on every run
+        std::sort(names.begin(), names.end());
+        m_listings.insert(path, names);
+    }
+    return m_listings[path];
+}
+
+void MockNfsServer::mount(char *const &path, mountres3 &res)
+{
+    if (qstrcmp(path, s_exportName) != 0) {
+        res.fhs_status = MNT3ERR_NOENT;
+        return;
+    }
+
+    static int flavors[] = { AUTH_UNIX };
+
+    const nfs_fh3 fh = handle(m_exportPath);
+    res.fhs_status = MNT3_OK;
+    res.mountres3_u.mountinfo.fhandle.fhandle3_len = fh.data.data_len;
+    res.mountres3_u.mountinfo.fhandle.fhandle3_val = fh.data.data_val;
+    res.mountres3_u.mountinfo.auth_flavors.auth_flavors_len = 1;
+    res.mountres3_u.mountinfo.auth_flavors.auth_flavors_val = flavors;
+}
+
+void MockNfsServer::exportList(const int &, exports3 &res)
+{
+    exportnode3 *node = reinterpret_cast<exportnode3 *>(scratch(QByteArray(sizeof(exportnode3), '\0')));
+    node->ex_dir = scratch(QByteArray(s_exportName));
+    res = node;
+}
+
+void MockNfsServer::getAttr(const GETATTR3args &args, GETATTR3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.object, filePath)) {
+        res.status = NFS3ERR_STALE;
+    } else if (!attributes(filePath, res.GETATTR3res_u.resok.obj_attributes)) {
+        res.status = NFS3ERR_STALE;
+    }
+}
+
+void MockNfsServer::setAttr(const SETATTR3args &args, SETATTR3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.object, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    fattr3 current;
+    if (!attributes(filePath, current)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    applyAttributes(filePath, args.new_attributes);
+    wccData(filePath, res.SETATTR3res_u.resok.obj_wcc);
+}
+
+void MockNfsServer::lookup(const LOOKUP3args &args, LOOKUP3res &res)
+{
+    QByteArray filePath;
+    nfsstat3 status;
+    if (!childPath(args.what, filePath, status)) {
+        res.status = status;
+        return;
+    }
+
+    LOOKUP3resok &resok = res.LOOKUP3res_u.resok;
+    if (!attributes(filePath, resok.obj_attributes.post_op_attr_u.attributes)) {
+        res.status = NFS3ERR_NOENT;
+        return;
+    }
+
+    resok.obj_attributes.attributes_follow = true;
+    resok.object = handle(filePath);
+    postOpAttr(filePath.left(filePath.lastIndexOf('/')), resok.dir_attributes);
+}
+
+void MockNfsServer::access(const ACCESS3args &args, ACCESS3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.object, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    postOpAttr(filePath, res.ACCESS3res_u.resok.obj_attributes);
+    res.ACCESS3res_u.resok.access = args.access;
+}
+
+void MockNfsServer::readLink(const READLINK3args &args, READLINK3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.symlink, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    char target[PATH_MAX];
+    const ssize_t length = readlink(filePath.constData(), target, sizeof(target) - 1);
+    if (length < 0) {
+        res.status = errno == EINVAL ? NFS3ERR_INVAL : errnoStatus(errno);
+        return;
+    }
+
+    postOpAttr(filePath, res.READLINK3res_u.resok.symlink_attributes);
+    res.READLINK3res_u.resok.data = scratch(QByteArray(target, int(length)));
+}
+
+void MockNfsServer::read(const READ3args &args, READ3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.file, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    const int fd = ::open(filePath.constData(), O_RDONLY);
+    if (fd < 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    const u_int count = qMin<u_int>(args.count, s_maxTransfer);
+    QByteArray data(int(count), Qt::Uninitialized);
+    const ssize_t length = pread(fd, data.data(), count, off_t(args.offset));
+    const int error = errno;
+    ::close(fd);
+
+    if (length < 0) {
+        res.status = errnoStatus(error);
+        return;
+    }
+
+    READ3resok &resok = res.READ3res_u.resok;
+    postOpAttr(filePath, resok.file_attributes);
+    resok.count = u_int(length);
+    resok.eof = !resok.file_attributes.attributes_follow ||
+                args.offset + length >= resok.file_attributes.post_op_attr_u.attributes.size;
+    resok.data.data_len = u_int(length);
+    resok.data.data_val = scratch(data.left(int(length)));
+}
+
+void MockNfsServer::write(const WRITE3args &args, WRITE3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.file, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    const int fd = ::open(filePath.constData(), O_WRONLY);
+    if (fd < 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    const u_int count = qMin<u_int>(qMin<u_int>(args.count, args.data.data_len), s_maxTransfer);
+    const ssize_t length = pwrite(fd, args.data.data_val, count, off_t(args.offset));
+    const int error = errno;
+    if (length >= 0 && args.stable != UNSTABLE) {
+        fdatasync(fd);
+    }
+    ::close(fd);
+
+    if (length < 0) {
+        res.status = errnoStatus(error);
+        return;
+    }
+
+    quint64 verifier;
+    {
+        QMutexLocker locker(&m_mutex);
+        verifier = m_verifier;
+    }
+
+    WRITE3resok &resok = res.WRITE3res_u.resok;
+    wccData(filePath, resok.file_wcc);
+    resok.count = u_int(length);
+    resok.committed = args.stable;
+    memcpy(resok.verf, &verifier, NFS3_WRITEVERFSIZE);
+}
+
+void MockNfsServer::create(const CREATE3args &args, CREATE3res &res)
+{
+    QByteArray filePath;
+    nfsstat3 status;
+    if (!childPath(args.where, filePath, status)) {
+        res.status = status;
+        return;
+    }
+
+    const createhow3 &how = args.how;
+    const sattr3 &attributes = how.createhow3_u.obj_attributes;
+    int flags = O_CREAT | O_WRONLY;
+    if (how.mode != UNCHECKED) {
+        flags |= O_EXCL;
+    }
+    const mode_t mode = how.mode != EXCLUSIVE && attributes.mode.set_it ? attributes.mode.set_mode3_u.mode : 0644;
+
+    const int fd = ::open(filePath.constData(), flags, mode);
+    if (fd < 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+    ::close(fd);
+
+    if (how.mode != EXCLUSIVE) {
+        applyAttributes(filePath, attributes);
+    }
+
+    CREATE3resok &resok = res.CREATE3res_u.resok;
+    postOpFh(filePath, resok.obj);
+    postOpAttr(filePath, resok.obj_attributes);
+    wccData(filePath.left(filePath.lastIndexOf('/')), resok.dir_wcc);
+}
+
+void MockNfsServer::makeDir(const MKDIR3args &args, MKDIR3res &res)
+{
+    QByteArray dirPath;
+    nfsstat3 status;
+    if (!childPath(args.where, dirPath, status)) {
+        res.status = status;
+        return;
+    }
+
+    const mode_t mode = args.attributes.mode.set_it ? args.attributes.mode.set_mode3_u.mode : 0755;
+    if (::mkdir(dirPath.constData(), mode) != 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    MKDIR3resok &resok = res.MKDIR3res_u.resok;
+    postOpFh(dirPath, resok.obj);
+    postOpAttr(dirPath, resok.obj_attributes);
+    wccData(dirPath.left(dirPath.lastIndexOf('/')), resok.dir_wcc);
+}
+
+void MockNfsServer::symLink(const SYMLINK3args &args, SYMLINK3res &res)
+{
+    QByteArray linkPath;
+    nfsstat3 status;
+    if (!childPath(args.where, linkPath, status)) {
+        res.status = status;
+        return;
+    }
+
+    if (::symlink(args.symlink.symlink_data, linkPath.constData()) != 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    SYMLINK3resok &resok = res.SYMLINK3res_u.resok;
+    postOpFh(linkPath, resok.obj);
+    postOpAttr(linkPath, resok.obj_attributes);
+    wccData(linkPath.left(linkPath.lastIndexOf('/')), resok.dir_wcc);
+}
+
+void MockNfsServer::remove(const REMOVE3args &args, REMOVE3res &res)
+{
+    QByteArray filePath;
+    nfsstat3 status;
+    if (!childPath(args.object, filePath, status)) {
+        res.status = status;
+        return;
+    }
+
+    if (::unlink(filePath.constData()) != 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    wccData(filePath.left(filePath.lastIndexOf('/')), res.REMOVE3res_u.resok.dir_wcc);
+}
+
+void MockNfsServer::removeDir(const RMDIR3args &args, RMDIR3res &res)
+{
+    QByteArray dirPath;
+    nfsstat3 status;
+    if (!childPath(args.object, dirPath, status)) {
+        res.status = status;
+        return;
+    }
+
+    if (::rmdir(dirPath.constData()) != 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    wccData(dirPath.left(dirPath.lastIndexOf('/')), res.RMDIR3res_u.resok.dir_wcc);
+}
+
+void MockNfsServer::rename(const RENAME3args &args, RENAME3res &res)
+{
+    QByteArray fromPath;
+    QByteArray toPath;
+    nfsstat3 status;
+    if (!childPath(args.from, fromPath, status) || !childPath(args.to, toPath, status)) {
+        res.status = status;
+        return;
+    }
+
+    if (::rename(fromPath.constData(), toPath.constData()) != 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+    renamed(fromPath, toPath);
+
+    wccData(fromPath.left(fromPath.lastIndexOf('/')), res.RENAME3res_u.resok.fromdir_wcc);
+    wccData(toPath.left(toPath.lastIndexOf('/')), res.RENAME3res_u.resok.todir_wcc);
+}
+
+void MockNfsServer::readDir(const READDIR3args &args, READDIR3res &res)
+{
+    QByteArray dirPath;
+    if (!path(args.dir, dirPath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    fattr3 dirAttributes;
+    if (!attributes(dirPath, dirAttributes)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+    if (dirAttributes.type != NF3DIR) {
+        res.status = NFS3ERR_NOTDIR;
+        return;
+    }
+
+    const QList<QByteArray> &names = listing(dirPath, args.cookie);
+    if (args.cookie > quint64(names.size())) {
+        res.status = NFS3ERR_BAD_COOKIE;
+        return;
+    }
+
+    READDIR3resok &resok = res.READDIR3res_u.resok;
+    postOpAttr(dirPath, resok.dir_attributes);
+
+    const int capacity = int(args.count / s_entrySize) + 1;
+    entry3 *entries = reinterpret_cast<entry3 *>(scratch(QByteArray(capacity * int(sizeof(entry3)), '\0')));
+    entry3 *last = nullptr;
+    u_int size = 128;
+    int used = 0;
+    quint64 index = args.cookie;
+    while (index < quint64(names.size()) && used < capacity) {
+        const QByteArray &name = names.at(int(index));
+        const u_int entrySize = s_entrySize + ((name.size() + 3) & ~3);
+        if (used > 0 && size + entrySize > args.count) {
+            break;
+        }
+
+        struct stat st;
+        entry3 &entry = entries[used++];
+        entry.fileid = lstat((dirPath + '/' + name).constData(), &st) == 0 ? st.st_ino : 0;
+        entry.name = scratch(name);
+        entry.cookie = index + 1;
+        if (last != nullptr) {
+            last->nextentry = &entry;
+        } else {
+            resok.reply.entries = &entry;
+        }
+        last = &entry;
+
+        size += entrySize;
+        ++index;
+    }
+    resok.reply.eof = index >= quint64(names.size());
+}
+
+void MockNfsServer::readDirPlus(const READDIRPLUS3args &args, READDIRPLUS3res &res)
+{
+    QByteArray dirPath;
+    if (!path(args.dir, dirPath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    fattr3 dirAttributes;
+    if (!attributes(dirPath, dirAttributes)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+    if (dirAttributes.type != NF3DIR) {
+        res.status = NFS3ERR_NOTDIR;
+        return;
+    }
+
+    const QList<QByteArray> &names = listing(dirPath, args.cookie);
+    if (args.cookie > quint64(names.size())) {
+        res.status = NFS3ERR_BAD_COOKIE;
+        return;
+    }
+
+    READDIRPLUS3resok &resok = res.READDIRPLUS3res_u.resok;
+    postOpAttr(dirPath, resok.dir_attributes);
+
+    const int capacity = int(qMin(args.dircount / s_entrySize, args.maxcount / s_entryPlusSize)) + 1;
+    entryplus3 *entries = reinterpret_cast<entryplus3 *>(scratch(QByteArray(capacity * int(sizeof(entryplus3)), '\0')));
+    entryplus3 *last = nullptr;
+    u_int dirSize = 0;
+    u_int size = 128;
+    int used = 0;
+    quint64 index = args.cookie;
+    while (index < quint64(names.size()) && used < capacity) {
+        const QByteArray &name = names.at(int(index));
+        const u_int nameSize = (name.size() + 3) & ~3;
+        if (used > 0 && (dirSize + s_entrySize + nameSize > args.dircount ||
+                         size + s_entryPlusSize + nameSize > args.maxcount)) {
+            break;
+        }
+
+        const QByteArray filePath = name == "." ? dirPath
+                                    : name == ".." ? (dirPath == m_exportPath ? dirPath : dirPath.left(dirPath.lastIndexOf('/')))
+                                    : dirPath + '/' + name;
+
+        entryplus3 &entry = entries[used++];
+        postOpAttr(filePath, entry.name_attributes);
+        entry.fileid = entry.name_attributes.attributes_follow ? entry.name_attributes.post_op_attr_u.attributes.fileid : 0;
+        entry.name = scratch(name);
+        entry.cookie = index + 1;
+        postOpFh(filePath, entry.name_handle);
+        if (last != nullptr) {
+            last->nextentry = &entry;
+        } else {
+            resok.reply.entries = &entry;
+        }
+        last = &entry;
+
+        dirSize += s_entrySize + nameSize;
+        size += s_entryPlusSize + nameSize;
+        ++index;
+    }
+    resok.reply.eof = index >= quint64(names.size());
+}
+
+void MockNfsServer::fsStat(const FSSTAT3args &args, FSSTAT3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.fsroot, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    struct statvfs st;
+    if (statvfs(filePath.constData(), &st) != 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+
+    FSSTAT3resok &resok = res.FSSTAT3res_u.resok;
+    postOpAttr(filePath, resok.obj_attributes);
+    resok.tbytes = quint64(st.f_blocks) * st.f_frsize;
+    resok.fbytes = quint64(st.f_bfree) * st.f_frsize;
+    resok.abytes = quint64(st.f_bavail) * st.f_frsize;
+    resok.tfiles = st.f_files;
+    resok.ffiles = st.f_ffree;
+    resok.afiles = st.f_favail;
+    resok.invarsec = 0;
+}
+
+void MockNfsServer::fsInfo(const FSINFO3args &args, FSINFO3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.fsroot, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    FSINFO3resok &resok = res.FSINFO3res_u.resok;
+    postOpAttr(filePath, resok.obj_attributes);
+    {
+        QMutexLocker locker(&m_mutex);
+        resok.rtpref = m_rtpref;
+        resok.wtpref = m_wtpref;
+        resok.dtpref = m_dtpref;
+    }
+    resok.rtmax = s_maxTransfer;
+    resok.rtmult = 4096;
+    resok.wtmax = s_maxTransfer;
+    resok.wtmult = 4096;
+    resok.maxfilesize = Q_UINT64_C(0x7fffffffffffffff);
+    resok.time_delta.seconds = 0;
+    resok.time_delta.nseconds = 1;
+    resok.properties = FSF3_LINK | FSF3_SYMLINK | FSF3_HOMOGENEOUS | FSF3_CANSETTIME;
+}
+
+void MockNfsServer::pathConf(const PATHCONF3args &args, PATHCONF3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.object, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    PATHCONF3resok &resok = res.PATHCONF3res_u.resok;
+    postOpAttr(filePath, resok.obj_attributes);
+    resok.linkmax = 32000;
+    resok.name_max = NAME_MAX;
+    resok.no_trunc = true;
+    resok.chown_restricted = true;
+    resok.case_insensitive = false;
+    resok.case_preserving = true;
+}
+
+void MockNfsServer::commit(const COMMIT3args &args, COMMIT3res &res)
+{
+    QByteArray filePath;
+    if (!path(args.file, filePath)) {
+        res.status = NFS3ERR_STALE;
+        return;
+    }
+
+    const int fd = ::open(filePath.constData(), O_RDONLY);
+    if (fd < 0) {
+        res.status = errnoStatus(errno);
+        return;
+    }
+    fsync(fd);
+    ::close(fd);
+
+    quint64 verifier;
+    {
+        QMutexLocker locker(&m_mutex);
+        verifier = m_verifier;
+    }
+
+    wccData(filePath, res.COMMIT3res_u.resok.file_wcc);
+    memcpy(res.COMMIT3res_u.resok.verf, &verifier, NFS3_WRITEVERFSIZE);
+}
@@ -0,0 +1,168 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MOCKNFSSERVER_H
+#define MOCKNFSSERVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+#include "rpc_nfs3_prot.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+/**
+ * Userspace NFSv3 and MOUNT v3 server for the autotests, no root needed.
+ *
+ * Exports a local directory as /bench.  Both programs are served on one
+ * TCP port and there is no portmapper, so the slave has to be given the
+ * port in the URL.  Other programs and versions are refused, which makes
+ * the slave fall back to NFSv3.
+ *
+ * The server can delay its replies by a fixed latency (the replies stay in
+ * order, so pipelined calls overlap their latencies like on a real network),
+ * announce any FSINFO preferred sizes, refuse READDIRPLUS, fail chosen calls
+ * and change its write verifier as if it had rebooted.  It counts the NFS
+ * calls per procedure.
+ *
+ * Lives on a thread of its own, see start(); the setters can be used from
+ * any thread.
+ */
+class MockNfsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MockNfsServer(const QString &exportPath);
+
+    quint16 port() const { return m_port; }
+
+    void setLatency(int ms);
+    void setPreferredSizes(quint32 rtpref, quint32 wtpref, quint32 dtpref);
+    void setReadDirPlusSupported(bool supported);
+
+    /**
+     * Makes the count'th next call of the NFS procedure proc fail with
+     * nfsStatus, or close the connection without a reply if nfsStatus is 0
+     */
+    void failCall(quint32 proc, int count, int nfsStatus);
+
+    /**
+     * Changes the write verifier, unstable writes have to be sent again
+     */
+    void reboot();
+
+    quint64 calls(quint32 proc) const;
+    quint64 totalCalls() const;
+    void resetCounters();
+
+    static const char *procedureName(quint32 proc);
+
+public Q_SLOTS:
+    // to be invoked (blocking) on the server's thread
+    void start();
+    void stop();
+
+private Q_SLOTS:
+    void newConnection();
+
+private:
+    struct Failure {
+        quint32 proc;
+        int count;
+        int nfsStatus;
+    };
+
+    void readCalls(QTcpSocket *socket);
+    QByteArray handleCall(const QByteArray &record, bool &drop);
+    QByteArray acceptedReply(quint32 xid, int acceptStatus, xdrproc_t xres = nullptr, void *res = nullptr);
+    void sendReply(QTcpSocket *socket, const QByteArray &reply);
+
+    template<typename Args, typename Res>
+    QByteArray serve(XDR *xdr, quint32 xid, xdrproc_t xargs, xdrproc_t xres,
+                     void (MockNfsServer::*handler)(const Args &, Res &), int failStatus = -1);
+
+    // MOUNT procedures
+    void mount(char *const &path, mountres3 &res);
+    void exportList(const int &, exports3 &res);
+
+    // NFS procedures
+    void getAttr(const GETATTR3args &args, GETATTR3res &res);
+    void setAttr(const SETATTR3args &args, SETATTR3res &res);
+    void lookup(const LOOKUP3args &args, LOOKUP3res &res);
+    void access(const ACCESS3args &args, ACCESS3res &res);
+    void readLink(const READLINK3args &args, READLINK3res &res);
+    void read(const READ3args &args, READ3res &res);
+    void write(const WRITE3args &args, WRITE3res &res);
+    void create(const CREATE3args &args, CREATE3res &res);
+    void makeDir(const MKDIR3args &args, MKDIR3res &res);
+    void symLink(const SYMLINK3args &args, SYMLINK3res &res);
+    void remove(const REMOVE3args &args, REMOVE3res &res);
+    void removeDir(const RMDIR3args &args, RMDIR3res &res);
+    void rename(const RENAME3args &args, RENAME3res &res);
+    void readDir(const READDIR3args &args, READDIR3res &res);
+    void readDirPlus(const READDIRPLUS3args &args, READDIRPLUS3res &res);
+    void fsStat(const FSSTAT3args &args, FSSTAT3res &res);
+    void fsInfo(const FSINFO3args &args, FSINFO3res &res);
+    void pathConf(const PATHCONF3args &args, PATHCONF3res &res);
+    void commit(const COMMIT3args &args, COMMIT3res &res);
+
+    // file handles are indexes into m_paths
+    nfs_fh3 handle(const QByteArray &path);
+    bool path(const nfs_fh3 &fh, QByteArray &path) const;
+    bool childPath(const diropargs3 &args, QByteArray &path, nfsstat3 &status) const;
+    void renamed(const QByteArray &from, const QByteArray &to);
+
+    bool attributes(const QByteArray &path, fattr3 &attributes) const;
+    void postOpAttr(const QByteArray &path, post_op_attr &attributes) const;
+    void postOpFh(const QByteArray &path, post_op_fh3 &fh);
+    void wccData(const QByteArray &path, wcc_data &wcc) const;
+    void applyAttributes(const QByteArray &path, const sattr3 &attributes);
+    const QList<QByteArray> &listing(const QByteArray &path, quint64 cookie);
+
+    // memory the results of the current call point to
+    char *scratch(const QByteArray &data);
+
+    const QByteArray m_exportPath;
+    quint16 m_port;
+    QTcpServer *m_server;
+    QHash<QTcpSocket *, QByteArray> m_input;
+
+    QVector<QByteArray> m_paths;
+    QVector<QByteArray> m_handles;
+    QHash<QByteArray, quint32> m_handleIds;
+    QHash<QByteArray, QList<QByteArray>> m_listings;
+    QList<QByteArray> m_scratch;
+
+    mutable QMutex m_mutex;
+    int m_latency;
+    quint32 m_rtpref;
+    quint32 m_wtpref;
+    quint32 m_dtpref;
+    bool m_readDirPlus;
+    QList<Failure> m_failures;
+    quint64 m_verifier;
+    QHash<quint32, quint64> m_calls;
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/utsname.h>
+#include <time.h>
 
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -40,10 +41,24 @@
 
 #include "nfsv2.h"
 #include "nfsv3.h"
+#include "nfsv4.h"
 
 using namespace KIO;
 using namespace std;
 
+// The number of paths the file cache keeps.
+#define NFS_CACHE_MAX_ENTRIES 10000
+
+// How long a path stays mapped to its file handle, in seconds.
+#define NFS_CACHE_HANDLE_TIMEOUT 60
+
+// The bounds of the attribute cache timeout for files and directories, in
+// seconds. These are the defaults of acregmin/acregmax and acdirmin/acdirmax.
+#define NFS_CACHE_REG_MIN 3
+#define NFS_CACHE_REG_MAX 60
+#define NFS_CACHE_DIR_MIN 30
+#define NFS_CACHE_DIR_MAX 60
+
 Q_LOGGING_CATEGORY(LOG_KIO_NFS, "kde.kio-nfs")
 
 
@@ -66,7 +81,8 @@ int kdemain(int argc, char** argv)
 
 NFSSlave::NFSSlave(const QByteArray& pool, const QByteArray& app)
     :  KIO::SlaveBase("nfs", pool, app),
-       m_protocol(nullptr)
+       m_protocol(nullptr),
+       m_port(0)
 {
 
     qCDebug(LOG_KIO_NFS) << pool << app;
@@ -87,15 +103,20 @@ void NFSSlave::openConnection()
     } else {
         bool connectionError = false;
 
-        int version = 4;
+        // NFSv4 has no FileJob support and no test server yet, it is only
+        // tried when asked for.
+        const QString v4Key = QStringLiteral("EnableNFSv4");
+        const bool enableV4 = hasMetaData(v4Key) ? metaData(v4Key) == QLatin1String("true")
+                                                 : config()->readEntry(v4Key, false);
+
+        int version = enableV4 ? 4 : 3;
         while (version > 1) {
             qCDebug(LOG_KIO_NFS) << "Trying NFS version" << version;
 
             // We need to create a new NFS protocol handler
             switch (version) {
             case 4: {
-                // TODO
-                qCDebug(LOG_KIO_NFS) << "NFSv4 is not supported at this time";
+                m_protocol = new NFSProtocolV4(this);
             }
             break;
             case 3: {
@@ -148,13 +169,13 @@ void NFSSlave::closeConnection()
     }
 }
 
-void NFSSlave::setHost(const QString& host, quint16 /*port*/, const QString& /*user*/, const QString& /*pass*/)
+void NFSSlave::setHost(const QString& host, quint16 port, const QString& /*user*/, const QString& /*pass*/)
 {
     qCDebug(LOG_KIO_NFS);
 
     if (m_protocol != nullptr) {
         // New host? New protocol!
-        if (m_host != host) {
+        if (m_host != host || m_port != port) {
             qCDebug(LOG_KIO_NFS) << "Deleting old protocol";
             delete m_protocol;
             m_protocol = nullptr;
@@ -164,6 +185,7 @@ void NFSSlave::setHost(const QString& host, quint16 /*port*/, const QString& /*u
     }
 
     m_host = host;
+    m_port = port;
 }
 
 void NFSSlave::put(const QUrl& url, int _mode, KIO::JobFlags _flags)
@@ -256,6 +278,51 @@ void NFSSlave::copy(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags f
     }
 }
 
+void NFSSlave::open(const QUrl& url, QIODevice::OpenMode mode)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    if (verifyProtocol()) {
+        m_protocol->open(url, mode);
+    }
+}
+
+void NFSSlave::read(KIO::filesize_t bytesRequested)
+{
+    qCDebug(LOG_KIO_NFS);
+
+    if (verifyProtocol()) {
+        m_protocol->read(bytesRequested);
+    }
+}
+
+void NFSSlave::write(const QByteArray& data)
+{
+    qCDebug(LOG_KIO_NFS);
+
+    if (verifyProtocol()) {
+        m_protocol->write(data);
+    }
+}
+
+void NFSSlave::seek(KIO::filesize_t offset)
+{
+    qCDebug(LOG_KIO_NFS);
+
+    if (verifyProtocol()) {
+        m_protocol->seek(offset);
+    }
+}
+
+void NFSSlave::close()
+{
+    qCDebug(LOG_KIO_NFS);
+
+    if (verifyProtocol()) {
+        m_protocol->close();
+    }
+}
+
 bool NFSSlave::verifyProtocol()
 {
     const bool haveProtocol = (m_protocol != nullptr);
@@ -473,6 +540,149 @@ void NFSFileHandle::setLinkSource(const nfs_fh& src)
 }
 
 
+static QString parentPath(const QString& path)
+{
+    return path.left(path.lastIndexOf(QLatin1Char('/')));
+}
+
+NFSFileCache::NFSFileCache()
+    : m_entries(NFS_CACHE_MAX_ENTRIES),
+      m_indexSize(0)
+{
+    m_clock.start();
+}
+
+void NFSFileCache::addExport(const QString& path, const NFSFileHandle& fh)
+{
+    m_exports.insert(path, fh);
+}
+
+void NFSFileCache::addHandle(const QString& path, const NFSFileHandle& fh)
+{
+    Entry* cached = entry(path);
+    cached->handle = fh;
+    cached->handleExpiry = m_clock.elapsed() + NFS_CACHE_HANDLE_TIMEOUT * 1000;
+}
+
+bool NFSFileCache::handle(const QString& path, NFSFileHandle& fh)
+{
+    const QHash<QString, NFSFileHandle>::const_iterator it = m_exports.constFind(path);
+    if (it != m_exports.constEnd()) {
+        fh = it.value();
+        return true;
+    }
+
+    Entry* cached = m_entries.object(path);
+    if (cached == nullptr || cached->handleExpiry <= m_clock.elapsed()) {
+        return false;
+    }
+
+    fh = cached->handle;
+    return true;
+}
+
+void NFSFileCache::addAttributes(const QString& path, const fattr3& attributes)
+{
+    // Files that haven't changed in a while are unlikely to change soon.
+    const bool isDir = (attributes.type == NF3DIR);
+    const qint64 age = qMax<qint64>(0, time(nullptr) - static_cast<qint64>(attributes.mtime.seconds));
+    const qint64 timeout = qBound<qint64>(isDir ? NFS_CACHE_DIR_MIN : NFS_CACHE_REG_MIN,
+                                          age / 10,
+                                          isDir ? NFS_CACHE_DIR_MAX : NFS_CACHE_REG_MAX);
+
+    Entry* cached = entry(path);
+    cached->attributes = attributes;
+    cached->attributesExpiry = m_clock.elapsed() + timeout * 1000;
+}
+
+bool NFSFileCache::attributes(const QString& path, fattr3& attributes)
+{
+    Entry* cached = m_entries.object(path);
+    if (cached == nullptr || cached->attributesExpiry <= m_clock.elapsed()) {
+        return false;
+    }
+
+    attributes = cached->attributes;
+    return true;
+}
+
+void NFSFileCache::removeAttributes(const QString& path)
+{
+    Entry* cached = m_entries.object(path);
+    if (cached != nullptr) {
+        cached->attributesExpiry = 0;
+    }
+}
+
+void NFSFileCache::remove(const QString& path)
+{
+    m_entries.remove(path);
+    removeChildren(path);
+
+    const QHash<QString, QSet<QString> >::iterator it = m_children.find(parentPath(path));
+    if (it != m_children.end() && it->remove(path)) {
+        --m_indexSize;
+        if (it->isEmpty()) {
+            m_children.erase(it);
+        }
+    }
+}
+
+void NFSFileCache::removeChildren(const QString& path)
+{
+    const QSet<QString> children = m_children.take(path);
+    m_indexSize -= children.size();
+
+    for (const QString& child : children) {
+        m_entries.remove(child);
+        removeChildren(child);
+    }
+}
+
+void NFSFileCache::clear()
+{
+    m_entries.clear();
+    m_children.clear();
+    m_indexSize = 0;
+}
+
+// Rebuilds the index from what is actually cached, done when it has grown to
+// twice the size of the cache, so it takes constant time per new entry.
+void NFSFileCache::indexEntries()
+{
+    m_children.clear();
+
+    const QList<QString> keys = m_entries.keys();
+    for (const QString& key : keys) {
+        m_children[parentPath(key)].insert(key);
+    }
+    m_indexSize = keys.size();
+}
+
+NFSFileCache::Entry* NFSFileCache::entry(const QString& path)
+{
+    Entry* cached = m_entries.object(path);
+    if (cached == nullptr) {
+        cached = new Entry;
+        cached->handleExpiry = 0;
+        memset(&cached->attributes, 0, sizeof(cached->attributes));
+        cached->attributesExpiry = 0;
+
+        m_entries.insert(path, cached);
+
+        QSet<QString>& siblings = m_children[parentPath(path)];
+        if (!siblings.contains(path)) {
+            siblings.insert(path);
+            if (++m_indexSize > 2 * NFS_CACHE_MAX_ENTRIES) {
+                indexEntries();
+            }
+        }
+    }
+
+    return cached;
+}
+
+
 NFSProtocol::NFSProtocol(NFSSlave* slave)
     : m_slave(slave)
 {
@@ -490,8 +700,34 @@ void NFSProtocol::copy(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlag
     }
 }
 
-void NFSProtocol::addExportedDir(const QString& path)
+void NFSProtocol::open(const QUrl& url, QIODevice::OpenMode /*mode*/)
+{
+    m_slave->error(KIO::ERR_UNSUPPORTED_ACTION, url.toDisplayString());
+}
+
+void NFSProtocol::read(KIO::filesize_t /*bytesRequested*/)
+{
+    m_slave->error(KIO::ERR_UNSUPPORTED_ACTION, QString());
+}
+
+void NFSProtocol::write(const QByteArray& /*data*/)
+{
+    m_slave->error(KIO::ERR_UNSUPPORTED_ACTION, QString());
+}
+
+void NFSProtocol::seek(KIO::filesize_t /*offset*/)
+{
+    m_slave->error(KIO::ERR_UNSUPPORTED_ACTION, QString());
+}
+
+void NFSProtocol::close()
+{
+    m_slave->error(KIO::ERR_UNSUPPORTED_ACTION, QString());
+}
+
+void NFSProtocol::addExportedDir(const QString& path, const NFSFileHandle& fh)
 {
+    m_fileCache.addExport(path, fh);
     m_exportedDirs.append(path);
 }
 
@@ -528,7 +764,7 @@ void NFSProtocol::removeExportedDir(const QString& path)
 
 void NFSProtocol::addFileHandle(const QString& path, NFSFileHandle fh)
 {
-    m_handleCache.insert(path, fh);
+    m_fileCache.addHandle(path, fh);
 }
 
 NFSFileHandle NFSProtocol::getFileHandle(const QString& path)
@@ -544,8 +780,9 @@ NFSFileHandle NFSProtocol::getFileHandle(const QString& path)
 
     // The handle may already be in the cache, check it now.
     // The exported dirs are always in the cache.
-    if (m_handleCache.contains(path)) {
-        return m_handleCache[path];
+    NFSFileHandle cachedFH;
+    if (m_fileCache.handle(path, cachedFH)) {
+        return cachedFH;
     }
 
     // Loop detected, abort.
@@ -556,15 +793,40 @@ NFSFileHandle NFSProtocol::getFileHandle(const QString& path)
     // Look up the file handle from the procotol
     NFSFileHandle childFH = lookupFileHandle(path);
     if (!childFH.isInvalid()) {
-        m_handleCache.insert(path, childFH);
+        m_fileCache.addHandle(path, childFH);
     }
 
     return childFH;
 }
 
+bool NFSProtocol::getCachedFileHandle(const QString& path, NFSFileHandle& fh)
+{
+    return m_fileCache.handle(path, fh);
+}
+
 void NFSProtocol::removeFileHandle(const QString& path)
 {
-    m_handleCache.remove(path);
+    m_fileCache.remove(path);
+}
+
+void NFSProtocol::clearFileHandles()
+{
+    m_fileCache.clear();
+}
+
+void NFSProtocol::addFileAttributes(const QString& path, const fattr3& attributes)
+{
+    m_fileCache.addAttributes(path, attributes);
+}
+
+bool NFSProtocol::getFileAttributes(const QString& path, fattr3& attributes)
+{
+    return m_fileCache.attributes(path, attributes);
+}
+
+void NFSProtocol::removeFileAttributes(const QString& path)
+{
+    m_fileCache.removeAttributes(path);
 }
 
 bool NFSProtocol::isValidPath(const QString& path)
@@ -617,12 +879,21 @@ int NFSProtocol::openConnection(const QString& host, int prog, int vers, CLIENT*
         memcpy(&server_addr.sin_addr, hp->h_addr, hp->h_length);
     }
 
-    server_addr.sin_port = 0;
+    // Without a port clnttcp_create asks the portmapper. With one, every
+    // program is expected on that port, like a single port server or the
+    // test server in autotests does.
+    // NFSv4 servers need not register with the portmapper at all, they are
+    // on the NFS port.
+    quint16 port = m_slave->port();
+    if (port == 0 && prog == NFS_PROGRAM && vers >= 4) {
+        port = NFS_PORT;
+    }
+    server_addr.sin_port = htons(port);
 
     sock = RPC_ANYSOCK;
     client = clnttcp_create(&server_addr, prog, vers, &sock, 0, 0);
     if (client == nullptr) {
-        server_addr.sin_port = 0;
+        server_addr.sin_port = htons(port);
         sock = RPC_ANYSOCK;
 
         timeval pertry_timeout;
@@ -25,8 +25,11 @@
 #include <kio/global.h>
 #include <kconfiggroup.h>
 
+#include <QCache>
+#include <QElapsedTimer>
 #include <QHash>
 #include <QMap>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 #include <QTimer>
@@ -63,6 +66,18 @@ public:
     void rename(const QUrl& src, const QUrl& dest, KIO::JobFlags flags) override;
     void copy(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) override;
 
+    void open(const QUrl& url, QIODevice::OpenMode mode) override;
+    void read(KIO::filesize_t bytesRequested) override;
+    void write(const QByteArray& data) override;
+    void seek(KIO::filesize_t offset) override;
+    void close() override;
+
+    // The port given with the host, 0 to ask the portmapper.
+    quint16 port() const
+    {
+        return m_port;
+    }
+
 protected:
     // Verifies the current protocol and connection state, returns true if valid.
     bool verifyProtocol();
@@ -73,6 +88,7 @@ private:
     // We need to cache this because the @openConnection call is responsible
     // for creating the protocol, and the @setHost call might happen before that.
     QString m_host;
+    quint16 m_port;
 };
 
 
@@ -139,7 +155,50 @@ protected:
     bool m_isLink;
 };
 
-typedef QMap<QString, NFSFileHandle> NFSFileHandleMap;
+// Caches the file handles and attributes of paths. At most a fixed number
+// of entries are kept, the least recently used ones are dropped first.
+// Like the attribute cache of the kernel client, attributes expire after
+// a time that grows with the time since the file was last modified.
+class NFSFileCache
+{
+public:
+    NFSFileCache();
+
+    // The handles of exported dirs are never dropped.
+    void addExport(const QString& path, const NFSFileHandle& fh);
+
+    void addHandle(const QString& path, const NFSFileHandle& fh);
+    bool handle(const QString& path, NFSFileHandle& fh);
+
+    void addAttributes(const QString& path, const fattr3& attributes);
+    bool attributes(const QString& path, fattr3& attributes);
+    void removeAttributes(const QString& path);
+
+    // Removes path and everything below it.
+    void remove(const QString& path);
+    // Removes everything but the exported dirs.
+    void clear();
+
+private:
+    struct Entry {
+        NFSFileHandle handle;
+        qint64 handleExpiry;
+        fattr3 attributes;
+        qint64 attributesExpiry;
+    };
+
+    Entry* entry(const QString& path);
+    void removeChildren(const QString& path);
+    void indexEntries();
+
+    QHash<QString, NFSFileHandle> m_exports;
+    QCache<QString, Entry> m_entries;
+    // The cached paths below each dir, so that remove() doesn't have to look at
+    // every entry. Entries the cache drops on its own stay until the next indexEntries().
+    QHash<QString, QSet<QString> > m_children;
+    int m_indexSize;
+    QElapsedTimer m_clock;
+};
 
 class NFSProtocol
 {
@@ -167,6 +226,13 @@ public:
 
     void copy(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags);
 
+    // Random access to a single open file, not supported unless overridden.
+    virtual void open(const QUrl& url, QIODevice::OpenMode mode);
+    virtual void read(KIO::filesize_t bytesRequested);
+    virtual void write(const QByteArray& data);
+    virtual void seek(KIO::filesize_t offset);
+    virtual void close();
+
 protected:
     // Copy from NFS to NFS
     virtual void copySame(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) = 0;
@@ -179,7 +245,7 @@ protected:
     virtual NFSFileHandle lookupFileHandle(const QString& path) = 0;
 
     // Modify the exported dirs.
-    void addExportedDir(const QString& path);
+    void addExportedDir(const QString& path, const NFSFileHandle& fh);
     const QStringList& getExportedDirs();
     bool isExportedDir(const QString& path);
     void removeExportedDir(const QString& path);
@@ -187,7 +253,15 @@ protected:
     // File handle cache functions.
     void addFileHandle(const QString& path, NFSFileHandle fh);
     NFSFileHandle getFileHandle(const QString& path);
+    // Only looks at the cache, the protocol isn't asked.
+    bool getCachedFileHandle(const QString& path, NFSFileHandle& fh);
     void removeFileHandle(const QString& path);
+    void clearFileHandles();
+
+    // File attribute cache functions, only used by NFSv3.
+    void addFileAttributes(const QString& path, const fattr3& attributes);
+    bool getFileAttributes(const QString& path, fattr3& attributes);
+    void removeFileAttributes(const QString& path);
 
     // Make sure that the path is actually a part of an nfs share.
     bool isValidPath(const QString& path);
@@ -202,7 +276,7 @@ protected:
 private:
     NFSSlave* m_slave;
 
-    NFSFileHandleMap m_handleCache;
+    NFSFileCache m_fileCache;
     QStringList m_exportedDirs;
 };
 
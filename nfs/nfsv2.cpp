@@ -248,8 +248,7 @@ void NFSProtocolV2::openConnection()
                 continue;
             }
 
-            addFileHandle(fname, static_cast<NFSFileHandle>(fhStatus.fhstatus_u.fhs_fhandle));
-            addExportedDir(fname);
+            addExportedDir(fname, static_cast<NFSFileHandle>(fhStatus.fhstatus_u.fhs_fhandle));
         } else {
             failList.append(exportlist->ex_dir);
         }
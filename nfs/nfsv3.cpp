@@ -33,10 +33,14 @@
 #include <grp.h>
 #include <memory.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pwd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <stdio.h>
+#include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 #include <utime.h>
@@ -53,6 +57,7 @@
 #include <kio/ioslave_defaults.h>
 
 #include "nfsv3.h"
+#include "nfsv3pipeline.h"
 
 // This ioslave is for NFS version 3.
 #define NFSPROG 100003UL
@@ -61,6 +66,17 @@
 #define NFS3_MAXDATA    32768
 #define NFS3_MAXPATHLEN PATH_MAX
 
+// clnt_call over UDP can't receive more than this, rpc/clnt.h has it.
+#ifndef UDPMSGSIZE
+#define UDPMSGSIZE 8800
+#endif
+
+// The RPC and READDIRPLUS headers of a reply, on top of its maxcount.
+#define NFS3_REPLY_OVERHEAD 256
+
+// The number of files listDirCompat looks up before it lists them.
+#define NFS3_LOOKUP_BATCH 256
+
 NFSProtocolV3::NFSProtocolV3(NFSSlave* slave)
     : NFSProtocol(slave),
       m_slave(slave),
@@ -68,9 +84,15 @@ NFSProtocolV3::NFSProtocolV3(NFSSlave* slave)
       m_mountSock(-1),
       m_nfsClient(nullptr),
       m_nfsSock(-1),
+      m_pipelineFailed(false),
+      m_openMode(QIODevice::NotOpen),
+      m_openOffset(0),
+      m_openReadStream(nullptr),
+      m_openWriteStream(nullptr),
       m_readBufferSize(0),
       m_writeBufferSize(0),
-      m_readDirSize(0)
+      m_readDirSize(0),
+      m_readDirPlusSize(0)
 {
     qCDebug(LOG_KIO_NFS) << "NFS3::NFS3";
 
@@ -138,6 +160,12 @@ void NFSProtocolV3::closeConnection()
                   clnt_timeout);
     }
 
+    // The streams of an open file use the connection.
+    resetOpenFile();
+
+    m_pipeline.close();
+    m_pipelineFailed = false;
+
     if (m_mountSock >= 0) {
         ::close(m_mountSock);
         m_mountSock = -1;
@@ -265,8 +293,7 @@ void NFSProtocolV3::openConnection()
                 continue;
             }
 
-            addFileHandle(fname, static_cast<NFSFileHandle>(fhStatus.mountres3_u.mountinfo.fhandle));
-            addExportedDir(fname);
+            addExportedDir(fname, static_cast<NFSFileHandle>(fhStatus.mountres3_u.mountinfo.fhandle));
         } else {
             failList.append(exportlist->ex_dir);
         }
@@ -356,108 +383,68 @@ void NFSProtocolV3::listDir(const QUrl& url)
         initPreferredSizes(fh);
     }
 
-    READDIRPLUS3args listargs;
-    memset(&listargs, 0, sizeof(listargs));
-    listargs.dircount = m_readDirSize;
-    listargs.maxcount = sizeof(entryplus3) * m_readDirSize;  // Not really sure what this should be set to.
-
-    fh.toFH(listargs.dir);
+    // The next page is asked for while this one is turned into entries.
+    NFSDirStreamV3 stream(m_nfsClient, pipeline(), clnt_timeout, fh, m_readDirSize, m_readDirPlusSize);
 
-    READDIRPLUS3res listres;
-    memset(&listres, 0, sizeof(listres));
-
-    entryplus3* lastEntry = nullptr;
-    do {
-        memset(&listres, 0, sizeof(listres));
+    const QString prefix = path.endsWith(QLatin1Char('/')) ? path : path + QLatin1Char('/');
 
-        // In case that we didn't get all entries we need to set the cookie to the last one we actually received.
-        if (lastEntry != nullptr) {
-            listargs.cookie = lastEntry->cookie;
-        }
-
-        int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_READDIRPLUS,
-                                  (xdrproc_t) xdr_READDIRPLUS3args, reinterpret_cast<caddr_t>(&listargs),
-                                  (xdrproc_t) xdr_READDIRPLUS3res, reinterpret_cast<caddr_t>(&listres),
-                                  clnt_timeout);
+    bool firstPage = true;
+    forever {
+        const READDIRPLUS3resok* page;
+        if (!stream.next(page)) {
+            // Not a supported call? Try the old READDIR method.
+            if (firstPage && stream.rpcStatus() == RPC_SUCCESS && stream.nfsStatus() == NFS3ERR_NOTSUPP) {
+                listDirCompat(url);
+                return;
+            }
 
-        // Not a supported call? Try the old READDIR method.
-        if (listres.status == NFS3ERR_NOTSUPP) {
-            listDirCompat(url);
+            // Do we have an error? There's not much more we can do but to abort at this point.
+            checkForError(stream.rpcStatus(), stream.nfsStatus(), path);
             return;
         }
 
-        // Do we have an error? There's not much more we can do but to abort at this point.
-        if (!checkForError(clnt_stat, listres.status, path)) {
-            return;
+        if (page == nullptr) {
+            break;
         }
+        firstPage = false;
+
+        // The links of a page are resolved together, the entries are listed
+        // once that is done, all at once.
+        KIO::UDSEntryList entries;
+        QVector<LinkEntry> links;
 
-        for (entryplus3* dirEntry = listres.READDIRPLUS3res_u.resok.reply.entries; dirEntry != nullptr; dirEntry = dirEntry->nextentry) {
-            if (dirEntry->name == QString(".") || dirEntry->name == QString("..")) {
+        for (const entryplus3* dirEntry = page->reply.entries; dirEntry != nullptr; dirEntry = dirEntry->nextentry) {
+            if (strcmp(dirEntry->name, ".") == 0 || strcmp(dirEntry->name, "..") == 0) {
                 continue;
             }
 
-            const QString& filePath = QFileInfo(QDir(path), dirEntry->name).filePath();
+            const QString name = QFile::decodeName(dirEntry->name);
+            const QString filePath = prefix + name;
 
             KIO::UDSEntry entry;
-            entry.insert(KIO::UDSEntry::UDS_NAME, dirEntry->name);
+            entry.insert(KIO::UDSEntry::UDS_NAME, name);
 
             // Is it a symlink ?
             if (dirEntry->name_attributes.post_op_attr_u.attributes.type == NF3LNK) {
-                int rpcStatus;
-                READLINK3res readLinkRes;
-                char nameBuf[NFS3_MAXPATHLEN];
-                if (readLink(filePath, rpcStatus, readLinkRes, nameBuf)) {
-                    QString linkDest = QString::fromLocal8Bit(readLinkRes.READLINK3res_u.resok.data);
-                    entry.insert(KIO::UDSEntry::UDS_LINK_DEST, linkDest);
-
-                    bool badLink = true;
-                    NFSFileHandle linkFH;
-                    if (isValidLink(path, linkDest)) {
-                        QString linkPath;
-                        if (QFileInfo(linkDest).isAbsolute()) {
-                            linkPath = linkDest;
-                        } else {
-                            linkPath = QFileInfo(path, linkDest).absoluteFilePath();
-                        }
-
-                        int rpcStatus;
-                        LOOKUP3res lookupRes;
-                        if (lookupHandle(linkPath, rpcStatus, lookupRes)) {
-                            GETATTR3res attrAndStat;
-                            if (getAttr(linkPath, rpcStatus, attrAndStat)) {
-                                badLink = false;
-
-                                linkFH = lookupRes.LOOKUP3res_u.resok.object;
-                                linkFH.setLinkSource(dirEntry->name_handle.post_op_fh3_u.handle);
-
-                                completeUDSEntry(entry, attrAndStat.GETATTR3res_u.resok.obj_attributes);
-                            }
-                        }
-                    }
-
-                    if (badLink) {
-                        linkFH = dirEntry->name_handle.post_op_fh3_u.handle;
-                        linkFH.setBadLink();
-
-                        completeBadLinkUDSEntry(entry, dirEntry->name_attributes.post_op_attr_u.attributes);
-                    }
-
-                    addFileHandle(filePath, linkFH);
-                } else {
-                    entry.insert(KIO::UDSEntry::UDS_LINK_DEST, i18n("Unknown target"));
-                    completeBadLinkUDSEntry(entry, dirEntry->name_attributes.post_op_attr_u.attributes);
-                }
+                LinkEntry link;
+                link.index = entries.size();
+                link.path = filePath;
+                link.handle = dirEntry->name_handle.post_op_fh3_u.handle;
+                link.attributes = dirEntry->name_attributes.post_op_attr_u.attributes;
+                links.append(link);
             } else {
                 addFileHandle(filePath, static_cast<NFSFileHandle>(dirEntry->name_handle.post_op_fh3_u.handle));
+                cacheAttributes(filePath, dirEntry->name_attributes);
 
                 completeUDSEntry(entry, dirEntry->name_attributes.post_op_attr_u.attributes);
             }
 
-            m_slave->listEntry(entry);
-
-            lastEntry = dirEntry;
+            entries.append(entry);
         }
-    } while (listres.READDIRPLUS3res_u.resok.reply.entries != nullptr && !listres.READDIRPLUS3res_u.resok.reply.eof);
+
+        completeLinkEntries(path, entries, links);
+        m_slave->listEntries(entries);
+    }
 
     m_slave->finished();
 }
@@ -523,102 +510,103 @@ void NFSProtocolV3::listDirCompat(const QUrl& url)
     fh.toFH(listargs.dir);
 
     READDIR3res listres;
-    entry3* lastEntry = nullptr;
+    bool eof;
     do {
         memset(&listres, 0, sizeof(listres));
 
-        // In case that we didn't get all entries we need to set the cookie to the last one we actually received
-        if (lastEntry != nullptr) {
-            listargs.cookie = lastEntry->cookie;
-        }
-
         int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_READDIR,
                                   (xdrproc_t) xdr_READDIR3args, reinterpret_cast<caddr_t>(&listargs),
                                   (xdrproc_t) xdr_READDIR3res, reinterpret_cast<caddr_t>(&listres),
                                   clnt_timeout);
 
         if (!checkForError(clnt_stat, listres.status, path)) {
+            xdr_free((xdrproc_t) xdr_READDIR3res, reinterpret_cast<char*>(&listres));
             return;
         }
 
+        entry3* lastEntry = nullptr;
         for (entry3* dirEntry = listres.READDIR3res_u.resok.reply.entries; dirEntry != nullptr; dirEntry = dirEntry->nextentry) {
-            if (dirEntry->name != QString(".") && dirEntry->name != QString("..")) {
+            if (strcmp(dirEntry->name, ".") != 0 && strcmp(dirEntry->name, "..") != 0) {
                 filesToList.append(QFile::decodeName(dirEntry->name));
             }
 
             lastEntry = dirEntry;
         }
-    } while (!listres.READDIR3res_u.resok.reply.eof);
 
-    // Loop through all files, getting attributes and link path.
-    KIO::UDSEntry entry;
-    for (QStringList::const_iterator it = filesToList.constBegin(); it != filesToList.constEnd(); ++it) {
-        QString filePath = QFileInfo(QDir(path), (*it)).filePath();
-
-        int rpcStatus;
-        LOOKUP3res dirres;
-        if (!lookupHandle(filePath, rpcStatus, dirres)) {
-            qCDebug(LOG_KIO_NFS) << "Failed to lookup" << filePath << ", rpc:" << rpcStatus << ", nfs:" << dirres.status;
-            // Try the next file instead of aborting
-            continue;
+        // In case that we didn't get all entries we need to continue after the last one we actually received.
+        if (lastEntry != nullptr) {
+            listargs.cookie = lastEntry->cookie;
+            memcpy(listargs.cookieverf, listres.READDIR3res_u.resok.cookieverf, NFS3_COOKIEVERFSIZE);
         }
 
-        entry.clear();
-        entry.insert(KIO::UDSEntry::UDS_NAME, (*it));
-
-        // Is it a symlink?
-        if (dirres.LOOKUP3res_u.resok.obj_attributes.post_op_attr_u.attributes.type == NF3LNK) {
-            int rpcStatus;
-            READLINK3res readLinkRes;
-            char nameBuf[NFS3_MAXPATHLEN];
-            if (readLink(filePath, rpcStatus, readLinkRes, nameBuf)) {
-                const QString linkDest = QString::fromLocal8Bit(readLinkRes.READLINK3res_u.resok.data);
-                entry.insert(KIO::UDSEntry::UDS_LINK_DEST, linkDest);
-
-                bool badLink = true;
-                NFSFileHandle linkFH;
-                if (isValidLink(path, linkDest)) {
-                    QString linkPath;
-                    if (QFileInfo(linkDest).isAbsolute()) {
-                        linkPath = linkDest;
-                    } else {
-                        linkPath = QFileInfo(path, linkDest).absoluteFilePath();
-                    }
-
-                    int rpcStatus;
-                    LOOKUP3res lookupRes;
-                    if (lookupHandle(linkPath, rpcStatus, lookupRes)) {
-                        GETATTR3res attrAndStat;
-                        if (getAttr(linkPath, rpcStatus, attrAndStat)) {
-                            badLink = false;
+        eof = (listres.READDIR3res_u.resok.reply.eof || lastEntry == nullptr);
+        xdr_free((xdrproc_t) xdr_READDIR3res, reinterpret_cast<char*>(&listres));
+    } while (!eof);
+
+    // Look up the files in batches, with all LOOKUP calls of a batch in flight
+    // at the same time, and list each batch in order once it is complete.
+    for (int first = 0; first < filesToList.size(); first += NFS3_LOOKUP_BATCH) {
+        const int count = qMin(NFS3_LOOKUP_BATCH, filesToList.size() - first);
+
+        QVector<QByteArray> names(count);
+        QVector<LOOKUP3args> lookupArgs(count);
+        QVector<LOOKUP3res> lookupRes(count);
+        QVector<int> lookupStatus(count);
+
+        NFSRpcBatch batch(m_nfsClient, pipeline(), clnt_timeout, lookupWindow());
+        for (int i = 0; i < count; ++i) {
+            names[i] = QFile::encodeName(filesToList.at(first + i));
+            fh.toFH(lookupArgs[i].what.dir);
+            lookupArgs[i].what.name = names[i].data();
+
+            batch.add(NFSPROC3_LOOKUP,
+                      (xdrproc_t) xdr_LOOKUP3args, reinterpret_cast<caddr_t>(&lookupArgs[i]),
+                      (xdrproc_t) xdr_LOOKUP3res, reinterpret_cast<caddr_t>(&lookupRes[i]),
+                      &lookupStatus[i]);
+        }
+        batch.run();
 
-                            linkFH = lookupRes.LOOKUP3res_u.resok.object;
-                            linkFH.setLinkSource(dirres.LOOKUP3res_u.resok.object);
+        KIO::UDSEntryList entries;
+        QVector<LinkEntry> links;
+        for (int i = 0; i < count; ++i) {
+            const QString& name = filesToList.at(first + i);
+            const QString filePath = QFileInfo(QDir(path), name).filePath();
 
-                            completeUDSEntry(entry, attrAndStat.GETATTR3res_u.resok.obj_attributes);
-                        }
-                    }
-                }
+            if (lookupStatus[i] != RPC_SUCCESS || lookupRes[i].status != NFS3_OK) {
+                qCDebug(LOG_KIO_NFS) << "Failed to lookup" << filePath << ", rpc:" << lookupStatus[i] << ", nfs:" << lookupRes[i].status;
+                // Try the next file instead of aborting
+                continue;
+            }
 
-                if (badLink) {
-                    linkFH = dirres.LOOKUP3res_u.resok.object;
-                    linkFH.setBadLink();
+            const LOOKUP3resok& resok = lookupRes[i].LOOKUP3res_u.resok;
 
-                    completeBadLinkUDSEntry(entry, dirres.LOOKUP3res_u.resok.obj_attributes.post_op_attr_u.attributes);
-                }
-
-                addFileHandle(filePath, linkFH);
+            KIO::UDSEntry entry;
+            entry.insert(KIO::UDSEntry::UDS_NAME, name);
+
+            // Is it a symlink?
+            if (resok.obj_attributes.post_op_attr_u.attributes.type == NF3LNK) {
+                LinkEntry link;
+                link.index = entries.size();
+                link.path = filePath;
+                link.handle = resok.object;
+                link.attributes = resok.obj_attributes.post_op_attr_u.attributes;
+                links.append(link);
             } else {
-                entry.insert(KIO::UDSEntry::UDS_LINK_DEST, i18n("Unknown target"));
-                completeBadLinkUDSEntry(entry, dirres.LOOKUP3res_u.resok.obj_attributes.post_op_attr_u.attributes);
+                addFileHandle(filePath, resok.object);
+                cacheAttributes(filePath, resok.obj_attributes);
+
+                completeUDSEntry(entry, resok.obj_attributes.post_op_attr_u.attributes);
             }
-        } else {
-            addFileHandle(filePath, dirres.LOOKUP3res_u.resok.object);
 
-            completeUDSEntry(entry, dirres.LOOKUP3res_u.resok.obj_attributes.post_op_attr_u.attributes);
+            entries.append(entry);
         }
 
-        m_slave->listEntry(entry);
+        completeLinkEntries(path, entries, links);
+        m_slave->listEntries(entries);
+
+        for (int i = 0; i < count; ++i) {
+            xdr_free((xdrproc_t) xdr_LOOKUP3res, reinterpret_cast<char*>(&lookupRes[i]));
+        }
     }
 
     m_slave->finished();
@@ -775,6 +763,8 @@ void NFSProtocolV3::mkdir(const QUrl& url, int permissions)
         return;
     }
 
+    removeFileAttributes(fileInfo.path());
+
     m_slave->finished();
 }
 
@@ -841,72 +831,46 @@ void NFSProtocolV3::get(const QUrl& url)
         initPreferredSizes(fh);
     }
 
-    READ3args readArgs;
-    memset(&readArgs, 0, sizeof(readArgs));
-    fh.toFH(readArgs.file);
-    readArgs.offset = 0;
-    readArgs.count = m_readBufferSize;
-
-    READ3res readRes;
-    memset(&readRes, 0, sizeof(readRes));
-    readRes.READ3res_u.resok.data.data_len = m_readBufferSize;
-    readRes.READ3res_u.resok.data.data_val = new char[m_readBufferSize];
-
-    // Most likely indicates out of memory
-    if (!readRes.READ3res_u.resok.data.data_val) {
-        m_slave->error(KIO::ERR_OUT_OF_MEMORY, path);
-        return;
-    }
+    NFSReadStreamV3 stream(m_nfsClient, pipeline(), clnt_timeout, fh, 0, m_readBufferSize, readWindow());
 
     bool validRead = false;
     bool hasError = false;
-    int read = 0;
+    bool firstRead = true;
     QByteArray readBuffer;
     do {
-        int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_READ,
-                                  (xdrproc_t) xdr_READ3args, reinterpret_cast<caddr_t>(&readArgs),
-                                  (xdrproc_t) xdr_READ3res, reinterpret_cast<caddr_t>(&readRes),
-                                  clnt_timeout);
-
-        // We are trying to read a directory, fail quietly
-        if (readRes.status == NFS3ERR_ISDIR) {
-            break;
-        }
+        if (!stream.next(readBuffer)) {
+            // We are trying to read a directory, fail quietly
+            if (stream.nfsStatus() == NFS3ERR_ISDIR) {
+                break;
+            }
 
-        if (!checkForError(clnt_stat, readRes.status, path)) {
+            checkForError(stream.rpcStatus(), stream.nfsStatus(), path);
             hasError = true;
             break;
         }
 
-        read = readRes.READ3res_u.resok.count;
-        readBuffer.setRawData(readRes.READ3res_u.resok.data.data_val, read);
+        if (firstRead) {
+            firstRead = false;
 
-        if (readArgs.offset == 0) {
             const QMimeDatabase db;
             const QMimeType type = db.mimeTypeForFileNameAndData(url.fileName(), readBuffer);
             m_slave->mimeType(type.name());
 
-            m_slave->totalSize(readRes.READ3res_u.resok.file_attributes.post_op_attr_u.attributes.size);
+            m_slave->totalSize(stream.fileSize());
         }
 
-        readArgs.offset += read;
-        if (read > 0) {
+        if (!readBuffer.isEmpty()) {
             validRead = true;
 
             m_slave->data(readBuffer);
-            m_slave->processedSize(readArgs.offset);
+            m_slave->processedSize(stream.offset());
         }
-
-    } while (read > 0);
-
-    if (readRes.READ3res_u.resok.data.data_val != nullptr) {
-        delete [] readRes.READ3res_u.resok.data.data_val;
-    }
+    } while (!readBuffer.isEmpty());
 
     // Only send the read data to the slave if we have actually sent some.
     if (validRead) {
         m_slave->data(QByteArray());
-        m_slave->processedSize(readArgs.offset);
+        m_slave->processedSize(stream.offset());
     }
 
     if (!hasError) {
@@ -954,68 +918,31 @@ void NFSProtocolV3::put(const QUrl& url, int _mode, KIO::JobFlags flags)
 
     int result;
 
-    WRITE3args writeArgs;
-    memset(&writeArgs, 0, sizeof(writeArgs));
-
-    destFH.toFH(writeArgs.file);
-    writeArgs.offset = 0;
-    writeArgs.stable = FILE_SYNC;
-
-    WRITE3res writeRes;
-    memset(&writeRes, 0, sizeof(writeRes));
+    NFSWriteStreamV3 stream(m_nfsClient, pipeline(), clnt_timeout, destFH, 0, m_writeBufferSize, writeWindow());
 
     // Loop until we get 0 (end of data).
-    int bytesWritten = 0;
     bool error = false;
     do {
         QByteArray buffer;
         m_slave->dataReq();
         result = m_slave->readData(buffer);
 
-        if (result > 0) {
-            char* data = buffer.data();
-            uint32 bytesToWrite = buffer.size();
-            int writeNow(0);
-
-            do {
-                if (bytesToWrite > m_writeBufferSize) {
-                    writeNow = m_writeBufferSize;
-                } else {
-                    writeNow = bytesToWrite;
-                }
-
-                writeArgs.data.data_val = data;
-                writeArgs.data.data_len = writeNow;
-                writeArgs.count = writeNow;
-
-                int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_WRITE,
-                                          (xdrproc_t) xdr_WRITE3args, reinterpret_cast<caddr_t>(&writeArgs),
-                                          (xdrproc_t) xdr_WRITE3res, reinterpret_cast<caddr_t>(&writeRes),
-                                          clnt_timeout);
-
-                if (!checkForError(clnt_stat, writeRes.status, destPath)) {
-                    error = true;
-                    break;
-                }
-
-                writeNow = writeRes.WRITE3res_u.resok.count;
-
-                bytesWritten += writeNow;
-                writeArgs.offset = bytesWritten;
-
-                data = data + writeNow;
-                bytesToWrite -= writeNow;
-            } while (bytesToWrite > 0);
-        }
-
-        if (error) {
+        if (result > 0 && !stream.write(buffer.constData(), buffer.size())) {
+            error = true;
             break;
         }
     } while (result > 0);
 
-    if (!error) {
-        m_slave->finished();
+    // The size and times the cache got from CREATE are outdated now.
+    removeFileAttributes(destPath);
+
+    // The writes are unstable, only report success once they are committed.
+    if (error || !stream.commit()) {
+        checkForError(stream.rpcStatus(), stream.nfsStatus(), destPath);
+        return;
     }
+
+    m_slave->finished();
 }
 
 void NFSProtocolV3::rename(const QUrl& src, const QUrl& dest, KIO::JobFlags _flags)
@@ -1049,6 +976,253 @@ void NFSProtocolV3::rename(const QUrl& src, const QUrl& dest, KIO::JobFlags _fla
     m_slave->finished();
 }
 
+void NFSProtocolV3::open(const QUrl& url, QIODevice::OpenMode mode)
+{
+    qCDebug(LOG_KIO_NFS) << url << mode;
+
+    resetOpenFile();
+
+    const QString path(url.path());
+
+    int rpcStatus;
+
+    NFSFileHandle fh = getFileHandle(path);
+    if (fh.isInvalid() && !fh.isBadLink() && (mode & QIODevice::WriteOnly)) {
+        // Opening a missing file for writing creates it, just like put does.
+        if (isExportedDir(QFileInfo(path).path())) {
+            m_slave->error(KIO::ERR_WRITE_ACCESS_DENIED, path);
+            return;
+        }
+
+        CREATE3res createRes;
+        if (!create(path, -1, rpcStatus, createRes)) {
+            checkForError(rpcStatus, createRes.status, path);
+            return;
+        }
+
+        fh = createRes.CREATE3res_u.resok.obj.post_op_fh3_u.handle;
+    }
+
+    if (fh.isInvalid() || fh.isBadLink()) {
+        m_slave->error(KIO::ERR_DOES_NOT_EXIST, path);
+        return;
+    }
+
+    // Another client may have changed the file since we last looked at it.
+    removeFileAttributes(path);
+
+    GETATTR3res attrRes;
+    if (!getAttr(path, rpcStatus, attrRes)) {
+        checkForError(rpcStatus, attrRes.status, path);
+        return;
+    }
+
+    if (attrRes.GETATTR3res_u.resok.obj_attributes.type == NF3DIR) {
+        m_slave->error(KIO::ERR_IS_DIRECTORY, path);
+        return;
+    }
+
+    uint64 size = attrRes.GETATTR3res_u.resok.obj_attributes.size;
+
+    if (m_readBufferSize == 0) {
+        initPreferredSizes(fh);
+    }
+
+    if ((mode & QIODevice::WriteOnly) && (mode & QIODevice::Truncate) && !(mode & QIODevice::Append)) {
+        sattr3 attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size.set_it = true;
+        attributes.size.set_size3_u.size = 0;
+
+        SETATTR3res setAttrRes;
+        if (!setAttr(path, attributes, rpcStatus, setAttrRes)) {
+            checkForError(rpcStatus, setAttrRes.status, path);
+            return;
+        }
+
+        size = 0;
+    }
+
+    m_openPath = path;
+    m_openFH = fh;
+    m_openMode = mode;
+    m_openOffset = 0;
+
+    m_slave->totalSize(size);
+
+    // The first read determines the mime type, and stays around for the
+    // first @read.
+    if (mode & QIODevice::ReadOnly) {
+        m_openReadStream = new NFSReadStreamV3(m_nfsClient, pipeline(), clnt_timeout, m_openFH, 0, m_readBufferSize, readWindow());
+        if (!m_openReadStream->next(m_openReadAhead)) {
+            checkForError(m_openReadStream->rpcStatus(), m_openReadStream->nfsStatus(), path);
+            resetOpenFile();
+            return;
+        }
+
+        const QMimeDatabase db;
+        const QMimeType type = db.mimeTypeForFileNameAndData(url.fileName(), m_openReadAhead);
+        m_slave->mimeType(type.name());
+    }
+
+    if (mode & QIODevice::Append) {
+        discardReadAhead();
+        m_openOffset = size;
+    }
+
+    m_slave->position(m_openOffset);
+    m_slave->opened();
+}
+
+void NFSProtocolV3::read(KIO::filesize_t bytesRequested)
+{
+    qCDebug(LOG_KIO_NFS) << m_openPath << m_openOffset << bytesRequested;
+
+    if (m_openPath.isEmpty() || !(m_openMode & QIODevice::ReadOnly)) {
+        m_slave->error(KIO::ERR_COULD_NOT_READ, m_openPath);
+        return;
+    }
+
+    // Make sure the server has what was written before.
+    if (!commitOpenFile()) {
+        resetOpenFile();
+        return;
+    }
+
+    if (m_openReadStream == nullptr) {
+        m_openReadStream = new NFSReadStreamV3(m_nfsClient, pipeline(), clnt_timeout, m_openFH, m_openOffset, m_readBufferSize, readWindow());
+    }
+
+    // The stream keeps reading ahead while we wait for the data we need.
+    while (static_cast<KIO::filesize_t>(m_openReadAhead.size()) < bytesRequested) {
+        QByteArray readBuffer;
+        if (!m_openReadStream->next(readBuffer)) {
+            checkForError(m_openReadStream->rpcStatus(), m_openReadStream->nfsStatus(), m_openPath);
+            resetOpenFile();
+            return;
+        }
+
+        if (readBuffer.isEmpty()) {
+            break;
+        }
+
+        m_openReadAhead.append(readBuffer);
+    }
+
+    const int count = static_cast<int>(qMin<KIO::filesize_t>(bytesRequested, m_openReadAhead.size()));
+    const QByteArray fileData = m_openReadAhead.left(count);
+    m_openReadAhead.remove(0, count);
+    m_openOffset += count;
+
+    m_slave->data(fileData);
+}
+
+void NFSProtocolV3::write(const QByteArray& data)
+{
+    qCDebug(LOG_KIO_NFS) << m_openPath << m_openOffset << data.size();
+
+    if (m_openPath.isEmpty() || !(m_openMode & QIODevice::WriteOnly)) {
+        m_slave->error(KIO::ERR_COULD_NOT_WRITE, m_openPath);
+        return;
+    }
+
+    // Whatever was read ahead may be overwritten now.
+    discardReadAhead();
+
+    // A write stream only writes sequentially, after a seek we need a new one.
+    if (m_openWriteStream != nullptr && m_openWriteStream->offset() != m_openOffset) {
+        if (!commitOpenFile()) {
+            resetOpenFile();
+            return;
+        }
+    }
+
+    if (m_openWriteStream == nullptr) {
+        m_openWriteStream = new NFSWriteStreamV3(m_nfsClient, pipeline(), clnt_timeout, m_openFH, m_openOffset, m_writeBufferSize, writeWindow());
+    }
+
+    if (!m_openWriteStream->write(data.constData(), data.size())) {
+        checkForError(m_openWriteStream->rpcStatus(), m_openWriteStream->nfsStatus(), m_openPath);
+        resetOpenFile();
+        return;
+    }
+
+    removeFileAttributes(m_openPath);
+    m_openOffset += data.size();
+
+    m_slave->written(data.size());
+}
+
+void NFSProtocolV3::seek(KIO::filesize_t offset)
+{
+    qCDebug(LOG_KIO_NFS) << m_openPath << offset;
+
+    if (m_openPath.isEmpty()) {
+        m_slave->error(KIO::ERR_COULD_NOT_SEEK, m_openPath);
+        return;
+    }
+
+    // Seeking forward within what was read ahead keeps the read stream.
+    if (offset >= m_openOffset && offset - m_openOffset <= static_cast<KIO::filesize_t>(m_openReadAhead.size())) {
+        m_openReadAhead.remove(0, static_cast<int>(offset - m_openOffset));
+    } else {
+        discardReadAhead();
+    }
+
+    m_openOffset = offset;
+    m_slave->position(m_openOffset);
+}
+
+void NFSProtocolV3::close()
+{
+    qCDebug(LOG_KIO_NFS) << m_openPath;
+
+    const bool committed = commitOpenFile();
+    resetOpenFile();
+
+    if (committed) {
+        m_slave->finished();
+    }
+}
+
+void NFSProtocolV3::discardReadAhead()
+{
+    delete m_openReadStream;
+    m_openReadStream = nullptr;
+
+    m_openReadAhead.clear();
+}
+
+bool NFSProtocolV3::commitOpenFile()
+{
+    if (m_openWriteStream == nullptr) {
+        return true;
+    }
+
+    const bool ret = m_openWriteStream->commit();
+    if (!ret) {
+        checkForError(m_openWriteStream->rpcStatus(), m_openWriteStream->nfsStatus(), m_openPath);
+    }
+
+    delete m_openWriteStream;
+    m_openWriteStream = nullptr;
+
+    return ret;
+}
+
+void NFSProtocolV3::resetOpenFile()
+{
+    discardReadAhead();
+
+    delete m_openWriteStream;
+    m_openWriteStream = nullptr;
+
+    m_openPath.clear();
+    m_openFH = NFSFileHandle();
+    m_openMode = QIODevice::NotOpen;
+    m_openOffset = 0;
+}
+
 void NFSProtocolV3::copySame(const QUrl& src, const QUrl& dest, int _mode, KIO::JobFlags _flags)
 {
     qCDebug(LOG_KIO_NFS) << src << "to" << dest;
@@ -1161,88 +1335,71 @@ void NFSProtocolV3::copySame(const QUrl& src, const QUrl& dest, int _mode, KIO::
         qCDebug(LOG_KIO_NFS) << "Resuming old transfer";
     }
 
-    // Check what buffer size we should use, always use the smallest one.
-    const int bufferSize = (m_readBufferSize < m_writeBufferSize) ? m_readBufferSize : m_writeBufferSize;
-
-    WRITE3args writeArgs;
-    memset(&writeArgs, 0, sizeof(writeArgs));
-
-    destFH.toFH(writeArgs.file);
-    writeArgs.offset = 0;
-    writeArgs.data.data_val = new char[bufferSize];
-    writeArgs.stable = FILE_SYNC;
-
-    READ3args readArgs;
-    memset(&readArgs, 0, sizeof(readArgs));
-
-    srcFH.toFH(readArgs.file);
-    readArgs.offset = 0;
-    readArgs.count = bufferSize;
-
-    if (bResume) {
-        writeArgs.offset = resumeOffset;
-        readArgs.offset = resumeOffset;
+    if (m_readBufferSize == 0 || m_writeBufferSize == 0) {
+        initPreferredSizes(srcFH);
     }
 
-    READ3res readRes;
-    readRes.READ3res_u.resok.data.data_val = writeArgs.data.data_val;
+    // The reads and the writes each have a window and a connection of their
+    // own, so that the READs for the next part of the file are already on
+    // their way while the WRITEs of the previous part are. The data in
+    // flight is bounded by the two windows and the commit interval.
+    NFSRpcPipeline* readPipeline = pipeline();
+    NFSRpcPipeline writePipeline;
+    if (readPipeline != nullptr && !writePipeline.open(m_nfsSock, m_nfsClient, NFSPROG, NFSVERS)) {
+        qCDebug(LOG_KIO_NFS) << "No second connection, writing synchronously";
+    }
 
-    WRITE3res writeRes;
-    memset(&writeRes, 0, sizeof(WRITE3res));
+    NFSReadStreamV3 readStream(m_nfsClient, readPipeline, clnt_timeout, srcFH, bResume ? resumeOffset : 0, m_readBufferSize, readWindow());
+    NFSWriteStreamV3 stream(m_nfsClient, writePipeline.isOpen() ? &writePipeline : nullptr, clnt_timeout,
+                            destFH, bResume ? resumeOffset : 0, m_writeBufferSize, writeWindow());
 
     bool error = false;
-    int bytesRead = 0;
+    bool firstRead = true;
+    QByteArray buffer;
     do {
-        int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_READ,
-                                  (xdrproc_t) xdr_READ3args, reinterpret_cast<caddr_t>(&readArgs),
-                                  (xdrproc_t) xdr_READ3res, reinterpret_cast<caddr_t>(&readRes),
-                                  clnt_timeout);
-
-        if (!checkForError(clnt_stat, readRes.status, srcPath)) {
+        if (!readStream.next(buffer)) {
+            checkForError(readStream.rpcStatus(), readStream.nfsStatus(), srcPath);
             error = true;
             break;
         }
 
-        bytesRead = readRes.READ3res_u.resok.data.data_len;
-
         // We should only send out the total size and mimetype at the start of the transfer
-        if (readArgs.offset == 0 || (bResume && writeArgs.offset == resumeOffset)) {
+        if (firstRead) {
+            firstRead = false;
+
             QMimeDatabase db;
-            QMimeType type = db.mimeTypeForFileNameAndData(src.fileName(), QByteArray::fromRawData(writeArgs.data.data_val, bytesRead));
+            QMimeType type = db.mimeTypeForFileNameAndData(src.fileName(), buffer);
             m_slave->mimeType(type.name());
 
-            m_slave->totalSize(readRes.READ3res_u.resok.file_attributes.post_op_attr_u.attributes.size);
+            m_slave->totalSize(readStream.fileSize());
         }
 
-        if (bytesRead > 0) {
-            readArgs.offset += bytesRead;
-
-            writeArgs.count = bytesRead;
-            writeArgs.data.data_len = bytesRead;
-
-            clnt_stat = clnt_call(m_nfsClient, NFSPROC3_WRITE,
-                                  (xdrproc_t) xdr_WRITE3args, reinterpret_cast<caddr_t>(&writeArgs),
-                                  (xdrproc_t) xdr_WRITE3res, reinterpret_cast<caddr_t>(&writeRes),
-                                  clnt_timeout);
-
-            if (!checkForError(clnt_stat, writeRes.status, destPath)) {
+        if (!buffer.isEmpty()) {
+            if (!stream.write(buffer.constData(), buffer.size())) {
+                checkForError(stream.rpcStatus(), stream.nfsStatus(), destPath);
                 error = true;
                 break;
             }
 
-            writeArgs.offset += bytesRead;
-
-            m_slave->processedSize(readArgs.offset);
+            m_slave->processedSize(readStream.offset());
         }
-    } while (bytesRead > 0);
+    } while (!buffer.isEmpty());
 
-    delete [] writeArgs.data.data_val;
+    // The size and times the cache got from CREATE are outdated now.
+    removeFileAttributes(bMarkPartial ? partFilePath : destPath);
+
+    // The writes are unstable, make sure they have reached the disk before
+    // the part file is renamed.
+    if (!error && !stream.commit()) {
+        checkForError(stream.rpcStatus(), stream.nfsStatus(), destPath);
+        error = true;
+    }
 
     if (error) {
         if (bMarkPartial) {
             // Remove the part file if it's smaller than the minimum keep size.
             const unsigned int size = m_slave->config()->readEntry("MinimumKeepSize", DEFAULT_MINIMUM_KEEP_SIZE);
-            if (writeArgs.offset <  size) {
+            if (stream.offset() <  size) {
                 if (!remove(partFilePath)) {
                     qCDebug(LOG_KIO_NFS) << "Could not remove part file, ignoring...";
                 }
@@ -1279,9 +1436,9 @@ void NFSProtocolV3::copySame(const QUrl& src, const QUrl& dest, int _mode, KIO::
             }
         }
 
-        qCDebug(LOG_KIO_NFS) << "Copied" << writeArgs.offset << "bytes of data";
+        qCDebug(LOG_KIO_NFS) << "Copied" << stream.offset() << "bytes of data";
 
-        m_slave->processedSize(readArgs.offset);
+        m_slave->processedSize(readStream.offset());
         m_slave->finished();
     }
 }
@@ -1390,60 +1547,39 @@ void NFSProtocolV3::copyFrom(const QUrl& src, const QUrl& dest, int _mode, KIO::
         return;
     }
 
-    READ3args readArgs;
-    srcFH.toFH(readArgs.file);
-    if (bResume) {
-        readArgs.offset = resumeOffset;
-    } else {
-        readArgs.offset = 0;
-    }
-    readArgs.count = m_readBufferSize;
-
-    READ3res readRes;
-    memset(&readRes, 0, sizeof(readres));
-    readRes.READ3res_u.resok.data.data_val = new char[m_readBufferSize];
-    readRes.READ3res_u.resok.data.data_len = m_readBufferSize;
+    NFSReadStreamV3 stream(m_nfsClient, pipeline(), clnt_timeout, srcFH, bResume ? resumeOffset : 0, m_readBufferSize, readWindow());
 
     bool error = false;
-    unsigned long bytesToRead = 0, bytesRead = 0;
+    bool firstRead = true;
+    QByteArray readBuffer;
     do {
-        int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_READ,
-                                  (xdrproc_t) xdr_READ3args, reinterpret_cast<caddr_t>(&readArgs),
-                                  (xdrproc_t) xdr_READ3res, reinterpret_cast<caddr_t>(&readRes),
-                                  clnt_timeout);
-
-        if (!checkForError(clnt_stat, readRes.status, destPath)) {
+        if (!stream.next(readBuffer)) {
+            checkForError(stream.rpcStatus(), stream.nfsStatus(), destPath);
             error = true;
             break;
         }
 
-        bytesRead = readRes.READ3res_u.resok.count;
+        if (firstRead) {
+            firstRead = false;
 
-        if (readArgs.offset == 0 || (bResume && readArgs.offset == resumeOffset)) {
-            bytesToRead = readRes.READ3res_u.resok.file_attributes.post_op_attr_u.attributes.size;
-
-            m_slave->totalSize(bytesToRead);
+            m_slave->totalSize(stream.fileSize());
 
             QMimeDatabase db;
-            QMimeType type = db.mimeTypeForFileNameAndData(src.fileName(), QByteArray::fromRawData(readRes.READ3res_u.resok.data.data_val, bytesRead));
+            QMimeType type = db.mimeTypeForFileNameAndData(src.fileName(), readBuffer);
             m_slave->mimeType(type.name());
         }
 
-        if (bytesRead > 0) {
-            readArgs.offset += bytesRead;
-
-            if (destFile.write(readRes.READ3res_u.resok.data.data_val, bytesRead) < 0) {
+        if (!readBuffer.isEmpty()) {
+            if (destFile.write(readBuffer) < 0) {
                 m_slave->error(KIO::ERR_COULD_NOT_WRITE, destPath);
 
                 error = true;
                 break;
             }
 
-            m_slave->processedSize(readArgs.offset);
+            m_slave->processedSize(stream.offset());
         }
-    } while (readArgs.offset < bytesToRead);
-
-    delete [] readRes.READ3res_u.resok.data.data_val;
+    } while (!readBuffer.isEmpty());
 
     // Close the file so we can modify the modification time later.
     destFile.close();
@@ -1482,9 +1618,9 @@ void NFSProtocolV3::copyFrom(const QUrl& src, const QUrl& dest, int _mode, KIO::
             }
         }
 
-        qCDebug(LOG_KIO_NFS) << "Copied" << readArgs.offset << "bytes of data";
+        qCDebug(LOG_KIO_NFS) << "Copied" << stream.offset() << "bytes of data";
 
-        m_slave->processedSize(readArgs.offset);
+        m_slave->processedSize(stream.offset());
         m_slave->finished();
     }
 }
@@ -1600,27 +1736,14 @@ void NFSProtocolV3::copyTo(const QUrl& src, const QUrl& dest, int _mode, KIO::Jo
         initPreferredSizes(destFH);
     }
 
-    // Set up write arguments.
-    WRITE3args writeArgs;
-    memset(&writeArgs, 0, sizeof(writeArgs));
-    destFH.toFH(writeArgs.file);
-    writeArgs.data.data_val = new char[m_writeBufferSize];
-    writeArgs.stable = FILE_SYNC;
-    if (bResume) {
-        writeArgs.offset = resumeOffset;
-    } else {
-        writeArgs.offset = 0;
-    }
+    NFSWriteStreamV3 stream(m_nfsClient, pipeline(), clnt_timeout, destFH, bResume ? resumeOffset : 0, m_writeBufferSize, writeWindow());
 
-    WRITE3res writeRes;
-    memset(&writeRes, 0 , sizeof(writeRes));
+    QByteArray buffer(m_writeBufferSize, Qt::Uninitialized);
 
     bool error = false;
     int bytesRead = 0;
     do {
-        memset(writeArgs.data.data_val, 0, m_writeBufferSize);
-
-        bytesRead = srcFile.read(writeArgs.data.data_val, m_writeBufferSize);
+        bytesRead = srcFile.read(buffer.data(), buffer.size());
         if (bytesRead < 0) {
             m_slave->error(KIO::ERR_COULD_NOT_READ, srcPath);
 
@@ -1629,32 +1752,31 @@ void NFSProtocolV3::copyTo(const QUrl& src, const QUrl& dest, int _mode, KIO::Jo
         }
 
         if (bytesRead > 0) {
-            writeArgs.count = bytesRead;
-            writeArgs.data.data_len = bytesRead;
-
-            int clnt_stat = clnt_call(m_nfsClient, NFSPROC3_WRITE,
-                                      (xdrproc_t) xdr_WRITE3args, reinterpret_cast<caddr_t>(&writeArgs),
-                                      (xdrproc_t) xdr_WRITE3res, reinterpret_cast<caddr_t>(&writeRes),
-                                      clnt_timeout);
-
-            if (!checkForError(clnt_stat, writeRes.status, destPath)) {
+            if (!stream.write(buffer.constData(), bytesRead)) {
+                checkForError(stream.rpcStatus(), stream.nfsStatus(), destPath);
                 error = true;
                 break;
             }
 
-            writeArgs.offset += bytesRead;
-
-            m_slave->processedSize(writeArgs.offset);
+            m_slave->processedSize(stream.offset());
         }
     } while (bytesRead > 0);
 
-    delete [] writeArgs.data.data_val;
+    // The size and times the cache got from CREATE are outdated now.
+    removeFileAttributes(bMarkPartial ? partFilePath : destPath);
+
+    // The writes are unstable, make sure they have reached the disk before
+    // the part file is renamed.
+    if (!error && !stream.commit()) {
+        checkForError(stream.rpcStatus(), stream.nfsStatus(), destPath);
+        error = true;
+    }
 
     if (error) {
         if (bMarkPartial) {
             // Remove the part file if it's smaller than the minimum keep size.
             const unsigned int size = m_slave->config()->readEntry("MinimumKeepSize", DEFAULT_MINIMUM_KEEP_SIZE);
-            if (writeArgs.offset <  size) {
+            if (stream.offset() <  size) {
                 if (!remove(partFilePath)) {
                     qCDebug(LOG_KIO_NFS) << "Could not remove part file, ignoring...";
                 }
@@ -1694,9 +1816,9 @@ void NFSProtocolV3::copyTo(const QUrl& src, const QUrl& dest, int _mode, KIO::Jo
             }
         }
 
-        qCDebug(LOG_KIO_NFS) << "Copied" << writeArgs.offset << "bytes of data";
+        qCDebug(LOG_KIO_NFS) << "Copied" << stream.offset() << "bytes of data";
 
-        m_slave->processedSize(writeArgs.offset);
+        m_slave->processedSize(stream.offset());
         m_slave->finished();
     }
 }
@@ -1750,7 +1872,210 @@ void NFSProtocolV3::initPreferredSizes(const NFSFileHandle& fh)
         m_readDirSize = NFS3_MAXDATA;
     }
 
-    qCDebug(LOG_KIO_NFS) << "Preferred sizes - write" << m_writeBufferSize << ", read" << m_readBufferSize << ", read dir" << m_readDirSize;
+    // dtpref counts only the names and cookies, a READDIRPLUS reply also has
+    // the attributes and handle of each entry, several times as much. A page
+    // the size of a READ is what the server sends best; over TCP it is cut
+    // down to whole segments, so that no page ends with a nearly empty one,
+    // and over UDP to what a datagram can carry.
+    m_readDirPlusSize = qMax(m_readDirSize, m_readBufferSize);
+
+    int sockType = 0;
+    socklen_t optionLength = sizeof(sockType);
+    if (getsockopt(m_nfsSock, SOL_SOCKET, SO_TYPE, &sockType, &optionLength) == 0 && sockType == SOCK_DGRAM) {
+        m_readDirPlusSize = qMin<uint32>(m_readDirPlusSize, UDPMSGSIZE - NFS3_REPLY_OVERHEAD);
+        m_readDirSize = qMin(m_readDirSize, m_readDirPlusSize);
+    } else {
+        int segmentSize = 0;
+        optionLength = sizeof(segmentSize);
+        if (getsockopt(m_nfsSock, IPPROTO_TCP, TCP_MAXSEG, &segmentSize, &optionLength) == 0 && segmentSize > 0) {
+            const uint32 segments = (m_readDirPlusSize + NFS3_REPLY_OVERHEAD) / segmentSize;
+            if (segments > 0) {
+                m_readDirPlusSize = segments * segmentSize - NFS3_REPLY_OVERHEAD;
+            }
+        }
+    }
+
+    qCDebug(LOG_KIO_NFS) << "Preferred sizes - write" << m_writeBufferSize << ", read" << m_readBufferSize << ", read dir" << m_readDirSize << ", read dir plus" << m_readDirPlusSize;
+}
+
+void NFSProtocolV3::cacheAttributes(const QString& path, const post_op_attr& attributes)
+{
+    // The handle of a link is the handle of its target, so its own
+    // attributes would not match what a GETATTR returns for the path.
+    if (attributes.attributes_follow && attributes.post_op_attr_u.attributes.type != NF3LNK) {
+        addFileAttributes(path, attributes.post_op_attr_u.attributes);
+    } else {
+        removeFileAttributes(path);
+    }
+}
+
+NFSRpcPipeline* NFSProtocolV3::pipeline()
+{
+    if (!m_pipeline.isOpen() && !m_pipelineFailed && isConnected()) {
+        if (!m_pipeline.open(m_nfsSock, m_nfsClient, NFSPROG, NFSVERS)) {
+            qCDebug(LOG_KIO_NFS) << "No pipelined connection, using synchronous calls";
+
+            // Don't try again until we reconnect.
+            m_pipelineFailed = true;
+        }
+    }
+
+    return m_pipeline.isOpen() ? &m_pipeline : nullptr;
+}
+
+int NFSProtocolV3::readWindow() const
+{
+    return window(QStringLiteral("ReadWindow"));
+}
+
+int NFSProtocolV3::writeWindow() const
+{
+    return window(QStringLiteral("WriteWindow"));
+}
+
+int NFSProtocolV3::lookupWindow() const
+{
+    return window(QStringLiteral("LookupWindow"));
+}
+
+int NFSProtocolV3::window(const QString& key) const
+{
+    // Meta data of the job overrides the configuration, the benchmark in
+    // autotests compares window sizes like this.
+    const int size = m_slave->hasMetaData(key) ? m_slave->metaData(key).toInt()
+                                               : m_slave->config()->readEntry(key, NFS3_DEFAULT_WINDOW);
+    return qBound(1, size, NFS3_MAX_WINDOW);
+}
+
+void NFSProtocolV3::completeLinkEntries(const QString& dirPath, KIO::UDSEntryList& entries, const QVector<LinkEntry>& links)
+{
+    const int count = links.size();
+    if (count == 0) {
+        return;
+    }
+
+    NFSRpcBatch batch(m_nfsClient, pipeline(), clnt_timeout, lookupWindow());
+
+    // First read where all the links point to...
+    QVector<READLINK3args> readLinkArgs(count);
+    QVector<READLINK3res> readLinkRes(count);
+    QVector<int> readLinkStatus(count);
+    for (int i = 0; i < count; ++i) {
+        links.at(i).handle.toFH(readLinkArgs[i].symlink);
+
+        batch.add(NFSPROC3_READLINK,
+                  (xdrproc_t) xdr_READLINK3args, reinterpret_cast<caddr_t>(&readLinkArgs[i]),
+                  (xdrproc_t) xdr_READLINK3res, reinterpret_cast<caddr_t>(&readLinkRes[i]),
+                  &readLinkStatus[i]);
+    }
+    batch.run();
+
+    // ...then look up all the targets in their directories. Targets that can't
+    // be looked up like this (not below a directory we know) are left to
+    // the slower path below.
+    QVector<QString> linkDests(count);
+    QVector<QString> linkPaths(count);
+    QVector<NFSFileHandle> targetDirs(count);
+    QVector<QByteArray> targetNames(count);
+    QVector<LOOKUP3args> lookupArgs(count);
+    QVector<LOOKUP3res> lookupRes(count);
+    QVector<int> lookupStatus(count, -1);
+    for (int i = 0; i < count; ++i) {
+        if (readLinkStatus[i] != RPC_SUCCESS || readLinkRes[i].status != NFS3_OK) {
+            continue;
+        }
+
+        linkDests[i] = QString::fromLocal8Bit(readLinkRes[i].READLINK3res_u.resok.data);
+        if (QFileInfo(linkDests[i]).isAbsolute()) {
+            linkPaths[i] = linkDests[i];
+        } else {
+            linkPaths[i] = QFileInfo(dirPath, linkDests[i]).absoluteFilePath();
+        }
+
+        if (!isValidPath(linkPaths[i]) || isExportedDir(linkPaths[i])) {
+            continue;
+        }
+
+        const QFileInfo targetInfo(linkPaths[i]);
+        targetDirs[i] = getFileHandle(targetInfo.path());
+        if (targetDirs[i].isInvalid() || targetDirs[i].isBadLink()) {
+            continue;
+        }
+
+        targetNames[i] = QFile::encodeName(targetInfo.fileName());
+        targetDirs[i].toFH(lookupArgs[i].what.dir);
+        lookupArgs[i].what.name = targetNames[i].data();
+
+        batch.add(NFSPROC3_LOOKUP,
+                  (xdrproc_t) xdr_LOOKUP3args, reinterpret_cast<caddr_t>(&lookupArgs[i]),
+                  (xdrproc_t) xdr_LOOKUP3res, reinterpret_cast<caddr_t>(&lookupRes[i]),
+                  &lookupStatus[i]);
+    }
+    batch.run();
+
+    for (int i = 0; i < count; ++i) {
+        const LinkEntry& link = links.at(i);
+        KIO::UDSEntry& entry = entries[link.index];
+
+        if (readLinkStatus[i] != RPC_SUCCESS || readLinkRes[i].status != NFS3_OK) {
+            entry.insert(KIO::UDSEntry::UDS_LINK_DEST, i18n("Unknown target"));
+            completeBadLinkUDSEntry(entry, link.attributes);
+            continue;
+        }
+
+        entry.insert(KIO::UDSEntry::UDS_LINK_DEST, linkDests[i]);
+
+        nfs_fh3 linkSource;
+        link.handle.toFH(linkSource);
+
+        bool badLink = true;
+        NFSFileHandle linkFH;
+
+        const LOOKUP3resok& resok = lookupRes[i].LOOKUP3res_u.resok;
+        if (lookupStatus[i] == RPC_SUCCESS && lookupRes[i].status == NFS3_OK &&
+            resok.obj_attributes.attributes_follow && resok.obj_attributes.post_op_attr_u.attributes.type != NF3LNK) {
+            badLink = false;
+
+            addFileHandle(linkPaths[i], resok.object);
+            cacheAttributes(linkPaths[i], resok.obj_attributes);
+
+            linkFH = resok.object;
+            linkFH.setLinkSource(linkSource);
+
+            completeUDSEntry(entry, resok.obj_attributes.post_op_attr_u.attributes);
+        } else if (lookupStatus[i] != RPC_SUCCESS || lookupRes[i].status == NFS3_OK) {
+            // Links to links, exported directories and failed calls.
+            if (isValidLink(dirPath, linkDests[i])) {
+                int rpcStatus;
+                LOOKUP3res linkRes;
+                if (lookupHandle(linkPaths[i], rpcStatus, linkRes)) {
+                    GETATTR3res attrAndStat;
+                    if (getAttr(linkPaths[i], rpcStatus, attrAndStat)) {
+                        badLink = false;
+
+                        linkFH = linkRes.LOOKUP3res_u.resok.object;
+                        linkFH.setLinkSource(linkSource);
+
+                        completeUDSEntry(entry, attrAndStat.GETATTR3res_u.resok.obj_attributes);
+                    }
+                }
+            }
+        }
+
+        if (badLink) {
+            linkFH = link.handle;
+            linkFH.setBadLink();
+
+            completeBadLinkUDSEntry(entry, link.attributes);
+        }
+
+        addFileHandle(link.path, linkFH);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        xdr_free((xdrproc_t) xdr_READLINK3res, reinterpret_cast<char*>(&readLinkRes[i]));
+        xdr_free((xdrproc_t) xdr_LOOKUP3res, reinterpret_cast<char*>(&lookupRes[i]));
+    }
 }
 
 
@@ -1801,7 +2126,19 @@ bool NFSProtocolV3::create(const QString& path, int mode, int& rpcStatus, CREATE
                           (xdrproc_t) xdr_CREATE3res, reinterpret_cast<caddr_t>(&result),
                           clnt_timeout);
 
-    return (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    const bool ret = (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    if (ret) {
+        // A file we overwrite might still be in the cache.
+        removeFileHandle(path);
+        removeFileAttributes(fileInfo.path());
+
+        if (result.CREATE3res_u.resok.obj.handle_follows) {
+            addFileHandle(path, result.CREATE3res_u.resok.obj.post_op_fh3_u.handle);
+            cacheAttributes(path, result.CREATE3res_u.resok.obj_attributes);
+        }
+    }
+
+    return ret;
 }
 
 bool NFSProtocolV3::getAttr(const QString& path, int& rpcStatus, GETATTR3res& result)
@@ -1822,6 +2159,11 @@ bool NFSProtocolV3::getAttr(const QString& path, int& rpcStatus, GETATTR3res& re
         return false;
     }
 
+    if (getFileAttributes(path, result.GETATTR3res_u.resok.obj_attributes)) {
+        result.status = NFS3_OK;
+        return true;
+    }
+
     GETATTR3args args;
     memset(&args, 0, sizeof(GETATTR3args));
     fileFH.toFH(args.object);
@@ -1831,7 +2173,12 @@ bool NFSProtocolV3::getAttr(const QString& path, int& rpcStatus, GETATTR3res& re
                           (xdrproc_t) xdr_GETATTR3res, reinterpret_cast<caddr_t>(&result),
                           clnt_timeout);
 
-    return (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    const bool ret = (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    if (ret) {
+        addFileAttributes(path, result.GETATTR3res_u.resok.obj_attributes);
+    }
+
+    return ret;
 }
 
 bool NFSProtocolV3::lookupHandle(const QString& path, int& rpcStatus, LOOKUP3res& result)
@@ -1865,7 +2212,12 @@ bool NFSProtocolV3::lookupHandle(const QString& path, int& rpcStatus, LOOKUP3res
                           (xdrproc_t) xdr_LOOKUP3res, reinterpret_cast<caddr_t>(&result),
                           clnt_timeout);
 
-    return (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    const bool ret = (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    if (ret) {
+        cacheAttributes(path, result.LOOKUP3res_u.resok.obj_attributes);
+    }
+
+    return ret;
 }
 
 bool NFSProtocolV3::readLink(const QString& path, int& rpcStatus, READLINK3res& result, char* dataBuffer)
@@ -1961,6 +2313,7 @@ bool NFSProtocolV3::remove(const QString& path, int& rpcStatus, REMOVE3res& resu
     if (ret) {
         // Remove it from the cache as well
         removeFileHandle(path);
+        removeFileAttributes(fileInfo.path());
     }
 
     return ret;
@@ -2023,12 +2376,16 @@ bool NFSProtocolV3::rename(const QString& src, const QString& dest, int& rpcStat
 
     bool ret = (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
     if (ret) {
+        // Whatever was cached for either name is gone now.
+        removeFileHandle(src);
+        removeFileHandle(dest);
+        removeFileAttributes(srcFileInfo.path());
+        removeFileAttributes(destFileInfo.path());
+
         // Can we actually find the new handle?
         int lookupStatus;
         LOOKUP3res lookupRes;
         if (lookupHandle(dest, lookupStatus, lookupRes)) {
-            // Remove the old file, and add the new one
-            removeFileHandle(src);
             addFileHandle(dest, lookupRes.LOOKUP3res_u.resok.object);
         }
     }
@@ -2059,7 +2416,13 @@ bool NFSProtocolV3::setAttr(const QString& path, const sattr3& attributes, int&
                           (xdrproc_t) xdr_SETATTR3res, reinterpret_cast<caddr_t>(&result),
                           clnt_timeout);
 
-    return (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    const bool ret = (rpcStatus == RPC_SUCCESS && result.status == NFS3_OK);
+    removeFileAttributes(path);
+    if (ret) {
+        cacheAttributes(path, result.SETATTR3res_u.resok.obj_wcc.after);
+    }
+
+    return ret;
 }
 
 bool NFSProtocolV3::symLink(const QString& target, const QString& dest, int& rpcStatus, SYMLINK3res& result)
@@ -2096,6 +2459,8 @@ bool NFSProtocolV3::symLink(const QString& target, const QString& dest, int& rpc
                           (xdrproc_t) xdr_SYMLINK3res, reinterpret_cast<caddr_t>(&result),
                           clnt_timeout);
 
+    removeFileAttributes(fileInfo.path());
+
     // Add the new handle to the cache
     NFSFileHandle destFH = getFileHandle(dest);
     if (!destFH.isInvalid()) {
@@ -22,6 +22,7 @@
 #define KIO_NFSV3_H
 
 #include "kio_nfs.h"
+#include "rpcpipeline.h"
 
 #define PORTMAP  //this seems to be required to compile on Solaris
 #include <rpc/rpc.h>
@@ -29,6 +30,9 @@
 #include <netinet/in.h>
 #include <sys/time.h>
 
+class NFSReadStreamV3;
+class NFSWriteStreamV3;
+
 class NFSProtocolV3 : public NFSProtocol
 {
 public:
@@ -53,6 +57,12 @@ public:
     void chmod(const QUrl& url, int permissions) override;
     void rename(const QUrl& src, const QUrl& dest, KIO::JobFlags flags) override;
 
+    void open(const QUrl& url, QIODevice::OpenMode mode) override;
+    void read(KIO::filesize_t bytesRequested) override;
+    void write(const QByteArray& data) override;
+    void seek(KIO::filesize_t offset) override;
+    void close() override;
+
 protected:
     void copySame(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) override;
     void copyFrom(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) override;
@@ -85,9 +95,48 @@ private:
 
     bool symLink(const QString& target, const QString& dest, int& rpcStatus, SYMLINK3res& result);
 
+    // Adds post operation attributes to the attribute cache, if there are any.
+    void cacheAttributes(const QString& path, const post_op_attr& attributes);
+
     // Initialises the optimal read, write and read dir buffer sizes
     void initPreferredSizes(const NFSFileHandle& fh);
 
+    // The connection to the NFS server used for pipelined calls, nullptr if
+    // the server can only be reached through m_nfsClient.
+    NFSRpcPipeline* pipeline();
+
+    // The number of READ and WRITE calls to keep outstanding.
+    int readWindow() const;
+    int writeWindow() const;
+
+    // The number of LOOKUP and READLINK calls to keep outstanding when listing.
+    int lookupWindow() const;
+
+    int window(const QString& key) const;
+
+    // Forgets whatever was read ahead of the current offset of the open file.
+    void discardReadAhead();
+
+    // Waits for the outstanding writes to the open file and commits them.
+    // Reports the error if that fails.
+    bool commitOpenFile();
+
+    // Forgets the open file, without committing anything.
+    void resetOpenFile();
+
+    // A symlink found while listing a directory, index is its position in
+    // the listed entries.
+    struct LinkEntry {
+        int index;
+        QString path;
+        NFSFileHandle handle;
+        fattr3 attributes;
+    };
+
+    // Reads the targets of the links and completes their entries, with the
+    // READLINK and LOOKUP calls of all of them in flight at the same time.
+    void completeLinkEntries(const QString& dirPath, KIO::UDSEntryList& entries, const QVector<LinkEntry>& links);
+
     // UDS helper functions
     void completeUDSEntry(KIO::UDSEntry& entry, const fattr3& attributes);
     void completeBadLinkUDSEntry(KIO::UDSEntry& entry, const fattr3& attributes);
@@ -100,15 +149,31 @@ private:
     CLIENT* m_nfsClient;
     int m_nfsSock;
 
+    NFSRpcPipeline m_pipeline;
+    bool m_pipelineFailed;
+
     timeval clnt_timeout;
 
     QHash<long, QString> m_usercache;
     QHash<long, QString> m_groupcache;
 
+    // The file opened with @open, m_openOffset is where the next read or
+    // write starts. The read stream is that far ahead of it, by the data that
+    // is in m_openReadAhead.
+    QString m_openPath;
+    NFSFileHandle m_openFH;
+    QIODevice::OpenMode m_openMode;
+    uint64 m_openOffset;
+    QByteArray m_openReadAhead;
+    NFSReadStreamV3* m_openReadStream;
+    NFSWriteStreamV3* m_openWriteStream;
+
     // The optimal read and write buffer sizes and read dir size, cached values
     uint32 m_readBufferSize;
     uint32 m_writeBufferSize;
     uint32 m_readDirSize;
+    // The maxcount of READDIRPLUS, which includes attributes and handles.
+    uint32 m_readDirPlusSize;
 };
 
 #endif
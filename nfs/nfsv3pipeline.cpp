@@ -0,0 +1,605 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "nfsv3pipeline.h"
+
+#include <string.h>
+
+NFSReadStreamV3::NFSReadStreamV3(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout,
+                                 const NFSFileHandle& fh, uint64 offset, uint32 chunkSize, int window)
+    : m_client(client),
+      m_pipeline(pipeline),
+      m_timeout(timeout),
+      m_fh(fh),
+      m_chunkSize(chunkSize),
+      m_window(pipeline != nullptr ? qBound(1, window, NFS3_MAX_WINDOW) : 1),
+      m_offset(offset),
+      m_nextOffset(offset),
+      m_fileSize(0),
+      m_eof(false),
+      m_failed(false),
+      m_rpcStatus(RPC_SUCCESS),
+      m_nfsStatus(NFS3_OK)
+{
+    memset(&m_args, 0, sizeof(m_args));
+    m_fh.toFH(m_args.file);
+}
+
+bool NFSReadStreamV3::next(QByteArray& data)
+{
+    data.clear();
+
+    while (!m_failed) {
+        // Keep the window full.
+        while (!m_failed && canIssue()) {
+            issue(m_nextOffset, m_chunkSize, m_requests.size());
+            m_nextOffset += m_chunkSize;
+        }
+
+        if (m_failed) {
+            break;
+        }
+
+        // Nothing left to read.
+        if (m_requests.isEmpty()) {
+            return true;
+        }
+
+        if (!m_requests.first().done) {
+            receive();
+            continue;
+        }
+
+        const Request head = m_requests.takeFirst();
+        if (head.data.isEmpty()) {
+            m_eof = true;
+            continue;
+        }
+
+        // The server returned less than asked for before the end of the file,
+        // the rest has to be read before anything that is already queued.
+        if (!head.eof && static_cast<uint32>(head.data.size()) < head.count) {
+            issue(head.offset + head.data.size(), head.count - head.data.size(), 0);
+        }
+
+        m_offset = head.offset + head.data.size();
+        data = head.data;
+        return true;
+    }
+
+    return false;
+}
+
+bool NFSReadStreamV3::canIssue() const
+{
+    if (m_eof || m_requests.size() >= m_window) {
+        return false;
+    }
+
+    // Until the first reply tells us the file size we only send one request,
+    // after that we stop at the known end and ask once more to find the end
+    // of a file that is still growing.
+    return m_nextOffset < m_fileSize || m_requests.isEmpty();
+}
+
+void NFSReadStreamV3::issue(uint64 offset, uint32 count, int position)
+{
+    Request request;
+    request.xid = 0;
+    request.offset = offset;
+    request.count = count;
+    request.done = false;
+    request.eof = false;
+
+    m_args.offset = offset;
+    m_args.count = count;
+
+    if (m_pipeline != nullptr) {
+        m_rpcStatus = m_pipeline->call(NFSPROC3_READ,
+                                       (xdrproc_t) xdr_READ3args, reinterpret_cast<caddr_t>(&m_args),
+                                       request.xid);
+        if (m_rpcStatus != RPC_SUCCESS) {
+            m_failed = true;
+            return;
+        }
+    } else {
+        READ3res res;
+        memset(&res, 0, sizeof(res));
+
+        m_rpcStatus = clnt_call(m_client, NFSPROC3_READ,
+                                (xdrproc_t) xdr_READ3args, reinterpret_cast<caddr_t>(&m_args),
+                                (xdrproc_t) xdr_READ3res, reinterpret_cast<caddr_t>(&res),
+                                m_timeout);
+
+        if (m_rpcStatus == RPC_SUCCESS) {
+            complete(request, res);
+        } else {
+            m_failed = true;
+        }
+
+        xdr_free((xdrproc_t) xdr_READ3res, reinterpret_cast<char*>(&res));
+    }
+
+    m_requests.insert(position, request);
+}
+
+void NFSReadStreamV3::receive()
+{
+    u_int xid;
+    m_rpcStatus = m_pipeline->receive(xid, m_timeout);
+    if (m_rpcStatus != RPC_SUCCESS) {
+        m_failed = true;
+        return;
+    }
+
+    for (Request& request : m_requests) {
+        if (request.xid != xid || request.done) {
+            continue;
+        }
+
+        READ3res res;
+        memset(&res, 0, sizeof(res));
+
+        m_rpcStatus = m_pipeline->decode((xdrproc_t) xdr_READ3res, reinterpret_cast<caddr_t>(&res));
+        if (m_rpcStatus == RPC_SUCCESS) {
+            complete(request, res);
+        } else {
+            m_failed = true;
+        }
+
+        xdr_free((xdrproc_t) xdr_READ3res, reinterpret_cast<char*>(&res));
+        return;
+    }
+
+    // Otherwise it's a late reply to a call an earlier stream gave up on.
+}
+
+void NFSReadStreamV3::complete(Request& request, const READ3res& res)
+{
+    if (res.status != NFS3_OK) {
+        m_nfsStatus = res.status;
+        m_failed = true;
+        return;
+    }
+
+    const READ3resok& resok = res.READ3res_u.resok;
+    if (resok.file_attributes.attributes_follow) {
+        m_fileSize = resok.file_attributes.post_op_attr_u.attributes.size;
+    }
+
+    // Never trust the server to return no more than we asked for.
+    const uint32 count = qMin<uint32>(resok.data.data_len, request.count);
+    request.data = QByteArray(resok.data.data_val, count);
+    request.eof = resok.eof;
+    request.done = true;
+
+    if (resok.eof) {
+        m_eof = true;
+    }
+}
+
+NFSWriteStreamV3::NFSWriteStreamV3(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout,
+                                   const NFSFileHandle& fh, uint64 offset, uint32 chunkSize, int window)
+    : m_client(client),
+      m_pipeline(pipeline),
+      m_timeout(timeout),
+      m_fh(fh),
+      m_chunkSize(chunkSize),
+      m_window(pipeline != nullptr ? qBound(1, window, NFS3_MAX_WINDOW) : 1),
+      m_outstanding(0),
+      m_uncommitted(0),
+      m_offset(offset),
+      m_failed(false),
+      m_rpcStatus(RPC_SUCCESS),
+      m_nfsStatus(NFS3_OK)
+{
+    memset(&m_args, 0, sizeof(m_args));
+    m_fh.toFH(m_args.file);
+    m_args.stable = UNSTABLE;
+}
+
+bool NFSWriteStreamV3::write(const char* data, int length)
+{
+    while (length > 0 && !m_failed) {
+        const int count = qMin<qint64>(length, m_chunkSize);
+
+        queue(m_offset, QByteArray(data, count));
+        sendPending();
+
+        m_offset += count;
+        m_uncommitted += count;
+        data += count;
+        length -= count;
+
+        if (m_uncommitted >= NFS3_COMMIT_INTERVAL) {
+            commit();
+        }
+    }
+
+    return !m_failed;
+}
+
+bool NFSWriteStreamV3::commit()
+{
+    // If the verifier keeps changing the server is in trouble, give up eventually.
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        flush();
+        if (m_failed) {
+            return false;
+        }
+
+        bool unstable = false;
+        for (const Request& request : qAsConst(m_requests)) {
+            if (!request.stable) {
+                unstable = true;
+                break;
+            }
+        }
+
+        if (unstable) {
+            COMMIT3args args;
+            memset(&args, 0, sizeof(args));
+            m_fh.toFH(args.file);
+
+            COMMIT3res res;
+            memset(&res, 0, sizeof(res));
+
+            const int rpcStatus = clnt_call(m_client, NFSPROC3_COMMIT,
+                                            (xdrproc_t) xdr_COMMIT3args, reinterpret_cast<caddr_t>(&args),
+                                            (xdrproc_t) xdr_COMMIT3res, reinterpret_cast<caddr_t>(&res),
+                                            m_timeout);
+
+            if (rpcStatus != RPC_SUCCESS || res.status != NFS3_OK) {
+                fail(rpcStatus, res.status);
+                return false;
+            }
+
+            // Anything written under a different verifier might have been lost.
+            bool resend = false;
+            for (int i = 0; i < m_requests.size(); ++i) {
+                Request& request = m_requests[i];
+                if (!request.stable && memcmp(request.verf, res.COMMIT3res_u.resok.verf, NFS3_WRITEVERFSIZE) != 0) {
+                    request.sent = false;
+                    request.done = false;
+                    resend = true;
+                }
+            }
+
+            if (resend) {
+                qCDebug(LOG_KIO_NFS) << "Write verifier changed, writing the uncommitted data again";
+                continue;
+            }
+        }
+
+        m_requests.clear();
+        m_uncommitted = 0;
+        return true;
+    }
+
+    fail(RPC_SUCCESS, NFS3ERR_IO);
+    return false;
+}
+
+void NFSWriteStreamV3::queue(uint64 offset, const QByteArray& data)
+{
+    Request request;
+    request.xid = 0;
+    request.offset = offset;
+    request.data = data;
+    request.sent = false;
+    request.done = false;
+    request.stable = false;
+    memset(request.verf, 0, NFS3_WRITEVERFSIZE);
+
+    m_requests.append(request);
+}
+
+void NFSWriteStreamV3::sendPending()
+{
+    for (int i = 0; i < m_requests.size() && !m_failed; ++i) {
+        if (m_requests.at(i).sent) {
+            continue;
+        }
+
+        while (!m_failed && m_outstanding >= m_window) {
+            receive();
+        }
+
+        if (!m_failed) {
+            issue(i);
+        }
+    }
+}
+
+void NFSWriteStreamV3::flush()
+{
+    bool pending;
+    do {
+        sendPending();
+        while (!m_failed && m_outstanding > 0) {
+            receive();
+        }
+
+        // Short writes leave the rest of their data to be sent again.
+        pending = false;
+        for (const Request& request : qAsConst(m_requests)) {
+            if (!request.sent) {
+                pending = true;
+                break;
+            }
+        }
+    } while (pending && !m_failed);
+}
+
+void NFSWriteStreamV3::issue(int index)
+{
+    Request& request = m_requests[index];
+    request.sent = true;
+    request.done = false;
+
+    m_args.offset = request.offset;
+    m_args.count = request.data.size();
+    m_args.data.data_len = request.data.size();
+    m_args.data.data_val = request.data.data();
+
+    if (m_pipeline != nullptr) {
+        const int rpcStatus = m_pipeline->call(NFSPROC3_WRITE,
+                                               (xdrproc_t) xdr_WRITE3args, reinterpret_cast<caddr_t>(&m_args),
+                                               request.xid);
+        if (rpcStatus != RPC_SUCCESS) {
+            fail(rpcStatus, NFS3_OK);
+            return;
+        }
+
+        ++m_outstanding;
+    } else {
+        WRITE3res res;
+        memset(&res, 0, sizeof(res));
+
+        const int rpcStatus = clnt_call(m_client, NFSPROC3_WRITE,
+                                        (xdrproc_t) xdr_WRITE3args, reinterpret_cast<caddr_t>(&m_args),
+                                        (xdrproc_t) xdr_WRITE3res, reinterpret_cast<caddr_t>(&res),
+                                        m_timeout);
+
+        if (rpcStatus == RPC_SUCCESS) {
+            complete(index, res);
+        } else {
+            fail(rpcStatus, NFS3_OK);
+        }
+
+        xdr_free((xdrproc_t) xdr_WRITE3res, reinterpret_cast<char*>(&res));
+    }
+}
+
+void NFSWriteStreamV3::receive()
+{
+    u_int xid;
+    int rpcStatus = m_pipeline->receive(xid, m_timeout);
+    if (rpcStatus != RPC_SUCCESS) {
+        fail(rpcStatus, NFS3_OK);
+        return;
+    }
+
+    for (int i = 0; i < m_requests.size(); ++i) {
+        const Request& request = m_requests.at(i);
+        if (!request.sent || request.done || request.xid != xid) {
+            continue;
+        }
+
+        --m_outstanding;
+
+        WRITE3res res;
+        memset(&res, 0, sizeof(res));
+
+        rpcStatus = m_pipeline->decode((xdrproc_t) xdr_WRITE3res, reinterpret_cast<caddr_t>(&res));
+        if (rpcStatus == RPC_SUCCESS) {
+            complete(i, res);
+        } else {
+            fail(rpcStatus, NFS3_OK);
+        }
+
+        xdr_free((xdrproc_t) xdr_WRITE3res, reinterpret_cast<char*>(&res));
+        return;
+    }
+
+    // Otherwise it's a late reply to a call an earlier stream gave up on.
+}
+
+void NFSWriteStreamV3::complete(int index, const WRITE3res& res)
+{
+    if (res.status != NFS3_OK) {
+        fail(RPC_SUCCESS, res.status);
+        return;
+    }
+
+    const WRITE3resok& resok = res.WRITE3res_u.resok;
+
+    Request& request = m_requests[index];
+    request.done = true;
+    request.stable = (resok.committed != UNSTABLE);
+    memcpy(request.verf, resok.verf, NFS3_WRITEVERFSIZE);
+
+    const int written = qMin<uint32>(resok.count, request.data.size());
+    if (written == 0) {
+        fail(RPC_SUCCESS, NFS3ERR_IO);
+        return;
+    }
+
+    if (written < request.data.size()) {
+        const uint64 restOffset = request.offset + written;
+        const QByteArray rest = request.data.mid(written);
+        request.data.truncate(written);
+
+        queue(restOffset, rest);
+    }
+}
+
+void NFSWriteStreamV3::fail(int rpcStatus, int nfsStatus)
+{
+    if (!m_failed) {
+        m_failed = true;
+        m_rpcStatus = rpcStatus;
+        m_nfsStatus = nfsStatus;
+    }
+}
+
+NFSDirStreamV3::NFSDirStreamV3(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout,
+                               const NFSFileHandle& fh, uint32 dirCount, uint32 maxCount)
+    : m_client(client),
+      m_pipeline(pipeline),
+      m_timeout(timeout),
+      m_fh(fh),
+      m_hasRes(false),
+      m_xid(0),
+      m_outstanding(false),
+      m_eof(false),
+      m_failed(false),
+      m_rpcStatus(RPC_SUCCESS),
+      m_nfsStatus(NFS3_OK)
+{
+    memset(&m_args, 0, sizeof(m_args));
+    m_fh.toFH(m_args.dir);
+    m_args.dircount = dirCount;
+    m_args.maxcount = maxCount;
+
+    memset(&m_res, 0, sizeof(m_res));
+}
+
+NFSDirStreamV3::~NFSDirStreamV3()
+{
+    // The reply to a call that is still outstanding is skipped by whoever
+    // receives on the pipeline next.
+    release();
+}
+
+bool NFSDirStreamV3::next(const READDIRPLUS3resok*& page)
+{
+    page = nullptr;
+    release();
+
+    if (m_failed) {
+        return false;
+    }
+    if (m_eof) {
+        return true;
+    }
+
+    if (!m_outstanding) {
+        issue();
+    }
+    if (m_outstanding) {
+        receive();
+    }
+    if (m_failed) {
+        return false;
+    }
+
+    if (m_res.status != NFS3_OK) {
+        m_nfsStatus = m_res.status;
+        m_failed = true;
+        return false;
+    }
+
+    const READDIRPLUS3resok& resok = m_res.READDIRPLUS3res_u.resok;
+
+    entryplus3* lastEntry = nullptr;
+    bool hasLinks = false;
+    for (entryplus3* dirEntry = resok.reply.entries; dirEntry != nullptr; dirEntry = dirEntry->nextentry) {
+        hasLinks |= (dirEntry->name_attributes.post_op_attr_u.attributes.type == NF3LNK);
+        lastEntry = dirEntry;
+    }
+
+    // A page without entries would be asked for again and again.
+    if (resok.reply.eof || lastEntry == nullptr) {
+        m_eof = true;
+    } else {
+        m_args.cookie = lastEntry->cookie;
+        memcpy(m_args.cookieverf, resok.cookieverf, NFS3_COOKIEVERFSIZE);
+
+        // The targets of links are read on the pipeline too, and the reply
+        // to this call would get in the way; the next page waits for them.
+        if (m_pipeline != nullptr && !hasLinks) {
+            issue();
+        }
+    }
+
+    page = &resok;
+    return true;
+}
+
+void NFSDirStreamV3::issue()
+{
+    if (m_pipeline != nullptr) {
+        m_rpcStatus = m_pipeline->call(NFSPROC3_READDIRPLUS,
+                                       (xdrproc_t) xdr_READDIRPLUS3args, reinterpret_cast<caddr_t>(&m_args),
+                                       m_xid);
+        if (m_rpcStatus != RPC_SUCCESS) {
+            m_failed = true;
+            return;
+        }
+
+        m_outstanding = true;
+    } else {
+        memset(&m_res, 0, sizeof(m_res));
+        m_hasRes = true;
+
+        m_rpcStatus = clnt_call(m_client, NFSPROC3_READDIRPLUS,
+                                (xdrproc_t) xdr_READDIRPLUS3args, reinterpret_cast<caddr_t>(&m_args),
+                                (xdrproc_t) xdr_READDIRPLUS3res, reinterpret_cast<caddr_t>(&m_res),
+                                m_timeout);
+        if (m_rpcStatus != RPC_SUCCESS) {
+            m_failed = true;
+        }
+    }
+}
+
+void NFSDirStreamV3::receive()
+{
+    forever {
+        u_int xid;
+        m_rpcStatus = m_pipeline->receive(xid, m_timeout);
+        if (m_rpcStatus != RPC_SUCCESS) {
+            m_failed = true;
+            return;
+        }
+
+        // Otherwise it's a late reply to a call an earlier stream gave up on.
+        if (xid == m_xid) {
+            break;
+        }
+    }
+
+    m_outstanding = false;
+
+    memset(&m_res, 0, sizeof(m_res));
+    m_hasRes = true;
+
+    m_rpcStatus = m_pipeline->decode((xdrproc_t) xdr_READDIRPLUS3res, reinterpret_cast<caddr_t>(&m_res));
+    if (m_rpcStatus != RPC_SUCCESS) {
+        m_failed = true;
+    }
+}
+
+void NFSDirStreamV3::release()
+{
+    if (m_hasRes) {
+        xdr_free((xdrproc_t) xdr_READDIRPLUS3res, reinterpret_cast<char*>(&m_res));
+        memset(&m_res, 0, sizeof(m_res));
+        m_hasRes = false;
+    }
+}
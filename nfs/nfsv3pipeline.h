@@ -0,0 +1,233 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIO_NFSV3PIPELINE_H
+#define KIO_NFSV3PIPELINE_H
+
+#include "kio_nfs.h"
+#include "rpcpipeline.h"
+
+#include <QByteArray>
+#include <QList>
+
+// The default and the largest number of calls a stream keeps outstanding.
+#define NFS3_DEFAULT_WINDOW 16
+#define NFS3_MAX_WINDOW 64
+
+// How much unstable data a write stream keeps before it commits it.
+#define NFS3_COMMIT_INTERVAL (16 * 1024 * 1024)
+
+// Reads a file sequentially, keeping up to window READ calls outstanding on
+// the pipeline. The replies are put back into file order before they are
+// returned. Without a pipeline every READ is a synchronous clnt_call.
+class NFSReadStreamV3
+{
+public:
+    NFSReadStreamV3(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout,
+                    const NFSFileHandle& fh, uint64 offset, uint32 chunkSize, int window);
+
+    // Returns the next part of the file, data is empty at the end of the file.
+    bool next(QByteArray& data);
+
+    // The offset the data returned next starts at.
+    uint64 offset() const
+    {
+        return m_offset;
+    }
+
+    // The file size according to the last reply, 0 until the first one.
+    uint64 fileSize() const
+    {
+        return m_fileSize;
+    }
+
+    // The reason @next failed.
+    int rpcStatus() const
+    {
+        return m_rpcStatus;
+    }
+    int nfsStatus() const
+    {
+        return m_nfsStatus;
+    }
+
+private:
+    struct Request {
+        u_int xid;
+        uint64 offset;
+        uint32 count;
+        bool done;
+        bool eof;
+        QByteArray data;
+    };
+
+    bool canIssue() const;
+    void issue(uint64 offset, uint32 count, int position);
+    void receive();
+    void complete(Request& request, const READ3res& res);
+
+    CLIENT* m_client;
+    NFSRpcPipeline* m_pipeline;
+    timeval m_timeout;
+
+    // The arguments point into the handle.
+    const NFSFileHandle m_fh;
+    READ3args m_args;
+    uint32 m_chunkSize;
+    int m_window;
+
+    // Issued requests, in file order.
+    QList<Request> m_requests;
+
+    uint64 m_offset;
+    uint64 m_nextOffset;
+    uint64 m_fileSize;
+    bool m_eof;
+    bool m_failed;
+
+    int m_rpcStatus;
+    int m_nfsStatus;
+};
+
+// Writes a file sequentially with UNSTABLE WRITE calls, keeping up to window
+// of them outstanding on the pipeline. The data is kept until a COMMIT
+// confirms it has reached stable storage; if the server's write verifier
+// changed in between (it rebooted), the affected writes are sent again.
+// Without a pipeline every WRITE is a synchronous clnt_call.
+class NFSWriteStreamV3
+{
+public:
+    NFSWriteStreamV3(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout,
+                     const NFSFileHandle& fh, uint64 offset, uint32 chunkSize, int window);
+
+    // Queues data at the current offset, only waits when the window is full.
+    bool write(const char* data, int length);
+
+    // Waits for all outstanding writes and commits them.
+    bool commit();
+
+    // The offset the data written next starts at.
+    uint64 offset() const
+    {
+        return m_offset;
+    }
+
+    // The reason @write or @commit failed.
+    int rpcStatus() const
+    {
+        return m_rpcStatus;
+    }
+    int nfsStatus() const
+    {
+        return m_nfsStatus;
+    }
+
+private:
+    struct Request {
+        u_int xid;
+        uint64 offset;
+        QByteArray data;
+        bool sent;
+        bool done;
+        bool stable;
+        char verf[NFS3_WRITEVERFSIZE];
+    };
+
+    void queue(uint64 offset, const QByteArray& data);
+    void sendPending();
+    void flush();
+    void issue(int index);
+    void receive();
+    void complete(int index, const WRITE3res& res);
+    void fail(int rpcStatus, int nfsStatus);
+
+    CLIENT* m_client;
+    NFSRpcPipeline* m_pipeline;
+    timeval m_timeout;
+
+    // The arguments point into the handle.
+    const NFSFileHandle m_fh;
+    WRITE3args m_args;
+    uint32 m_chunkSize;
+    int m_window;
+
+    // Writes that have not been committed yet.
+    QList<Request> m_requests;
+    int m_outstanding;
+    qint64 m_uncommitted;
+
+    uint64 m_offset;
+    bool m_failed;
+
+    int m_rpcStatus;
+    int m_nfsStatus;
+};
+
+// Lists a directory with READDIRPLUS. As soon as a page arrives the call for
+// the next one is sent on the pipeline, so that the server works on it while
+// the caller turns the current page into entries. That is not done after a
+// page with links, whose targets the caller reads on the same pipeline.
+// Without a pipeline every page is a synchronous clnt_call.
+class NFSDirStreamV3
+{
+public:
+    NFSDirStreamV3(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout,
+                   const NFSFileHandle& fh, uint32 dirCount, uint32 maxCount);
+    ~NFSDirStreamV3();
+
+    // Returns the next page, which stays valid until the next call. page is
+    // nullptr at the end of the directory.
+    bool next(const READDIRPLUS3resok*& page);
+
+    // The reason @next failed.
+    int rpcStatus() const
+    {
+        return m_rpcStatus;
+    }
+    int nfsStatus() const
+    {
+        return m_nfsStatus;
+    }
+
+private:
+    void issue();
+    void receive();
+    void release();
+
+    CLIENT* m_client;
+    NFSRpcPipeline* m_pipeline;
+    timeval m_timeout;
+
+    // The arguments point into the handle.
+    const NFSFileHandle m_fh;
+    READDIRPLUS3args m_args;
+
+    // The page last returned by @next.
+    READDIRPLUS3res m_res;
+    bool m_hasRes;
+
+    u_int m_xid;
+    bool m_outstanding;
+    bool m_eof;
+    bool m_failed;
+
+    int m_rpcStatus;
+    int m_nfsStatus;
+};
+
+#endif
@@ -0,0 +1,1709 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include <config-runtime.h>
+
+// This is needed on Solaris so that rpc.h defines clnttcp_create etc.
+#ifndef PORTMAP
+#define PORTMAP
+#endif
+#include <rpc/rpc.h> // for rpc calls
+
+#include <grp.h>
+#include <pwd.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostInfo>
+#include <QMimeDatabase>
+#include <QMimeType>
+#include <QThread>
+
+#include <KLocalizedString>
+#include <kio/global.h>
+#include <kio/ioslave_defaults.h>
+
+#include "nfsv4.h"
+
+// What the slave asks for when it creates a session, the server may lower it.
+#define NFS4_MAX_REQUEST (1024 * 1024 + 4096)
+#define NFS4_MAX_RESPONSE (1024 * 1024 + 4096)
+#define NFS4_MAX_OPERATIONS 64
+
+// Room for the RPC header and the operations around a READ or WRITE.
+#define NFS4_CALL_OVERHEAD 1024
+
+#define NFS4_MIN_IO_SIZE 4096
+#define NFS4_READDIR_SIZE 65536
+
+#define NFS4_MAX_LINK_DEPTH 8
+
+// How often a call is repeated while the server asks for a delay.
+#define NFS4_DELAY_RETRIES 10
+
+static const QVector<uint32> s_statAttributes = {
+    NFS4_ATTR_TYPE, NFS4_ATTR_SIZE, NFS4_ATTR_FILEID, NFS4_ATTR_MODE, NFS4_ATTR_NUMLINKS,
+    NFS4_ATTR_OWNER, NFS4_ATTR_OWNER_GROUP, NFS4_ATTR_SPACE_USED,
+    NFS4_ATTR_TIME_ACCESS, NFS4_ATTR_TIME_METADATA, NFS4_ATTR_TIME_MODIFY
+};
+
+// The same, and the handle so that what is listed needs no LOOKUP later.
+static const QVector<uint32> s_listAttributes = {
+    NFS4_ATTR_TYPE, NFS4_ATTR_SIZE, NFS4_ATTR_FILEHANDLE, NFS4_ATTR_FILEID, NFS4_ATTR_MODE, NFS4_ATTR_NUMLINKS,
+    NFS4_ATTR_OWNER, NFS4_ATTR_OWNER_GROUP, NFS4_ATTR_SPACE_USED,
+    NFS4_ATTR_TIME_ACCESS, NFS4_ATTR_TIME_METADATA, NFS4_ATTR_TIME_MODIFY
+};
+
+// The file cache shared with v2 and v3 keeps NFSFileHandles, which take the
+// larger v4 handles through nfs_fh3 as well.
+static NFSFileHandle toFileHandle(const QByteArray& fh)
+{
+    nfs_fh3 handle;
+    handle.data.data_len = fh.size();
+    handle.data.data_val = const_cast<char*>(fh.constData());
+    return NFSFileHandle(handle);
+}
+
+static QByteArray fromFileHandle(const NFSFileHandle& fh)
+{
+    nfs_fh3 handle;
+    fh.toFH(handle);
+    return QByteArray(handle.data.data_val, handle.data.data_len);
+}
+
+NFSProtocolV4::NFSProtocolV4(NFSSlave* slave)
+    : NFSProtocol(slave),
+      m_slave(slave),
+      m_client(nullptr),
+      m_sock(-1),
+      m_clientId(0),
+      m_sequenceId(0),
+      m_maxRequestSize(0),
+      m_maxResponseSize(0),
+      m_maxOperations(0),
+      m_readSize(0),
+      m_writeSize(0)
+{
+    qCDebug(LOG_KIO_NFS) << "NFS4::NFS4";
+
+    clnt_timeout.tv_sec = 20;
+    clnt_timeout.tv_usec = 0;
+}
+
+NFSProtocolV4::~NFSProtocolV4()
+{
+    closeConnection();
+}
+
+bool NFSProtocolV4::isCompatible(bool& connectionError)
+{
+    qCDebug(LOG_KIO_NFS);
+
+    int ret = -1;
+
+    CLIENT* client = nullptr;
+    int sock = 0;
+    if (NFSProtocol::openConnection(m_currentHost, NFS4_PROGRAM, NFS4_VERSION, client, sock) == 0) {
+        timeval check_timeout;
+        check_timeout.tv_sec = 20;
+        check_timeout.tv_usec = 0;
+
+        // Check if the NFS version is compatible
+        ret = clnt_call(client, NFSPROC4_NULL,
+                        (xdrproc_t) xdr_void, nullptr,
+                        (xdrproc_t) xdr_void, nullptr,
+                        check_timeout);
+
+        // The version doesn't tell the minor version, a COMPOUND without
+        // operations does: the server fails it if it doesn't know 4.1.
+        if (ret == RPC_SUCCESS) {
+            NFSCompoundV4 compound;
+            QByteArray args = compound.encode();
+            QByteArray res;
+            ret = clnt_call(client, NFSPROC4_COMPOUND,
+                            (xdrproc_t) xdr_nfs4_compound_args, reinterpret_cast<caddr_t>(&args),
+                            (xdrproc_t) xdr_nfs4_compound_res, reinterpret_cast<caddr_t>(&res),
+                            check_timeout);
+
+            if (ret == RPC_SUCCESS && (!compound.decode(res) || compound.status() != NFS4_OK)) {
+                qCDebug(LOG_KIO_NFS) << "NFSv4.1 is not supported:" << compound.status();
+                ret = -1;
+            }
+        }
+
+        connectionError = false;
+    } else {
+        qCDebug(LOG_KIO_NFS) << "openConnection failed";
+        connectionError = true;
+    }
+
+    if (sock != -1) {
+        ::close(sock);
+    }
+
+    if (client != nullptr) {
+        CLNT_DESTROY(client);
+    }
+
+    qCDebug(LOG_KIO_NFS) << ret;
+
+    return (ret == RPC_SUCCESS);
+}
+
+bool NFSProtocolV4::isConnected() const
+{
+    return (m_client != nullptr && !m_sessionId.isEmpty());
+}
+
+void NFSProtocolV4::closeConnection()
+{
+    qCDebug(LOG_KIO_NFS);
+
+    // Let the server free the session now rather than when its lease runs out.
+    if (m_client != nullptr && !m_sessionId.isEmpty()) {
+        NFSCompoundV4 compound;
+        compound.destroySession(m_sessionId);
+        send(compound);
+    }
+
+    m_sessionId.clear();
+    clearFileHandles();
+
+    if (m_sock >= 0) {
+        ::close(m_sock);
+        m_sock = -1;
+    }
+
+    if (m_client != nullptr) {
+        CLNT_DESTROY(m_client);
+        m_client = nullptr;
+    }
+}
+
+NFSFileHandle NFSProtocolV4::lookupFileHandle(const QString& path)
+{
+    int rpcStatus;
+    NFSCompoundV4 compound;
+    if (!callAt(path, [](NFSCompoundV4& c) {
+                c.getFh();
+            }, compound, rpcStatus)) {
+        return NFSFileHandle();
+    }
+
+    const QByteArray fh = compound.result(NFS4_OP_GETFH)->fh;
+    cacheHandle(path, fh);
+
+    return toFileHandle(fh);
+}
+
+/* NFSv4 has no MOUNT protocol and no exports list, the root of the server's
+ pseudo file system is "/". Opening the connection sets up the client ID and
+ the session every later call goes through, and asks for the transfer sizes.
+ */
+void NFSProtocolV4::openConnection()
+{
+    qCDebug(LOG_KIO_NFS) << m_currentHost;
+
+    // Destroy the old connection first
+    closeConnection();
+
+    int connErr;
+    if ((connErr = NFSProtocol::openConnection(m_currentHost, NFS4_PROGRAM, NFS4_VERSION, m_client, m_sock)) != 0) {
+        closeConnection();
+        m_slave->error(connErr, m_currentHost);
+        return;
+    }
+
+    int rpcStatus;
+    const uint32 status = createSession(rpcStatus);
+    if (!checkForError(rpcStatus, status, m_currentHost)) {
+        closeConnection();
+        return;
+    }
+
+    uint64 maxRead = 0;
+    uint64 maxWrite = 0;
+
+    NFSCompoundV4 compound;
+    compound.putRootFh();
+    compound.getFh();
+    compound.getAttr({NFS4_ATTR_MAXREAD, NFS4_ATTR_MAXWRITE});
+    if (call(compound, rpcStatus)) {
+        cacheHandle(QStringLiteral("/"), compound.result(NFS4_OP_GETFH)->fh);
+
+        const NFSAttributesV4& attributes = compound.result(NFS4_OP_GETATTR)->attributes;
+        maxRead = attributes.maxRead;
+        maxWrite = attributes.maxWrite;
+    }
+
+    // A READ or WRITE has to fit into a reply or call of the session.
+    const uint64 maxResponse = m_maxResponseSize - NFS4_CALL_OVERHEAD;
+    const uint64 maxRequest = m_maxRequestSize - NFS4_CALL_OVERHEAD;
+    m_readSize = qMax<uint64>(NFS4_MIN_IO_SIZE, maxRead > 0 ? qMin(maxRead, maxResponse) : maxResponse);
+    m_writeSize = qMax<uint64>(NFS4_MIN_IO_SIZE, maxWrite > 0 ? qMin(maxWrite, maxRequest) : maxRequest);
+
+    qCDebug(LOG_KIO_NFS) << "read size" << m_readSize << "write size" << m_writeSize;
+
+    m_slave->connected();
+
+    qCDebug(LOG_KIO_NFS) << "openConnection succeeded";
+}
+
+void NFSProtocolV4::listDir(const QUrl& url)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString dirPath = url.path().isEmpty() ? QStringLiteral("/") : QDir::cleanPath(url.path());
+
+    const uint32 maxCount = qMin<uint32>(NFS4_READDIR_SIZE, m_maxResponseSize - NFS4_CALL_OVERHEAD);
+
+    // The first page comes with the lookup of the directory.
+    int rpcStatus;
+    NFSCompoundV4 compound;
+    if (!callAt(dirPath, [maxCount](NFSCompoundV4& c) {
+                c.getFh();
+                c.readDir(0, QByteArray(), maxCount, maxCount, s_listAttributes);
+            }, compound, rpcStatus)) {
+        checkForError(rpcStatus, compound.status(), dirPath);
+        return;
+    }
+
+    const QByteArray dirFH = compound.result(NFS4_OP_GETFH)->fh;
+    cacheHandle(dirPath, dirFH);
+
+    const QString prefix = dirPath.endsWith(QLatin1Char('/')) ? dirPath : dirPath + QLatin1Char('/');
+
+    forever {
+        const NFSResultV4* page = compound.result(NFS4_OP_READDIR);
+
+        KIO::UDSEntryList entries;
+        QVector<LinkEntry> links;
+        uint64 cookie = 0;
+        for (const NFSDirEntryV4& dirEntry : page->entries) {
+            const QString name = QFile::decodeName(dirEntry.name);
+            const NFSAttributesV4& attributes = dirEntry.attributes;
+
+            if (!attributes.fh.isEmpty()) {
+                cacheHandle(prefix + name, attributes.fh);
+            }
+
+            KIO::UDSEntry entry;
+            entry.insert(KIO::UDSEntry::UDS_NAME, name);
+
+            if (attributes.attributes.type == NF4LNK) {
+                links.append({entries.size(), name, attributes.fh, attributes});
+            } else {
+                completeUDSEntry(entry, attributes);
+            }
+
+            entries.append(entry);
+            cookie = dirEntry.cookie;
+        }
+
+        completeLinkEntries(dirPath, dirFH, entries, links);
+
+        m_slave->listEntries(entries);
+
+        if (page->eof || page->entries.isEmpty()) {
+            break;
+        }
+
+        const QByteArray verifier = page->verifier;
+
+        compound = NFSCompoundV4();
+        compound.putFh(dirFH);
+        compound.readDir(cookie, verifier, maxCount, maxCount, s_listAttributes);
+        if (!call(compound, rpcStatus)) {
+            checkForError(rpcStatus, compound.status(), dirPath);
+            return;
+        }
+    }
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::stat(const QUrl& url)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString path = url.path().isEmpty() ? QStringLiteral("/") : QDir::cleanPath(url.path());
+
+    int rpcStatus;
+    uint32 nfsStatus;
+    KIO::UDSEntry entry;
+    if (!statPath(path, entry, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, path);
+        return;
+    }
+
+    m_slave->statEntry(entry);
+    m_slave->finished();
+}
+
+void NFSProtocolV4::setHost(const QString& host)
+{
+    qCDebug(LOG_KIO_NFS) << host;
+
+    if (host.isEmpty()) {
+        m_slave->error(KIO::ERR_UNKNOWN_HOST, QString());
+        return;
+    }
+
+    // No need to update if the host hasn't changed
+    if (host == m_currentHost) {
+        return;
+    }
+
+    m_currentHost = host;
+    closeConnection();
+}
+
+void NFSProtocolV4::mkdir(const QUrl& url, int permissions)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString path(url.path());
+    const QFileInfo fileInfo(path);
+    const QByteArray name = QFile::encodeName(fileInfo.fileName());
+    const int mode = (permissions == -1 ? 0755 : permissions);
+
+    int rpcStatus;
+    NFSCompoundV4 compound;
+    if (!callAt(fileInfo.path(), [&name, mode](NFSCompoundV4& c) {
+                c.createDir(name, mode);
+                c.getFh();
+            }, compound, rpcStatus)) {
+        checkForError(rpcStatus, compound.status(), path);
+        return;
+    }
+
+    cacheHandle(path, compound.result(NFS4_OP_GETFH)->fh);
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::del(const QUrl& url, bool/* isfile*/)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString path(url.path());
+    const QFileInfo fileInfo(path);
+    const QByteArray name = QFile::encodeName(fileInfo.fileName());
+
+    int rpcStatus;
+    NFSCompoundV4 compound;
+    if (!callAt(fileInfo.path(), [&name](NFSCompoundV4& c) {
+                c.remove(name);
+            }, compound, rpcStatus)) {
+        checkForError(rpcStatus, compound.status(), path);
+        return;
+    }
+
+    uncacheHandles(path);
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::chmod(const QUrl& url, int permissions)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString path(url.path());
+
+    int rpcStatus;
+    NFSCompoundV4 compound;
+    if (!callAt(path, [permissions](NFSCompoundV4& c) {
+                c.setMode(permissions);
+            }, compound, rpcStatus)) {
+        checkForError(rpcStatus, compound.status(), path);
+        return;
+    }
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::get(const QUrl& url)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString path(url.path());
+
+    int rpcStatus;
+    uint32 nfsStatus;
+    OpenFile file;
+    QByteArray readBuffer;
+    if (!openForReading(path, 0, file, readBuffer, rpcStatus, nfsStatus)) {
+        // We are trying to read a directory, fail quietly
+        if (rpcStatus == RPC_SUCCESS && nfsStatus == NFS4ERR_ISDIR) {
+            m_slave->finished();
+            return;
+        }
+
+        checkForError(rpcStatus, nfsStatus, path);
+        return;
+    }
+
+    const QMimeDatabase db;
+    const QMimeType type = db.mimeTypeForFileNameAndData(url.fileName(), readBuffer);
+    m_slave->mimeType(type.name());
+
+    m_slave->totalSize(file.size);
+
+    bool validRead = false;
+    bool hasError = false;
+    forever {
+        if (!readBuffer.isEmpty()) {
+            validRead = true;
+
+            m_slave->data(readBuffer);
+            m_slave->processedSize(file.offset);
+        }
+
+        if (file.eof) {
+            break;
+        }
+
+        if (!readFile(file, readBuffer, rpcStatus, nfsStatus)) {
+            hasError = true;
+            break;
+        }
+    }
+
+    if (hasError) {
+        int closeRpcStatus;
+        uint32 closeNfsStatus;
+        closeFile(file, closeRpcStatus, closeNfsStatus);
+
+        checkForError(rpcStatus, nfsStatus, path);
+        return;
+    }
+
+    // Nothing was written, so a failing CLOSE loses nothing.
+    closeFile(file, rpcStatus, nfsStatus);
+
+    // Only send the read data to the slave if we have actually sent some.
+    if (validRead) {
+        m_slave->data(QByteArray());
+        m_slave->processedSize(file.offset);
+    }
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::put(const QUrl& url, int _mode, KIO::JobFlags flags)
+{
+    qCDebug(LOG_KIO_NFS) << url;
+
+    const QString destPath(url.path());
+
+    // An exclusive create fails with NFS4ERR_EXIST if the file exists and
+    // we don't want to overwrite.
+    int rpcStatus;
+    uint32 nfsStatus;
+    OpenFile file;
+    if (!openForWriting(destPath, _mode, (flags & KIO::Overwrite) != 0, file, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, destPath);
+        return;
+    }
+
+    int result;
+
+    // Loop until we get 0 (end of data).
+    bool error = false;
+    do {
+        QByteArray buffer;
+        m_slave->dataReq();
+        result = m_slave->readData(buffer);
+
+        if (result > 0 && !writeFile(file, buffer, rpcStatus, nfsStatus)) {
+            error = true;
+            break;
+        }
+    } while (result > 0);
+
+    if (error) {
+        int closeRpcStatus;
+        uint32 closeNfsStatus;
+        closeFile(file, closeRpcStatus, closeNfsStatus);
+
+        checkForError(rpcStatus, nfsStatus, destPath);
+        return;
+    }
+
+    // The writes are unstable, only report success once they are committed.
+    if (!closeFile(file, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, destPath);
+        return;
+    }
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::rename(const QUrl& src, const QUrl& dest, KIO::JobFlags _flags)
+{
+    qCDebug(LOG_KIO_NFS) << src << dest;
+
+    const QString srcPath(src.path());
+    const QString destPath(dest.path());
+
+    int rpcStatus;
+    if ((_flags & KIO::Overwrite) == 0) {
+        NFSCompoundV4 exists;
+        if (callAt(destPath, [](NFSCompoundV4& c) {
+                    c.getFh();
+                }, exists, rpcStatus)) {
+            m_slave->error(KIO::ERR_FILE_ALREADY_EXIST, destPath);
+            return;
+        }
+    }
+
+    const QFileInfo srcInfo(srcPath);
+    const QFileInfo destInfo(destPath);
+    const QStringList srcDir = QDir::cleanPath(srcInfo.path()).split(QLatin1Char('/'), QString::SkipEmptyParts);
+    const QStringList destDir = QDir::cleanPath(destInfo.path()).split(QLatin1Char('/'), QString::SkipEmptyParts);
+
+    // The source directory is the saved handle, the target one the current.
+    NFSCompoundV4 compound;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        compound = NFSCompoundV4();
+        int start;
+        bool cached = putPath(compound, srcDir, start);
+        compound.saveFh();
+        cached |= putPath(compound, destDir, start);
+        compound.rename(QFile::encodeName(srcInfo.fileName()), QFile::encodeName(destInfo.fileName()));
+
+        if (call(compound, rpcStatus)) {
+            break;
+        }
+
+        // A cached handle went away, look the paths up from the root.
+        if (rpcStatus != RPC_SUCCESS || !cached ||
+                (compound.status() != NFS4ERR_STALE && compound.status() != NFS4ERR_FHEXPIRED)) {
+            checkForError(rpcStatus, compound.status(), destPath);
+            return;
+        }
+        clearFileHandles();
+    }
+
+    if (compound.status() != NFS4_OK) {
+        checkForError(rpcStatus, compound.status(), destPath);
+        return;
+    }
+
+    uncacheHandles(srcPath);
+    uncacheHandles(destPath);
+
+    m_slave->finished();
+}
+
+void NFSProtocolV4::copySame(const QUrl& src, const QUrl& dest, int _mode, KIO::JobFlags _flags)
+{
+    qCDebug(LOG_KIO_NFS) << src << "to" << dest;
+
+    const QString srcPath(src.path());
+    const QString destPath(dest.path());
+
+    int rpcStatus;
+    uint32 nfsStatus;
+
+    // Is it a link? No need to copy the data then, just copy the link destination.
+    NFSCompoundV4 link;
+    if (callAt(srcPath, [](NFSCompoundV4& c) {
+                c.readLink();
+            }, link, rpcStatus)) {
+        const QByteArray linkDest = link.result(NFS4_OP_READLINK)->data;
+        symlink(QFile::decodeName(linkDest), dest, _flags);
+        return;
+    }
+
+    OpenFile srcFile;
+    QByteArray readBuffer;
+    if (!openForReading(srcPath, 0, srcFile, readBuffer, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, srcPath);
+        return;
+    }
+
+    OpenFile destFile;
+    if (!openForWriting(destPath, _mode, (_flags & KIO::Overwrite) != 0, destFile, rpcStatus, nfsStatus)) {
+        closeFile(srcFile, rpcStatus, nfsStatus);
+        checkForError(rpcStatus, nfsStatus, destPath);
+        return;
+    }
+
+    m_slave->totalSize(srcFile.size);
+
+    bool error = false;
+    QString errorPath;
+    forever {
+        if (!readBuffer.isEmpty()) {
+            if (!writeFile(destFile, readBuffer, rpcStatus, nfsStatus)) {
+                errorPath = destPath;
+                error = true;
+                break;
+            }
+
+            m_slave->processedSize(destFile.offset);
+        }
+
+        if (srcFile.eof) {
+            break;
+        }
+
+        if (!readFile(srcFile, readBuffer, rpcStatus, nfsStatus)) {
+            errorPath = srcPath;
+            error = true;
+            break;
+        }
+    }
+
+    int closeRpcStatus;
+    uint32 closeNfsStatus;
+    closeFile(srcFile, closeRpcStatus, closeNfsStatus);
+
+    if (error) {
+        closeFile(destFile, closeRpcStatus, closeNfsStatus);
+        checkForError(rpcStatus, nfsStatus, errorPath);
+        return;
+    }
+
+    if (!closeFile(destFile, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, destPath);
+        return;
+    }
+
+    qCDebug(LOG_KIO_NFS) << "Copied" << destFile.offset << "bytes of data";
+
+    m_slave->processedSize(destFile.offset);
+    m_slave->finished();
+}
+
+void NFSProtocolV4::copyFrom(const QUrl& src, const QUrl& dest, int _mode, KIO::JobFlags _flags)
+{
+    qCDebug(LOG_KIO_NFS) << src << "to" << dest;
+
+    const QString srcPath(src.path());
+    const QString destPath(dest.path());
+
+    // The file exists and we don't want to overwrite.
+    if (QFile::exists(destPath) && (_flags & KIO::Overwrite) == 0) {
+        m_slave->error(KIO::ERR_FILE_ALREADY_EXIST, destPath);
+        return;
+    }
+
+    int rpcStatus;
+    uint32 nfsStatus;
+
+    // Is it a link? No need to copy the data then, just copy the link destination.
+    NFSCompoundV4 link;
+    if (callAt(srcPath, [](NFSCompoundV4& c) {
+                c.readLink();
+            }, link, rpcStatus)) {
+        QFile::link(QFile::decodeName(link.result(NFS4_OP_READLINK)->data), destPath);
+
+        m_slave->finished();
+        return;
+    }
+
+    unsigned int resumeOffset = 0;
+    bool bResume = false;
+    const QFileInfo partInfo(destPath + QLatin1String(".part"));
+    const bool bPartExists = partInfo.exists();
+    const bool bMarkPartial = m_slave->config()->readEntry("MarkPartial", true);
+
+    if (bMarkPartial && bPartExists && partInfo.size() > 0) {
+        if (partInfo.isDir()) {
+            m_slave->error(KIO::ERR_IS_DIRECTORY, partInfo.absoluteFilePath());
+            return;
+        }
+
+        bResume = m_slave->canResume(partInfo.size());
+        resumeOffset = partInfo.size();
+    }
+
+    if (bPartExists && !bResume) {
+        QFile::remove(partInfo.absoluteFilePath());
+    }
+
+    // Open the source first, so that a missing source leaves no empty file behind.
+    OpenFile srcFile;
+    QByteArray readBuffer;
+    if (!openForReading(srcPath, bResume ? resumeOffset : 0, srcFile, readBuffer, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, srcPath);
+        return;
+    }
+
+    QFile::OpenMode openMode;
+    QString outFileName;
+    if (bResume) {
+        outFileName = partInfo.absoluteFilePath();
+        openMode = QFile::WriteOnly | QFile::Append;
+    } else {
+        outFileName = (bMarkPartial ? partInfo.absoluteFilePath() : destPath);
+        openMode = QFile::WriteOnly | QFile::Truncate;
+    }
+
+    QFile destFile(outFileName);
+    if (!bResume) {
+        QFile::Permissions perms;
+        if (_mode == -1) {
+            perms = QFile::ReadOwner | QFile::WriteOwner;
+        } else {
+            perms = KIO::convertPermissions(_mode | QFile::WriteOwner);
+        }
+
+        destFile.setPermissions(perms);
+    }
+
+    if (!destFile.open(openMode)) {
+        closeFile(srcFile, rpcStatus, nfsStatus);
+
+        switch (destFile.error()) {
+        case QFile::OpenError:
+            if (bResume) {
+                m_slave->error(KIO::ERR_CANNOT_RESUME, destPath);
+            } else {
+                m_slave->error(KIO::ERR_CANNOT_OPEN_FOR_WRITING, destPath);
+            }
+            break;
+        case QFile::PermissionsError:
+            m_slave->error(KIO::ERR_WRITE_ACCESS_DENIED, destPath);
+            break;
+        default:
+            m_slave->error(KIO::ERR_CANNOT_OPEN_FOR_WRITING, destPath);
+            break;
+        }
+        return;
+    }
+
+    m_slave->totalSize(srcFile.size);
+
+    QMimeDatabase db;
+    QMimeType type = db.mimeTypeForFileNameAndData(src.fileName(), readBuffer);
+    m_slave->mimeType(type.name());
+
+    bool error = false;
+    forever {
+        if (!readBuffer.isEmpty()) {
+            if (destFile.write(readBuffer) < 0) {
+                m_slave->error(KIO::ERR_COULD_NOT_WRITE, destPath);
+
+                error = true;
+                break;
+            }
+
+            m_slave->processedSize(srcFile.offset);
+        }
+
+        if (srcFile.eof) {
+            break;
+        }
+
+        if (!readFile(srcFile, readBuffer, rpcStatus, nfsStatus)) {
+            checkForError(rpcStatus, nfsStatus, srcPath);
+            error = true;
+            break;
+        }
+    }
+
+    int closeRpcStatus;
+    uint32 closeNfsStatus;
+    closeFile(srcFile, closeRpcStatus, closeNfsStatus);
+
+    // Close the file so we can modify the modification time later.
+    destFile.close();
+
+    if (error) {
+        if (bMarkPartial) {
+            // Remove the part file if it's smaller than the minimum keep
+            const int size = m_slave->config()->readEntry("MinimumKeepSize", DEFAULT_MINIMUM_KEEP_SIZE);
+            if (partInfo.size() <  size) {
+                QFile::remove(partInfo.absoluteFilePath());
+            }
+        }
+        return;
+    }
+
+    // Rename partial file to its original name.
+    if (bMarkPartial) {
+        const QString sPart = partInfo.absoluteFilePath();
+        if (QFile::exists(destPath)) {
+            QFile::remove(destPath);
+        }
+        if (!QFile::rename(sPart, destPath)) {
+            qCDebug(LOG_KIO_NFS) << "failed to rename" << sPart << "to" << destPath;
+            m_slave->error(KIO::ERR_CANNOT_RENAME_PARTIAL, sPart);
+            return;
+        }
+    }
+
+    // Restore the mtime on the file.
+    const QString mtimeStr = m_slave->metaData("modified");
+    if (!mtimeStr.isEmpty()) {
+        QDateTime dt = QDateTime::fromString(mtimeStr, Qt::ISODate);
+        if (dt.isValid()) {
+            struct utimbuf utbuf;
+            utbuf.actime = QFileInfo(destPath).lastRead().toTime_t(); // access time, unchanged
+            utbuf.modtime = dt.toTime_t(); // modification time
+            utime(QFile::encodeName(destPath).constData(), &utbuf);
+        }
+    }
+
+    qCDebug(LOG_KIO_NFS) << "Copied" << srcFile.offset << "bytes of data";
+
+    m_slave->processedSize(srcFile.offset);
+    m_slave->finished();
+}
+
+void NFSProtocolV4::copyTo(const QUrl& src, const QUrl& dest, int _mode, KIO::JobFlags _flags)
+{
+    qCDebug(LOG_KIO_NFS) << src << "to" << dest;
+
+    // The source does not exist, how strange
+    const QString srcPath(src.path());
+    if (!QFile::exists(srcPath)) {
+        m_slave->error(KIO::ERR_DOES_NOT_EXIST, srcPath);
+        return;
+    }
+
+    const QString destPath(dest.path());
+
+    // Is it a link? No need to copy the data then, just copy the link destination.
+    const QString symlinkTarget = QFile::symLinkTarget(srcPath);
+    if (!symlinkTarget.isEmpty()) {
+        symlink(symlinkTarget, dest, _flags);
+        return;
+    }
+
+    int rpcStatus;
+    uint32 nfsStatus;
+
+    // The file exists and we don't want to overwrite.
+    NFSCompoundV4 exists;
+    if (callAt(destPath, [](NFSCompoundV4& c) {
+                c.getFh();
+            }, exists, rpcStatus) && (_flags & KIO::Overwrite) == 0) {
+        m_slave->error(KIO::ERR_FILE_ALREADY_EXIST, destPath);
+        return;
+    }
+
+    // Open the source file
+    QFile srcFile(srcPath);
+    if (!srcFile.open(QIODevice::ReadOnly)) {
+        m_slave->error(KIO::ERR_CANNOT_OPEN_FOR_READING, srcPath);
+        return;
+    }
+
+    // A part file is written from the start, it is only renamed once complete.
+    const QFileInfo destInfo(destPath);
+    const QString partFilePath = destPath + QLatin1String(".part");
+    const bool bMarkPartial = m_slave->config()->readEntry("MarkPartial", true);
+    const QString createPath = (bMarkPartial ? partFilePath : destPath);
+
+    OpenFile destFile;
+    if (!openForWriting(createPath, _mode, true, destFile, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, createPath);
+        return;
+    }
+
+    // Send the total size to the slave.
+    m_slave->totalSize(srcFile.size());
+
+    // Read as much as the WRITEs of one call take.
+    QByteArray buffer;
+
+    bool error = false;
+    forever {
+        buffer.resize(m_writeSize * qMax(1, int(m_maxOperations) / 4));
+        const qint64 bytesRead = srcFile.read(buffer.data(), buffer.size());
+        if (bytesRead < 0) {
+            m_slave->error(KIO::ERR_COULD_NOT_READ, srcPath);
+
+            error = true;
+            break;
+        }
+
+        if (bytesRead == 0) {
+            break;
+        }
+
+        buffer.truncate(bytesRead);
+        if (!writeFile(destFile, buffer, rpcStatus, nfsStatus)) {
+            checkForError(rpcStatus, nfsStatus, destPath);
+            error = true;
+            break;
+        }
+
+        m_slave->processedSize(destFile.offset);
+    }
+
+    // The writes are unstable, make sure they have reached the disk before
+    // the part file is renamed.
+    if (error) {
+        closeFile(destFile, rpcStatus, nfsStatus);
+    } else if (!closeFile(destFile, rpcStatus, nfsStatus)) {
+        checkForError(rpcStatus, nfsStatus, destPath);
+        error = true;
+    }
+
+    if (error) {
+        if (bMarkPartial) {
+            // Remove the part file if it's smaller than the minimum keep size.
+            const unsigned int size = m_slave->config()->readEntry("MinimumKeepSize", DEFAULT_MINIMUM_KEEP_SIZE);
+            if (destFile.offset < size) {
+                NFSCompoundV4 compound;
+                const QByteArray partName = QFile::encodeName(QFileInfo(partFilePath).fileName());
+                if (!callAt(destInfo.path(), [&partName](NFSCompoundV4& c) {
+                            c.remove(partName);
+                        }, compound, rpcStatus)) {
+                    qCDebug(LOG_KIO_NFS) << "Could not remove part file, ignoring...";
+                }
+            }
+        }
+        return;
+    }
+
+    // Rename partial file to its original name, RENAME replaces the destination.
+    if (bMarkPartial) {
+        const QByteArray partName = QFile::encodeName(QFileInfo(partFilePath).fileName());
+        const QByteArray destName = QFile::encodeName(destInfo.fileName());
+
+        NFSCompoundV4 compound;
+        if (!callAt(destInfo.path(), [&partName, &destName](NFSCompoundV4& c) {
+                    c.saveFh();
+                    c.rename(partName, destName);
+                }, compound, rpcStatus)) {
+            qCDebug(LOG_KIO_NFS) << "failed to rename" << partFilePath << "to" << destPath;
+            m_slave->error(KIO::ERR_CANNOT_RENAME_PARTIAL, partFilePath);
+            return;
+        }
+        uncacheHandles(destPath);
+    }
+
+    qCDebug(LOG_KIO_NFS) << "Copied" << destFile.offset << "bytes of data";
+
+    m_slave->processedSize(destFile.offset);
+    m_slave->finished();
+}
+
+void NFSProtocolV4::symlink(const QString& target, const QUrl& dest, KIO::JobFlags flags)
+{
+    const QString destPath(dest.path());
+    const QFileInfo destInfo(destPath);
+    const QByteArray name = QFile::encodeName(destInfo.fileName());
+
+    int rpcStatus;
+    NFSCompoundV4 exists;
+    if (callAt(destPath, [](NFSCompoundV4& c) {
+                c.getFh();
+            }, exists, rpcStatus)) {
+        if ((flags & KIO::Overwrite) == 0) {
+            m_slave->error(KIO::ERR_FILE_ALREADY_EXIST, destPath);
+            return;
+        }
+
+        // CREATE doesn't replace what is there.
+        NFSCompoundV4 compound;
+        callAt(destInfo.path(), [&name](NFSCompoundV4& c) {
+            c.remove(name);
+        }, compound, rpcStatus);
+        uncacheHandles(destPath);
+    }
+
+    const QByteArray linkDest = QFile::encodeName(target);
+
+    NFSCompoundV4 compound;
+    if (!callAt(destInfo.path(), [&name, &linkDest](NFSCompoundV4& c) {
+                c.createLink(name, linkDest);
+            }, compound, rpcStatus)) {
+        checkForError(rpcStatus, compound.status(), destPath);
+        return;
+    }
+
+    m_slave->finished();
+}
+
+uint32 NFSProtocolV4::createSession(int& rpcStatus)
+{
+    m_sessionId.clear();
+
+    // The owner is unique for this slave, the verifier for this run of it,
+    // so that the server can tell a restarted client from the same one.
+    QByteArray verifier(NFS4_VERIFIER_SIZE, '\0');
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    memcpy(verifier.data(), &now, qMin<int>(sizeof(now), NFS4_VERIFIER_SIZE));
+
+    const QByteArray owner = QStringLiteral("kio_nfs/%1/%2/%3")
+                             .arg(QHostInfo::localHostName())
+                             .arg(getuid())
+                             .arg(getpid()).toUtf8();
+
+    NFSCompoundV4 exchange;
+    exchange.exchangeId(verifier, owner);
+    rpcStatus = send(exchange);
+    if (rpcStatus != RPC_SUCCESS || exchange.status() != NFS4_OK) {
+        return exchange.status();
+    }
+
+    const NFSResultV4* client = exchange.result(NFS4_OP_EXCHANGE_ID);
+    m_clientId = client->clientId;
+
+    NFSCompoundV4 create;
+    create.createSession(m_clientId, client->sequenceId, NFS4_MAX_REQUEST, NFS4_MAX_RESPONSE, NFS4_MAX_OPERATIONS);
+    rpcStatus = send(create);
+    if (rpcStatus != RPC_SUCCESS || create.status() != NFS4_OK) {
+        return create.status();
+    }
+
+    const NFSResultV4* session = create.result(NFS4_OP_CREATE_SESSION);
+    m_sessionId = session->sessionId;
+    m_sequenceId = 1;
+    m_maxRequestSize = qMin<uint32>(session->maxRequestSize, NFS4_MAX_REQUEST);
+    m_maxResponseSize = qMin<uint32>(session->maxResponseSize, NFS4_MAX_RESPONSE);
+    m_maxOperations = qBound<uint32>(2, session->maxOperations, NFS4_MAX_OPERATIONS);
+
+    qCDebug(LOG_KIO_NFS) << "Session" << m_sessionId.toHex() << m_maxRequestSize << m_maxResponseSize << m_maxOperations;
+
+    // There is no state to reclaim, which the server waits to hear before it
+    // allows OPENs.
+    NFSCompoundV4 reclaim;
+    reclaim.reclaimComplete();
+    if (!call(reclaim, rpcStatus)) {
+        if (rpcStatus != RPC_SUCCESS || reclaim.status() != NFS4ERR_COMPLETE_ALREADY) {
+            return reclaim.status();
+        }
+    }
+
+    rpcStatus = RPC_SUCCESS;
+    return NFS4_OK;
+}
+
+int NFSProtocolV4::send(NFSCompoundV4& compound)
+{
+    QByteArray args = compound.encode();
+    QByteArray res;
+
+    int rpcStatus = clnt_call(m_client, NFSPROC4_COMPOUND,
+                              (xdrproc_t) xdr_nfs4_compound_args, reinterpret_cast<caddr_t>(&args),
+                              (xdrproc_t) xdr_nfs4_compound_res, reinterpret_cast<caddr_t>(&res),
+                              clnt_timeout);
+
+    if (rpcStatus == RPC_SUCCESS && !compound.decode(res)) {
+        rpcStatus = RPC_CANTDECODERES;
+    }
+
+    return rpcStatus;
+}
+
+bool NFSProtocolV4::call(NFSCompoundV4& compound, int& rpcStatus)
+{
+    int delays = 0;
+    bool newSession = false;
+
+    forever {
+        compound.setSequence(m_sessionId, m_sequenceId);
+
+        rpcStatus = send(compound);
+        if (rpcStatus != RPC_SUCCESS) {
+            return false;
+        }
+
+        // The slot is used up once SEQUENCE went through, whatever follows.
+        const NFSResultV4* sequence = compound.result(NFS4_OP_SEQUENCE);
+        const bool sequenced = (sequence != nullptr && sequence->status == NFS4_OK);
+        if (sequenced) {
+            ++m_sequenceId;
+        }
+
+        switch (compound.status()) {
+        case NFS4_OK:
+            return true;
+        case NFS4ERR_DELAY:
+        case NFS4ERR_GRACE:
+            // The server is busy or has just restarted, the operation was
+            // not done and can be sent again.
+            if (++delays > NFS4_DELAY_RETRIES) {
+                return false;
+            }
+            QThread::msleep(100 * delays);
+            break;
+        case NFS4ERR_BADSESSION:
+        case NFS4ERR_DEADSESSION:
+        case NFS4ERR_STALE_CLIENTID:
+        case NFS4ERR_EXPIRED:
+        case NFS4ERR_SEQ_MISORDERED:
+            // The server has forgotten the session, after a restart for
+            // instance. Set up a new one, once per call.
+            if (sequenced || newSession) {
+                return false;
+            }
+            newSession = true;
+
+            qCDebug(LOG_KIO_NFS) << "Session lost:" << compound.status();
+            if (createSession(rpcStatus) != NFS4_OK || rpcStatus != RPC_SUCCESS) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+}
+
+bool NFSProtocolV4::callAt(const QString& path, const std::function<void(NFSCompoundV4&)>& operations,
+                           NFSCompoundV4& compound, int& rpcStatus)
+{
+    QString currentPath = QDir::cleanPath(path);
+    bool lookedUpAgain = false;
+    int depth = 0;
+
+    forever {
+        const QStringList components = currentPath.split(QLatin1Char('/'), QString::SkipEmptyParts);
+
+        compound = NFSCompoundV4();
+        int start;
+        const bool cached = putPath(compound, components, start);
+        operations(compound);
+
+        if (call(compound, rpcStatus)) {
+            return true;
+        }
+        if (rpcStatus != RPC_SUCCESS) {
+            return false;
+        }
+
+        const uint32 status = compound.status();
+        if ((status == NFS4ERR_STALE || status == NFS4ERR_FHEXPIRED) && cached && !lookedUpAgain) {
+            lookedUpAgain = true;
+            clearFileHandles();
+            continue;
+        }
+
+        // A link where a directory, or a file to open, was expected. The
+        // LOOKUPs that went through tell which component it is.
+        if ((status != NFS4ERR_SYMLINK && status != NFS4ERR_NOTDIR) || depth >= NFS4_MAX_LINK_DEPTH) {
+            return false;
+        }
+
+        int lookups = 0;
+        for (const NFSResultV4& result : compound.results()) {
+            if (result.op == NFS4_OP_LOOKUP && result.status == NFS4_OK) {
+                ++lookups;
+            }
+        }
+
+        const int linkComponents = start + lookups;
+        if (linkComponents == 0) {
+            return false;
+        }
+
+        const QStringList linkComponentList = components.mid(0, linkComponents);
+        const QString link = QLatin1Char('/') + linkComponentList.join(QLatin1Char('/'));
+
+        NFSCompoundV4 readLink;
+        int linkStart;
+        int linkRpcStatus;
+        putPath(readLink, linkComponentList, linkStart);
+        readLink.readLink();
+        if (!call(readLink, linkRpcStatus)) {
+            return false;
+        }
+
+        const QString linkDest = QFile::decodeName(readLink.result(NFS4_OP_READLINK)->data);
+        qCDebug(LOG_KIO_NFS) << "Following" << link << "to" << linkDest;
+
+        QStringList resolved = linkPath(QFileInfo(link).path(), linkDest).split(QLatin1Char('/'), QString::SkipEmptyParts);
+        resolved += components.mid(linkComponents);
+        currentPath = QLatin1Char('/') + resolved.join(QLatin1Char('/'));
+        ++depth;
+    }
+}
+
+bool NFSProtocolV4::putPath(NFSCompoundV4& compound, const QStringList& components, int& start)
+{
+    for (start = components.size(); start >= 0; --start) {
+        const QString prefix = QLatin1Char('/') + components.mid(0, start).join(QLatin1Char('/'));
+        NFSFileHandle fh;
+        if (getCachedFileHandle(prefix, fh)) {
+            compound.putFh(fromFileHandle(fh));
+            break;
+        }
+    }
+
+    const bool cached = (start >= 0);
+    if (!cached) {
+        compound.putRootFh();
+        start = 0;
+    }
+
+    for (int i = start; i < components.size(); ++i) {
+        compound.lookup(QFile::encodeName(components.at(i)));
+    }
+
+    return cached;
+}
+
+void NFSProtocolV4::cacheHandle(const QString& path, const QByteArray& fh)
+{
+    addFileHandle(QDir::cleanPath(path), toFileHandle(fh));
+}
+
+void NFSProtocolV4::uncacheHandles(const QString& path)
+{
+    removeFileHandle(QDir::cleanPath(path));
+}
+
+QString NFSProtocolV4::linkPath(const QString& dirPath, const QString& linkDest) const
+{
+    if (QFileInfo(linkDest).isAbsolute()) {
+        return QDir::cleanPath(linkDest);
+    }
+
+    return QDir::cleanPath(dirPath + QLatin1Char('/') + linkDest);
+}
+
+bool NFSProtocolV4::openForReading(const QString& path, uint64 offset, OpenFile& file, QByteArray& data, int& rpcStatus, uint32& nfsStatus)
+{
+    const uint64 clientId = m_clientId;
+    const uint32 readSize = m_readSize;
+
+    // OPEN, and the first READ with the stateid the OPEN returned.
+    NFSCompoundV4 compound;
+    if (!callAt(path, [clientId, offset, readSize](NFSCompoundV4& c) {
+                c.getFh();
+                c.open(clientId, NFS4_SHARE_ACCESS_READ);
+                c.getAttr({NFS4_ATTR_SIZE});
+                c.read(NFSCompoundV4::currentStateid(), offset, readSize);
+            }, compound, rpcStatus)) {
+        nfsStatus = compound.status();
+
+        // The OPEN went through but the READ didn't.
+        const NFSResultV4* open = compound.result(NFS4_OP_OPEN);
+        if (rpcStatus == RPC_SUCCESS && open != nullptr && open->status == NFS4_OK) {
+            NFSCompoundV4 close;
+            int closeRpcStatus;
+            close.putFh(compound.result(NFS4_OP_GETFH)->fh);
+            close.close(open->stateid);
+            call(close, closeRpcStatus);
+        }
+        return false;
+    }
+
+    const NFSResultV4* read = compound.result(NFS4_OP_READ);
+
+    file.path = path;
+    file.fh = compound.result(NFS4_OP_GETFH)->fh;
+    file.stateid = compound.result(NFS4_OP_OPEN)->stateid;
+    file.size = compound.result(NFS4_OP_GETATTR)->attributes.attributes.size;
+    file.offset = offset + read->data.size();
+    file.eof = read->eof || read->data.isEmpty();
+    file.verifier.clear();
+
+    cacheHandle(path, file.fh);
+
+    data = read->data;
+    rpcStatus = RPC_SUCCESS;
+    nfsStatus = NFS4_OK;
+    return true;
+}
+
+bool NFSProtocolV4::readFile(OpenFile& file, QByteArray& data, int& rpcStatus, uint32& nfsStatus)
+{
+    NFSCompoundV4 compound;
+    compound.putFh(file.fh);
+    compound.read(file.stateid, file.offset, m_readSize);
+    if (!call(compound, rpcStatus)) {
+        nfsStatus = compound.status();
+        return false;
+    }
+
+    const NFSResultV4* read = compound.result(NFS4_OP_READ);
+    data = read->data;
+    file.offset += data.size();
+    file.eof = read->eof || data.isEmpty();
+
+    nfsStatus = NFS4_OK;
+    return true;
+}
+
+bool NFSProtocolV4::openForWriting(const QString& path, int mode, bool overwrite, OpenFile& file, int& rpcStatus, uint32& nfsStatus)
+{
+    const QFileInfo fileInfo(path);
+    const QByteArray name = QFile::encodeName(fileInfo.fileName());
+    const uint64 clientId = m_clientId;
+    const int createMode = (mode == -1 ? 0644 : mode);
+
+    NFSCompoundV4 compound;
+    if (!callAt(fileInfo.path(), [clientId, &name, createMode, overwrite](NFSCompoundV4& c) {
+                c.open(clientId, NFS4_SHARE_ACCESS_WRITE, name, createMode, overwrite, !overwrite);
+                c.getFh();
+            }, compound, rpcStatus)) {
+        nfsStatus = compound.status();
+        return false;
+    }
+
+    file.path = path;
+    file.fh = compound.result(NFS4_OP_GETFH)->fh;
+    file.stateid = compound.result(NFS4_OP_OPEN)->stateid;
+    file.size = 0;
+    file.offset = 0;
+    file.eof = false;
+    file.verifier.clear();
+
+    cacheHandle(path, file.fh);
+
+    nfsStatus = NFS4_OK;
+    return true;
+}
+
+bool NFSProtocolV4::writeFile(OpenFile& file, const QByteArray& data, int& rpcStatus, uint32& nfsStatus)
+{
+    int pos = 0;
+    while (pos < data.size()) {
+        // As many WRITEs as the session takes in one call.
+        NFSCompoundV4 compound;
+        compound.putFh(file.fh);
+
+        QVector<int> lengths;
+        int end = pos;
+        while (end < data.size() && compound.operationCount() + 1 < int(m_maxOperations)) {
+            const int length = qMin<int>(m_writeSize, data.size() - end);
+            if (!lengths.isEmpty() && compound.size() + length + NFS4_CALL_OVERHEAD > int(m_maxRequestSize)) {
+                break;
+            }
+
+            compound.write(file.stateid, file.offset + (end - pos), NFS4_UNSTABLE, data.constData() + end, length);
+            lengths.append(length);
+            end += length;
+        }
+
+        if (!call(compound, rpcStatus)) {
+            nfsStatus = compound.status();
+            return false;
+        }
+
+        // A short WRITE leaves a gap, send everything after it again.
+        int written = 0;
+        for (int i = 0; i < lengths.size(); ++i) {
+            const NFSResultV4* write = compound.result(NFS4_OP_WRITE, i);
+
+            // A different verifier means the server restarted, and lost
+            // whatever unstable data it had.
+            if (file.verifier.isEmpty()) {
+                file.verifier = write->verifier;
+            } else if (write->verifier != file.verifier) {
+                qCDebug(LOG_KIO_NFS) << "Write verifier changed, the server restarted";
+                nfsStatus = NFS3ERR_IO;
+                return false;
+            }
+
+            written += write->count;
+            if (int(write->count) < lengths.at(i)) {
+                break;
+            }
+        }
+
+        if (written == 0) {
+            nfsStatus = NFS3ERR_IO;
+            return false;
+        }
+
+        pos += written;
+        file.offset += written;
+    }
+
+    file.size = qMax(file.size, file.offset);
+
+    nfsStatus = NFS4_OK;
+    return true;
+}
+
+bool NFSProtocolV4::closeFile(OpenFile& file, int& rpcStatus, uint32& nfsStatus)
+{
+    const bool written = !file.verifier.isEmpty();
+
+    NFSCompoundV4 compound;
+    compound.putFh(file.fh);
+    if (written) {
+        compound.commit();
+    }
+    compound.close(file.stateid);
+    if (!call(compound, rpcStatus)) {
+        nfsStatus = compound.status();
+        return false;
+    }
+
+    if (written && compound.result(NFS4_OP_COMMIT)->verifier != file.verifier) {
+        qCDebug(LOG_KIO_NFS) << "Commit verifier changed, the server restarted";
+        nfsStatus = NFS3ERR_IO;
+        return false;
+    }
+
+    nfsStatus = NFS4_OK;
+    return true;
+}
+
+bool NFSProtocolV4::statPath(const QString& path, KIO::UDSEntry& entry, int& rpcStatus, uint32& nfsStatus)
+{
+    NFSCompoundV4 compound;
+    if (!callAt(path, [](NFSCompoundV4& c) {
+                c.getFh();
+                c.getAttr(s_statAttributes);
+            }, compound, rpcStatus)) {
+        nfsStatus = compound.status();
+        return false;
+    }
+
+    const QByteArray fh = compound.result(NFS4_OP_GETFH)->fh;
+    cacheHandle(path, fh);
+
+    const QFileInfo fileInfo(path);
+    entry.insert(KIO::UDSEntry::UDS_NAME, path == QLatin1String("/") ? path : fileInfo.fileName());
+
+    const NFSAttributesV4& attributes = compound.result(NFS4_OP_GETATTR)->attributes;
+
+    // Is it a symlink?
+    if (attributes.attributes.type == NF4LNK) {
+        qCDebug(LOG_KIO_NFS) << "It's a symlink";
+
+        QString linkDest;
+
+        NFSCompoundV4 link;
+        link.putFh(fh);
+        link.readLink();
+        if (call(link, rpcStatus)) {
+            linkDest = QFile::decodeName(link.result(NFS4_OP_READLINK)->data);
+        }
+
+        qCDebug(LOG_KIO_NFS) << "link dest is" << linkDest;
+
+        entry.insert(KIO::UDSEntry::UDS_LINK_DEST, linkDest);
+
+        NFSCompoundV4 target;
+        if (linkDest.isEmpty() || !callAt(linkPath(fileInfo.path(), linkDest), [](NFSCompoundV4& c) {
+                    c.getAttr(s_statAttributes);
+                }, target, rpcStatus)) {
+            completeBadLinkUDSEntry(entry, attributes);
+        } else {
+            completeUDSEntry(entry, target.result(NFS4_OP_GETATTR)->attributes);
+        }
+    } else {
+        completeUDSEntry(entry, attributes);
+    }
+
+    rpcStatus = RPC_SUCCESS;
+    nfsStatus = NFS4_OK;
+    return true;
+}
+
+void NFSProtocolV4::completeLinkEntries(const QString& dirPath, const QByteArray& dirFH,
+                                        KIO::UDSEntryList& entries, const QVector<LinkEntry>& links)
+{
+    if (links.isEmpty()) {
+        return;
+    }
+
+    // The targets. The server stops at the first READLINK that fails, which
+    // leaves that link bad and the ones after it for the next call.
+    QVector<QString> targets(links.size());
+    int next = 0;
+    while (next < links.size()) {
+        NFSCompoundV4 compound;
+        int count = 0;
+        while (next + count < links.size() && compound.operationCount() + 3 < int(m_maxOperations)) {
+            const LinkEntry& link = links.at(next + count);
+            if (!link.fh.isEmpty()) {
+                compound.putFh(link.fh);
+            } else {
+                compound.putFh(dirFH);
+                compound.lookup(QFile::encodeName(link.name));
+            }
+            compound.readLink();
+            ++count;
+        }
+
+        int rpcStatus;
+        call(compound, rpcStatus);
+        if (rpcStatus != RPC_SUCCESS) {
+            break;
+        }
+
+        int done = 0;
+        for (; done < count; ++done) {
+            const NFSResultV4* result = compound.result(NFS4_OP_READLINK, done);
+            if (result == nullptr || result->status != NFS4_OK) {
+                break;
+            }
+            targets[next + done] = QFile::decodeName(result->data);
+        }
+
+        next += (done < count ? done + 1 : count);
+    }
+
+    // What the targets are, as links to directories are shown as directories.
+    // The lookups of several targets share a call, one that fails is looked
+    // up again on its own, which follows links on the way.
+    next = 0;
+    while (next < links.size()) {
+        NFSCompoundV4 compound;
+        QVector<int> batch;
+        for (; next < links.size(); ++next) {
+            if (targets.at(next).isEmpty()) {
+                KIO::UDSEntry& entry = entries[links.at(next).index];
+                entry.insert(KIO::UDSEntry::UDS_LINK_DEST, QString());
+                completeBadLinkUDSEntry(entry, links.at(next).attributes);
+                continue;
+            }
+
+            const QStringList components = linkPath(dirPath, targets.at(next)).split(QLatin1Char('/'), QString::SkipEmptyParts);
+            if (!batch.isEmpty() && compound.operationCount() + components.size() + 2 >= int(m_maxOperations)) {
+                break;
+            }
+
+            int start;
+            putPath(compound, components, start);
+            compound.getAttr(s_statAttributes);
+            batch.append(next);
+        }
+
+        if (batch.isEmpty()) {
+            break;
+        }
+
+        int rpcStatus;
+        call(compound, rpcStatus);
+
+        for (int i = 0; i < batch.size(); ++i) {
+            const LinkEntry& link = links.at(batch.at(i));
+            const QString& target = targets.at(batch.at(i));
+
+            KIO::UDSEntry& entry = entries[link.index];
+            entry.insert(KIO::UDSEntry::UDS_LINK_DEST, target);
+
+            const NFSResultV4* result = (rpcStatus == RPC_SUCCESS ? compound.result(NFS4_OP_GETATTR, i) : nullptr);
+            if (result != nullptr && result->status == NFS4_OK) {
+                completeUDSEntry(entry, result->attributes);
+                continue;
+            }
+
+            NFSCompoundV4 single;
+            if (callAt(linkPath(dirPath, target), [](NFSCompoundV4& c) {
+                        c.getAttr(s_statAttributes);
+                    }, single, rpcStatus)) {
+                completeUDSEntry(entry, single.result(NFS4_OP_GETATTR)->attributes);
+            } else {
+                completeBadLinkUDSEntry(entry, link.attributes);
+            }
+
+            // Those after the failed one were not looked up.
+            next = batch.at(i) + 1;
+            break;
+        }
+    }
+}
+
+void NFSProtocolV4::completeUDSEntry(KIO::UDSEntry& entry, const NFSAttributesV4& attributes)
+{
+    const fattr3& attr = attributes.attributes;
+
+    entry.insert(KIO::UDSEntry::UDS_SIZE, attr.size);
+    entry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, attr.mtime.seconds);
+    entry.insert(KIO::UDSEntry::UDS_ACCESS_TIME, attr.atime.seconds);
+    entry.insert(KIO::UDSEntry::UDS_CREATION_TIME, attr.ctime.seconds);
+    entry.insert(KIO::UDSEntry::UDS_ACCESS, (attr.mode & 07777));
+
+    unsigned int type;
+    switch (attr.type) {
+    case NF3DIR:
+        type = S_IFDIR;
+        break;
+    case NF3BLK:
+        type = S_IFBLK;
+        break;
+    case NF3CHR:
+        type = S_IFCHR;
+        break;
+    case NF3LNK:
+        type = S_IFLNK;
+        break;
+    case NF3SOCK:
+        type = S_IFSOCK;
+        break;
+    case NF3FIFO:
+        type = S_IFIFO;
+        break;
+    default:
+        type = S_IFREG;
+        break;
+    }
+
+    entry.insert(KIO::UDSEntry::UDS_FILE_TYPE, type);
+
+    entry.insert(KIO::UDSEntry::UDS_USER, ownerName(attributes.owner, false));
+    entry.insert(KIO::UDSEntry::UDS_GROUP, ownerName(attributes.group, true));
+}
+
+void NFSProtocolV4::completeBadLinkUDSEntry(KIO::UDSEntry& entry, const NFSAttributesV4& attributes)
+{
+    const fattr3& attr = attributes.attributes;
+
+    entry.insert(KIO::UDSEntry::UDS_SIZE, 0LL);
+    entry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, attr.mtime.seconds);
+    entry.insert(KIO::UDSEntry::UDS_ACCESS_TIME, attr.atime.seconds);
+    entry.insert(KIO::UDSEntry::UDS_CREATION_TIME, attr.ctime.seconds);
+    entry.insert(KIO::UDSEntry::UDS_FILE_TYPE, S_IFMT - 1);
+    entry.insert(KIO::UDSEntry::UDS_ACCESS, S_IRWXU | S_IRWXG | S_IRWXO);
+    entry.insert(KIO::UDSEntry::UDS_USER, ownerName(attributes.owner, false));
+    entry.insert(KIO::UDSEntry::UDS_GROUP, ownerName(attributes.group, true));
+}
+
+QString NFSProtocolV4::ownerName(const QString& owner, bool group)
+{
+    // Owners are "name@domain", or a plain number from servers that don't
+    // map IDs. Numbers are looked up like NFSv3 does.
+    const QString key = (group ? QLatin1String("g:") : QLatin1String("u:")) + owner;
+    const auto it = m_ownerNames.constFind(key);
+    if (it != m_ownerNames.constEnd()) {
+        return it.value();
+    }
+
+    QString name = owner.section(QLatin1Char('@'), 0, 0);
+
+    bool isNumber;
+    const uint id = name.toUInt(&isNumber);
+    if (isNumber) {
+        if (group) {
+            struct group* grp = getgrgid(id);
+            if (grp) {
+                name = QString::fromLatin1(grp->gr_name);
+            }
+        } else {
+            struct passwd* user = getpwuid(id);
+            if (user) {
+                name = QString::fromLatin1(user->pw_name);
+            }
+        }
+    }
+
+    m_ownerNames.insert(key, name);
+    return name;
+}
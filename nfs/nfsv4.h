@@ -0,0 +1,167 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIO_NFSV4_H
+#define KIO_NFSV4_H
+
+#include "kio_nfs.h"
+#include "nfsv4compound.h"
+
+#include <functional>
+
+#define PORTMAP  //this seems to be required to compile on Solaris
+#include <rpc/rpc.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/time.h>
+
+// NFSv4.1. There is no MOUNT protocol, the server exports a pseudo file
+// system that starts at "/", and each path is resolved by a single COMPOUND
+// of PUTROOTFH and one LOOKUP per component. Calls go through a session,
+// which is kept for as long as the connection and set up again if the
+// server forgets it.
+class NFSProtocolV4 : public NFSProtocol
+{
+public:
+    NFSProtocolV4(NFSSlave* slave);
+    ~NFSProtocolV4() override;
+
+    bool isCompatible(bool& connectionError) override;
+    bool isConnected() const override;
+
+    void openConnection() override;
+    void closeConnection() override;
+
+    void setHost(const QString& host) override;
+
+    void put(const QUrl& url, int _mode, KIO::JobFlags _flags) override;
+    void get(const QUrl& url) override;
+    void listDir(const QUrl& url) override;
+    void symlink(const QString& target, const QUrl& dest, KIO::JobFlags) override;
+    void stat(const QUrl& url) override;
+    void mkdir(const QUrl& url, int permissions) override;
+    void del(const QUrl& url, bool isfile) override;
+    void chmod(const QUrl& url, int permissions) override;
+    void rename(const QUrl& src, const QUrl& dest, KIO::JobFlags flags) override;
+
+protected:
+    void copySame(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) override;
+    void copyFrom(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) override;
+    void copyTo(const QUrl& src, const QUrl& dest, int mode, KIO::JobFlags flags) override;
+
+    // Look up a file handle.
+    NFSFileHandle lookupFileHandle(const QString& path) override;
+
+private:
+    // A file opened for reading or writing.
+    struct OpenFile {
+        QString path;
+        QByteArray fh;
+        QByteArray stateid;
+        uint64 size;
+        uint64 offset;
+        bool eof;
+        // The verifier of the unstable writes, to check the COMMIT against.
+        QByteArray verifier;
+    };
+
+    // A link found by listDir, completed once its target is known.
+    struct LinkEntry {
+        int index;
+        QString name;
+        QByteArray fh;
+        NFSAttributesV4 attributes;
+    };
+
+    // Sets up the client ID and session, returns an nfsstat4.
+    uint32 createSession(int& rpcStatus);
+
+    // Sends a call as it is, returns a clnt_stat.
+    int send(NFSCompoundV4& compound);
+
+    // Makes a call in the session. Returns true if all operations
+    // succeeded; otherwise rpcStatus or compound.status() tell why.
+    bool call(NFSCompoundV4& compound, int& rpcStatus);
+
+    // Makes a call that starts at path: operations adds what follows the
+    // PUTFH and LOOKUPs that make path the current file handle. If a cached
+    // handle has gone stale, the path is looked up again from the root, and
+    // links on the way are followed.
+    bool callAt(const QString& path, const std::function<void(NFSCompoundV4&)>& operations,
+                NFSCompoundV4& compound, int& rpcStatus);
+
+    // Adds the operations that make the path of components the current file
+    // handle, starting from the nearest directory whose handle is cached.
+    // start is set to the number of components that handle covers. Returns
+    // whether a cached handle was used.
+    bool putPath(NFSCompoundV4& compound, const QStringList& components, int& start);
+
+    void cacheHandle(const QString& path, const QByteArray& fh);
+    void uncacheHandles(const QString& path);
+
+    // Resolves a link in dirPath to an absolute path.
+    QString linkPath(const QString& dirPath, const QString& linkDest) const;
+
+    // Opens path for reading, following links, and reads the first chunk of
+    // data from offset in the same call. data is set to that chunk.
+    bool openForReading(const QString& path, uint64 offset, OpenFile& file, QByteArray& data, int& rpcStatus, uint32& nfsStatus);
+    bool readFile(OpenFile& file, QByteArray& data, int& rpcStatus, uint32& nfsStatus);
+
+    // Creates path, or truncates it if overwrite is set, and opens it for writing.
+    bool openForWriting(const QString& path, int mode, bool overwrite, OpenFile& file, int& rpcStatus, uint32& nfsStatus);
+    // Writes data at the offset of the file, in as few calls as the session allows.
+    bool writeFile(OpenFile& file, const QByteArray& data, int& rpcStatus, uint32& nfsStatus);
+
+    // Commits the writes, if there were any, and closes the file.
+    bool closeFile(OpenFile& file, int& rpcStatus, uint32& nfsStatus);
+
+    // Stats path in one call, reads the target of a link and stats that too.
+    bool statPath(const QString& path, KIO::UDSEntry& entry, int& rpcStatus, uint32& nfsStatus);
+
+    // Reads the targets of links, with as many READLINKs in a call as the
+    // session allows, and completes their entries.
+    void completeLinkEntries(const QString& dirPath, const QByteArray& dirFH,
+                             KIO::UDSEntryList& entries, const QVector<LinkEntry>& links);
+
+    // UDS helper functions
+    void completeUDSEntry(KIO::UDSEntry& entry, const NFSAttributesV4& attributes);
+    void completeBadLinkUDSEntry(KIO::UDSEntry& entry, const NFSAttributesV4& attributes);
+    QString ownerName(const QString& owner, bool group);
+
+    NFSSlave* m_slave;
+
+    QString m_currentHost;
+    CLIENT* m_client;
+    int m_sock;
+
+    timeval clnt_timeout;
+
+    uint64 m_clientId;
+    QByteArray m_sessionId;
+    uint32 m_sequenceId;
+    uint32 m_maxRequestSize;
+    uint32 m_maxResponseSize;
+    uint32 m_maxOperations;
+
+    uint32 m_readSize;
+    uint32 m_writeSize;
+
+    QHash<QString, QString> m_ownerNames;
+};
+
+#endif
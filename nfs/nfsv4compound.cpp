@@ -0,0 +1,813 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "nfsv4compound.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+// The values of enums and flags in the calls.
+#define NFS4_CLAIM_NULL 0
+#define NFS4_CLAIM_FH 4
+#define NFS4_OPEN_NOCREATE 0
+#define NFS4_OPEN_CREATE 1
+#define NFS4_CREATE_UNCHECKED 0
+#define NFS4_CREATE_GUARDED 1
+#define NFS4_SHARE_DENY_NONE 0
+#define NFS4_SHARE_ACCESS_WANT_NO_DELEG 0x0400
+#define NFS4_EXCHGID_FLAG_USE_NON_PNFS 0x00010000
+#define NFS4_SP4_NONE 0
+#define NFS4_CB_PROGRAM 0x40000000
+#define NFS4_AUTH_NONE 0
+
+#define NFS4_OPEN_DELEGATE_NONE 0
+#define NFS4_OPEN_DELEGATE_READ 1
+#define NFS4_OPEN_DELEGATE_WRITE 2
+#define NFS4_OPEN_DELEGATE_NONE_EXT 3
+#define NFS4_LIMIT_SIZE 1
+#define NFS4_WND_CONTENTION 6
+#define NFS4_WND_RESOURCE 7
+
+// The largest piece of a reply taken from the record stream at once.
+#define NFS4_DECODE_CHUNK 4096
+
+// The owner of all opens of the slave, the client ID tells the slaves apart.
+static const char s_openOwner[] = "kio_nfs";
+
+namespace
+{
+
+// Reads XDR encoded data. Reading past the end sets a flag instead of
+// failing right away, so a truncated reply only has to be checked once.
+class Reader
+{
+public:
+    Reader(const QByteArray& data)
+        : m_data(data),
+          m_pos(0),
+          m_ok(true)
+    {
+    }
+
+    bool ok() const
+    {
+        return m_ok;
+    }
+
+    uint32 uint32Value()
+    {
+        if (!check(4)) {
+            return 0;
+        }
+        const quint32 value = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(m_data.constData() + m_pos));
+        m_pos += 4;
+        return value;
+    }
+
+    uint64 uint64Value()
+    {
+        const uint64 high = uint32Value();
+        return (high << 32) | uint32Value();
+    }
+
+    bool boolValue()
+    {
+        return uint32Value() != 0;
+    }
+
+    QByteArray fixed(int size)
+    {
+        const int padded = (size + 3) & ~3;
+        if (!check(padded)) {
+            return QByteArray();
+        }
+        const QByteArray value = m_data.mid(m_pos, size);
+        m_pos += padded;
+        return value;
+    }
+
+    QByteArray opaque()
+    {
+        const uint32 length = uint32Value();
+        if (length > uint32(m_data.size())) {
+            m_ok = false;
+            return QByteArray();
+        }
+        return fixed(int(length));
+    }
+
+    QVector<uint32> bitmap()
+    {
+        const uint32 count = uint32Value();
+        QVector<uint32> words;
+        for (uint32 i = 0; i < count && m_ok; ++i) {
+            words.append(uint32Value());
+        }
+        return words;
+    }
+
+    void skip(int size)
+    {
+        fixed(size);
+    }
+
+private:
+    bool check(int size)
+    {
+        if (!m_ok || m_pos + size > m_data.size()) {
+            m_ok = false;
+            return false;
+        }
+        return true;
+    }
+
+    const QByteArray& m_data;
+    int m_pos;
+    bool m_ok;
+};
+
+bool isSet(const QVector<uint32>& bitmap, int bit)
+{
+    const int word = bit / 32;
+    return word < bitmap.size() && (bitmap.at(word) & (1UL << (bit % 32))) != 0;
+}
+
+void readTime(Reader& reader, nfstime3& time)
+{
+    time.seconds = uint32(reader.uint64Value());
+    time.nseconds = reader.uint32Value();
+}
+
+// A fattr4, as far as the attributes that the slave asks for are concerned.
+// Servers only send what was asked for, in the order of the bits.
+void readAttributes(Reader& reader, NFSAttributesV4& result)
+{
+    const QVector<uint32> bitmap = reader.bitmap();
+    const QByteArray values = reader.opaque();
+
+    Reader attrs(values);
+    for (int bit = 0; bit < bitmap.size() * 32 && attrs.ok(); ++bit) {
+        if (!isSet(bitmap, bit)) {
+            continue;
+        }
+
+        fattr3& attributes = result.attributes;
+        switch (bit) {
+        case NFS4_ATTR_TYPE:
+            attributes.type = ftype3(attrs.uint32Value());
+            break;
+        case NFS4_ATTR_SIZE:
+            attributes.size = attrs.uint64Value();
+            break;
+        case NFS4_ATTR_FILEHANDLE:
+            result.fh = attrs.opaque();
+            break;
+        case NFS4_ATTR_FILEID:
+            attributes.fileid = attrs.uint64Value();
+            break;
+        case NFS4_ATTR_MAXREAD:
+            result.maxRead = attrs.uint64Value();
+            break;
+        case NFS4_ATTR_MAXWRITE:
+            result.maxWrite = attrs.uint64Value();
+            break;
+        case NFS4_ATTR_MODE:
+            attributes.mode = attrs.uint32Value();
+            break;
+        case NFS4_ATTR_NUMLINKS:
+            attributes.nlink = attrs.uint32Value();
+            break;
+        case NFS4_ATTR_OWNER:
+            result.owner = QString::fromUtf8(attrs.opaque());
+            break;
+        case NFS4_ATTR_OWNER_GROUP:
+            result.group = QString::fromUtf8(attrs.opaque());
+            break;
+        case NFS4_ATTR_SPACE_USED:
+            attributes.used = attrs.uint64Value();
+            break;
+        case NFS4_ATTR_TIME_ACCESS:
+            readTime(attrs, attributes.atime);
+            break;
+        case NFS4_ATTR_TIME_METADATA:
+            readTime(attrs, attributes.ctime);
+            break;
+        case NFS4_ATTR_TIME_MODIFY:
+            readTime(attrs, attributes.mtime);
+            break;
+        default:
+            // Not asked for, so we don't know its size; nothing after it
+            // can be read.
+            return;
+        }
+    }
+}
+
+void readChangeInfo(Reader& reader)
+{
+    reader.boolValue();
+    reader.uint64Value();
+    reader.uint64Value();
+}
+
+void readAce(Reader& reader)
+{
+    reader.uint32Value();
+    reader.uint32Value();
+    reader.uint32Value();
+    reader.opaque();
+}
+
+void readChannelAttributes(Reader& reader, NFSResultV4& result, bool fore)
+{
+    reader.uint32Value(); // headerpadsize
+    const uint32 maxRequestSize = reader.uint32Value();
+    const uint32 maxResponseSize = reader.uint32Value();
+    reader.uint32Value(); // maxresponsesize_cached
+    const uint32 maxOperations = reader.uint32Value();
+    reader.uint32Value(); // maxrequests
+    const uint32 rdmaCount = reader.uint32Value();
+    for (uint32 i = 0; i < rdmaCount && reader.ok(); ++i) {
+        reader.uint32Value();
+    }
+
+    if (fore) {
+        result.maxRequestSize = maxRequestSize;
+        result.maxResponseSize = maxResponseSize;
+        result.maxOperations = maxOperations;
+    }
+}
+
+void readOpen(Reader& reader, NFSResultV4& result)
+{
+    result.stateid = reader.fixed(NFS4_STATEID_SIZE);
+    readChangeInfo(reader);
+    reader.uint32Value(); // rflags
+    reader.bitmap();      // attrset
+
+    switch (reader.uint32Value()) {
+    case NFS4_OPEN_DELEGATE_NONE:
+        break;
+    case NFS4_OPEN_DELEGATE_READ:
+        reader.skip(NFS4_STATEID_SIZE);
+        reader.boolValue();
+        readAce(reader);
+        break;
+    case NFS4_OPEN_DELEGATE_WRITE:
+        reader.skip(NFS4_STATEID_SIZE);
+        reader.boolValue();
+        if (reader.uint32Value() == NFS4_LIMIT_SIZE) {
+            reader.uint64Value();
+        } else {
+            reader.uint32Value();
+            reader.uint32Value();
+        }
+        readAce(reader);
+        break;
+    case NFS4_OPEN_DELEGATE_NONE_EXT: {
+        const uint32 why = reader.uint32Value();
+        if (why == NFS4_WND_CONTENTION || why == NFS4_WND_RESOURCE) {
+            reader.boolValue();
+        }
+        break;
+    }
+    }
+}
+
+void readResult(Reader& reader, NFSResultV4& result)
+{
+    switch (result.op) {
+    case NFS4_OP_GETFH:
+        result.fh = reader.opaque();
+        break;
+    case NFS4_OP_GETATTR:
+        readAttributes(reader, result.attributes);
+        break;
+    case NFS4_OP_READDIR:
+        result.verifier = reader.fixed(NFS4_VERIFIER_SIZE);
+        while (reader.boolValue() && reader.ok()) {
+            NFSDirEntryV4 entry;
+            entry.cookie = reader.uint64Value();
+            entry.name = reader.opaque();
+            readAttributes(reader, entry.attributes);
+            result.entries.append(entry);
+        }
+        result.eof = reader.boolValue();
+        break;
+    case NFS4_OP_READLINK:
+        result.data = reader.opaque();
+        break;
+    case NFS4_OP_OPEN:
+        readOpen(reader, result);
+        break;
+    case NFS4_OP_CLOSE:
+        result.stateid = reader.fixed(NFS4_STATEID_SIZE);
+        break;
+    case NFS4_OP_READ:
+        result.eof = reader.boolValue();
+        result.data = reader.opaque();
+        break;
+    case NFS4_OP_WRITE:
+        result.count = reader.uint32Value();
+        result.committed = reader.uint32Value();
+        result.verifier = reader.fixed(NFS4_VERIFIER_SIZE);
+        break;
+    case NFS4_OP_COMMIT:
+        result.verifier = reader.fixed(NFS4_VERIFIER_SIZE);
+        break;
+    case NFS4_OP_CREATE:
+        readChangeInfo(reader);
+        reader.bitmap();
+        break;
+    case NFS4_OP_REMOVE:
+        readChangeInfo(reader);
+        break;
+    case NFS4_OP_RENAME:
+        readChangeInfo(reader);
+        readChangeInfo(reader);
+        break;
+    case NFS4_OP_SEQUENCE:
+        result.sessionId = reader.fixed(NFS4_SESSIONID_SIZE);
+        result.sequenceId = reader.uint32Value();
+        reader.uint32Value(); // slotid
+        reader.uint32Value(); // highest_slotid
+        reader.uint32Value(); // target_highest_slotid
+        reader.uint32Value(); // status_flags
+        break;
+    case NFS4_OP_EXCHANGE_ID: {
+        result.clientId = reader.uint64Value();
+        result.sequenceId = reader.uint32Value();
+        reader.uint32Value(); // flags
+        if (reader.uint32Value() != NFS4_SP4_NONE) {
+            // Not asked for, can't be decoded.
+            result.status = NFS4ERR_NOTSUPP;
+            return;
+        }
+        reader.uint64Value(); // so_minor_id
+        reader.opaque();      // so_major_id
+        reader.opaque();      // server scope
+        const uint32 implCount = reader.uint32Value();
+        for (uint32 i = 0; i < implCount && reader.ok(); ++i) {
+            reader.opaque();
+            reader.opaque();
+            reader.uint64Value();
+            reader.uint32Value();
+        }
+        break;
+    }
+    case NFS4_OP_CREATE_SESSION:
+        result.sessionId = reader.fixed(NFS4_SESSIONID_SIZE);
+        result.sequenceId = reader.uint32Value();
+        reader.uint32Value(); // flags
+        readChannelAttributes(reader, result, true);
+        readChannelAttributes(reader, result, false);
+        break;
+    case NFS4_OP_SETATTR:
+        // Handled by the caller, as its bitmap comes with errors too.
+        break;
+    default:
+        // PUTFH, PUTROOTFH, SAVEFH, LOOKUP, RECLAIM_COMPLETE and
+        // DESTROY_SESSION return just the status.
+        break;
+    }
+}
+
+}
+
+NFSAttributesV4::NFSAttributesV4()
+    : maxRead(0),
+      maxWrite(0)
+{
+    memset(&attributes, 0, sizeof(attributes));
+}
+
+NFSResultV4::NFSResultV4()
+    : op(0),
+      status(NFS4_OK),
+      eof(false),
+      count(0),
+      committed(0),
+      clientId(0),
+      sequenceId(0),
+      maxRequestSize(0),
+      maxResponseSize(0),
+      maxOperations(0)
+{
+}
+
+NFSCompoundV4::NFSCompoundV4()
+    : m_count(0),
+      m_status(NFS4_OK)
+{
+}
+
+void NFSCompoundV4::setSequence(const QByteArray& sessionId, uint32 sequenceId)
+{
+    QByteArray ops;
+    m_sequence.clear();
+    qSwap(m_ops, ops);
+
+    beginOp(NFS4_OP_SEQUENCE);
+    putFixed(sessionId, NFS4_SESSIONID_SIZE);
+    putUint32(sequenceId);
+    putUint32(0); // slot
+    putUint32(0); // highest slot
+    putUint32(0); // don't cache the reply
+    --m_count;
+
+    qSwap(m_ops, ops);
+    m_sequence = ops;
+}
+
+void NFSCompoundV4::putRootFh()
+{
+    beginOp(NFS4_OP_PUTROOTFH);
+}
+
+void NFSCompoundV4::putFh(const QByteArray& fh)
+{
+    beginOp(NFS4_OP_PUTFH);
+    putOpaque(fh);
+}
+
+void NFSCompoundV4::saveFh()
+{
+    beginOp(NFS4_OP_SAVEFH);
+}
+
+void NFSCompoundV4::lookup(const QByteArray& name)
+{
+    beginOp(NFS4_OP_LOOKUP);
+    putOpaque(name);
+}
+
+void NFSCompoundV4::getFh()
+{
+    beginOp(NFS4_OP_GETFH);
+}
+
+void NFSCompoundV4::getAttr(const QVector<uint32>& attributes)
+{
+    beginOp(NFS4_OP_GETATTR);
+    putBitmap(attributes);
+}
+
+void NFSCompoundV4::readDir(uint64 cookie, const QByteArray& verifier, uint32 dirCount, uint32 maxCount, const QVector<uint32>& attributes)
+{
+    beginOp(NFS4_OP_READDIR);
+    putUint64(cookie);
+    putFixed(verifier, NFS4_VERIFIER_SIZE);
+    putUint32(dirCount);
+    putUint32(maxCount);
+    putBitmap(attributes);
+}
+
+void NFSCompoundV4::readLink()
+{
+    beginOp(NFS4_OP_READLINK);
+}
+
+void NFSCompoundV4::open(uint64 clientId, uint32 access, const QByteArray& name, int mode, bool truncate, bool exclusive)
+{
+    beginOp(NFS4_OP_OPEN);
+    putUint32(0); // seqid, unused since 4.1
+    putUint32(access | NFS4_SHARE_ACCESS_WANT_NO_DELEG);
+    putUint32(NFS4_SHARE_DENY_NONE);
+    putUint64(clientId);
+    putOpaque(s_openOwner, sizeof(s_openOwner) - 1);
+
+    if (name.isEmpty()) {
+        putUint32(NFS4_OPEN_NOCREATE);
+        putUint32(NFS4_CLAIM_FH);
+    } else {
+        putUint32(NFS4_OPEN_CREATE);
+        putUint32(exclusive ? NFS4_CREATE_GUARDED : NFS4_CREATE_UNCHECKED);
+        putModeAttributes(mode, truncate);
+        putUint32(NFS4_CLAIM_NULL);
+        putOpaque(name);
+    }
+}
+
+void NFSCompoundV4::close(const QByteArray& stateid)
+{
+    beginOp(NFS4_OP_CLOSE);
+    putUint32(0);
+    putFixed(stateid, NFS4_STATEID_SIZE);
+}
+
+void NFSCompoundV4::read(const QByteArray& stateid, uint64 offset, uint32 count)
+{
+    beginOp(NFS4_OP_READ);
+    putFixed(stateid, NFS4_STATEID_SIZE);
+    putUint64(offset);
+    putUint32(count);
+}
+
+void NFSCompoundV4::write(const QByteArray& stateid, uint64 offset, uint32 stable, const char* data, uint32 length)
+{
+    beginOp(NFS4_OP_WRITE);
+    putFixed(stateid, NFS4_STATEID_SIZE);
+    putUint64(offset);
+    putUint32(stable);
+    putOpaque(data, length);
+}
+
+void NFSCompoundV4::commit()
+{
+    beginOp(NFS4_OP_COMMIT);
+    putUint64(0);
+    putUint32(0);
+}
+
+void NFSCompoundV4::createDir(const QByteArray& name, int mode)
+{
+    beginOp(NFS4_OP_CREATE);
+    putUint32(NF4DIR);
+    putOpaque(name);
+    putModeAttributes(mode, false);
+}
+
+void NFSCompoundV4::createLink(const QByteArray& name, const QByteArray& target)
+{
+    beginOp(NFS4_OP_CREATE);
+    putUint32(NF4LNK);
+    putOpaque(target);
+    putOpaque(name);
+    putModeAttributes(-1, false);
+}
+
+void NFSCompoundV4::remove(const QByteArray& name)
+{
+    beginOp(NFS4_OP_REMOVE);
+    putOpaque(name);
+}
+
+void NFSCompoundV4::rename(const QByteArray& oldName, const QByteArray& newName)
+{
+    beginOp(NFS4_OP_RENAME);
+    putOpaque(oldName);
+    putOpaque(newName);
+}
+
+void NFSCompoundV4::setMode(int mode)
+{
+    beginOp(NFS4_OP_SETATTR);
+    // The anonymous stateid, the file is not open.
+    putFixed(QByteArray(), NFS4_STATEID_SIZE);
+    putModeAttributes(mode, false);
+}
+
+void NFSCompoundV4::exchangeId(const QByteArray& verifier, const QByteArray& owner)
+{
+    beginOp(NFS4_OP_EXCHANGE_ID);
+    putFixed(verifier, NFS4_VERIFIER_SIZE);
+    putOpaque(owner);
+    putUint32(NFS4_EXCHGID_FLAG_USE_NON_PNFS);
+    putUint32(NFS4_SP4_NONE);
+    putUint32(0); // no implementation id
+}
+
+void NFSCompoundV4::createSession(uint64 clientId, uint32 sequenceId, uint32 maxRequestSize, uint32 maxResponseSize, uint32 maxOperations)
+{
+    beginOp(NFS4_OP_CREATE_SESSION);
+    putUint64(clientId);
+    putUint32(sequenceId);
+    putUint32(0); // flags, no back channel
+
+    // fore channel, one slot as the slave makes one call at a time
+    putUint32(0);
+    putUint32(maxRequestSize);
+    putUint32(maxResponseSize);
+    putUint32(0);
+    putUint32(maxOperations);
+    putUint32(1);
+    putUint32(0);
+
+    // back channel, unused
+    putUint32(0);
+    putUint32(4096);
+    putUint32(4096);
+    putUint32(0);
+    putUint32(2);
+    putUint32(1);
+    putUint32(0);
+
+    putUint32(NFS4_CB_PROGRAM);
+    putUint32(1);
+    putUint32(NFS4_AUTH_NONE);
+}
+
+void NFSCompoundV4::reclaimComplete()
+{
+    beginOp(NFS4_OP_RECLAIM_COMPLETE);
+    putUint32(0); // for all file systems
+}
+
+void NFSCompoundV4::destroySession(const QByteArray& sessionId)
+{
+    beginOp(NFS4_OP_DESTROY_SESSION);
+    putFixed(sessionId, NFS4_SESSIONID_SIZE);
+}
+
+QByteArray NFSCompoundV4::encode() const
+{
+    const int count = m_count + (m_sequence.isEmpty() ? 0 : 1);
+
+    QByteArray call;
+    call.reserve(12 + m_sequence.size() + m_ops.size());
+    call.resize(12);
+    uchar* header = reinterpret_cast<uchar*>(call.data());
+    qToBigEndian<quint32>(0, header);          // empty tag
+    qToBigEndian<quint32>(NFS4_MINOR_VERSION, header + 4);
+    qToBigEndian<quint32>(quint32(count), header + 8);
+
+    call += m_sequence;
+    call += m_ops;
+    return call;
+}
+
+bool NFSCompoundV4::decode(const QByteArray& reply)
+{
+    m_results.clear();
+
+    Reader reader(reply);
+    m_status = reader.uint32Value();
+    reader.opaque(); // tag
+
+    const uint32 count = reader.uint32Value();
+    for (uint32 i = 0; i < count && reader.ok(); ++i) {
+        NFSResultV4 result;
+        result.op = reader.uint32Value();
+        result.status = reader.uint32Value();
+        if (result.status == NFS4_OK) {
+            readResult(reader, result);
+        }
+        if (result.op == NFS4_OP_SETATTR) {
+            reader.bitmap();
+        }
+        m_results.append(result);
+    }
+
+    return reader.ok();
+}
+
+const NFSResultV4* NFSCompoundV4::result(uint32 op, int n) const
+{
+    for (const NFSResultV4& result : m_results) {
+        if (result.op == op && n-- == 0) {
+            return &result;
+        }
+    }
+    return nullptr;
+}
+
+QByteArray NFSCompoundV4::currentStateid()
+{
+    QByteArray stateid(NFS4_STATEID_SIZE, '\0');
+    stateid[3] = 1;
+    return stateid;
+}
+
+void NFSCompoundV4::putUint32(uint32 value)
+{
+    const int pos = m_ops.size();
+    m_ops.resize(pos + 4);
+    qToBigEndian<quint32>(quint32(value), reinterpret_cast<uchar*>(m_ops.data() + pos));
+}
+
+void NFSCompoundV4::putUint64(uint64 value)
+{
+    putUint32(uint32(value >> 32));
+    putUint32(uint32(value & 0xffffffff));
+}
+
+void NFSCompoundV4::putFixed(const QByteArray& data, int size)
+{
+    const int pos = m_ops.size();
+    const int padded = (size + 3) & ~3;
+    m_ops.resize(pos + padded);
+    memset(m_ops.data() + pos, 0, padded);
+    memcpy(m_ops.data() + pos, data.constData(), qMin(size, data.size()));
+}
+
+void NFSCompoundV4::putOpaque(const char* data, uint32 length)
+{
+    putUint32(length);
+    const int pos = m_ops.size();
+    const int padded = (int(length) + 3) & ~3;
+    m_ops.resize(pos + padded);
+    memcpy(m_ops.data() + pos, data, length);
+    memset(m_ops.data() + pos + length, 0, padded - int(length));
+}
+
+void NFSCompoundV4::putOpaque(const QByteArray& data)
+{
+    putOpaque(data.constData(), uint32(data.size()));
+}
+
+void NFSCompoundV4::putBitmap(const QVector<uint32>& attributes)
+{
+    uint32 words[2] = { 0, 0 };
+    for (uint32 attribute : attributes) {
+        words[attribute / 32] |= 1UL << (attribute % 32);
+    }
+
+    const int count = words[1] != 0 ? 2 : 1;
+    putUint32(count);
+    for (int i = 0; i < count; ++i) {
+        putUint32(words[i]);
+    }
+}
+
+void NFSCompoundV4::putModeAttributes(int mode, bool truncate)
+{
+    QVector<uint32> attributes;
+    if (truncate) {
+        attributes.append(NFS4_ATTR_SIZE);
+    }
+    if (mode != -1) {
+        attributes.append(NFS4_ATTR_MODE);
+    }
+    if (attributes.isEmpty()) {
+        // An empty bitmap and no values.
+        putUint32(0);
+        putUint32(0);
+        return;
+    }
+
+    putBitmap(attributes);
+    putUint32((truncate ? 8 : 0) + (mode != -1 ? 4 : 0));
+    if (truncate) {
+        putUint64(0);
+    }
+    if (mode != -1) {
+        putUint32(uint32(mode & 07777));
+    }
+}
+
+void NFSCompoundV4::beginOp(uint32 op)
+{
+    putUint32(op);
+    ++m_count;
+}
+
+bool_t xdr_nfs4_compound_args(XDR* xdrs, QByteArray* args)
+{
+    if (xdrs->x_op != XDR_ENCODE) {
+        return TRUE;
+    }
+
+    // Already marshalled, and a multiple of 4 bytes long.
+    return xdr_opaque(xdrs, args->data(), u_int(args->size()));
+}
+
+bool_t xdr_nfs4_compound_res(XDR* xdrs, QByteArray* res)
+{
+    if (xdrs->x_op != XDR_DECODE) {
+        return TRUE;
+    }
+
+    // The reply has no length of its own, and the record stream doesn't tell
+    // how much of the record is left. Take whatever it has buffered in large
+    // pieces, XDR_INLINE doesn't consume anything when it fails, and only
+    // read a word through it to make it fetch more, until the record ends.
+    res->clear();
+    u_int chunk = NFS4_DECODE_CHUNK;
+    for (;;) {
+        const int32_t* data = XDR_INLINE(xdrs, chunk);
+        if (data != nullptr) {
+            res->append(reinterpret_cast<const char*>(data), int(chunk));
+            continue;
+        }
+        if (chunk > BYTES_PER_XDR_UNIT) {
+            chunk /= 2;
+            continue;
+        }
+
+        u_int word;
+        if (!xdr_u_int(xdrs, &word)) {
+            break;
+        }
+        char bytes[BYTES_PER_XDR_UNIT];
+        qToBigEndian<quint32>(word, reinterpret_cast<uchar*>(bytes));
+        res->append(bytes, BYTES_PER_XDR_UNIT);
+        chunk = NFS4_DECODE_CHUNK;
+    }
+    return TRUE;
+}
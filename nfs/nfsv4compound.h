@@ -0,0 +1,269 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIO_NFS_NFSV4COMPOUND_H
+#define KIO_NFS_NFSV4COMPOUND_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "rpc_nfs3_prot.h"
+
+// The part of NFSv4.1 (RFC 5661) the slave uses. There is no rpcgen output
+// for it, the calls are marshalled by hand by NFSCompoundV4 below.
+#define NFS4_PROGRAM 100003UL
+#define NFS4_VERSION 4UL
+#define NFS4_MINOR_VERSION 1
+
+#define NFSPROC4_NULL 0
+#define NFSPROC4_COMPOUND 1
+
+#define NFS4_FHSIZE 128
+#define NFS4_VERIFIER_SIZE 8
+#define NFS4_SESSIONID_SIZE 16
+#define NFS4_STATEID_SIZE 16
+
+#define NFS4_OP_CLOSE 4
+#define NFS4_OP_COMMIT 5
+#define NFS4_OP_CREATE 6
+#define NFS4_OP_GETATTR 9
+#define NFS4_OP_GETFH 10
+#define NFS4_OP_LOOKUP 15
+#define NFS4_OP_OPEN 18
+#define NFS4_OP_PUTFH 22
+#define NFS4_OP_PUTROOTFH 24
+#define NFS4_OP_READ 25
+#define NFS4_OP_READDIR 26
+#define NFS4_OP_READLINK 27
+#define NFS4_OP_REMOVE 28
+#define NFS4_OP_RENAME 29
+#define NFS4_OP_SAVEFH 32
+#define NFS4_OP_SETATTR 34
+#define NFS4_OP_WRITE 38
+#define NFS4_OP_EXCHANGE_ID 42
+#define NFS4_OP_CREATE_SESSION 43
+#define NFS4_OP_DESTROY_SESSION 44
+#define NFS4_OP_SEQUENCE 53
+#define NFS4_OP_RECLAIM_COMPLETE 58
+#define NFS4_OP_ILLEGAL 10044
+
+// The errors that match an NFSv2/v3 error have its value, checkForError
+// understands those.
+#define NFS4_OK 0
+#define NFS4ERR_NOENT 2
+#define NFS4ERR_EXIST 17
+#define NFS4ERR_NOTDIR 20
+#define NFS4ERR_ISDIR 21
+#define NFS4ERR_INVAL 22
+#define NFS4ERR_STALE 70
+#define NFS4ERR_NOTSUPP 10004
+#define NFS4ERR_DELAY 10008
+#define NFS4ERR_EXPIRED 10011
+#define NFS4ERR_GRACE 10013
+#define NFS4ERR_FHEXPIRED 10014
+#define NFS4ERR_MINOR_VERS_MISMATCH 10021
+#define NFS4ERR_STALE_CLIENTID 10022
+#define NFS4ERR_SYMLINK 10029
+#define NFS4ERR_COMPLETE_ALREADY 10054
+#define NFS4ERR_BADSESSION 10052
+#define NFS4ERR_SEQ_MISORDERED 10063
+#define NFS4ERR_DEADSESSION 10078
+
+// The file types are the same as the ftype3 ones.
+#define NF4REG 1
+#define NF4DIR 2
+#define NF4LNK 5
+
+#define NFS4_UNSTABLE 0
+#define NFS4_FILE_SYNC 2
+
+#define NFS4_SHARE_ACCESS_READ 1
+#define NFS4_SHARE_ACCESS_WRITE 2
+#define NFS4_SHARE_ACCESS_BOTH 3
+
+// The attributes, as bit numbers of the attribute bitmap.
+#define NFS4_ATTR_TYPE 1
+#define NFS4_ATTR_SIZE 4
+#define NFS4_ATTR_FILEHANDLE 19
+#define NFS4_ATTR_FILEID 20
+#define NFS4_ATTR_MAXREAD 30
+#define NFS4_ATTR_MAXWRITE 31
+#define NFS4_ATTR_MODE 33
+#define NFS4_ATTR_NUMLINKS 35
+#define NFS4_ATTR_OWNER 36
+#define NFS4_ATTR_OWNER_GROUP 37
+#define NFS4_ATTR_SPACE_USED 45
+#define NFS4_ATTR_TIME_ACCESS 47
+#define NFS4_ATTR_TIME_METADATA 52
+#define NFS4_ATTR_TIME_MODIFY 53
+
+// The attributes of a file decoded from a fattr4. type, mode, size, times
+// and so on are in attributes, uid and gid are not set as NFSv4 sends the
+// owners by name.
+struct NFSAttributesV4 {
+    NFSAttributesV4();
+
+    fattr3 attributes;
+    QString owner;
+    QString group;
+    QByteArray fh;
+    uint64 maxRead;
+    uint64 maxWrite;
+};
+
+struct NFSDirEntryV4 {
+    uint64 cookie;
+    QByteArray name;
+    NFSAttributesV4 attributes;
+};
+
+// The result of one operation of a COMPOUND, with the fields of the
+// operations the slave uses.
+struct NFSResultV4 {
+    NFSResultV4();
+
+    uint32 op;
+    uint32 status;
+
+    // GETFH
+    QByteArray fh;
+    // GETATTR
+    NFSAttributesV4 attributes;
+    // READ and READLINK
+    QByteArray data;
+    // READ and READDIR
+    bool eof;
+    // OPEN and CLOSE
+    QByteArray stateid;
+    // WRITE and COMMIT, and the cookie verifier of READDIR
+    QByteArray verifier;
+    // WRITE
+    uint32 count;
+    uint32 committed;
+    // READDIR
+    QVector<NFSDirEntryV4> entries;
+    // EXCHANGE_ID and CREATE_SESSION
+    uint64 clientId;
+    uint32 sequenceId;
+    QByteArray sessionId;
+    uint32 maxRequestSize;
+    uint32 maxResponseSize;
+    uint32 maxOperations;
+};
+
+// A COMPOUND call: the operations are added in order, @encode marshals the
+// call and @decode the reply. The server stops at the first operation that
+// fails, so there may be fewer results than operations.
+class NFSCompoundV4
+{
+public:
+    NFSCompoundV4();
+
+    // Each call of a session starts with SEQUENCE, added by whoever owns the
+    // session just before the call is sent.
+    void setSequence(const QByteArray& sessionId, uint32 sequenceId);
+
+    void putRootFh();
+    void putFh(const QByteArray& fh);
+    void saveFh();
+    void lookup(const QByteArray& name);
+    void getFh();
+    void getAttr(const QVector<uint32>& attributes);
+    void readDir(uint64 cookie, const QByteArray& verifier, uint32 dirCount, uint32 maxCount, const QVector<uint32>& attributes);
+    void readLink();
+
+    // Opens the current file, if name is empty, or creates name in the
+    // current directory. A created file gets mode, truncate empties it if
+    // it exists already and exclusive makes the OPEN fail instead.
+    void open(uint64 clientId, uint32 access, const QByteArray& name = QByteArray(),
+              int mode = -1, bool truncate = false, bool exclusive = false);
+    void close(const QByteArray& stateid);
+    void read(const QByteArray& stateid, uint64 offset, uint32 count);
+    void write(const QByteArray& stateid, uint64 offset, uint32 stable, const char* data, uint32 length);
+    void commit();
+
+    void createDir(const QByteArray& name, int mode);
+    void createLink(const QByteArray& name, const QByteArray& target);
+    void remove(const QByteArray& name);
+    // Renames oldName in the saved directory to newName in the current one.
+    void rename(const QByteArray& oldName, const QByteArray& newName);
+    void setMode(int mode);
+
+    void exchangeId(const QByteArray& verifier, const QByteArray& owner);
+    void createSession(uint64 clientId, uint32 sequenceId, uint32 maxRequestSize, uint32 maxResponseSize, uint32 maxOperations);
+    void reclaimComplete();
+    void destroySession(const QByteArray& sessionId);
+
+    int operationCount() const
+    {
+        return m_count;
+    }
+
+    // The size of the call so far, to keep it below what the session allows.
+    int size() const
+    {
+        return m_ops.size();
+    }
+
+    QByteArray encode() const;
+    bool decode(const QByteArray& reply);
+
+    // NFS4_OK if all operations succeeded, otherwise the error of the one
+    // that failed.
+    uint32 status() const
+    {
+        return m_status;
+    }
+
+    const QVector<NFSResultV4>& results() const
+    {
+        return m_results;
+    }
+
+    // The result of the n-th operation op, nullptr if it was not executed.
+    const NFSResultV4* result(uint32 op, int n = 0) const;
+
+    // The current stateid of NFSv4.1, the one the last OPEN of the call returned.
+    static QByteArray currentStateid();
+
+private:
+    void putUint32(uint32 value);
+    void putUint64(uint64 value);
+    void putFixed(const QByteArray& data, int size);
+    void putOpaque(const char* data, uint32 length);
+    void putOpaque(const QByteArray& data);
+    void putBitmap(const QVector<uint32>& attributes);
+    void putModeAttributes(int mode, bool truncate);
+    void beginOp(uint32 op);
+
+    QByteArray m_sequence;
+    QByteArray m_ops;
+    int m_count;
+
+    uint32 m_status;
+    QVector<NFSResultV4> m_results;
+};
+
+// The raw arguments and results of a COMPOUND for clnt_call, the arguments
+// are the QByteArray from @NFSCompoundV4::encode, the results are whatever
+// the reply contains after the RPC header, for @NFSCompoundV4::decode.
+bool_t xdr_nfs4_compound_args(XDR* xdrs, QByteArray* args);
+bool_t xdr_nfs4_compound_res(XDR* xdrs, QByteArray* res);
+
+#endif
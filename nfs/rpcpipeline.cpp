@@ -0,0 +1,419 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "rpcpipeline.h"
+#include "kio_nfs.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Small reads are buffered, anything bigger goes straight to its destination.
+static const int s_inputBufferSize = 64 * 1024;
+
+// The largest reply we accept, a READ or READDIRPLUS is well below this.
+static const int s_maxReplySize = 4 * 1024 * 1024;
+
+static const quint32 s_lastFragment = 0x80000000u;
+
+NFSRpcPipeline::NFSRpcPipeline()
+    : m_sock(-1),
+      m_prog(0),
+      m_vers(0),
+      m_xid(0),
+      m_inputPos(0)
+{
+}
+
+NFSRpcPipeline::~NFSRpcPipeline()
+{
+    close();
+}
+
+bool NFSRpcPipeline::open(int sock, CLIENT* client, u_long prog, u_long vers)
+{
+    close();
+
+    if (sock < 0 || client == nullptr || client->cl_auth == nullptr) {
+        return false;
+    }
+
+    int type = 0;
+    socklen_t typeLength = sizeof(type);
+    if (getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &typeLength) != 0 || type != SOCK_STREAM) {
+        qCDebug(LOG_KIO_NFS) << "Not a TCP connection, no pipelining";
+        return false;
+    }
+
+    sockaddr_storage address;
+    socklen_t addressLength = sizeof(address);
+    if (getpeername(sock, reinterpret_cast<sockaddr*>(&address), &addressLength) != 0) {
+        return false;
+    }
+
+    char authBuffer[2 * (MAX_AUTH_BYTES + 2 * BYTES_PER_XDR_UNIT)];
+    XDR xdr;
+    xdrmem_create(&xdr, authBuffer, sizeof(authBuffer), XDR_ENCODE);
+    const bool authOk = AUTH_MARSHALL(client->cl_auth, &xdr);
+    const u_int authLength = xdr_getpos(&xdr);
+    XDR_DESTROY(&xdr);
+    if (!authOk) {
+        return false;
+    }
+    m_auth = QByteArray(authBuffer, authLength);
+
+    m_sock = ::socket(address.ss_family, SOCK_STREAM, 0);
+    if (m_sock < 0) {
+        return false;
+    }
+
+    // Some servers only accept clients on a reserved port, clnttcp_create
+    // tries the same, and fails just as quietly when not running as root.
+    if (address.ss_family == AF_INET) {
+        bindresvport(m_sock, nullptr);
+    }
+
+    if (::connect(m_sock, reinterpret_cast<sockaddr*>(&address), addressLength) != 0) {
+        qCDebug(LOG_KIO_NFS) << "Failed to connect pipeline:" << strerror(errno);
+        close();
+        return false;
+    }
+
+    const int noDelay = 1;
+    setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    m_prog = prog;
+    m_vers = vers;
+    m_xid = getpid() ^ time(nullptr);
+
+    return true;
+}
+
+void NFSRpcPipeline::close()
+{
+    if (m_sock >= 0) {
+        ::close(m_sock);
+        m_sock = -1;
+    }
+
+    m_input.clear();
+    m_inputPos = 0;
+    m_reply.clear();
+}
+
+int NFSRpcPipeline::call(u_long proc, xdrproc_t xargs, caddr_t args, u_int& xid)
+{
+    if (m_sock < 0) {
+        return RPC_CANTSEND;
+    }
+
+    xid = ++m_xid;
+
+    // Record mark, call header (xid, direction, rpc version, program, version
+    // and procedure), credentials and the arguments.
+    const u_int size = 7 * BYTES_PER_XDR_UNIT + m_auth.size() + xdr_sizeof(xargs, args);
+    if (m_output.size() < static_cast<int>(size)) {
+        m_output.resize(size);
+    }
+
+    rpc_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.rm_xid = xid;
+    msg.rm_direction = CALL;
+    msg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+    msg.rm_call.cb_prog = m_prog;
+    msg.rm_call.cb_vers = m_vers;
+
+    XDR xdr;
+    xdrmem_create(&xdr, m_output.data() + BYTES_PER_XDR_UNIT, size - BYTES_PER_XDR_UNIT, XDR_ENCODE);
+    const bool encoded = xdr_callhdr(&xdr, &msg) &&
+                         xdr_u_long(&xdr, &proc) &&
+                         xdr_opaque(&xdr, m_auth.data(), m_auth.size()) &&
+                         xargs(&xdr, args);
+    const u_int length = xdr_getpos(&xdr);
+    XDR_DESTROY(&xdr);
+
+    if (!encoded) {
+        return RPC_CANTENCODEARGS;
+    }
+
+    // We always send the whole call as a single fragment.
+    const quint32 mark = htonl(s_lastFragment | length);
+    memcpy(m_output.data(), &mark, sizeof(mark));
+
+    const char* data = m_output.constData();
+    size_t remaining = length + BYTES_PER_XDR_UNIT;
+    while (remaining > 0) {
+        const ssize_t written = ::send(m_sock, data, remaining, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            qCDebug(LOG_KIO_NFS) << "Failed to send call:" << strerror(errno);
+            close();
+            return RPC_CANTSEND;
+        }
+
+        data += written;
+        remaining -= written;
+    }
+
+    return RPC_SUCCESS;
+}
+
+int NFSRpcPipeline::receive(u_int& xid, const timeval& timeout)
+{
+    m_reply.clear();
+
+    bool lastFragment = false;
+    while (!lastFragment) {
+        quint32 mark;
+        int status = readBytes(reinterpret_cast<char*>(&mark), sizeof(mark), timeout);
+        if (status != RPC_SUCCESS) {
+            return status;
+        }
+
+        mark = ntohl(mark);
+        lastFragment = (mark & s_lastFragment) != 0;
+
+        const int fragmentSize = mark & ~s_lastFragment;
+        const int replySize = m_reply.size();
+        if (fragmentSize > s_maxReplySize - replySize) {
+            qCDebug(LOG_KIO_NFS) << "Reply too large";
+            close();
+            return RPC_CANTDECODERES;
+        }
+
+        m_reply.resize(replySize + fragmentSize);
+        status = readBytes(m_reply.data() + replySize, fragmentSize, timeout);
+        if (status != RPC_SUCCESS) {
+            return status;
+        }
+    }
+
+    if (m_reply.size() < BYTES_PER_XDR_UNIT) {
+        close();
+        return RPC_CANTDECODERES;
+    }
+
+    quint32 replyXid;
+    memcpy(&replyXid, m_reply.constData(), sizeof(replyXid));
+    xid = ntohl(replyXid);
+
+    return RPC_SUCCESS;
+}
+
+int NFSRpcPipeline::decode(xdrproc_t xres, caddr_t res)
+{
+    rpc_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.acpted_rply.ar_verf = _null_auth;
+    msg.acpted_rply.ar_results.where = res;
+    msg.acpted_rply.ar_results.proc = xres;
+
+    XDR xdr;
+    xdrmem_create(&xdr, m_reply.data(), m_reply.size(), XDR_DECODE);
+    const bool decoded = xdr_replymsg(&xdr, &msg);
+    XDR_DESTROY(&xdr);
+
+    // The verifier shares its memory with the rejected reply fields.
+    if (msg.rm_reply.rp_stat == MSG_ACCEPTED && msg.acpted_rply.ar_verf.oa_base != nullptr) {
+        xdr_free((xdrproc_t) xdr_opaque_auth, reinterpret_cast<char*>(&msg.acpted_rply.ar_verf));
+    }
+
+    if (!decoded) {
+        return RPC_CANTDECODERES;
+    }
+
+    if (msg.rm_reply.rp_stat != MSG_ACCEPTED) {
+        return (msg.rjcted_rply.rj_stat == RPC_MISMATCH) ? RPC_VERSMISMATCH : RPC_AUTHERROR;
+    }
+
+    switch (msg.acpted_rply.ar_stat) {
+    case SUCCESS:
+        return RPC_SUCCESS;
+    case PROG_UNAVAIL:
+        return RPC_PROGUNAVAIL;
+    case PROG_MISMATCH:
+        return RPC_PROGVERSMISMATCH;
+    case PROC_UNAVAIL:
+        return RPC_PROCUNAVAIL;
+    case GARBAGE_ARGS:
+        return RPC_CANTDECODEARGS;
+    default:
+        return RPC_SYSTEMERROR;
+    }
+}
+
+int NFSRpcPipeline::readBytes(char* dest, int length, const timeval& timeout)
+{
+    while (length > 0) {
+        const int buffered = m_input.size() - m_inputPos;
+        if (buffered > 0) {
+            const int count = qMin(length, buffered);
+            memcpy(dest, m_input.constData() + m_inputPos, count);
+            m_inputPos += count;
+            dest += count;
+            length -= count;
+            continue;
+        }
+
+        if (m_sock < 0) {
+            return RPC_CANTRECV;
+        }
+
+        pollfd pfd;
+        pfd.fd = m_sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        const int ready = ::poll(&pfd, 1, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
+        if (ready == 0) {
+            qCDebug(LOG_KIO_NFS) << "Timed out waiting for a reply";
+            close();
+            return RPC_TIMEDOUT;
+        }
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close();
+            return RPC_CANTRECV;
+        }
+
+        ssize_t received;
+        if (length >= s_inputBufferSize) {
+            received = ::recv(m_sock, dest, length, 0);
+            if (received > 0) {
+                dest += received;
+                length -= received;
+            }
+        } else {
+            m_input.resize(s_inputBufferSize);
+            m_inputPos = 0;
+            received = ::recv(m_sock, m_input.data(), s_inputBufferSize, 0);
+            m_input.resize(received > 0 ? received : 0);
+        }
+
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            qCDebug(LOG_KIO_NFS) << "Connection closed while waiting for a reply";
+            close();
+            return RPC_CANTRECV;
+        }
+    }
+
+    return RPC_SUCCESS;
+}
+
+NFSRpcBatch::NFSRpcBatch(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout, int window)
+    : m_client(client),
+      m_pipeline(pipeline),
+      m_timeout(timeout),
+      m_window(qMax(1, window))
+{
+}
+
+void NFSRpcBatch::add(u_long proc, xdrproc_t xargs, caddr_t args, xdrproc_t xres, caddr_t res, int* rpcStatus)
+{
+    Call call;
+    call.proc = proc;
+    call.xargs = xargs;
+    call.args = args;
+    call.xres = xres;
+    call.res = res;
+    call.rpcStatus = rpcStatus;
+    call.xid = 0;
+    call.sent = false;
+    call.done = false;
+
+    m_calls.append(call);
+}
+
+void NFSRpcBatch::run()
+{
+    int next = 0;
+    int outstanding = 0;
+
+    while (next < m_calls.size() || outstanding > 0) {
+        while (next < m_calls.size() && outstanding < m_window) {
+            Call& call = m_calls[next++];
+
+            if (m_pipeline == nullptr || !m_pipeline->isOpen()) {
+                callSync(call);
+                continue;
+            }
+
+            if (m_pipeline->call(call.proc, call.xargs, call.args, call.xid) != RPC_SUCCESS) {
+                callSync(call);
+                continue;
+            }
+
+            call.sent = true;
+            ++outstanding;
+        }
+
+        if (outstanding == 0) {
+            continue;
+        }
+
+        u_int xid;
+        if (m_pipeline->receive(xid, m_timeout) != RPC_SUCCESS) {
+            // The pipeline is closed now, these calls don't change anything
+            // on the server, so it is safe to just make them again.
+            qCDebug(LOG_KIO_NFS) << "Pipeline failed, making the outstanding calls again";
+            for (Call& call : m_calls) {
+                if (call.sent && !call.done) {
+                    callSync(call);
+                }
+            }
+
+            outstanding = 0;
+            continue;
+        }
+
+        for (Call& call : m_calls) {
+            if (call.sent && !call.done && call.xid == xid) {
+                *call.rpcStatus = m_pipeline->decode(call.xres, call.res);
+                call.done = true;
+                --outstanding;
+                break;
+            }
+        }
+    }
+
+    m_calls.clear();
+}
+
+void NFSRpcBatch::callSync(Call& call)
+{
+    *call.rpcStatus = clnt_call(m_client, call.proc,
+                                call.xargs, call.args,
+                                call.xres, call.res,
+                                m_timeout);
+    call.done = true;
+}
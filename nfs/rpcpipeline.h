@@ -0,0 +1,120 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIO_NFS_RPCPIPELINE_H
+#define KIO_NFS_RPCPIPELINE_H
+
+#include <QByteArray>
+#include <QVector>
+
+// This is needed on Solaris so that rpc.h defines clnttcp_create etc.
+#ifndef PORTMAP
+#define PORTMAP
+#endif
+#include <rpc/rpc.h>
+#include <sys/time.h>
+
+// A TCP connection to an RPC server on which any number of calls can be
+// outstanding at the same time. Unlike clnt_call, sending a call does not wait
+// for its reply; the replies arrive in whatever order the server answers and
+// it is up to the caller to match them to its calls by their XID.
+class NFSRpcPipeline
+{
+public:
+    NFSRpcPipeline();
+    ~NFSRpcPipeline();
+
+    // Opens a second connection to the server and port the TCP socket sock is
+    // connected to, authenticating the same way as client. Fails if the client
+    // is not using TCP.
+    bool open(int sock, CLIENT* client, u_long prog, u_long vers);
+    void close();
+
+    bool isOpen() const
+    {
+        return m_sock >= 0;
+    }
+
+    // Sends a call without waiting for its reply, returns a clnt_stat.
+    int call(u_long proc, xdrproc_t xargs, caddr_t args, u_int& xid);
+
+    // Waits for the next reply, whichever call it belongs to, returns a clnt_stat.
+    int receive(u_int& xid, const timeval& timeout);
+
+    // Decodes the results of the reply last returned by @receive, returns a
+    // clnt_stat. The results have to be released with xdr_free.
+    int decode(xdrproc_t xres, caddr_t res);
+
+private:
+    int readBytes(char* dest, int length, const timeval& timeout);
+
+    int m_sock;
+    u_long m_prog;
+    u_long m_vers;
+    u_int m_xid;
+
+    // The marshalled credentials and verifier, the same for every call.
+    QByteArray m_auth;
+
+    QByteArray m_output;
+    QByteArray m_input;
+    int m_inputPos;
+
+    // The last reply received, without the record marks.
+    QByteArray m_reply;
+};
+
+// A batch of independent calls that are sent at the same time, at most
+// window of them outstanding, and whose replies are all waited for. Without
+// a pipeline, or if it fails, the calls are made with clnt_call instead.
+class NFSRpcBatch
+{
+public:
+    NFSRpcBatch(CLIENT* client, NFSRpcPipeline* pipeline, const timeval& timeout, int window);
+
+    // Queues a call. args, res and rpcStatus have to stay valid until @run
+    // returns, the results have to be released with xdr_free.
+    void add(u_long proc, xdrproc_t xargs, caddr_t args, xdrproc_t xres, caddr_t res, int* rpcStatus);
+
+    // Makes all queued calls and waits for their replies.
+    void run();
+
+private:
+    struct Call {
+        u_long proc;
+        xdrproc_t xargs;
+        caddr_t args;
+        xdrproc_t xres;
+        caddr_t res;
+        int* rpcStatus;
+        u_int xid;
+        bool sent;
+        bool done;
+    };
+
+    void callSync(Call& call);
+
+    CLIENT* m_client;
+    NFSRpcPipeline* m_pipeline;
+    timeval m_timeout;
+    int m_window;
+
+    QVector<Call> m_calls;
+};
+
+#endif
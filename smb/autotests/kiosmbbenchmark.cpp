@@ -0,0 +1,269 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "kiosmbbenchmark.h"
+#include "latencyproxy.h"
+
+#include <kio/filejob.h>
+#include <kio/job.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+#include <random>
+
+#include <pwd.h>
+#include <unistd.h>
+
+QTEST_GUILESS_MAIN(KioSmbBenchmark)
+
+static const int s_statCount = 1000;
+static const int s_randomReadCount = 500;
+static const int s_randomReadSize = 64 * 1024;
+
+void KioSmbBenchmark::initTestCase()
+{
+    KIO_BENCHMARK_REQUIRE("KIO_SMB_BENCHMARK");
+
+    QString smbd = QString::fromLocal8Bit(qgetenv("KIO_SMB_BENCH_SMBD"));
+    if (smbd.isEmpty()) {
+        smbd = QStandardPaths::findExecutable(QStringLiteral("smbd"),
+                                              { QStringLiteral("/usr/sbin"), QStringLiteral("/usr/local/sbin") });
+    }
+    if (smbd.isEmpty()) {
+        QSKIP("smbd not found");
+    }
+
+    QVERIFY(m_tempDir.isValid());
+    const QString stateDir = m_tempDir.path() + QStringLiteral("/state");
+    QVERIFY(QDir().mkpath(stateDir + QStringLiteral("/ncalrpc")));
+    QVERIFY(QDir().mkpath(sharePath()));
+
+    const struct passwd *pw = getpwuid(getuid());
+    QVERIFY(pw);
+    const QString user = QString::fromLocal8Bit(pw->pw_name);
+
+    const QString config = QStringLiteral(
+        "[global]\n"
+        "workgroup = KIOTEST\n"
+        "netbios name = KIOSMBBENCH\n"
+        "server role = standalone server\n"
+        "interfaces = lo\n"
+        "bind interfaces only = yes\n"
+        "disable netbios = yes\n"
+        "pid directory = %1\n"
+        "lock directory = %1\n"
+        "state directory = %1\n"
+        "cache directory = %1\n"
+        "private dir = %1\n"
+        "ncalrpc dir = %1/ncalrpc\n"
+        "log file = %1/log.smbd\n"
+        "map to guest = Bad User\n"
+        "guest account = %2\n"
+        "load printers = no\n"
+        "printcap name = /dev/null\n"
+        "disable spoolss = yes\n"
+        "\n"
+        "[bench]\n"
+        "path = %3\n"
+        "guest ok = yes\n"
+        "guest only = yes\n"
+        "read only = no\n"
+        "force user = %2\n").arg(stateDir, user, sharePath());
+
+    const QString configFile = m_tempDir.path() + QStringLiteral("/smb.conf");
+    QFile file(configFile);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(config.toUtf8());
+    file.close();
+
+    // smbd runs in inetd mode, one per connection the proxy gets
+    m_proxy = new LatencyProxy(smbd, { QStringLiteral("--configfile=") + configFile },
+                               setting("KIO_SMB_BENCH_LATENCY", 0));
+    m_proxy->moveToThread(&m_proxyThread);
+    connect(&m_proxyThread, &QThread::finished, m_proxy, &QObject::deleteLater);
+    m_proxyThread.start();
+    QMetaObject::invokeMethod(m_proxy, "start", Qt::BlockingQueuedConnection);
+    QVERIFY(m_proxy->port() != 0);
+
+    useBuildTree(KIO_BENCHMARK_DATA_DIR);
+
+    m_fileSize = createRandomFile(sharePath(QStringLiteral("big")), setting("KIO_SMB_BENCH_FILE_MB", 64));
+    QVERIFY(m_fileSize > 0);
+
+    qInfo() << "smbd behind proxy on port" << m_proxy->port()
+            << "latency" << setting("KIO_SMB_BENCH_LATENCY", 0) << "ms";
+}
+
+void KioSmbBenchmark::cleanupTestCase()
+{
+    if (m_proxy) {
+        QMetaObject::invokeMethod(m_proxy, "stop", Qt::BlockingQueuedConnection);
+        m_proxyThread.quit();
+        m_proxyThread.wait();
+        m_proxy = nullptr;
+    }
+}
+
+QUrl KioSmbBenchmark::shareUrl(const QString &path) const
+{
+    QUrl url;
+    url.setScheme(QStringLiteral("smb"));
+    url.setHost(QStringLiteral("127.0.0.1"));
+    url.setPort(m_proxy->port());
+    url.setPath(QStringLiteral("/bench/") + path);
+    return url;
+}
+
+QString KioSmbBenchmark::sharePath(const QString &path) const
+{
+    return m_tempDir.path() + QStringLiteral("/share/") + path;
+}
+
+void KioSmbBenchmark::startMeasurement()
+{
+    m_proxy->resetCounters();
+    KioBenchmark::startMeasurement();
+}
+
+QString KioSmbBenchmark::counters(int count, qint64 msecs) const
+{
+    Q_UNUSED(msecs)
+
+    const quint64 roundTrips = m_proxy->roundTrips();
+    return QStringLiteral(", %1 round trips (%2 per operation)")
+           .arg(roundTrips)
+           .arg(double(roundTrips) / qMax(count, 1), 0, 'f', 2);
+}
+
+void KioSmbBenchmark::benchListDir_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+}
+
+void KioSmbBenchmark::benchListDir()
+{
+    QFETCH(int, count);
+
+    const QString dir = QStringLiteral("list%1").arg(count);
+    QVERIFY(createFiles(sharePath(dir), count));
+
+    int listed = 0;
+    startMeasurement();
+    KIO::ListJob *job = KIO::listDir(shareUrl(dir), KIO::HideProgressInfo);
+    connect(job, &KIO::ListJob::entries, this, [&listed](KIO::Job *, const KIO::UDSEntryList &entries) {
+        listed += entries.count();
+    });
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("listDir"), 1);
+
+    QCOMPARE(listed, count + 1); // "."
+}
+
+void KioSmbBenchmark::benchStatStorm()
+{
+    const QString dir = QStringLiteral("stat");
+    QVERIFY(createFiles(sharePath(dir), s_statCount));
+
+    startMeasurement();
+    for (int i = 0; i < s_statCount; ++i) {
+        const QString name = QStringLiteral("/file%1").arg(i, 6, 10, QLatin1Char('0'));
+        KIO::StatJob *job = KIO::stat(shareUrl(dir + name), KIO::HideProgressInfo);
+        QVERIFY2(job->exec(), qPrintable(job->errorString()));
+        QVERIFY(job->statResult().isDir() == false);
+    }
+    report(QStringLiteral("stat"), s_statCount);
+}
+
+void KioSmbBenchmark::benchGet()
+{
+    const QString dest = m_tempDir.path() + QStringLiteral("/got");
+    QFile::remove(dest);
+
+    startMeasurement();
+    KIO::FileCopyJob *job = KIO::file_copy(shareUrl(QStringLiteral("big")), QUrl::fromLocalFile(dest),
+                                           -1, KIO::HideProgressInfo);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("get"), 1, m_fileSize);
+
+    QCOMPARE(QFileInfo(dest).size(), m_fileSize);
+}
+
+void KioSmbBenchmark::benchPut()
+{
+    const QString src = sharePath(QStringLiteral("big"));
+    QFile::remove(sharePath(QStringLiteral("put")));
+
+    startMeasurement();
+    KIO::FileCopyJob *job = KIO::file_copy(QUrl::fromLocalFile(src), shareUrl(QStringLiteral("put")),
+                                           -1, KIO::HideProgressInfo);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("put"), 1, m_fileSize);
+
+    QCOMPARE(QFileInfo(sharePath(QStringLiteral("put"))).size(), m_fileSize);
+}
+
+void KioSmbBenchmark::benchSmbCopy()
+{
+    QFile::remove(sharePath(QStringLiteral("copy")));
+
+    startMeasurement();
+    KIO::FileCopyJob *job = KIO::file_copy(shareUrl(QStringLiteral("big")), shareUrl(QStringLiteral("copy")),
+                                           -1, KIO::HideProgressInfo);
+    QVERIFY2(job->exec(), qPrintable(job->errorString()));
+    report(QStringLiteral("smbCopy"), 1, m_fileSize);
+
+    QCOMPARE(QFileInfo(sharePath(QStringLiteral("copy"))).size(), m_fileSize);
+}
+
+void KioSmbBenchmark::benchFileJobRandomRead()
+{
+    QFile reference(sharePath(QStringLiteral("big")));
+    QVERIFY(reference.open(QIODevice::ReadOnly));
+
+    startMeasurement();
+    KIO::FileJob *job = KIO::open(shareUrl(QStringLiteral("big")), QIODevice::ReadOnly);
+    QSignalSpy openSpy(job, &KIO::FileJob::open);
+    QVERIFY(openSpy.wait(10000));
+
+    QSignalSpy positionSpy(job, &KIO::FileJob::position);
+    QSignalSpy dataSpy(job, &KIO::FileJob::data);
+    for (int i = 0; i < s_randomReadCount; ++i) {
+        const qint64 offset = std::uniform_int_distribution<qint64>(0, m_fileSize - s_randomReadSize)(random());
+
+        job->seek(offset);
+        QVERIFY(positionSpy.count() > i || positionSpy.wait(10000));
+
+        job->read(s_randomReadSize);
+        QVERIFY(dataSpy.count() > i || dataSpy.wait(10000));
+
+        const QByteArray data = dataSpy.at(i).at(1).toByteArray();
+        reference.seek(offset);
+        QCOMPARE(data, reference.read(data.size()));
+    }
+
+    job->close();
+    report(QStringLiteral("FileJob random read"), s_randomReadCount, quint64(s_randomReadCount) * s_randomReadSize);
+}
@@ -0,0 +1,73 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KIOSMBBENCHMARK_H
+#define KIOSMBBENCHMARK_H
+
+#include "kiobenchmark.h"
+
+#include <QTemporaryDir>
+#include <QThread>
+#include <QUrl>
+
+class LatencyProxy;
+
+/**
+ * Benchmark and regression harness for kio_smb.
+ *
+ * Runs the slave against throwaway smbds that export a generated share,
+ * started by LatencyProxy for each connection, which can add latency and
+ * counts round trips.  Every test prints time, round trips per operation and
+ * throughput, and checks that the results are correct.
+ *
+ * As it takes a while, it only runs if KIO_SMB_BENCHMARK is set.  Further
+ * knobs (environment):
+ *   KIO_SMB_BENCH_SMBD      smbd binary, e.g. a wrapper running it under
+ *                           uid_wrapper/nss_wrapper when not root
+ *   KIO_SMB_BENCH_LATENCY   added latency in ms per direction (default 0)
+ *   KIO_SMB_BENCH_FILE_MB   size of the transfer test file (default 64)
+ */
+class KioSmbBenchmark : public KioBenchmark
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchListDir_data();
+    void benchListDir();
+    void benchStatStorm();
+    void benchGet();
+    void benchPut();
+    void benchSmbCopy();
+    void benchFileJobRandomRead();
+
+private:
+    QUrl shareUrl(const QString &path = QString()) const;
+    QString sharePath(const QString &path = QString()) const;
+    void startMeasurement() override;
+    QString counters(int count, qint64 msecs) const override;
+
+    QTemporaryDir m_tempDir;
+    QThread m_proxyThread;
+    LatencyProxy *m_proxy = nullptr;
+    qint64 m_fileSize = 0;
+};
+
+#endif
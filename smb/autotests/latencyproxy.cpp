@@ -0,0 +1,186 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "latencyproxy.h"
+
+#include <QDebug>
+#include <QHostAddress>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <unistd.h>
+
+namespace {
+
+/**
+ * A server with its standard input and output on a socket, as inetd starts it
+ */
+class InetdProcess : public QProcess
+{
+public:
+    InetdProcess(qintptr socket, QObject *parent)
+        : QProcess(parent),
+          m_socket(socket)
+    {
+        setStandardInputFile(QProcess::nullDevice());
+        setStandardOutputFile(QProcess::nullDevice());
+        setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    }
+
+protected:
+    void setupChildProcess() override
+    {
+        ::dup2(m_socket, 0);
+        ::dup2(m_socket, 1);
+    }
+
+private:
+    const qintptr m_socket;
+};
+
+}
+
+LatencyProxy::LatencyProxy(const QString &program, const QStringList &arguments, int latencyMs)
+    : m_program(program),
+      m_arguments(arguments),
+      m_latencyMs(latencyMs),
+      m_port(0),
+      m_server(nullptr),
+      m_roundTrips(0),
+      m_bytesSent(0),
+      m_bytesReceived(0)
+{
+}
+
+void LatencyProxy::resetCounters()
+{
+    m_roundTrips.store(0);
+    m_bytesSent.store(0);
+    m_bytesReceived.store(0);
+}
+
+void LatencyProxy::start()
+{
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &LatencyProxy::newConnection);
+    if (!m_server->listen(QHostAddress::LocalHost)) {
+        qWarning() << "latency proxy cannot listen:" << m_server->errorString();
+        return;
+    }
+    m_port = m_server->serverPort();
+}
+
+void LatencyProxy::stop()
+{
+    delete m_server;
+    m_server = nullptr;
+    qDeleteAll(findChildren<QTcpSocket *>());
+    // QProcess kills what is still running
+    qDeleteAll(findChildren<QProcess *>());
+}
+
+void LatencyProxy::newConnection()
+{
+    while (QTcpSocket *client = m_server->nextPendingConnection()) {
+        client->setParent(this);
+        QTcpSocket *server = startServer();
+        if (!server) {
+            client->abort();
+            client->deleteLater();
+            continue;
+        }
+
+        connect(client, &QTcpSocket::readyRead, this, [this, client, server]() { forward(client, server, true); });
+        connect(server, &QTcpSocket::readyRead, this, [this, client, server]() { forward(server, client, false); });
+        connect(client, &QTcpSocket::disconnected, server, &QTcpSocket::disconnectFromHost);
+        connect(server, &QTcpSocket::disconnected, client, &QTcpSocket::disconnectFromHost);
+        connect(client, &QTcpSocket::disconnected, client, &QObject::deleteLater);
+        connect(server, &QTcpSocket::disconnected, server, &QObject::deleteLater);
+    }
+}
+
+QTcpSocket *LatencyProxy::startServer()
+{
+    // the listener only lives until its one connection is accepted
+    QTcpServer pair;
+    if (!pair.listen(QHostAddress::LocalHost)) {
+        qWarning() << "latency proxy cannot listen:" << pair.errorString();
+        return nullptr;
+    }
+
+    QTcpSocket *local = new QTcpSocket(this);
+    local->connectToHost(QHostAddress::LocalHost, pair.serverPort());
+    if (!pair.waitForNewConnection(5000) || !local->waitForConnected(5000)) {
+        qWarning() << "latency proxy cannot connect to itself:" << local->errorString();
+        delete local;
+        return nullptr;
+    }
+
+    QTcpSocket *remote = pair.nextPendingConnection();
+    if (remote->peerPort() != local->localPort()) {
+        qWarning() << "latency proxy got a connection from someone else";
+        delete local;
+        return nullptr;
+    }
+
+    InetdProcess *process = new InetdProcess(remote->socketDescriptor(), this);
+    process->start(m_program, m_arguments);
+    if (!process->waitForStarted()) {
+        qWarning() << "cannot start" << m_program << process->errorString();
+        delete process;
+        delete local;
+        return nullptr;
+    }
+    connect(process, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            process, &QObject::deleteLater);
+
+    // the child has its copy of remote, ours is closed with pair
+    return local;
+}
+
+void LatencyProxy::forward(QTcpSocket *from, QTcpSocket *to, bool upstream)
+{
+    const QByteArray chunk = from->readAll();
+    if (chunk.isEmpty()) {
+        return;
+    }
+
+    // a request that follows a response starts a new round trip
+    const bool lastUpstream = from->property("lastUpstream").toBool();
+    if (upstream) {
+        m_bytesSent += chunk.size();
+        if (!lastUpstream) {
+            ++m_roundTrips;
+        }
+    } else {
+        m_bytesReceived += chunk.size();
+    }
+    from->setProperty("lastUpstream", upstream);
+    to->setProperty("lastUpstream", upstream);
+
+    if (m_latencyMs <= 0) {
+        to->write(chunk);
+        return;
+    }
+
+    // timers with the same interval fire in the order they were started,
+    // so the stream is not reordered
+    QTimer::singleShot(m_latencyMs, Qt::PreciseTimer, to, [to, chunk]() { to->write(chunk); });
+}
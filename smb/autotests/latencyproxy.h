@@ -0,0 +1,77 @@
+/*  This file is part of the KDE project
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef LATENCYPROXY_H
+#define LATENCYPROXY_H
+
+#include <QAtomicInteger>
+#include <QObject>
+#include <QStringList>
+
+class QTcpServer;
+class QTcpSocket;
+
+/**
+ * TCP forwarder between kio_smb and the test smbd.  It delays every chunk
+ * by a fixed latency in both directions, to simulate a remote server, and
+ * counts the request/response turnarounds (round trips) it sees.
+ *
+ * Every connection gets a server of its own, started in inetd mode on one
+ * end of a loopback connection the proxy makes to itself, so the only port
+ * involved is the one the proxy listens on, which it gets from the system.
+ * Lives on a thread of its own, see start().
+ */
+class LatencyProxy : public QObject
+{
+    Q_OBJECT
+
+public:
+    LatencyProxy(const QString &program, const QStringList &arguments, int latencyMs);
+
+    // 0 until start() could listen
+    quint16 port() const { return m_port; }
+
+    quint64 roundTrips() const { return m_roundTrips.load(); }
+    quint64 bytesSent() const { return m_bytesSent.load(); }
+    quint64 bytesReceived() const { return m_bytesReceived.load(); }
+    void resetCounters();
+
+public Q_SLOTS:
+    // to be invoked (blocking) on the proxy's thread
+    void start();
+    void stop();
+
+private Q_SLOTS:
+    void newConnection();
+
+private:
+    QTcpSocket *startServer();
+    void forward(QTcpSocket *from, QTcpSocket *to, bool upstream);
+
+    const QString m_program;
+    const QStringList m_arguments;
+    const int m_latencyMs;
+    quint16 m_port;
+    QTcpServer *m_server;
+
+    QAtomicInteger<quint64> m_roundTrips;
+    QAtomicInteger<quint64> m_bytesSent;
+    QAtomicInteger<quint64> m_bytesReceived;
+};
+
+#endif
@@ -1,2 +1,8 @@
 /* Define to 1 if you have the <utime.h> header file. */
 #cmakedefine HAVE_UTIME_H 1
+
+/* Define to 1 if libsmbclient can be used from several threads */
+#cmakedefine HAVE_SMBC_THREAD_POSIX 1
+
+/* Define to 1 if libsmbclient can return attributes with directory entries */
+#cmakedefine HAVE_SMBC_READDIRPLUS 1
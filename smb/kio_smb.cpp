@@ -79,6 +79,18 @@ SMBSlave::SMBSlave(const QByteArray& pool, const QByteArray& app)
 //===========================================================================
 SMBSlave::~SMBSlave()
 {
+    // let background refreshes of the browse cache finish their write
+    for (SMBBrowseRefresher *refresher : qAsConst(m_browseRefreshers)) {
+        refresher->wait();
+    }
+    qDeleteAll(m_browseRefreshers);
+}
+
+//===========================================================================
+void SMBSlave::slave_status()
+{
+    qCDebug(KIO_SMB) << m_stats.report();
+    slaveStatus(m_current_url.host(), m_initialized_smbc && !m_current_url.host().isEmpty());
 }
 
 void SMBSlave::virtual_hook(int id, void *data) {
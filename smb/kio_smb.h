@@ -78,6 +78,10 @@ extern "C"
 // kio_smb internal includes
 //---------------------------
 #include "kio_smb_internal.h"
+#include "kio_smb_browsecache.h"
+#include "kio_smb_stats.h"
+
+class SMBTreeWalker;
 
 #define MAX_XFER_BUF_SIZE           65534
 
@@ -113,6 +117,29 @@ private:
     QString  m_default_password;
     QString  m_default_encoding;
 
+    /**
+     * From Controlcenter, whether workgroup, server and share listings
+     * are served from the browse cache and how old (in seconds) a cached
+     * listing may get before it is no longer shown, respectively before
+     * it is refreshed in the background
+     */
+    bool     m_browseCacheEnabled;
+    int      m_browseCacheMaxAge;
+    int      m_browseCacheRefreshInterval;
+
+    /**
+     * From Controlcenter, number of connections a tree stat may use
+     */
+    int      m_treeStatConnections;
+
+    /**
+     * What this slave did so far, see special() command 6
+     */
+    SMBStats m_stats;
+
+    SMBBrowseCache m_browseCache;
+    QList<SMBBrowseRefresher *> m_browseRefreshers;
+
     /**
      * we store the current url, it's needed for
      * callback authorization method
@@ -146,6 +173,12 @@ protected:
 
     bool checkPassword(SMBUrl &url);
 
+    /**
+     * Description :   Looks up the credentials the authentication callback
+     *                 would use for url, without asking the user
+     */
+    SMBCredentials auth_cachedCredentials(const SMBUrl &url);
+
 
     //---------------------------------------------
     // Cache functions (kio_smb_auth.cpp)
@@ -177,6 +210,29 @@ protected:
      */
     int cache_stat( const SMBUrl& url, struct stat* st );
 
+    /**
+     * Description :  Fill udsentry for a workgroup, server or share
+     */
+    void browse_fillEntry(const SMBBrowseEntry& entry, UDSEntry& udsentry) const;
+
+    /**
+     * Description :  List url from the browse cache if possible
+     * Parameter :    SMBUrl the url to list, timestamp of the cached listing
+     * Return :       true if the entries have been listed
+     */
+    bool browse_listCached(const SMBUrl& url, QDateTime& timestamp);
+
+    /**
+     * Description :  Refresh the cached listing of url in the background
+     */
+    void browse_refreshCache(const SMBUrl& url);
+
+    /**
+     * Description :  The user whose cached listings of url may be shown,
+     *                the one libsmbclient would authenticate as right now
+     */
+    QString browse_cacheUser(const SMBUrl& url);
+
     //---------------------------------------------
     // Configuration functions (kio_smb_config.cpp)
     //---------------------------------------------
@@ -230,6 +286,9 @@ public:
                             char *username, int unmaxlen,
                             char *password, int pwmaxlen);
 
+    // accounts the time spent in the callback above
+    void auth_accountCallback(qint64 nsecs) { m_stats.authCallback(nsecs); }
+
 
     //-----------------------------------------------------------------------
     // Overwritten functions from the base class that define the operation of
@@ -263,17 +322,42 @@ public:
     void seek( KIO::filesize_t offset ) override;
     void close() override;
 
+    // Functions overwritten in kio_smb_mount.cpp
+    // Commands: 1/3 mount, 2/4 unmount, 5 tree stat (see treeStat()),
+    //           6 statistics (bool reset), sent as text
+    void special( const QByteArray & ) override;
+
+    // Functions overwritten in kio_smb.cpp
+    void slave_status() override;
+
     // Functions not implemented  (yet)
     //virtual void setHost(const QString& host, int port, const QString& user, const QString& pass);
     //virtual void openConnection();
     //virtual void closeConnection();
-    //virtual void slave_status();
-    void special( const QByteArray & ) override;
 
 protected:
     void virtual_hook(int id, void *data) override;
 
 private:
+    /**
+     * Record types of the data sent by treeStat()
+     */
+    enum TreeStatRecord {
+        TreeStatTotals = 1,   // quint64 directories, files, bytes, errors
+        TreeStatEntries = 2   // KIO::UDSEntryList, names relative to the root
+    };
+
+    // Functions in kio_smb_treestat.cpp
+
+    /**
+     * Description :  special() command 5, walks the tree below url with
+     *                several connections at once and sends its totals, and
+     *                if asked for all entries, back as data records; the
+     *                final totals are also set as meta data
+     */
+    void treeStat(const QUrl &url, bool withEntries);
+    void treeStatProgress(SMBTreeWalker &walker, bool withEntries);
+
     SMBError errnumToKioError(const SMBUrl& url, const int errNum);
     void smbCopy(const QUrl& src, const QUrl &dest, int permissions, KIO::JobFlags flags);
     void smbCopyGet(const QUrl& src, const QUrl& dest, int permissions, KIO::JobFlags flags);
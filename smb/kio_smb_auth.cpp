@@ -37,6 +37,8 @@
 #include <klocalizedstring.h>
 #include <stdlib.h>
 
+#include <QElapsedTimer>
+
 // call for libsmbclient
 //==========================================================================
 void auth_smbc_get_data(SMBCCTX * context,
@@ -52,10 +54,13 @@ void auth_smbc_get_data(SMBCCTX * context,
 #else
         SMBSlave *theSlave = (SMBSlave*)smbc_option_get(context, "user_data");
 #endif
+        QElapsedTimer timer;
+        timer.start();
         theSlave->auth_smbc_get_data(server, share,
                                      workgroup,wgmaxlen,
                                      username, unmaxlen,
                                      password, pwmaxlen);
+        theSlave->auth_accountCallback(timer.nsecsElapsed());
     }
 
 }
@@ -119,6 +124,36 @@ void SMBSlave::auth_smbc_get_data(const char *server,const char *share,
     strncpy(password, info.password.toUtf8(), pwmaxlen - 1);
 }
 
+SMBCredentials SMBSlave::auth_cachedCredentials(const SMBUrl &url)
+{
+    if (!url.userName().isEmpty() && !url.password().isEmpty())
+        return SMBCredentials{ url.userName(), url.password() };
+
+    // same lookup as in auth_smbc_get_data(); after checkPassword() the
+    // url has the user name only, the password is in the cache, stored
+    // for the share
+    QString share = url.path();
+    const int index = share.indexOf('/', 1);
+    if (index > 1)
+        share = share.left(index);
+
+    KIO::AuthInfo info;
+    info.url = QUrl("smb:///");
+    info.url.setHost(url.host());
+    info.url.setPath(share.startsWith('/') ? share : '/' + share);
+    info.username = url.userName();
+    info.verifyPath = true;
+
+    if ( checkCachedAuthentication( info ) )
+        return SMBCredentials{ info.username, info.password };
+    else if ( !url.userName().isEmpty() )
+        return SMBCredentials{ url.userName(), QString() };
+    else if ( m_default_user.isEmpty() )
+        return SMBCredentials{ QStringLiteral("anonymous"), QString() };
+    else
+        return SMBCredentials{ m_default_user, m_default_password };
+}
+
 bool SMBSlave::checkPassword(SMBUrl &url)
 {
     qCDebug(KIO_SMB) << "checkPassword for " << url;
@@ -151,6 +186,7 @@ bool SMBSlave::checkPassword(SMBUrl &url)
 
     info.username = url.userName();
     qCDebug(KIO_SMB) << "call openPasswordDialog for " << info.url;
+    m_stats.passwordDialog();
 
     if ( openPasswordDialog(info) ) {
         qCDebug(KIO_SMB) << "openPasswordDialog returned " << info.username;
@@ -183,6 +219,11 @@ bool SMBSlave::auth_initialize_smbc()
         KConfig cfg( "kioslaverc", KConfig::SimpleConfig);
         int debug_level = cfg.group( "SMB" ).readEntry( "DebugLevel", 0 );
 
+#ifdef HAVE_SMBC_THREAD_POSIX
+	// the browse cache is refreshed from threads with contexts of their own
+	smbc_thread_posix();
+#endif
+
 	smb_context = smbc_new_context();
 	if (smb_context == nullptr) {
             SlaveBase::error(ERR_INTERNAL, i18n("libsmbclient failed to create context"));
@@ -219,6 +260,10 @@ bool SMBSlave::auth_initialize_smbc()
 
 	smbc_set_context(smb_context);
 
+#ifdef DEPRECATED_SMBC_INTERFACE
+	m_stats.installHooks(smb_context);
+#endif
+
         m_initialized_smbc = true;
     }
 
@@ -37,9 +37,24 @@
 #include "kio_smb_internal.h"
 #include <KLocalizedString>
 #include <KIO/Job>
+#include <KConfig>
+#include <KConfigGroup>
 
 using namespace KIO;
 
+// Workgroup and server names come in upper case, make them look nicer
+static QString browseDisplayName(const QString &name, const QString &comment, uint type)
+{
+    if (name.isEmpty() || (type != SMBC_SERVER && type != SMBC_WORKGROUP))
+        return name;
+
+    QString udsName = name.toLower();
+    udsName[0] = name.at( 0 ).toUpper();
+    if ( !comment.isEmpty() && type == SMBC_SERVER )
+        udsName += " (" + comment + ')';
+    return udsName;
+}
+
 int SMBSlave::cache_stat(const SMBUrl &url, struct stat* st )
 {
     int cacheStatErr;
@@ -101,6 +116,7 @@ int SMBSlave::browse_stat_path(const SMBUrl& _url, UDSEntry& udsentry)
 //===========================================================================
 void SMBSlave::stat( const QUrl& kurl )
 {
+    SMBOperationScope scope(m_stats, "stat", kurl);
     qCDebug(KIO_SMB) << kurl;
     // make a valid URL
     QUrl url = checkURL(kurl);
@@ -298,6 +314,7 @@ void SMBSlave::reportWarning(const SMBUrl& url, const int errNum)
 //===========================================================================
 void SMBSlave::listDir( const QUrl& kurl )
 {
+   SMBOperationScope scope(m_stats, "listDir", kurl);
    qCDebug(KIO_SMB) << kurl;
    int errNum = 0;
 
@@ -313,9 +330,24 @@ void SMBSlave::listDir( const QUrl& kurl )
 
    m_current_url = kurl;
 
+   const bool browseLevel = m_current_url.getType() == SMBURLTYPE_ENTIRE_NETWORK ||
+                            m_current_url.getType() == SMBURLTYPE_WORKGROUP_OR_SERVER;
+
+   // Workgroups, servers and shares change rarely but take long to list,
+   // show what we know and ask the network again behind the user's back
+   QDateTime cacheTimestamp;
+   if (browseLevel && m_browseCacheEnabled && browse_listCached(m_current_url, cacheTimestamp))
+   {
+       finished();
+       if (cacheTimestamp.secsTo(QDateTime::currentDateTimeUtc()) >= m_browseCacheRefreshInterval)
+           browse_refreshCache(m_current_url);
+       return;
+   }
+
    int                 dirfd;
    struct smbc_dirent  *dirp = nullptr;
    UDSEntry    udsentry;
+   QVector<SMBBrowseEntry> browseEntries;
    bool dir_is_root = true;
 
    dirfd = smbc_opendir( m_current_url.toSmbcUrl() );
@@ -334,30 +366,14 @@ void SMBSlave::listDir( const QUrl& kurl )
            if(dirp == nullptr)
                break;
 
-           // Set name
-           QString udsName;
            const QString dirpName = QString::fromUtf8( dirp->name );
            // We cannot trust dirp->commentlen has it might be with or without the NUL character
            // See KDE bug #111430 and Samba bug #3030
            const QString comment = QString::fromUtf8( dirp->comment );
-           if ( dirp->smbc_type == SMBC_SERVER || dirp->smbc_type == SMBC_WORKGROUP ) {
-               udsName = dirpName.toLower();
-               udsName[0] = dirpName.at( 0 ).toUpper();
-               if ( !comment.isEmpty() && dirp->smbc_type == SMBC_SERVER )
-                   udsName += " (" + comment + ')';
-           } else
-               udsName = dirpName;
+           const QString udsName = browseDisplayName(dirpName, comment, dirp->smbc_type);
 
            qCDebug(KIO_SMB) << "dirp->name " <<  dirp->name  << " " << dirpName << " '" << comment << "'" << " " << dirp->smbc_type;
 
-           udsentry.insert( KIO::UDSEntry::UDS_NAME, udsName );
-
-           // Mark all administrative shares, e.g ADMIN$, as hidden. #197903
-           if (dirpName.endsWith(QLatin1Char('$'))) {
-              //qCDebug(KIO_SMB) << dirpName << "marked as hidden";
-              udsentry.insert(KIO::UDSEntry::UDS_HIDDEN, 1);
-           }
-
            if (udsName == ".")
            {
                // Skip the "." entry
@@ -372,6 +388,13 @@ void SMBSlave::listDir( const QUrl& kurl )
            else if (dirp->smbc_type == SMBC_FILE ||
                     dirp->smbc_type == SMBC_DIR)
            {
+               udsentry.insert( KIO::UDSEntry::UDS_NAME, udsName );
+
+               // Mark all administrative shares, e.g ADMIN$, as hidden. #197903
+               if (dirpName.endsWith(QLatin1Char('$'))) {
+                  udsentry.insert(KIO::UDSEntry::UDS_HIDDEN, 1);
+               }
+
                // Set stat information
                m_current_url.addPath(dirpName);
                const int statErr = browse_stat_path(m_current_url, udsentry);
@@ -390,46 +413,12 @@ void SMBSlave::listDir( const QUrl& kurl )
                m_current_url.cd("..");
            }
            else if(dirp->smbc_type == SMBC_SERVER ||
-                   dirp->smbc_type == SMBC_FILE_SHARE)
-           {
-               // Set type
-               udsentry.insert( KIO::UDSEntry::UDS_FILE_TYPE, S_IFDIR );
-
-
-               if (dirp->smbc_type == SMBC_SERVER) {
-                   udsentry.insert(KIO::UDSEntry::UDS_ACCESS, (S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH));
-
-                   // QString workgroup = m_current_url.host().toUpper();
-                   QUrl u("smb://");
-                   u.setHost(dirpName);
-
-                   // when libsmbclient knows
-                   // u = QString("smb://%1?WORKGROUP=%2").arg(dirpName).arg(workgroup.toUpper());
-                   qCDebug(KIO_SMB) << "list item " << u;
-                   udsentry.insert(KIO::UDSEntry::UDS_URL, u.url());
-
-                   udsentry.insert(KIO::UDSEntry::UDS_MIME_TYPE, QString::fromLatin1("application/x-smb-server"));
-               } else
-                   udsentry.insert(KIO::UDSEntry::UDS_ACCESS, (S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH));
-
-
-               // Call base class to list entry
-               listEntry(udsentry);
-           }
-           else if(dirp->smbc_type == SMBC_WORKGROUP)
+                   dirp->smbc_type == SMBC_FILE_SHARE ||
+                   dirp->smbc_type == SMBC_WORKGROUP)
            {
-               // Set type
-               udsentry.insert(KIO::UDSEntry::UDS_FILE_TYPE, S_IFDIR);
-
-               // Set permissions
-               udsentry.insert(KIO::UDSEntry::UDS_ACCESS, (S_IRUSR | S_IRGRP | S_IROTH | S_IXUSR | S_IXGRP | S_IXOTH));
-
-               udsentry.insert(KIO::UDSEntry::UDS_MIME_TYPE, QString::fromLatin1("application/x-smb-workgroup"));
-
-               // QString workgroup = m_current_url.host().toUpper();
-               QUrl u("smb://");
-               u.setHost(dirpName);
-               udsentry.insert(KIO::UDSEntry::UDS_URL, u.url());
+               const SMBBrowseEntry entry{ dirpName, comment, dirp->smbc_type };
+               browse_fillEntry(entry, udsentry);
+               browseEntries.append(entry);
 
                // Call base class to list entry
                listEntry(udsentry);
@@ -470,6 +459,9 @@ void SMBSlave::listDir( const QUrl& kurl )
 
        // clean up
        smbc_closedir(dirfd);
+
+       if (browseLevel && m_browseCacheEnabled)
+           m_browseCache.store(m_current_url, browse_cacheUser(m_current_url), browseEntries);
    }
    else
    {
@@ -488,8 +480,121 @@ void SMBSlave::listDir( const QUrl& kurl )
    finished();
 }
 
+//===========================================================================
+void SMBSlave::browse_fillEntry(const SMBBrowseEntry& entry, UDSEntry& udsentry) const
+{
+    udsentry.insert(KIO::UDSEntry::UDS_NAME, browseDisplayName(entry.name, entry.comment, entry.type));
+
+    // Mark all administrative shares, e.g ADMIN$, as hidden. #197903
+    if (entry.name.endsWith(QLatin1Char('$'))) {
+        udsentry.insert(KIO::UDSEntry::UDS_HIDDEN, 1);
+    }
+
+    // Set type
+    udsentry.insert(KIO::UDSEntry::UDS_FILE_TYPE, S_IFDIR);
+
+    if (entry.type == SMBC_SERVER || entry.type == SMBC_WORKGROUP) {
+        udsentry.insert(KIO::UDSEntry::UDS_ACCESS, (S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH));
+
+        // QString workgroup = m_current_url.host().toUpper();
+        QUrl u("smb://");
+        u.setHost(entry.name);
+
+        // when libsmbclient knows
+        // u = QString("smb://%1?WORKGROUP=%2").arg(dirpName).arg(workgroup.toUpper());
+        qCDebug(KIO_SMB) << "list item " << u;
+        udsentry.insert(KIO::UDSEntry::UDS_URL, u.url());
+
+        if (entry.type == SMBC_SERVER)
+            udsentry.insert(KIO::UDSEntry::UDS_MIME_TYPE, QString::fromLatin1("application/x-smb-server"));
+        else
+            udsentry.insert(KIO::UDSEntry::UDS_MIME_TYPE, QString::fromLatin1("application/x-smb-workgroup"));
+    } else
+        udsentry.insert(KIO::UDSEntry::UDS_ACCESS, (S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH));
+}
+
+bool SMBSlave::browse_listCached(const SMBUrl& url, QDateTime& timestamp)
+{
+    QVector<SMBBrowseEntry> entries;
+    // only what the user we would authenticate as has been shown before,
+    // anyone else gets the uncached listing and has to log in first
+    if (!m_browseCache.load(url, browse_cacheUser(url), entries, timestamp))
+        return false;
+
+    if (timestamp.secsTo(QDateTime::currentDateTimeUtc()) > m_browseCacheMaxAge)
+    {
+        qCDebug(KIO_SMB) << "browse cache of" << url << "expired";
+        return false;
+    }
+
+    qCDebug(KIO_SMB) << "listing" << url << "from browse cache of" << timestamp;
+
+    UDSEntry udsentry;
+    udsentry.insert(KIO::UDSEntry::UDS_FILE_TYPE, S_IFDIR);
+    udsentry.insert(KIO::UDSEntry::UDS_NAME, ".");
+    udsentry.insert(KIO::UDSEntry::UDS_ACCESS, (S_IRUSR | S_IRGRP | S_IROTH | S_IXUSR | S_IXGRP | S_IXOTH));
+    listEntry(udsentry);
+    udsentry.clear();
+
+    for (const SMBBrowseEntry &entry : qAsConst(entries))
+    {
+        browse_fillEntry(entry, udsentry);
+        listEntry(udsentry);
+        udsentry.clear();
+    }
+
+    return true;
+}
+
+void SMBSlave::browse_refreshCache(const SMBUrl& url)
+{
+    // reap refreshes that are done, and don't run two for the same url
+    for (auto it = m_browseRefreshers.begin(); it != m_browseRefreshers.end(); )
+    {
+        if ((*it)->isFinished()) {
+            delete *it;
+            it = m_browseRefreshers.erase(it);
+        } else if ((*it)->url() == url) {
+            qCDebug(KIO_SMB) << "browse cache refresh of" << url << "already running";
+            return;
+        } else {
+            ++it;
+        }
+    }
+
+#ifdef HAVE_SMBC_THREAD_POSIX
+    SMBCredentials credentials;
+    if (url.getType() != SMBURLTYPE_ENTIRE_NETWORK)
+        credentials = auth_cachedCredentials(url);
+
+    KConfig cfg( "kioslaverc", KConfig::SimpleConfig );
+    const int debugLevel = cfg.group( "SMB" ).readEntry( "DebugLevel", 0 );
+
+    SMBBrowseRefresher *refresher = new SMBBrowseRefresher(m_browseCache, url, url.toSmbcUrl(),
+                                                           credentials, debugLevel);
+    m_browseRefreshers.append(refresher);
+    refresher->start(QThread::LowPriority);
+#else
+    // libsmbclient cannot be used from several threads, so refresh right
+    // here; the listing has already been finished, so the user is not
+    // kept waiting, only the next job on this slave is
+    m_current_url = url;
+    m_browseCache.refresh(smbc_set_context(nullptr), url, browse_cacheUser(url), url.toSmbcUrl());
+#endif
+}
+
+QString SMBSlave::browse_cacheUser(const SMBUrl& url)
+{
+    // the workgroup list is fetched anonymously, it is the same for everyone
+    if (url.getType() == SMBURLTYPE_ENTIRE_NETWORK)
+        return QString();
+
+    return auth_cachedCredentials(url).user;
+}
+
 void SMBSlave::fileSystemFreeSpace(const QUrl& url)
 {
+    SMBOperationScope scope(m_stats, "fileSystemFreeSpace", url);
     qCDebug(KIO_SMB) << url;
 
     // Avoid crashing in smbc_fstatvfs below when
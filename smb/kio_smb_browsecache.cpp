@@ -0,0 +1,199 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_browsecache.cpp
+//
+// Abstract:    Persistent cache for the network browse levels, see
+//              kio_smb_browsecache.h
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "kio_smb.h"
+#include "kio_smb_browsecache.h"
+
+#include <KDirNotify>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <string.h>
+
+// Bump whenever the layout of the cache files changes
+static const quint32 s_cacheFormatVersion = 1;
+
+QDataStream &operator<<(QDataStream &stream, const SMBBrowseEntry &entry)
+{
+    stream << entry.name << entry.comment << quint32(entry.type);
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, SMBBrowseEntry &entry)
+{
+    quint32 type;
+    stream >> entry.name >> entry.comment >> type;
+    entry.type = type;
+    return stream;
+}
+
+// Passwords must never end up on disk, neither in the file nor in its name
+static QString cacheKey(const QUrl &url, const QString &user)
+{
+    QUrl key = url.adjusted(QUrl::RemovePassword | QUrl::StripTrailingSlash);
+    key.setUserName(user);
+    return key.toString();
+}
+
+//===========================================================================
+SMBBrowseCache::SMBBrowseCache()
+    : m_directory(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                  + QLatin1String("/kio_smb/browse"))
+{
+}
+
+QString SMBBrowseCache::fileName(const QUrl &url, const QString &user) const
+{
+    const QByteArray hash = QCryptographicHash::hash(cacheKey(url, user).toUtf8(), QCryptographicHash::Sha1);
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(hash.toHex());
+}
+
+bool SMBBrowseCache::load(const QUrl &url, const QString &user, QVector<SMBBrowseEntry> &entries, QDateTime &timestamp) const
+{
+    QFile file(fileName(url, user));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 version;
+    QString key;
+    stream >> version;
+    if (version != s_cacheFormatVersion) {
+        return false;
+    }
+
+    stream >> key >> timestamp >> entries;
+    if (stream.status() != QDataStream::Ok || key != cacheKey(url, user)) {
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void SMBBrowseCache::store(const QUrl &url, const QString &user, const QVector<SMBBrowseEntry> &entries) const
+{
+    if (!QDir().mkpath(m_directory)) {
+        qCDebug(KIO_SMB) << "cannot create browse cache directory" << m_directory;
+        return;
+    }
+
+    QSaveFile file(fileName(url, user));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCDebug(KIO_SMB) << "cannot write browse cache" << file.fileName() << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << s_cacheFormatVersion << cacheKey(url, user) << QDateTime::currentDateTimeUtc() << entries;
+    file.commit();
+}
+
+int SMBBrowseCache::fetch(SMBCCTX *context, const QByteArray &smbcUrl, QVector<SMBBrowseEntry> &entries)
+{
+    SMBCFILE *dir = smbc_getFunctionOpendir(context)(context, smbcUrl.constData());
+    if (dir == nullptr) {
+        return errno;
+    }
+
+    struct smbc_dirent *dirp;
+    while ((dirp = smbc_getFunctionReaddir(context)(context, dir)) != nullptr) {
+        if (dirp->smbc_type != SMBC_WORKGROUP &&
+            dirp->smbc_type != SMBC_SERVER &&
+            dirp->smbc_type != SMBC_FILE_SHARE) {
+            continue;
+        }
+        // We cannot trust dirp->commentlen, see SMBSlave::listDir()
+        entries.append(SMBBrowseEntry{ QString::fromUtf8(dirp->name),
+                                       QString::fromUtf8(dirp->comment),
+                                       dirp->smbc_type });
+    }
+
+    smbc_getFunctionClosedir(context)(context, dir);
+    return 0;
+}
+
+void SMBBrowseCache::refresh(SMBCCTX *context, const QUrl &url, const QString &user, const QByteArray &smbcUrl) const
+{
+    QVector<SMBBrowseEntry> fresh;
+    const int errNum = fetch(context, smbcUrl, fresh);
+    if (errNum == EPERM || errNum == EACCES) {
+        // what we have may no longer be what user is allowed to see; drop
+        // it, so that the next listing goes to the server in the foreground,
+        // where the slave can ask for credentials or report the error
+        qCWarning(KIO_SMB) << "browse cache refresh of" << url << "as" << user
+                           << "failed to authenticate:" << strerror(errNum);
+        QFile::remove(fileName(url, user));
+        return;
+    }
+    if (errNum != 0) {
+        // keep serving what we have, the next foreground listing will report the error
+        qCDebug(KIO_SMB) << "browse cache refresh of" << url << "failed:" << strerror(errNum);
+        return;
+    }
+
+    QVector<SMBBrowseEntry> cached;
+    QDateTime timestamp;
+    const bool changed = !load(url, user, cached, timestamp) || cached != fresh;
+
+    store(url, user, fresh);
+
+    if (changed) {
+        qCDebug(KIO_SMB) << "browse cache of" << url << "changed, notifying listers";
+        // makes KDirLister list the url again, which is then served from the updated cache
+        OrgKdeKDirNotifyInterface::emitFilesAdded(url.adjusted(QUrl::RemovePassword));
+    }
+}
+
+//===========================================================================
+SMBBrowseRefresher::SMBBrowseRefresher(const SMBBrowseCache &cache, const QUrl &url, const QByteArray &smbcUrl,
+                                       const SMBCredentials &credentials, int debugLevel)
+    : m_cache(cache),
+      m_url(url),
+      m_smbcUrl(smbcUrl),
+      m_credentials(credentials),
+      m_debugLevel(debugLevel)
+{
+}
+
+void SMBBrowseRefresher::run()
+{
+    SMBCCTX *context = smbc_new_private_context(&m_credentials, m_debugLevel);
+    if (context == nullptr) {
+        return;
+    }
+
+    m_cache.refresh(context, m_url, m_credentials.user, m_smbcUrl);
+
+    smbc_free_context(context, 1);
+}
@@ -0,0 +1,132 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_browsecache.h
+//
+// Abstract:    Persistent cache for the network browse levels (workgroups,
+//              servers and shares) so that they can be shown immediately
+//              and refreshed behind the user's back.
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef KIO_SMB_BROWSECACHE_H_INCLUDED
+#define KIO_SMB_BROWSECACHE_H_INCLUDED
+
+#include "config-smb.h"
+#include "kio_smb_context.h"
+
+#include <QDateTime>
+#include <QString>
+#include <QThread>
+#include <QUrl>
+#include <QVector>
+
+extern "C"
+{
+#include <libsmbclient.h>
+}
+
+class QDataStream;
+
+/**
+ * One workgroup, server or share as returned by smbc_readdir().
+ */
+struct SMBBrowseEntry
+{
+    QString name;
+    QString comment;
+    uint type;
+
+    bool operator==(const SMBBrowseEntry &other) const
+    {
+        return type == other.type && name == other.name && comment == other.comment;
+    }
+    bool operator!=(const SMBBrowseEntry &other) const { return !(*this == other); }
+};
+
+QDataStream &operator<<(QDataStream &stream, const SMBBrowseEntry &entry);
+QDataStream &operator>>(QDataStream &stream, SMBBrowseEntry &entry);
+
+//===========================================================================
+/**
+ * Stores browse listings below the user's cache directory, one file per
+ * listed URL.  Files are replaced atomically, so several slaves (and the
+ * refresh threads) may read and write the cache at the same time.
+ */
+class SMBBrowseCache
+{
+public:
+    SMBBrowseCache();
+
+    /**
+     * Description :  Reads the cached listing of url as seen by user; what
+     *                a server shows depends on who asks, so every user has
+     *                listings of their own
+     * Return :       false if there is no usable cache entry
+     */
+    bool load(const QUrl &url, const QString &user, QVector<SMBBrowseEntry> &entries, QDateTime &timestamp) const;
+
+    void store(const QUrl &url, const QString &user, const QVector<SMBBrowseEntry> &entries) const;
+
+    /**
+     * Description :  Lists the workgroups, servers and shares below
+     *                smbcUrl using the given libsmbclient context
+     * Return :       0 on success, the errno of the failed call otherwise
+     */
+    static int fetch(SMBCCTX *context, const QByteArray &smbcUrl, QVector<SMBBrowseEntry> &entries);
+
+    /**
+     * Description :  Fetches url again as user, updates the cache and
+     *                notifies directory listers if the listing has changed.
+     *                If user is refused, the cached listing is dropped.
+     */
+    void refresh(SMBCCTX *context, const QUrl &url, const QString &user, const QByteArray &smbcUrl) const;
+
+private:
+    QString fileName(const QUrl &url, const QString &user) const;
+
+    QString m_directory;
+};
+
+//===========================================================================
+/**
+ * Refreshes one cached listing on a thread of its own.  The thread uses a
+ * private libsmbclient context, the slave's global context is never touched.
+ */
+class SMBBrowseRefresher : public QThread
+{
+public:
+    SMBBrowseRefresher(const SMBBrowseCache &cache, const QUrl &url, const QByteArray &smbcUrl,
+                       const SMBCredentials &credentials, int debugLevel);
+
+    QUrl url() const { return m_url; }
+
+protected:
+    void run() override;
+
+private:
+    const SMBBrowseCache m_cache;
+    const QUrl m_url;
+    const QByteArray m_smbcUrl;
+    const SMBCredentials m_credentials;
+    const int m_debugLevel;
+};
+
+#endif
@@ -47,6 +47,14 @@ void SMBSlave::reparseConfiguration()
   QString m_encoding = QTextCodec::codecForLocale()->name();
   m_default_encoding = group.readEntry( "Encoding", m_encoding.toLower() );
 
+  m_browseCacheEnabled = group.readEntry( "BrowseCache", true );
+  m_browseCacheMaxAge = group.readEntry( "BrowseCacheMaxAge", 24 * 60 * 60 );
+  m_browseCacheRefreshInterval = group.readEntry( "BrowseCacheRefreshInterval", 10 );
+  m_treeStatConnections = qBound( 1, group.readEntry( "TreeStatConnections", 4 ), 16 );
+
+  // one line per operation, for diagnosing slow shares
+  m_stats.setTraceFile( cfg.group( "SMB" ).readEntry( "TraceFile", QString() ) );
+
   // unscramble, taken from Nicola Brodu's smb ioslave
   //not really secure, but better than storing the plain password
   QString scrambled = group.readEntry( "Password" );
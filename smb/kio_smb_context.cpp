@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_context.cpp
+//
+// Abstract:    Private libsmbclient contexts, see kio_smb_context.h
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "kio_smb.h"
+#include "kio_smb_context.h"
+
+#include <string.h>
+
+extern "C"
+{
+static void auth_private_context(SMBCCTX *context,
+                                 const char * /*server*/, const char * /*share*/,
+                                 char * /*workgroup*/, int /*wgmaxlen*/,
+                                 char *username, int unmaxlen,
+                                 char *password, int pwmaxlen)
+{
+    const SMBCredentials *credentials = static_cast<const SMBCredentials *>(smbc_getOptionUserData(context));
+    if (credentials == nullptr || credentials->user.isEmpty()) {
+        return;
+    }
+
+    strncpy(username, credentials->user.toUtf8().constData(), unmaxlen - 1);
+    username[unmaxlen - 1] = 0;
+    strncpy(password, credentials->password.toUtf8().constData(), pwmaxlen - 1);
+    password[pwmaxlen - 1] = 0;
+}
+}
+
+SMBCCTX *smbc_new_private_context(const SMBCredentials *credentials, int debugLevel)
+{
+    SMBCCTX *context = smbc_new_context();
+    if (context == nullptr) {
+        qCDebug(KIO_SMB) << "cannot create private context";
+        return nullptr;
+    }
+
+    smbc_setDebug(context, debugLevel);
+    smbc_setFunctionAuthDataWithContext(context, auth_private_context);
+    smbc_setOptionUserData(context, const_cast<SMBCredentials *>(credentials));
+    smbc_setOptionUseKerberos(context, 1);
+    smbc_setOptionFallbackAfterKerberos(context, 1);
+
+    if (!smbc_init_context(context)) {
+        qCDebug(KIO_SMB) << "cannot initialize private context";
+        smbc_free_context(context, 0);
+        return nullptr;
+    }
+
+    return context;
+}
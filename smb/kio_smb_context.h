@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_context.h
+//
+// Abstract:    Private libsmbclient contexts for work that is done on
+//              threads other than the slave's main thread
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef KIO_SMB_CONTEXT_H_INCLUDED
+#define KIO_SMB_CONTEXT_H_INCLUDED
+
+#include <QString>
+
+extern "C"
+{
+#include <libsmbclient.h>
+}
+
+/**
+ * Credentials handed to a private context.  Threads cannot ask the slave,
+ * let alone the user, for a password, so they have to be looked up (see
+ * SMBSlave::auth_cachedCredentials()) before the context is created.
+ * An empty user leaves the authentication to libsmbclient (e.g. Kerberos).
+ */
+struct SMBCredentials
+{
+    QString user;
+    QString password;
+};
+
+/**
+ * Description :  Creates and initializes a context that is independent of
+ *                the global one used by the slave
+ * Parameter :    credentials must stay valid until the context is freed
+ * Return :       the context, to be freed with smbc_free_context(), or
+ *                nullptr on error
+ */
+SMBCCTX *smbc_new_private_context(const SMBCredentials *credentials, int debugLevel);
+
+#endif
@@ -42,6 +42,7 @@
 //===========================================================================
 void SMBSlave::copy(const QUrl& src, const QUrl& dst, int permissions, KIO::JobFlags flags)
 {
+    SMBOperationScope scope(m_stats, "copy", src);
     const bool isSourceLocal = src.isLocalFile();
     const bool isDestinationLocal = dst.isLocalFile();
 
@@ -616,6 +617,7 @@ void SMBSlave::smbCopyPut(const QUrl& ksrc, const QUrl& kdst, int permissions, K
 //===========================================================================
 void SMBSlave::del( const QUrl &kurl, bool isfile)
 {
+    SMBOperationScope scope(m_stats, "del", kurl);
     qCDebug(KIO_SMB) << kurl;
     m_current_url = kurl;
     int errNum = 0;
@@ -657,6 +659,7 @@ void SMBSlave::del( const QUrl &kurl, bool isfile)
 //===========================================================================
 void SMBSlave::mkdir( const QUrl &kurl, int permissions )
 {
+    SMBOperationScope scope(m_stats, "mkdir", kurl);
     qCDebug(KIO_SMB) << kurl;
     int errNum = 0;
     int retVal = 0;
@@ -703,6 +706,7 @@ void SMBSlave::mkdir( const QUrl &kurl, int permissions )
 //===========================================================================
 void SMBSlave::rename( const QUrl& ksrc, const QUrl& kdest, KIO::JobFlags flags )
 {
+    SMBOperationScope scope(m_stats, "rename", ksrc);
 
     SMBUrl      src;
     SMBUrl      dst;
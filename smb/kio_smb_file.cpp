@@ -41,6 +41,7 @@
 //===========================================================================
 void SMBSlave::get( const QUrl& kurl )
 {
+    SMBOperationScope scope(m_stats, "get", kurl);
     char        buf[MAX_XFER_BUF_SIZE];
     int         filefd          = 0;
     int         errNum          = 0;
@@ -140,6 +141,7 @@ void SMBSlave::get( const QUrl& kurl )
 //===========================================================================
 void SMBSlave::open( const QUrl& kurl, QIODevice::OpenMode mode)
 {
+    SMBOperationScope scope(m_stats, "open", kurl);
     int           errNum = 0;
     qCDebug(KIO_SMB) << kurl;
 
@@ -246,6 +248,7 @@ void SMBSlave::open( const QUrl& kurl, QIODevice::OpenMode mode)
 
 void SMBSlave::read( KIO::filesize_t bytesRequested )
 {
+    SMBOperationScope scope(m_stats, "read", m_openUrl);
     Q_ASSERT(m_openFd != -1);
 
     QVarLengthArray<char> buffer(bytesRequested);
@@ -269,6 +272,7 @@ void SMBSlave::read( KIO::filesize_t bytesRequested )
 
 void SMBSlave::write(const QByteArray &fileData)
 {
+    SMBOperationScope scope(m_stats, "write", m_openUrl);
     Q_ASSERT(m_openFd != -1);
 
     QByteArray buf(fileData);
@@ -287,6 +291,7 @@ void SMBSlave::write(const QByteArray &fileData)
 
 void SMBSlave::seek(KIO::filesize_t offset)
 {
+    SMBOperationScope scope(m_stats, "seek", m_openUrl);
     off_t res = smbc_lseek(m_openFd, static_cast<off_t>(offset), SEEK_SET);
     if (res == (off_t)-1) {
         error(KIO::ERR_COULD_NOT_SEEK, m_openUrl.path());
@@ -299,6 +304,7 @@ void SMBSlave::seek(KIO::filesize_t offset)
 
 void SMBSlave::close()
 {
+    SMBOperationScope scope(m_stats, "close", m_openUrl);
     smbc_close(m_openFd);
     finished();
 }
@@ -308,6 +314,7 @@ void SMBSlave::put( const QUrl& kurl,
                     int permissions,
                     KIO::JobFlags flags )
 {
+    SMBOperationScope scope(m_stats, "put", kurl);
 
     void *buf;
     size_t bufsize;
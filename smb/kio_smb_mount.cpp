@@ -30,6 +30,7 @@
 
 void SMBSlave::special( const QByteArray & data)
 {
+   SMBOperationScope scope(m_stats, "special");
    qCDebug(KIO_SMB)<<"Smb::special()";
    int tmp;
    QDataStream stream(data);
@@ -186,6 +187,24 @@ void SMBSlave::special( const QByteArray & data)
          finished();
       }
       break;
+   case 5:
+      {
+         QUrl url;
+         bool withEntries;
+         stream >> url >> withEntries;
+         treeStat(url, withEntries);
+         return;
+      }
+   case 6:
+      {
+         // statistics of this slave so far, as text
+         bool reset;
+         stream >> reset;
+         SlaveBase::data(m_stats.report().toUtf8());
+         if (reset)
+            m_stats.reset();
+         break;
+      }
    default:
       break;
    }
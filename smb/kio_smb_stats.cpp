@@ -0,0 +1,386 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_stats.cpp
+//
+// Abstract:    Per operation statistics, see kio_smb_stats.h
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "kio_smb.h"
+#include "kio_smb_stats.h"
+
+#include <QDateTime>
+#include <QTextStream>
+
+#include <unistd.h>
+
+//===========================================================================
+// libsmbclient hooks
+//
+// Every smbc_*() call of the slave ends up in the function table of the
+// global context.  The table entries are replaced by wrappers that time
+// the original function and account it to the current operation.
+//===========================================================================
+
+static SMBStats *s_hookedStats = nullptr;
+
+static struct
+{
+    smbc_open_fn open;
+    smbc_read_fn read;
+    smbc_write_fn write;
+    smbc_lseek_fn lseek;
+    smbc_close_fn close;
+    smbc_stat_fn stat;
+    smbc_fstat_fn fstat;
+    smbc_unlink_fn unlink;
+    smbc_rename_fn rename;
+    smbc_opendir_fn opendir;
+    smbc_readdir_fn readdir;
+    smbc_closedir_fn closedir;
+    smbc_mkdir_fn mkdir;
+    smbc_rmdir_fn rmdir;
+    smbc_chmod_fn chmod;
+    smbc_utimes_fn utimes;
+    smbc_fstatvfs_fn fstatvfs;
+} s_original;
+
+// Times one call of the original function and accounts it
+#define SMBC_HOOK(function, call)                          \
+    QElapsedTimer timer;                                   \
+    timer.start();                                         \
+    auto result = s_original.call;                         \
+    s_hookedStats->smbcCall(#function, timer.nsecsElapsed());
+
+extern "C"
+{
+
+static SMBCFILE *hook_open(SMBCCTX *c, const char *fname, int flags, mode_t mode)
+{
+    SMBC_HOOK(open, open(c, fname, flags, mode));
+    return result;
+}
+
+static ssize_t hook_read(SMBCCTX *c, SMBCFILE *file, void *buf, size_t count)
+{
+    SMBC_HOOK(read, read(c, file, buf, count));
+    if (result > 0)
+        s_hookedStats->bytesRead(result);
+    return result;
+}
+
+static ssize_t hook_write(SMBCCTX *c, SMBCFILE *file, const void *buf, size_t count)
+{
+    SMBC_HOOK(write, write(c, file, buf, count));
+    if (result > 0)
+        s_hookedStats->bytesWritten(result);
+    return result;
+}
+
+static off_t hook_lseek(SMBCCTX *c, SMBCFILE *file, off_t offset, int whence)
+{
+    SMBC_HOOK(lseek, lseek(c, file, offset, whence));
+    return result;
+}
+
+static int hook_close(SMBCCTX *c, SMBCFILE *file)
+{
+    SMBC_HOOK(close, close(c, file));
+    return result;
+}
+
+static int hook_stat(SMBCCTX *c, const char *fname, struct stat *st)
+{
+    SMBC_HOOK(stat, stat(c, fname, st));
+    return result;
+}
+
+static int hook_fstat(SMBCCTX *c, SMBCFILE *file, struct stat *st)
+{
+    SMBC_HOOK(fstat, fstat(c, file, st));
+    return result;
+}
+
+static int hook_unlink(SMBCCTX *c, const char *fname)
+{
+    SMBC_HOOK(unlink, unlink(c, fname));
+    return result;
+}
+
+static int hook_rename(SMBCCTX *ocontext, const char *oname, SMBCCTX *ncontext, const char *nname)
+{
+    SMBC_HOOK(rename, rename(ocontext, oname, ncontext, nname));
+    return result;
+}
+
+static SMBCFILE *hook_opendir(SMBCCTX *c, const char *fname)
+{
+    SMBC_HOOK(opendir, opendir(c, fname));
+    return result;
+}
+
+static struct smbc_dirent *hook_readdir(SMBCCTX *c, SMBCFILE *dir)
+{
+    SMBC_HOOK(readdir, readdir(c, dir));
+    return result;
+}
+
+static int hook_closedir(SMBCCTX *c, SMBCFILE *dir)
+{
+    SMBC_HOOK(closedir, closedir(c, dir));
+    return result;
+}
+
+static int hook_mkdir(SMBCCTX *c, const char *fname, mode_t mode)
+{
+    SMBC_HOOK(mkdir, mkdir(c, fname, mode));
+    return result;
+}
+
+static int hook_rmdir(SMBCCTX *c, const char *fname)
+{
+    SMBC_HOOK(rmdir, rmdir(c, fname));
+    return result;
+}
+
+static int hook_chmod(SMBCCTX *c, const char *fname, mode_t mode)
+{
+    SMBC_HOOK(chmod, chmod(c, fname, mode));
+    return result;
+}
+
+static int hook_utimes(SMBCCTX *c, const char *fname, struct timeval *tbuf)
+{
+    SMBC_HOOK(utimes, utimes(c, fname, tbuf));
+    return result;
+}
+
+static int hook_fstatvfs(SMBCCTX *c, SMBCFILE *file, struct statvfs *st)
+{
+    SMBC_HOOK(fstatvfs, fstatvfs(c, file, st));
+    return result;
+}
+
+}
+
+void SMBStats::installHooks(SMBCCTX *context)
+{
+    s_hookedStats = this;
+
+#define SMBC_INSTALL_HOOK(member, Name)                     \
+    s_original.member = smbc_getFunction##Name(context);    \
+    smbc_setFunction##Name(context, hook_##member);
+
+    SMBC_INSTALL_HOOK(open, Open)
+    SMBC_INSTALL_HOOK(read, Read)
+    SMBC_INSTALL_HOOK(write, Write)
+    SMBC_INSTALL_HOOK(lseek, Lseek)
+    SMBC_INSTALL_HOOK(close, Close)
+    SMBC_INSTALL_HOOK(stat, Stat)
+    SMBC_INSTALL_HOOK(fstat, Fstat)
+    SMBC_INSTALL_HOOK(unlink, Unlink)
+    SMBC_INSTALL_HOOK(rename, Rename)
+    SMBC_INSTALL_HOOK(opendir, Opendir)
+    SMBC_INSTALL_HOOK(readdir, Readdir)
+    SMBC_INSTALL_HOOK(closedir, Closedir)
+    SMBC_INSTALL_HOOK(mkdir, Mkdir)
+    SMBC_INSTALL_HOOK(rmdir, Rmdir)
+    SMBC_INSTALL_HOOK(chmod, Chmod)
+    SMBC_INSTALL_HOOK(utimes, Utimes)
+    SMBC_INSTALL_HOOK(fstatvfs, FstatVFS)
+
+#undef SMBC_INSTALL_HOOK
+}
+
+//===========================================================================
+void SMBStats::Counters::add(const Counters &other)
+{
+    count += other.count;
+    nsecs += other.nsecs;
+    maxNsecs = qMax(maxNsecs, other.maxNsecs);
+    smbcCalls += other.smbcCalls;
+    smbcNsecs += other.smbcNsecs;
+    authCalls += other.authCalls;
+    authNsecs += other.authNsecs;
+    passwordDialogs += other.passwordDialogs;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+}
+
+SMBStats::SMBStats()
+    : m_operation(nullptr)
+{
+}
+
+void SMBStats::setTraceFile(const QString &fileName)
+{
+    if (m_traceFile.isOpen())
+        m_traceFile.close();
+
+    if (fileName.isEmpty())
+        return;
+
+    m_traceFile.setFileName(fileName);
+    if (!m_traceFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        qCDebug(KIO_SMB) << "cannot open trace file" << fileName << m_traceFile.errorString();
+}
+
+void SMBStats::beginOperation(const char *name, const QUrl &url)
+{
+    m_operation = name;
+    m_url = url;
+    m_current = Counters();
+    m_currentCalls.clear();
+    m_timer.start();
+}
+
+void SMBStats::endOperation()
+{
+    if (m_operation == nullptr)
+        return;
+
+    m_current.count = 1;
+    m_current.nsecs = m_timer.nsecsElapsed();
+    m_current.maxNsecs = m_current.nsecs;
+    m_operations[m_operation].add(m_current);
+
+    if (m_traceFile.isOpen())
+        trace(m_current);
+
+    m_operation = nullptr;
+}
+
+void SMBStats::smbcCall(const char *function, qint64 nsecs)
+{
+    QPair<quint64, qint64> &total = m_functions[function];
+    ++total.first;
+    total.second += nsecs;
+
+    if (m_operation == nullptr)
+        return;
+
+    ++m_current.smbcCalls;
+    m_current.smbcNsecs += nsecs;
+    ++m_currentCalls[function];
+}
+
+void SMBStats::bytesRead(qint64 bytes)
+{
+    m_current.bytesRead += bytes;
+}
+
+void SMBStats::bytesWritten(qint64 bytes)
+{
+    m_current.bytesWritten += bytes;
+}
+
+void SMBStats::authCallback(qint64 nsecs)
+{
+    ++m_current.authCalls;
+    m_current.authNsecs += nsecs;
+}
+
+void SMBStats::passwordDialog()
+{
+    ++m_current.passwordDialogs;
+}
+
+void SMBStats::trace(const Counters &op)
+{
+    QString calls;
+    for (auto it = m_currentCalls.constBegin(); it != m_currentCalls.constEnd(); ++it)
+        calls += QStringLiteral(" %1=%2").arg(QString::fromLatin1(it.key())).arg(it.value());
+
+    QTextStream stream(&m_traceFile);
+    stream << QDateTime::currentDateTime().toString(QStringLiteral("yyyy-MM-ddTHH:mm:ss.zzz"))
+           << ' ' << getpid()
+           << ' ' << m_operation
+           << ' ' << m_url.toDisplayString(QUrl::RemovePassword)
+           << " ms=" << op.nsecs / 1000000.0
+           << " smbc=" << op.smbcCalls
+           << " smbc_ms=" << op.smbcNsecs / 1000000.0
+           << " auth=" << op.authCalls
+           << " auth_ms=" << op.authNsecs / 1000000.0
+           << " dialogs=" << op.passwordDialogs
+           << " read=" << op.bytesRead
+           << " written=" << op.bytesWritten
+           << calls << '\n';
+    stream.flush();
+}
+
+QString SMBStats::report() const
+{
+    QString text;
+    QTextStream stream(&text);
+
+    stream << "operation count total_ms max_ms smbc_calls smbc_ms auth_calls auth_ms dialogs bytes_read bytes_written MB/s\n";
+    for (auto it = m_operations.constBegin(); it != m_operations.constEnd(); ++it) {
+        const Counters &op = it.value();
+        const double seconds = op.nsecs / 1e9;
+        const double mbs = seconds > 0 ? (op.bytesRead + op.bytesWritten) / 1048576.0 / seconds : 0;
+        stream << it.key()
+               << ' ' << op.count
+               << ' ' << op.nsecs / 1000000.0
+               << ' ' << op.maxNsecs / 1000000.0
+               << ' ' << op.smbcCalls
+               << ' ' << op.smbcNsecs / 1000000.0
+               << ' ' << op.authCalls
+               << ' ' << op.authNsecs / 1000000.0
+               << ' ' << op.passwordDialogs
+               << ' ' << op.bytesRead
+               << ' ' << op.bytesWritten
+               << ' ' << mbs << '\n';
+    }
+
+    stream << "\nfunction calls total_ms\n";
+    for (auto it = m_functions.constBegin(); it != m_functions.constEnd(); ++it) {
+        stream << "smbc_" << it.key()
+               << ' ' << it.value().first
+               << ' ' << it.value().second / 1000000.0 << '\n';
+    }
+
+    stream.flush();
+    return text;
+}
+
+void SMBStats::reset()
+{
+    m_operations.clear();
+    m_functions.clear();
+}
+
+//===========================================================================
+int SMBOperationScope::s_depth = 0;
+
+SMBOperationScope::SMBOperationScope(SMBStats &stats, const char *name, const QUrl &url)
+    : m_stats(stats),
+      m_outermost(s_depth++ == 0)
+{
+    if (m_outermost)
+        m_stats.beginOperation(name, url);
+}
+
+SMBOperationScope::~SMBOperationScope()
+{
+    --s_depth;
+    if (m_outermost)
+        m_stats.endOperation();
+}
@@ -0,0 +1,125 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_stats.h
+//
+// Abstract:    Per operation statistics: libsmbclient calls, time spent in
+//              them and in authentication, bytes transferred
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef KIO_SMB_STATS_H_INCLUDED
+#define KIO_SMB_STATS_H_INCLUDED
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QUrl>
+
+extern "C"
+{
+#include <libsmbclient.h>
+}
+
+//===========================================================================
+/**
+ * Collects what the slave does per KIO operation.  Calls into libsmbclient
+ * are counted by hooking the function table of the slave's (global)
+ * context, see installHooks(), so nothing is missed and the call sites
+ * need no changes.  Only used from the slave's main thread.
+ */
+class SMBStats
+{
+public:
+    SMBStats();
+
+    /**
+     * Description :  Counts the calls made through context from now on
+     *                (one slave per process, so one hooked context)
+     */
+    void installHooks(SMBCCTX *context);
+
+    /**
+     * Description :  Appends one line per finished operation to fileName,
+     *                an empty name stops tracing
+     */
+    void setTraceFile(const QString &fileName);
+
+    void beginOperation(const char *name, const QUrl &url);
+    void endOperation();
+
+    void smbcCall(const char *function, qint64 nsecs);
+    void bytesRead(qint64 bytes);
+    void bytesWritten(qint64 bytes);
+    void authCallback(qint64 nsecs);
+    void passwordDialog();
+
+    QString report() const;
+    void reset();
+
+private:
+    struct Counters
+    {
+        quint64 count = 0;
+        qint64 nsecs = 0;
+        qint64 maxNsecs = 0;
+        quint64 smbcCalls = 0;
+        qint64 smbcNsecs = 0;
+        quint64 authCalls = 0;
+        qint64 authNsecs = 0;
+        quint64 passwordDialogs = 0;
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+
+        void add(const Counters &other);
+    };
+
+    void trace(const Counters &op);
+
+    // the operation in progress
+    const char *m_operation;
+    QUrl m_url;
+    QElapsedTimer m_timer;
+    Counters m_current;
+    QMap<QByteArray, quint64> m_currentCalls;
+
+    QMap<QByteArray, Counters> m_operations;
+    QMap<QByteArray, QPair<quint64, qint64> > m_functions;  // calls, nsecs
+
+    QFile m_traceFile;
+};
+
+/**
+ * Accounts the enclosing scope to the named operation.  Nested scopes, e.g.
+ * close() called from read(), are accounted to the outermost one.
+ */
+class SMBOperationScope
+{
+public:
+    SMBOperationScope(SMBStats &stats, const char *name, const QUrl &url = QUrl());
+    ~SMBOperationScope();
+
+private:
+    SMBStats &m_stats;
+    bool m_outermost;
+    static int s_depth;
+};
+
+#endif
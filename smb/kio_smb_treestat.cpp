@@ -0,0 +1,346 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_treestat.cpp
+//
+// Abstract:    Parallel walk of a directory tree on a share, see
+//              kio_smb_treestat.h
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "kio_smb.h"
+#include "kio_smb_treestat.h"
+
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QDataStream>
+#include <QElapsedTimer>
+
+#include <string.h>
+
+// Entries are sent to the application in batches of this size
+#define TREESTAT_ENTRY_BATCH 200
+
+// How often (msecs) the totals are sent while the walk is running
+#define TREESTAT_PROGRESS_INTERVAL 250
+
+//===========================================================================
+SMBTreeWalker::SMBTreeWalker(const SMBUrl &root, bool collectEntries)
+    : m_collectEntries(collectEntries),
+      m_busy(0),
+      m_abandoned(false)
+{
+    m_queue.enqueue(Directory{ root, QString() });
+}
+
+void SMBTreeWalker::work(SMBCCTX *context)
+{
+    forever {
+        QMutexLocker locker(&m_mutex);
+        while (m_queue.isEmpty() && m_busy > 0) {
+            m_changed.wait(&m_mutex);
+        }
+        if (isDone() || m_abandoned) {
+            m_changed.wakeAll();
+            return;
+        }
+
+        const Directory dir = m_queue.dequeue();
+        ++m_busy;
+        locker.unlock();
+
+        const bool isRoot = dir.path.isEmpty();
+        const bool listed = listDirectory(context, dir, !isRoot);
+
+        locker.relock();
+        --m_busy;
+        if (!listed && isRoot) {
+            // the credentials the workers got are no good, leave the
+            // walk to the slave, whose context can ask for them
+            qCDebug(KIO_SMB) << "tree stat: workers cannot open the root, falling back";
+            m_queue.enqueue(dir);
+            m_abandoned = true;
+        }
+        m_changed.wakeAll();
+    }
+}
+
+bool SMBTreeWalker::step(SMBCCTX *context)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_queue.isEmpty()) {
+        return false;
+    }
+
+    const Directory dir = m_queue.dequeue();
+    ++m_busy;
+    locker.unlock();
+
+    listDirectory(context, dir, true);
+
+    locker.relock();
+    --m_busy;
+    return true;
+}
+
+bool SMBTreeWalker::waitForProgress(unsigned long msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (isDone()) {
+        return false;
+    }
+    m_changed.wait(&m_mutex, msecs);
+    return !isDone();
+}
+
+SMBTreeWalker::Totals SMBTreeWalker::totals() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totals;
+}
+
+KIO::UDSEntryList SMBTreeWalker::takeEntries()
+{
+    QMutexLocker locker(&m_mutex);
+    KIO::UDSEntryList entries;
+    entries.swap(m_entries);
+    return entries;
+}
+
+bool SMBTreeWalker::listDirectory(SMBCCTX *context, const Directory &dir, bool countFailure)
+{
+    Totals totals;
+    KIO::UDSEntryList entries;
+    QList<Directory> subdirs;
+
+    SMBCFILE *fd = smbc_getFunctionOpendir(context)(context, dir.url.toSmbcUrl().constData());
+    if (fd == nullptr) {
+        qCDebug(KIO_SMB) << "tree stat: cannot open" << dir.url << strerror(errno);
+        if (countFailure) {
+            QMutexLocker locker(&m_mutex);
+            ++m_totals.errors;
+        }
+        return false;
+    }
+
+    const QString prefix = dir.path.isEmpty() ? QString() : dir.path + QLatin1Char('/');
+
+#ifdef HAVE_SMBC_READDIRPLUS
+    // the attributes come with the listing, no round trip per entry
+    const struct libsmb_file_info *info;
+    while ((info = smbc_getFunctionReaddirPlus(context)(context, fd)) != nullptr) {
+        const QString name = QString::fromUtf8(info->name);
+        if (name == QLatin1String(".") || name == QLatin1String("..")) {
+            continue;
+        }
+        const bool isDir = info->attrs & SMBC_DOS_MODE_DIRECTORY;
+        const KIO::filesize_t size = isDir ? 0 : info->size;
+        const time_t mtime = info->mtime_ts.tv_sec;
+#else
+    struct smbc_dirent *dirp;
+    while ((dirp = smbc_getFunctionReaddir(context)(context, fd)) != nullptr) {
+        if (dirp->smbc_type != SMBC_DIR && dirp->smbc_type != SMBC_FILE) {
+            continue;
+        }
+        const QString name = QString::fromUtf8(dirp->name);
+        if (name == QLatin1String(".") || name == QLatin1String("..")) {
+            continue;
+        }
+
+        SMBUrl url = dir.url;
+        url.addPath(name);
+        struct stat st;
+        if (smbc_getFunctionStat(context)(context, url.toSmbcUrl().constData(), &st) != 0) {
+            ++totals.errors;
+            continue;
+        }
+        const bool isDir = S_ISDIR(st.st_mode);
+        const KIO::filesize_t size = isDir ? 0 : st.st_size;
+        const time_t mtime = st.st_mtime;
+#endif
+
+        if (isDir) {
+            SMBUrl url = dir.url;
+            url.addPath(name);
+            subdirs.append(Directory{ url, prefix + name });
+            ++totals.directories;
+        } else {
+            ++totals.files;
+            totals.bytes += size;
+        }
+
+        if (m_collectEntries) {
+            KIO::UDSEntry entry;
+            entry.insert(KIO::UDSEntry::UDS_NAME, prefix + name);
+            entry.insert(KIO::UDSEntry::UDS_FILE_TYPE, isDir ? S_IFDIR : S_IFREG);
+            entry.insert(KIO::UDSEntry::UDS_SIZE, size);
+            entry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, mtime);
+            entries.append(entry);
+        }
+    }
+
+    smbc_getFunctionClosedir(context)(context, fd);
+
+    QMutexLocker locker(&m_mutex);
+    for (const Directory &subdir : qAsConst(subdirs)) {
+        m_queue.enqueue(subdir);
+    }
+    m_totals.directories += totals.directories;
+    m_totals.files += totals.files;
+    m_totals.bytes += totals.bytes;
+    m_totals.errors += totals.errors;
+    m_entries += entries;
+    return true;
+}
+
+//===========================================================================
+SMBTreeWalkerThread::SMBTreeWalkerThread(SMBTreeWalker *walker, const SMBCredentials &credentials, int debugLevel)
+    : m_walker(walker),
+      m_credentials(credentials),
+      m_debugLevel(debugLevel)
+{
+}
+
+void SMBTreeWalkerThread::run()
+{
+    SMBCCTX *context = smbc_new_private_context(&m_credentials, m_debugLevel);
+    if (context == nullptr) {
+        // the slave takes over whatever is left
+        return;
+    }
+
+    m_walker->work(context);
+
+    smbc_free_context(context, 1);
+}
+
+//===========================================================================
+void SMBSlave::treeStatProgress(SMBTreeWalker &walker, bool withEntries)
+{
+    if (withEntries) {
+        KIO::UDSEntryList entries = walker.takeEntries();
+        while (!entries.isEmpty()) {
+            const KIO::UDSEntryList batch = entries.mid(0, TREESTAT_ENTRY_BATCH);
+            entries.erase(entries.begin(), entries.begin() + batch.count());
+
+            QByteArray buffer;
+            QDataStream stream(&buffer, QIODevice::WriteOnly);
+            stream << qint32(TreeStatEntries) << batch;
+            data(buffer);
+        }
+    }
+
+    const SMBTreeWalker::Totals totals = walker.totals();
+
+    QByteArray buffer;
+    QDataStream stream(&buffer, QIODevice::WriteOnly);
+    stream << qint32(TreeStatTotals)
+           << totals.directories << totals.files << totals.bytes << totals.errors;
+    data(buffer);
+}
+
+void SMBSlave::treeStat(const QUrl &kurl, bool withEntries)
+{
+    qCDebug(KIO_SMB) << kurl << withEntries;
+
+    SMBUrl url = checkURL(kurl);
+    m_current_url = url;
+
+    if (url.getType() != SMBURLTYPE_SHARE_OR_PATH)
+    {
+        error(ERR_UNSUPPORTED_ACTION, url.toDisplayString());
+        return;
+    }
+
+    // stat the root in the foreground, so authentication problems are
+    // sorted out before the workers need the credentials
+    int errNum = cache_stat(url, &st);
+    if ((errNum == EPERM || errNum == EACCES || workaroundEEXIST(errNum)) && checkPassword(url))
+    {
+        m_current_url = url;
+        errNum = cache_stat(url, &st);
+    }
+    if (errNum != 0)
+    {
+        reportError(url, errNum);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        error(ERR_IS_FILE, url.toDisplayString());
+        return;
+    }
+
+    SMBTreeWalker walker(url, withEntries);
+
+#ifdef HAVE_SMBC_THREAD_POSIX
+    QList<SMBTreeWalkerThread *> threads;
+    const SMBCredentials credentials = auth_cachedCredentials(url);
+    KConfig cfg( "kioslaverc", KConfig::SimpleConfig );
+    const int debugLevel = cfg.group( "SMB" ).readEntry( "DebugLevel", 0 );
+
+    for (int i = 0; i < m_treeStatConnections; ++i)
+    {
+        SMBTreeWalkerThread *thread = new SMBTreeWalkerThread(&walker, credentials, debugLevel);
+        threads.append(thread);
+        thread->start();
+    }
+
+    while (walker.waitForProgress(TREESTAT_PROGRESS_INTERVAL))
+    {
+        treeStatProgress(walker, withEntries);
+
+        bool running = false;
+        for (SMBTreeWalkerThread *thread : qAsConst(threads))
+            running = running || thread->isRunning();
+        if (!running)
+            break;
+    }
+
+    for (SMBTreeWalkerThread *thread : qAsConst(threads))
+        thread->wait();
+    qDeleteAll(threads);
+#endif
+
+    // without thread support, or if no worker could get a context of its
+    // own, walk (the rest of) the tree with the global context
+    SMBCCTX *context = smbc_set_context(nullptr);
+    QElapsedTimer timer;
+    timer.start();
+    while (walker.step(context))
+    {
+        if (timer.elapsed() >= TREESTAT_PROGRESS_INTERVAL)
+        {
+            treeStatProgress(walker, withEntries);
+            timer.restart();
+        }
+    }
+
+    treeStatProgress(walker, withEntries);
+
+    const SMBTreeWalker::Totals totals = walker.totals();
+    setMetaData("directories", QString::number(totals.directories));
+    setMetaData("files", QString::number(totals.files));
+    setMetaData("size", QString::number(totals.bytes));
+    setMetaData("errors", QString::number(totals.errors));
+
+    finished();
+}
@@ -0,0 +1,120 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Project:     SMB kioslave for KDE
+//
+// File:        kio_smb_treestat.h
+//
+// Abstract:    Walks a directory tree on a share with several libsmbclient
+//              contexts at once, to compute its size or list it recursively
+//              (see SMBSlave::treeStat())
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program; see the file COPYING.  If not, please obtain
+//     a copy from http://www.gnu.org/copyleft/gpl.html
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef KIO_SMB_TREESTAT_H_INCLUDED
+#define KIO_SMB_TREESTAT_H_INCLUDED
+
+#include "config-smb.h"
+#include "kio_smb_context.h"
+#include "kio_smb_internal.h"
+
+#include <kio/udsentry.h>
+
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+/**
+ * Shared state of one tree walk.  Directories still to be listed are kept
+ * in a queue; every worker takes one, lists it with its own context and
+ * queues the subdirectories it finds.  The slave collects the results from
+ * the main thread, it is the only one allowed to talk to the application.
+ */
+class SMBTreeWalker
+{
+public:
+    struct Totals
+    {
+        quint64 directories = 0;
+        quint64 files = 0;
+        quint64 bytes = 0;
+        quint64 errors = 0;
+    };
+
+    SMBTreeWalker(const SMBUrl &root, bool collectEntries);
+
+    /**
+     * Description :  Worker loop, lists directories until the whole tree
+     *                has been walked.  If the root cannot be opened, it is
+     *                left in the queue for step() and all workers stop.
+     */
+    void work(SMBCCTX *context);
+
+    /**
+     * Description :  Lists a single directory
+     * Return :       false if there was nothing left to list
+     */
+    bool step(SMBCCTX *context);
+
+    /**
+     * Description :  Waits until a worker has made progress, at most msecs
+     * Return :       false once the whole tree has been walked
+     */
+    bool waitForProgress(unsigned long msecs);
+
+    Totals totals() const;
+    KIO::UDSEntryList takeEntries();
+
+private:
+    struct Directory
+    {
+        SMBUrl url;
+        QString path;  // relative to the root of the walk
+    };
+
+    bool isDone() const { return m_queue.isEmpty() && m_busy == 0; }
+    bool listDirectory(SMBCCTX *context, const Directory &dir, bool countFailure);
+
+    const bool m_collectEntries;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;
+    QQueue<Directory> m_queue;
+    int m_busy;
+    bool m_abandoned;
+    Totals m_totals;
+    KIO::UDSEntryList m_entries;
+};
+
+//===========================================================================
+class SMBTreeWalkerThread : public QThread
+{
+public:
+    SMBTreeWalkerThread(SMBTreeWalker *walker, const SMBCredentials &credentials, int debugLevel);
+
+protected:
+    void run() override;
+
+private:
+    SMBTreeWalker *const m_walker;
+    const SMBCredentials m_credentials;
+    const int m_debugLevel;
+};
+
+#endif